@@ -18,15 +18,17 @@ GNU General Public License for more details.
 #include <string>
 
 #include "crtlib.h"
+#include "containers/internedstring.h"
 
 struct appsys_t
 {
-	const char*   parent;
-	const char*   name;
-	bool	      loaded;
-	bool	      init;
-	struct mod_t* module;
-	void*	      pinterface;
+	const char*    parent;
+	InternedString parentName; /* Interned parent, FindInterface compares these */
+	const char*    name;
+	bool	       loaded;
+	bool	       init;
+	struct mod_t*  module;
+	void*	       pinterface;
 };
 
 struct mod_t
@@ -156,6 +158,7 @@ bool AppFramework::AddInterface(const char* module, const char* iface)
 			appsys.init	  = false;
 			appsys.pinterface = 0;
 			appsys.parent	  = iface_list[i].parent;
+			appsys.parentName = InternedString(iface_list[i].parent);
 			g_appsystems.push_back(appsys);
 			return true;
 		}
@@ -240,12 +243,13 @@ bool AppFramework::LoadInterfaces()
 
 void* AppFramework::FindInterface(const char* iface)
 {
-	for (auto x : g_appsystems)
+	InternedString key = InternedString::Find(iface);
+	if (!key)
+		return nullptr;
+	for (auto& x : g_appsystems)
 	{
-		if (Q_strcmp(x.parent, iface) == 0)
-		{
+		if (x.parentName == key)
 			return x.pinterface;
-		}
 	}
 	return nullptr;
 }
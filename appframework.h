@@ -14,7 +14,7 @@ GNU General Public License for more details.
 */
 #pragma once
 
-#include "containers/list.h"
+#include "containers/deque.h"
 
 /* Make sure these dumbos are not here */
 #undef min
@@ -178,14 +178,14 @@ public:
 */
 
 #define EXPOSE_INTERFACE(_int)                                                                                                                       \
-	extern List<IAppInterface*>* g_pInterfaces;                                                                                                  \
+	extern Deque<IAppInterface*>* g_pInterfaces;                                                                                                 \
 	class __CStaticWrapperForInterfaces_##_int                                                                                                   \
 	{                                                                                                                                            \
 	public:                                                                                                                                      \
 		__CStaticWrapperForInterfaces_##_int()                                                                                               \
 		{                                                                                                                                    \
 			if (!g_pInterfaces)                                                                                                          \
-				g_pInterfaces = new List<IAppInterface*>();                                                                          \
+				g_pInterfaces = new Deque<IAppInterface*>();                                                                         \
 			g_pInterfaces->push_back(new _int());                                                                                        \
 		}                                                                                                                                    \
 	};                                                                                                                                           \
@@ -193,7 +193,7 @@ public:
 
 /* For the CreateInterface impl */
 #define MODULE_INTERFACE_IMPL()                                                                                                                      \
-	List<IAppInterface*>*	g_pInterfaces;                                                                                                       \
+	Deque<IAppInterface*>*	g_pInterfaces;                                                                                                       \
 	extern "C" EXPORT void* CreateInterface(const char* name, int* retcode)                                                                      \
 	{                                                                                                                                            \
 		if (!g_pInterfaces)                                                                                                                  \
@@ -38,6 +38,17 @@ public:
 	void deallocate(T* ptr) override final { std::free(ptr); }
 };
 
+/* Same as DefaultAllocator without the virtual interface. Empty, so containers that derive from it pay nothing for it */
+template <class T> class MallocAllocator
+{
+public:
+	T* allocate(std::size_t sz) { return (T*)std::malloc(sz); }
+
+	T* reallocate(T* ptr, std::size_t sz) { return (T*)std::realloc(ptr, sz); }
+
+	void deallocate(T* ptr) { std::free(ptr); }
+};
+
 template <class T, unsigned long long num> class StaticAllocator : public AllocatorBase<T>
 {
 	T m_internalStore[num];
@@ -0,0 +1,766 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * bitset.h
+ * 	Sets of small integers stored as bits
+ *
+ * BitSet is a dense, growable bitset for IDs that are handed out sequentially (channels, backends, groups...).
+ * Membership is one load and a mask, and up to 128 bits are stored inline without allocating.
+ * SparseBitSet is a three level hierarchy for IDs spread over a large range: a bitset of allocated 4096 bit blocks,
+ * a 64 bit summary of non-zero words per block, and the words themselves. Empty regions cost nothing and are skipped
+ * a block at a time when iterating.
+ *
+ * Bulk operations (and/or/xor/andnot, count) run 2-4 words at a time with SSE2/AVX2/NEON where the build allows it.
+ * Iteration is find-first-set on whole words, so it visits only set bits.
+ *
+ * USAGE:
+ * 	BitSet enabled;
+ * 	enabled.set(backend);
+ * 	if (enabled.test(backend))
+ * 		...
+ * 	enabled.ForEachSet([](size_t id) { ... });
+ */
+#pragma once
+
+#include "smallarray.h"
+#include "array.h"
+#include "buffer.h"
+#include "../build.h"
+
+/* Standard includes */
+#undef min
+#undef max
+#include <string.h>
+#include <utility>
+
+#if USE_AVX2
+#include <immintrin.h>
+#elif USE_SSE2
+#include <emmintrin.h>
+#elif USE_NEON
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//===========================================
+//
+//      Word helpers
+//
+//===========================================
+
+enum class EBitOp
+{
+	AND = 0,
+	OR,
+	XOR,
+	ANDNOT, /* dst & ~src */
+};
+
+inline size_t BitCount64(unsigned long long w)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	return (size_t)__popcnt64(w);
+#elif defined(_MSC_VER)
+	return (size_t)(__popcnt((unsigned int)w) + __popcnt((unsigned int)(w >> 32)));
+#else
+	return (size_t)__builtin_popcountll(w);
+#endif
+}
+
+/* Index of the lowest set bit. w must not be 0 */
+inline size_t LowestBit64(unsigned long long w)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, w);
+	return index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)w))
+		return index;
+	_BitScanForward(&index, (unsigned long)(w >> 32));
+	return index + 32;
+#else
+	return (size_t)__builtin_ctzll(w);
+#endif
+}
+
+/* dst[i] = dst[i] op src[i] for n words */
+template <EBitOp Op> inline void BitWordsApply(unsigned long long* dst, const unsigned long long* src, size_t n)
+{
+	size_t i = 0;
+#if USE_AVX2
+	for (; i < (n & ~(size_t)3); i += 4)
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		__m256i r;
+		if (Op == EBitOp::AND)
+			r = _mm256_and_si256(a, b);
+		else if (Op == EBitOp::OR)
+			r = _mm256_or_si256(a, b);
+		else if (Op == EBitOp::XOR)
+			r = _mm256_xor_si256(a, b);
+		else
+			r = _mm256_andnot_si256(b, a);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+	}
+#elif USE_SSE2
+	for (; i < (n & ~(size_t)1); i += 2)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		__m128i r;
+		if (Op == EBitOp::AND)
+			r = _mm_and_si128(a, b);
+		else if (Op == EBitOp::OR)
+			r = _mm_or_si128(a, b);
+		else if (Op == EBitOp::XOR)
+			r = _mm_xor_si128(a, b);
+		else
+			r = _mm_andnot_si128(b, a);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+	}
+#elif USE_NEON
+	for (; i < (n & ~(size_t)1); i += 2)
+	{
+		uint64x2_t a = vld1q_u64(reinterpret_cast<const uint64_t*>(dst + i));
+		uint64x2_t b = vld1q_u64(reinterpret_cast<const uint64_t*>(src + i));
+		uint64x2_t r;
+		if (Op == EBitOp::AND)
+			r = vandq_u64(a, b);
+		else if (Op == EBitOp::OR)
+			r = vorrq_u64(a, b);
+		else if (Op == EBitOp::XOR)
+			r = veorq_u64(a, b);
+		else
+			r = vbicq_u64(a, b);
+		vst1q_u64(reinterpret_cast<uint64_t*>(dst + i), r);
+	}
+#endif
+	for (; i < n; i++)
+	{
+		if (Op == EBitOp::AND)
+			dst[i] &= src[i];
+		else if (Op == EBitOp::OR)
+			dst[i] |= src[i];
+		else if (Op == EBitOp::XOR)
+			dst[i] ^= src[i];
+		else
+			dst[i] &= ~src[i];
+	}
+}
+
+/* Number of set bits in n words */
+inline size_t BitWordsCount(const unsigned long long* w, size_t n)
+{
+	size_t i = 0, total = 0;
+#if USE_AVX2
+	/* Nibble lookup through pshufb, summed with psadbw (Mula et al.) */
+	if (n >= 8)
+	{
+		const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		const __m256i low    = _mm256_set1_epi8(0x0f);
+		__m256i	      acc    = _mm256_setzero_si256();
+		for (; i < (n & ~(size_t)3); i += 4)
+		{
+			__m256i v   = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+			__m256i lo  = _mm256_and_si256(v, low);
+			__m256i hi  = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+			__m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+			acc	    = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+		}
+		total = (size_t)(_mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) + _mm256_extract_epi64(acc, 2) +
+				 _mm256_extract_epi64(acc, 3));
+	}
+#elif USE_NEON
+	for (; i < (n & ~(size_t)1); i += 2)
+	{
+		uint8x16_t cnt = vcntq_u8(vreinterpretq_u8_u64(vld1q_u64(reinterpret_cast<const uint64_t*>(w + i))));
+#ifdef __aarch64__
+		total += vaddlvq_u8(cnt);
+#else
+		/* No across-vector add on 32 bit ARM, widen pairwise down to two 64 bit lanes instead */
+		uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(cnt)));
+		total += (size_t)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#endif
+	}
+#endif
+	for (; i < n; i++)
+		total += BitCount64(w[i]);
+	return total;
+}
+
+//===========================================
+//
+//      BitSet
+//
+//===========================================
+
+class BitSet
+{
+public:
+	static constexpr size_t NPOS	  = ~(size_t)0;
+	static constexpr size_t WORD_BITS = 64;
+
+private:
+	SmallArray<unsigned long long, 2> m_words;
+	size_t				  m_size; /* In bits */
+
+	/* Written out so sizes near NPOS can't wrap around to a small word count */
+	static size_t WordsFor(size_t bits) { return bits / WORD_BITS + (bits % WORD_BITS != 0); }
+
+	/* Bits past m_size in the last word are always kept at 0 */
+	void TrimTail()
+	{
+		if (m_size % WORD_BITS)
+			m_words.back() &= (1ULL << (m_size % WORD_BITS)) - 1;
+	}
+
+public:
+	BitSet() : m_size(0) {}
+	explicit BitSet(size_t bits) : m_size(0) { resize(bits); }
+
+	/* Number of bits, set or not */
+	size_t size() const { return m_size; }
+
+	/* Grows with zeroes or truncates */
+	void resize(size_t bits)
+	{
+		m_words.resize(WordsFor(bits), 0ULL);
+		m_size = bits;
+		TrimTail();
+	}
+
+	/* Drops every bit, size() becomes 0 */
+	void clear()
+	{
+		m_words.clear();
+		m_size = 0;
+	}
+
+	bool test(size_t i) const { return i < m_size && ((m_words[i / WORD_BITS] >> (i % WORD_BITS)) & 1); }
+	bool operator[](size_t i) const { return test(i); }
+
+	/* Sets bit i, growing the set if needed. NPOS is not a valid index (it's what the find functions return for
+	 * "nothing"), so set(NPOS) and flip(NPOS) do nothing instead of overflowing the new size */
+	void set(size_t i)
+	{
+		if (i == NPOS)
+			return;
+		if (i >= m_size)
+			resize(i + 1);
+		m_words[i / WORD_BITS] |= 1ULL << (i % WORD_BITS);
+	}
+
+	void set(size_t i, bool value)
+	{
+		if (value)
+			set(i);
+		else
+			reset(i);
+	}
+
+	void reset(size_t i)
+	{
+		if (i < m_size)
+			m_words[i / WORD_BITS] &= ~(1ULL << (i % WORD_BITS));
+	}
+
+	void flip(size_t i)
+	{
+		if (i == NPOS)
+			return;
+		if (i >= m_size)
+			resize(i + 1);
+		m_words[i / WORD_BITS] ^= 1ULL << (i % WORD_BITS);
+	}
+
+	/* Clears every bit, keeping the size */
+	void reset() { memset(m_words.data(), 0, m_words.size() * sizeof(unsigned long long)); }
+
+	/* Sets every bit below size() */
+	void set()
+	{
+		memset(m_words.data(), 0xff, m_words.size() * sizeof(unsigned long long));
+		TrimTail();
+	}
+
+	size_t count() const { return BitWordsCount(m_words.data(), m_words.size()); }
+
+	bool any() const
+	{
+		for (auto w : m_words)
+		{
+			if (w)
+				return true;
+		}
+		return false;
+	}
+
+	bool none() const { return !any(); }
+
+	/* Lowest set bit, or NPOS */
+	size_t find_first() const { return find_from(0); }
+
+	/* Lowest set bit after i, or NPOS */
+	size_t find_next(size_t i) const { return i + 1 < m_size ? find_from(i + 1) : NPOS; }
+
+	/* Lowest set bit at or after i, or NPOS */
+	size_t find_from(size_t i) const
+	{
+		if (i >= m_size)
+			return NPOS;
+		size_t		   wi = i / WORD_BITS;
+		unsigned long long w  = m_words[wi] & (~0ULL << (i % WORD_BITS));
+		while (!w)
+		{
+			if (++wi >= m_words.size())
+				return NPOS;
+			w = m_words[wi];
+		}
+		return wi * WORD_BITS + LowestBit64(w);
+	}
+
+	/* Calls fn(size_t index) for every set bit, in increasing order */
+	template <class Fn> void ForEachSet(Fn fn) const
+	{
+		for (size_t wi = 0; wi < m_words.size(); wi++)
+		{
+			for (unsigned long long w = m_words[wi]; w; w &= w - 1)
+				fn(wi * WORD_BITS + LowestBit64(w));
+		}
+	}
+
+	BitSet& operator|=(const BitSet& other)
+	{
+		if (other.m_size > m_size)
+			resize(other.m_size);
+		BitWordsApply<EBitOp::OR>(m_words.data(), other.m_words.data(), other.m_words.size());
+		return *this;
+	}
+
+	/* Bits past the end of other are cleared */
+	BitSet& operator&=(const BitSet& other)
+	{
+		size_t n = other.m_words.size() < m_words.size() ? other.m_words.size() : m_words.size();
+		BitWordsApply<EBitOp::AND>(m_words.data(), other.m_words.data(), n);
+		if (n < m_words.size())
+			memset(m_words.data() + n, 0, (m_words.size() - n) * sizeof(unsigned long long));
+		return *this;
+	}
+
+	BitSet& operator^=(const BitSet& other)
+	{
+		if (other.m_size > m_size)
+			resize(other.m_size);
+		BitWordsApply<EBitOp::XOR>(m_words.data(), other.m_words.data(), other.m_words.size());
+		return *this;
+	}
+
+	/* Clears every bit that is set in other */
+	BitSet& andnot(const BitSet& other)
+	{
+		size_t n = other.m_words.size() < m_words.size() ? other.m_words.size() : m_words.size();
+		BitWordsApply<EBitOp::ANDNOT>(m_words.data(), other.m_words.data(), n);
+		return *this;
+	}
+
+	/* True if any bit is set in both */
+	bool intersects(const BitSet& other) const
+	{
+		size_t n = other.m_words.size() < m_words.size() ? other.m_words.size() : m_words.size();
+		for (size_t i = 0; i < n; i++)
+		{
+			if (m_words[i] & other.m_words[i])
+				return true;
+		}
+		return false;
+	}
+
+	/* True if every bit set here is also set in other */
+	bool is_subset_of(const BitSet& other) const
+	{
+		for (size_t i = 0; i < m_words.size(); i++)
+		{
+			unsigned long long o = i < other.m_words.size() ? other.m_words[i] : 0;
+			if (m_words[i] & ~o)
+				return false;
+		}
+		return true;
+	}
+
+	/* Sets are equal when the same bits are set, whatever their sizes */
+	bool operator==(const BitSet& other) const
+	{
+		size_t n = m_words.size() > other.m_words.size() ? m_words.size() : other.m_words.size();
+		for (size_t i = 0; i < n; i++)
+		{
+			unsigned long long a = i < m_words.size() ? m_words[i] : 0;
+			unsigned long long b = i < other.m_words.size() ? other.m_words[i] : 0;
+			if (a != b)
+				return false;
+		}
+		return true;
+	}
+
+	bool operator!=(const BitSet& other) const { return !(*this == other); }
+
+	const unsigned long long* data() const { return m_words.data(); }
+	size_t			  num_words() const { return m_words.size(); }
+
+	/* Size in bits followed by the words, all little endian */
+	void Serialize(Buffer& buf) const
+	{
+		buf.write_le<unsigned long long>(m_size);
+		for (auto w : m_words)
+			buf.write_le(w);
+	}
+
+	bool Deserialize(Buffer& buf)
+	{
+		unsigned long long bits;
+		if (!buf.read_le(bits) || bits > (unsigned long long)NPOS)
+			return false;
+		/* Written out so a huge bit count can't wrap around to a small word count */
+		unsigned long long words = bits / WORD_BITS + (bits % WORD_BITS != 0);
+		if (words > (unsigned long long)(buf.size() - buf.current_pos()) / sizeof(unsigned long long))
+			return false;
+		resize((size_t)bits);
+		for (auto& w : m_words)
+			buf.read_le(w);
+		TrimTail();
+		return true;
+	}
+};
+
+//===========================================
+//
+//      SparseBitSet
+//
+//===========================================
+
+class SparseBitSet
+{
+public:
+	static constexpr size_t NPOS	    = ~(size_t)0;
+	static constexpr size_t BLOCK_WORDS = 64;
+	static constexpr size_t BLOCK_BITS  = BLOCK_WORDS * 64;
+	/* Deserialize rejects blocks past this. The block table is dense, so one crafted index could otherwise demand
+	 * gigabytes. Covers every 32 bit index */
+	static constexpr size_t MAX_SERIALIZED_BLOCKS = (size_t)((1ULL << 32) / BLOCK_BITS);
+
+private:
+	struct Block_t
+	{
+		unsigned long long summary; /* Bit w is set when words[w] != 0 */
+		unsigned long long words[BLOCK_WORDS];
+	};
+
+	Array<Block_t*> m_blocks; /* Indexed by bit / BLOCK_BITS, null for empty blocks */
+	BitSet		m_blockMask;
+	size_t		m_count;
+
+	Block_t* GetBlock(size_t b) const { return b < m_blocks.size() ? m_blocks[b] : nullptr; }
+
+	Block_t* AddBlock(size_t b)
+	{
+		if (b >= m_blocks.size())
+			m_blocks.resize(b + 1, nullptr);
+		if (!m_blocks[b])
+		{
+			m_blocks[b] = new Block_t();
+			m_blockMask.set(b);
+		}
+		return m_blocks[b];
+	}
+
+	void FreeBlock(size_t b)
+	{
+		delete m_blocks[b];
+		m_blocks[b] = nullptr;
+		m_blockMask.reset(b);
+	}
+
+	/* Rebuilds the summary after a bulk operation. Frees the block and returns false if it ended up empty */
+	bool Resummarize(size_t b)
+	{
+		Block_t* block = m_blocks[b];
+		block->summary = 0;
+		for (size_t w = 0; w < BLOCK_WORDS; w++)
+			block->summary |= (unsigned long long)(block->words[w] != 0) << w;
+		if (block->summary)
+			return true;
+		FreeBlock(b);
+		return false;
+	}
+
+	void CopyFrom(const SparseBitSet& other)
+	{
+		m_blocks.resize(other.m_blocks.size(), nullptr);
+		for (size_t b = 0; b < other.m_blocks.size(); b++)
+			m_blocks[b] = other.m_blocks[b] ? new Block_t(*other.m_blocks[b]) : nullptr;
+		m_blockMask = other.m_blockMask;
+		m_count	    = other.m_count;
+	}
+
+public:
+	SparseBitSet() : m_count(0) {}
+	SparseBitSet(const SparseBitSet& other) : m_count(0) { CopyFrom(other); }
+	SparseBitSet(SparseBitSet&& other) noexcept
+		: m_blocks(std::move(other.m_blocks)), m_blockMask(std::move(other.m_blockMask)), m_count(other.m_count)
+	{
+		other.m_blocks.clear();
+		other.m_count = 0;
+	}
+
+	~SparseBitSet() { clear(); }
+
+	SparseBitSet& operator=(const SparseBitSet& other)
+	{
+		if (this != &other)
+		{
+			clear();
+			CopyFrom(other);
+		}
+		return *this;
+	}
+
+	SparseBitSet& operator=(SparseBitSet&& other) noexcept
+	{
+		if (this != &other)
+		{
+			clear();
+			m_blocks    = std::move(other.m_blocks);
+			m_blockMask = std::move(other.m_blockMask);
+			m_count	    = other.m_count;
+			other.m_blocks.clear();
+			other.m_blockMask.clear();
+			other.m_count = 0;
+		}
+		return *this;
+	}
+
+	/* Number of set bits. Kept up to date, so this is free */
+	size_t count() const { return m_count; }
+	bool   any() const { return m_count != 0; }
+	bool   none() const { return m_count == 0; }
+
+	void clear()
+	{
+		for (auto block : m_blocks)
+			delete block;
+		m_blocks.clear();
+		m_blockMask.clear();
+		m_count = 0;
+	}
+
+	bool test(size_t i) const
+	{
+		Block_t* block = GetBlock(i / BLOCK_BITS);
+		return block && ((block->words[(i % BLOCK_BITS) / 64] >> (i % 64)) & 1);
+	}
+
+	bool operator[](size_t i) const { return test(i); }
+
+	/* Like BitSet, set(NPOS) does nothing */
+	void set(size_t i)
+	{
+		if (i == NPOS)
+			return;
+		Block_t*	    block = AddBlock(i / BLOCK_BITS);
+		size_t		    w	  = (i % BLOCK_BITS) / 64;
+		unsigned long long bit	  = 1ULL << (i % 64);
+		if (block->words[w] & bit)
+			return;
+		block->words[w] |= bit;
+		block->summary |= 1ULL << w;
+		m_count++;
+	}
+
+	void reset(size_t i)
+	{
+		size_t		    b	  = i / BLOCK_BITS;
+		Block_t*	    block = GetBlock(b);
+		size_t		    w	  = (i % BLOCK_BITS) / 64;
+		unsigned long long bit	  = 1ULL << (i % 64);
+		if (!block || !(block->words[w] & bit))
+			return;
+		block->words[w] &= ~bit;
+		m_count--;
+		if (!block->words[w])
+		{
+			block->summary &= ~(1ULL << w);
+			if (!block->summary)
+				FreeBlock(b);
+		}
+	}
+
+	void set(size_t i, bool value)
+	{
+		if (value)
+			set(i);
+		else
+			reset(i);
+	}
+
+	/* Lowest set bit at or after i, or NPOS */
+	size_t find_from(size_t i) const
+	{
+		for (size_t b = m_blockMask.find_from(i / BLOCK_BITS); b != BitSet::NPOS; b = m_blockMask.find_next(b))
+		{
+			const Block_t* block = m_blocks[b];
+			size_t	       start = b == i / BLOCK_BITS ? i % BLOCK_BITS : 0;
+			/* Summary bits of the words that can still hold a match */
+			unsigned long long words = block->summary & (~0ULL << (start / 64));
+			while (words)
+			{
+				size_t		   w	= LowestBit64(words);
+				unsigned long long bits = block->words[w];
+				if (w == start / 64)
+					bits &= ~0ULL << (start % 64);
+				if (bits)
+					return b * BLOCK_BITS + w * 64 + LowestBit64(bits);
+				words &= words - 1;
+			}
+		}
+		return NPOS;
+	}
+
+	size_t find_first() const { return find_from(0); }
+	size_t find_next(size_t i) const { return find_from(i + 1); }
+
+	/* Calls fn(size_t index) for every set bit, in increasing order. Empty blocks and words are skipped wholesale */
+	template <class Fn> void ForEachSet(Fn fn) const
+	{
+		m_blockMask.ForEachSet([&](size_t b) {
+			const Block_t* block = m_blocks[b];
+			for (unsigned long long words = block->summary; words; words &= words - 1)
+			{
+				size_t w = LowestBit64(words);
+				for (unsigned long long bits = block->words[w]; bits; bits &= bits - 1)
+					fn(b * BLOCK_BITS + w * 64 + LowestBit64(bits));
+			}
+		});
+	}
+
+	SparseBitSet& operator|=(const SparseBitSet& other)
+	{
+		other.m_blockMask.ForEachSet([&](size_t b) {
+			Block_t* block = AddBlock(b);
+			m_count -= BitWordsCount(block->words, BLOCK_WORDS);
+			BitWordsApply<EBitOp::OR>(block->words, other.m_blocks[b]->words, BLOCK_WORDS);
+			block->summary |= other.m_blocks[b]->summary;
+			m_count += BitWordsCount(block->words, BLOCK_WORDS);
+		});
+		return *this;
+	}
+
+	SparseBitSet& operator&=(const SparseBitSet& other)
+	{
+		m_blockMask.ForEachSet([&](size_t b) {
+			Block_t* block = m_blocks[b];
+			m_count -= BitWordsCount(block->words, BLOCK_WORDS);
+			Block_t* o = other.GetBlock(b);
+			if (!o)
+			{
+				FreeBlock(b);
+				return;
+			}
+			BitWordsApply<EBitOp::AND>(block->words, o->words, BLOCK_WORDS);
+			if (Resummarize(b))
+				m_count += BitWordsCount(block->words, BLOCK_WORDS);
+		});
+		return *this;
+	}
+
+	/* Clears every bit that is set in other */
+	SparseBitSet& andnot(const SparseBitSet& other)
+	{
+		m_blockMask.ForEachSet([&](size_t b) {
+			Block_t* o = other.GetBlock(b);
+			if (!o)
+				return;
+			Block_t* block = m_blocks[b];
+			m_count -= BitWordsCount(block->words, BLOCK_WORDS);
+			BitWordsApply<EBitOp::ANDNOT>(block->words, o->words, BLOCK_WORDS);
+			if (Resummarize(b))
+				m_count += BitWordsCount(block->words, BLOCK_WORDS);
+		});
+		return *this;
+	}
+
+	bool operator==(const SparseBitSet& other) const
+	{
+		if (m_count != other.m_count || m_blockMask != other.m_blockMask)
+			return false;
+		bool equal = true;
+		m_blockMask.ForEachSet([&](size_t b) {
+			if (equal && memcmp(m_blocks[b]->words, other.m_blocks[b]->words, sizeof(Block_t::words)) != 0)
+				equal = false;
+		});
+		return equal;
+	}
+
+	bool operator!=(const SparseBitSet& other) const { return !(*this == other); }
+
+	/* Number of blocks, then per block its index, its summary and only its non-zero words. All little endian */
+	void Serialize(Buffer& buf) const
+	{
+		buf.write_le<unsigned long long>(m_blockMask.count());
+		m_blockMask.ForEachSet([&](size_t b) {
+			const Block_t* block = m_blocks[b];
+			buf.write_le<unsigned long long>(b);
+			buf.write_le(block->summary);
+			for (unsigned long long words = block->summary; words; words &= words - 1)
+				buf.write_le(block->words[LowestBit64(words)]);
+		});
+	}
+
+	bool Deserialize(Buffer& buf)
+	{
+		clear();
+		unsigned long long numBlocks;
+		/* Every block takes at least its index, summary and one word */
+		if (!buf.read_le(numBlocks) || numBlocks > (unsigned long long)(buf.size() - buf.current_pos()) / (3 * sizeof(unsigned long long)))
+			return false;
+		unsigned long long next = 0;
+		for (unsigned long long i = 0; i < numBlocks; i++)
+		{
+			unsigned long long b, summary;
+			/* Serialize writes blocks in increasing order, anything else is corrupt */
+			if (!buf.read_le(b) || !buf.read_le(summary) || !summary || b < next || b >= MAX_SERIALIZED_BLOCKS)
+			{
+				clear();
+				return false;
+			}
+			next = b + 1;
+			Block_t* block = AddBlock((size_t)b);
+			for (unsigned long long words = summary; words; words &= words - 1)
+			{
+				size_t w = LowestBit64(words);
+				if (!buf.read_le(block->words[w]) || !block->words[w])
+				{
+					clear();
+					return false;
+				}
+				block->summary |= 1ULL << w;
+				m_count += BitCount64(block->words[w]);
+			}
+		}
+		return true;
+	}
+};
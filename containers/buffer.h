@@ -13,19 +13,21 @@ GNU General Public License for more details.
 */
 #pragma once
 
-#include <sstream>
-#include <cstdarg>
-#include <ios>
 #include <cstdio>
 #include <cstdlib>
-#include <memory>
-#include <memory.h>
+#include <cstring>
+#include <type_traits>
 #include "allocator.h"
+#include "../build.h"
+
+#ifdef _POSIX
+#include <sys/uio.h>
+#endif
 
 class BufferSizePolicyLinear
 {
 public:
-	unsigned long long GetNewSize(unsigned long long old) { return old * 2; }
+	unsigned long long GetNewSize(unsigned long long old) { return old ? old * 2 : 64; }
 };
 
 class BufferSizePolicyFixed
@@ -34,6 +36,13 @@ public:
 	unsigned long long GetNewSize(unsigned long long old) { return old; }
 };
 
+/**
+ * Byte stream with a single read/write head
+ * Writes happen at the head and grow the buffer through SizePolicyT when they don't fit. size() is the high water mark
+ * of everything written, and reads never go past it.
+ * A buffer can also borrow memory it doesn't own (see Borrow), e.g. to deserialize a received packet in place. Borrowed
+ * memory is never written to: the first write or resize copies it into memory owned by the buffer.
+ */
 template <class CharT = char, class AllocatorT = DefaultAllocator<CharT>, class SizePolicyT = BufferSizePolicyLinear> class BufferT
 {
 public:
@@ -42,24 +51,33 @@ public:
 
 	BufferT& operator=(const BufferT& other)
 	{
+		if (this == &other)
+			return *this;
+		release();
+		m_size	     = other.m_size;
 		this->m_data = m_allocator.allocate(m_size * sizeof(CharT));
-		memcpy(this->m_data, other.m_data, sizeof(CharT) * m_size);
+		memcpy(this->m_data, other.m_data, sizeof(CharT) * other.m_maxWrite);
 		this->m_bufPos	 = other.m_bufPos;
-		this->m_size	 = other.m_size;
 		this->m_maxWrite = other.m_maxWrite;
+		this->m_owned	 = true;
 		return *this;
 	}
 
 	BufferT& operator=(BufferT&& other) noexcept
 	{
+		if (this == &other)
+			return *this;
+		release();
 		this->m_data	 = other.m_data;
 		this->m_bufPos	 = other.m_bufPos;
 		this->m_size	 = other.m_size;
 		this->m_maxWrite = other.m_maxWrite;
+		this->m_owned	 = other.m_owned;
 		other.m_data	 = nullptr;
 		other.m_maxWrite = 0;
 		other.m_size	 = 0;
 		other.m_bufPos	 = 0;
+		other.m_owned	 = true;
 		return *this;
 	}
 
@@ -75,21 +93,51 @@ private:
 	BufferPos   m_bufPos;
 	BufferPos   m_size;
 	BufferPos   m_maxWrite;
+	bool	    m_owned;
 	AllocatorT  m_allocator;
 	SizePolicyT m_sizePolicy;
 
 	inline void compute_max_write() { m_maxWrite = m_bufPos > m_maxWrite ? m_bufPos : m_maxWrite; }
 
+	inline void release()
+	{
+		if (m_data && m_owned)
+			m_allocator.deallocate(m_data);
+		m_data	 = nullptr;
+		m_owned	 = true;
+		m_size	 = 0;
+		m_bufPos = m_maxWrite = 0;
+	}
+
+	/* Makes room for count chars at the head, growing if the size policy allows it. Returns how many chars fit */
+	inline BufferSize reserve_write(BufferSize count)
+	{
+		BufferSize needed = m_bufPos + count;
+		if (needed > m_size)
+		{
+			BufferSize newsize = m_sizePolicy.GetNewSize(m_size);
+			if (newsize > m_size)
+				resize(newsize < needed ? needed : newsize);
+		}
+		if (!m_owned)
+			resize(m_size);
+		BufferSize room = m_size - m_bufPos;
+		return count < room ? count : (room > 0 ? room : 0);
+	}
+
+	/* Number of written chars between the head and the end of the data */
+	inline BufferSize readable() const { return m_maxWrite > m_bufPos ? m_maxWrite - m_bufPos : 0; }
+
 public:
-	BufferT(BufferSize sz) : m_size(sz), m_bufPos(0), m_maxWrite(-1) { m_data = m_allocator.allocate(sizeof(CharT) * m_size); }
+	BufferT(BufferSize sz = 0) : m_bufPos(0), m_size(sz), m_maxWrite(0), m_owned(true)
+	{
+		m_data = m_allocator.allocate(sizeof(CharT) * m_size);
+	}
 
-	BufferT(const BufferT& other)
+	BufferT(const BufferT& other) : m_bufPos(other.m_bufPos), m_size(other.m_size), m_maxWrite(other.m_maxWrite), m_owned(true)
 	{
 		this->m_data = m_allocator.allocate(m_size * sizeof(CharT));
-		memcpy(this->m_data, other.m_data, sizeof(CharT) * m_size);
-		this->m_bufPos	 = other.m_bufPos;
-		this->m_size	 = other.m_size;
-		this->m_maxWrite = other.m_maxWrite;
+		memcpy(this->m_data, other.m_data, sizeof(CharT) * m_maxWrite);
 	}
 
 	BufferT(BufferT&& other) noexcept
@@ -98,20 +146,38 @@ public:
 		this->m_bufPos	 = other.m_bufPos;
 		this->m_size	 = other.m_size;
 		this->m_maxWrite = other.m_maxWrite;
+		this->m_owned	 = other.m_owned;
 		other.m_data	 = nullptr;
 		other.m_maxWrite = 0;
 		other.m_size	 = 0;
 		other.m_bufPos	 = 0;
+		other.m_owned	 = true;
 	}
 
-	virtual ~BufferT()
+	virtual ~BufferT() { release(); }
+
+	/**
+	 * @brief Creates a buffer that reads size chars straight out of data, without copying them
+	 * data must outlive the buffer, or at least the buffer's first write
+	 * @param data Memory to borrow
+	 * @param size Number of chars in data
+	 */
+	static BufferT Borrow(const CharT* data, BufferSize size)
 	{
-		if (m_data)
-			m_allocator.deallocate(m_data);
-		m_size	 = 0;
-		m_bufPos = 0;
+		BufferT buf;
+		buf.release();
+		buf.m_data     = const_cast<CharT*>(data);
+		buf.m_size     = size;
+		buf.m_maxWrite = size;
+		buf.m_owned    = false;
+		return buf;
 	}
 
+	/**
+	 * @return True if the buffer owns its memory, false if it is still borrowing it
+	 */
+	inline bool owned() const { return m_owned; }
+
 	/**
 	 * @brief Resizes the buffer based on the internal size policy
 	 * @return New size
@@ -121,43 +187,54 @@ public:
 		BufferSize newsize = m_sizePolicy.GetNewSize(m_size);
 		if (newsize == m_size)
 			return m_size;
-		m_data = m_allocator.reallocate(m_data, newsize);
-		m_size = newsize;
-		return m_size;
+		return resize(newsize);
 	}
 
 	/**
-	 * @brief Resizes the buffer based on an excplicit size
+	 * @brief Resizes the buffer based on an excplicit size. Borrowed memory is copied into memory owned by the buffer
 	 * @param newsize New size
 	 * @return New buffer size
 	 */
 	inline BufferSize resize(BufferSize newsize)
 	{
-		if (newsize == m_size)
+		if (newsize == m_size && m_owned)
 			return m_size;
-		m_data = m_allocator.reallocate(m_data, newsize);
+		if (m_owned)
+			m_data = m_allocator.reallocate(m_data, newsize * sizeof(CharT));
+		else
+		{
+			CharT* data = m_allocator.allocate(newsize * sizeof(CharT));
+			memcpy(data, m_data, sizeof(CharT) * (m_maxWrite < newsize ? m_maxWrite : newsize));
+			m_data	= data;
+			m_owned = true;
+		}
 		m_size = newsize;
 		/* Fix up the buffer pointers */
-		m_maxWrite >= m_size ? 0 : m_maxWrite;
-		m_bufPos >= m_size ? 0 : m_bufPos;
+		m_maxWrite = m_maxWrite > m_size ? m_size : m_maxWrite;
+		m_bufPos   = m_bufPos > m_size ? m_size : m_bufPos;
 
 		return m_size;
 	}
 
 	/**
-	 * @brief Inserts the string into the buffer.
+	 * @brief Makes sure count more chars can be written at the head without reallocating
+	 * @return False if the size policy doesn't allow the buffer to grow that much
+	 */
+	inline bool reserve(BufferSize count) { return reserve_write(count) == count; }
+
+	/**
+	 * @brief Inserts the string into the buffer, growing it if needed
 	 * @param data Pointer to the data buffer
 	 * @param count Number of bytes in string
-	 * @return Number of bytes written into the buffer
+	 * @return Number of bytes written into the buffer. Less than count only if the buffer can't grow
 	 */
 	inline BufferSize puts(const CharT* data, BufferSize count)
 	{
-		BufferSize i;
-		for (i = 0; i < count && (i + m_bufPos) < m_size; i++)
-			m_data[m_bufPos + i] = data[i];
-		m_bufPos += i;
+		count = reserve_write(count);
+		memcpy(m_data + m_bufPos, data, sizeof(CharT) * count);
+		m_bufPos += count;
 		compute_max_write();
-		return i;
+		return count;
 	}
 
 	/**
@@ -167,7 +244,7 @@ public:
 	 */
 	inline BufferSize putc(CharT c)
 	{
-		if (m_bufPos + 1 >= m_size)
+		if (reserve_write(1) != 1)
 			return 0;
 		m_data[m_bufPos] = c;
 		m_bufPos++;
@@ -183,12 +260,9 @@ public:
 	 */
 	inline BufferSize gets(CharT* data, BufferSize maxsize)
 	{
-		BufferSize i;
-		for (i = 0; i < maxsize && (m_bufPos + i) < m_size; i++)
-			data[i] = m_data[i + m_bufPos];
-		m_bufPos += i;
-		compute_max_write();
-		return i;
+		BufferSize n = peeks(data, maxsize);
+		m_bufPos += n;
+		return n;
 	}
 
 	/**
@@ -197,31 +271,115 @@ public:
 	 * @param sz Size of the output buffer
 	 * @return Number of bytes written
 	 */
-	inline BufferSize peeks(CharT* data, BufferSize sz)
+	inline BufferSize peeks(CharT* data, BufferSize sz) const
 	{
-		BufferSize i;
-		for (i = 0; i < sz && (i + m_bufPos) < m_size; i++)
-			data[i] = m_data[i + m_bufPos];
-		return i;
+		BufferSize n = readable();
+		n	     = sz < n ? sz : n;
+		memcpy(data, m_data + m_bufPos, sizeof(CharT) * n);
+		return n;
 	}
 
 	/**
 	 * @brief Returns the next char from the buffer and increments the buffer pos
-	 * @return next char from the buffer
+	 * @return next char from the buffer, or EOF at the end of the data
 	 */
 	inline int getc()
 	{
-		int dat = m_data[m_bufPos];
-		m_bufPos++;
-		compute_max_write();
-		return dat;
+		if (!readable())
+			return EOF;
+		return m_data[m_bufPos++];
 	}
 
 	/**
 	 * @brief Returns next char from buffer without incrementing it
-	 * @return next char
+	 * @return next char, or EOF at the end of the data
+	 */
+	inline int peek() const { return readable() ? m_data[m_bufPos] : EOF; }
+
+	/**
+	 * @brief Writes v in little endian byte order, whatever the host's byte order is
+	 * @return False if the buffer couldn't grow to fit v
+	 */
+	template <class T> inline bool write_le(T v)
+	{
+		static_assert(std::is_arithmetic<T>::value, "write_le only handles integer and floating point types");
+		static_assert(sizeof(CharT) == 1, "Typed reads and writes need a byte buffer");
+		if (reserve_write(sizeof(T)) != sizeof(T))
+			return false;
+#ifdef XASH_BIG_ENDIAN
+		const unsigned char* src = reinterpret_cast<const unsigned char*>(&v);
+		for (size_t i = 0; i < sizeof(T); i++)
+			m_data[m_bufPos + i] = src[sizeof(T) - 1 - i];
+#else
+		memcpy(m_data + m_bufPos, &v, sizeof(T));
+#endif
+		m_bufPos += sizeof(T);
+		compute_max_write();
+		return true;
+	}
+
+	/**
+	 * @brief Reads a little endian value written by write_le
+	 * @return False (and out is left alone) if fewer than sizeof(T) bytes are left
+	 */
+	template <class T> inline bool read_le(T& out)
+	{
+		static_assert(std::is_arithmetic<T>::value, "read_le only handles integer and floating point types");
+		static_assert(sizeof(CharT) == 1, "Typed reads and writes need a byte buffer");
+		if (readable() < (BufferSize)sizeof(T))
+			return false;
+#ifdef XASH_BIG_ENDIAN
+		unsigned char* dst = reinterpret_cast<unsigned char*>(&out);
+		for (size_t i = 0; i < sizeof(T); i++)
+			dst[i] = m_data[m_bufPos + sizeof(T) - 1 - i];
+#else
+		memcpy(&out, m_data + m_bufPos, sizeof(T));
+#endif
+		m_bufPos += sizeof(T);
+		return true;
+	}
+
+	template <class T> inline T read_le()
+	{
+		T v = T();
+		read_le(v);
+		return v;
+	}
+
+#ifdef _POSIX
+	/**
+	 * @brief Describes the data between the head and the end of the data, e.g. for writev.
+	 * Call seek_cur with the number of chars actually written afterwards
+	 */
+	inline struct iovec readable_iovec() const
+	{
+		struct iovec iov;
+		iov.iov_base = m_data + m_bufPos;
+		iov.iov_len  = readable() * sizeof(CharT);
+		return iov;
+	}
+
+	/**
+	 * @brief Grows the buffer so at least count chars fit at the head and describes that space, e.g. for readv.
+	 * Call commit with the number of chars actually read into it afterwards
 	 */
-	inline int peek() const { return m_data[m_bufPos]; }
+	inline struct iovec writable_iovec(BufferSize count)
+	{
+		struct iovec iov;
+		iov.iov_len  = reserve_write(count) * sizeof(CharT);
+		iov.iov_base = m_data + m_bufPos; /* After reserve_write, which may move the data */
+		return iov;
+	}
+#endif
+
+	/**
+	 * @brief Marks count chars at the head as written, after filling them in through writable_iovec
+	 */
+	inline void commit(BufferSize count)
+	{
+		m_bufPos += count;
+		compute_max_write();
+	}
 
 	/**
 	 * @brief Get the current pos of the read/write head
@@ -258,9 +416,10 @@ public:
 	 */
 	inline BufferPos seek_cur(int offset)
 	{
-		if (offset + m_bufPos >= m_size)
+		if (offset + m_bufPos >= m_size || offset + m_bufPos < 0)
 			return m_bufPos;
 		m_bufPos += offset;
+		return m_bufPos;
 	}
 
 	/**
@@ -270,11 +429,11 @@ public:
 	 */
 	inline BufferPos seek_absolute(BufferPos offset)
 	{
-		if (offset > m_size)
+		if (offset > m_size || offset < 0)
 			return m_bufPos;
 		BufferPos old = m_bufPos;
 		m_bufPos      = offset;
-		return m_bufPos;
+		return old;
 	}
 
 	/**
@@ -295,7 +454,12 @@ public:
 	/**
 	 * @brief Zeroes out the internal buffer
 	 */
-	inline void clear() { memset(m_data, 0, sizeof(CharT) * m_size); }
+	inline void clear()
+	{
+		if (!m_owned)
+			resize(m_size);
+		memset(m_data, 0, sizeof(CharT) * m_size);
+	}
 
 	/**
 	 * @brief Resizes the internal buffer so that it's  the same size as the data written to it
@@ -303,7 +467,7 @@ public:
 	inline void compact()
 	{
 		/* Cannot compact if we're already at max compaction */
-		if (m_maxWrite == m_size - 1)
+		if (m_maxWrite == m_size)
 			return;
 		this->resize(m_maxWrite);
 	}
@@ -312,12 +476,12 @@ public:
 	 * @brief Returns true if the buffer is empty
 	 * @return
 	 */
-	inline bool empty() const { return (m_maxWrite == -1 || m_size == 0); }
+	inline bool empty() const { return (m_maxWrite == 0 || m_size == 0); }
 
 	/**
 	 * @return returns if the buffer will overflow if you write the specified number of bytes to it
 	 */
-	inline bool will_overflow(BufferSize num_bytes) const { return (m_bufPos + num_bytes >= m_size); }
+	inline bool will_overflow(BufferSize num_bytes) const { return (m_bufPos + num_bytes > m_size); }
 
 	/**
 	 * @brief Writes the current buffer to a stream
@@ -326,7 +490,7 @@ public:
 	 */
 	inline BufferSize write_to_stream(FILE* stream) const
 	{
-		if (m_maxWrite == m_bufPos)
+		if (m_maxWrite <= m_bufPos)
 			return 0;
 		return (BufferSize)std::fwrite(&m_data[m_bufPos], sizeof(CharT), m_maxWrite - m_bufPos, stream);
 	}
@@ -339,12 +503,11 @@ public:
 	 */
 	inline BufferSize read_from_stream(FILE* stream, BufferSize num_bytes)
 	{
-		if ((num_bytes / sizeof(CharT)) > m_size)
-			resize(num_bytes / sizeof(CharT));
-		std::size_t num_read = fread(&m_data[m_bufPos], 1, num_bytes, stream);
-		m_bufPos += (num_read / sizeof(CharT));
+		BufferSize count    = reserve_write(num_bytes / sizeof(CharT));
+		std::size_t num_read = fread(&m_data[m_bufPos], sizeof(CharT), count, stream);
+		m_bufPos += num_read;
 		compute_max_write();
-		return (BufferSize)num_read;
+		return (BufferSize)(num_read * sizeof(CharT));
 	}
 };
 
@@ -0,0 +1,453 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * concurrenthashmap.h
+ * 	Hash map with lock-free lookups
+ *
+ * Lookups never lock or write to shared memory: they enter an epoch critical section, hash to a bucket and walk its
+ * chain. Inserts and erases lock one of NUM_STRIPES spinlocks, picked by the low bits of the hash, so writers only
+ * contend when they touch the same stripe. Nodes are immutable once published. Assigning a value publishes a
+ * replacement node, and unlinked nodes are handed to GlobalEpochDomain() so readers still walking them stay safe.
+ *
+ * Growing doesn't stop the world. Once the table is over MAX_LOAD, a table twice the size is linked behind it and
+ * buckets are copied over one at a time, each under its stripe lock. Writers copy their own bucket first, then help
+ * with a few more. A copied bucket is left holding a MOVED marker, and a lookup that hits the marker continues in
+ * the next table. The last bucket copied makes the new table current and retires the old one.
+ *
+ * Keys and values are copied when a bucket moves, so both must be copyable. find() returns a copy of the value.
+ * get() returns a pointer into the node, which is only valid while the caller holds a CEpochGuard on
+ * GlobalEpochDomain().
+ *
+ * USAGE:
+ * 	ConcurrentHashMap<InternedString, LogChannel> index;
+ * 	index.insert(name, id);	 // Any thread
+ * 	LogChannel chan;
+ * 	if (index.find(name, chan)) // Any thread, doesn't lock
+ * 		...
+ */
+#pragma once
+
+#include "hashmap.h"
+#include "../reclaim.h"
+#include "../threadtools.h"
+
+/* Standard includes */
+#undef min
+#undef max
+#include <atomic>
+#include <utility>
+#include <stdint.h>
+
+template <class KeyT, class ValT, class Hash = HashMapHash<KeyT>, class Equal = HashMapEqual<KeyT>> class ConcurrentHashMap
+{
+public:
+	/* Must be a power of two and no larger than MIN_BUCKETS, so a stripe covers the same buckets in every table */
+	static constexpr size_t NUM_STRIPES   = 64;
+	static constexpr size_t MIN_BUCKETS   = 64;
+	static constexpr size_t MAX_LOAD      = 2; /* Average chain length that triggers a resize */
+	static constexpr size_t MIGRATE_BATCH = 8; /* Buckets a writer helps move per operation while resizing */
+
+	static_assert(NUM_STRIPES <= MIN_BUCKETS && (NUM_STRIPES & (NUM_STRIPES - 1)) == 0, "Stripes must evenly divide every table");
+
+private:
+	struct Node_t
+	{
+		std::atomic<Node_t*> next;
+		size_t		     hash;
+		KeyT		     key;
+		ValT		     value;
+
+		template <class K, class V>
+		Node_t(Node_t* n, size_t h, K&& k, V&& v) : next(n), hash(h), key(std::forward<K>(k)), value(std::forward<V>(v))
+		{
+		}
+	};
+
+	struct Table_t
+	{
+		size_t		      mask;
+		std::atomic<Table_t*> next;	     /* Set once a resize starts, before any bucket is moved */
+		std::atomic<size_t>   migrateCursor; /* Next bucket for helpers to claim */
+		std::atomic<size_t>   migrated;	     /* Buckets moved so far */
+		std::atomic<Node_t*>* buckets;
+
+		explicit Table_t(size_t n) : mask(n - 1), next(nullptr), migrateCursor(0), migrated(0), buckets(new std::atomic<Node_t*>[n])
+		{
+			for (size_t i = 0; i < n; i++)
+				buckets[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		~Table_t() { delete[] buckets; }
+	};
+
+	struct alignas(64) Stripe_t
+	{
+		CThreadSpinlock lock;
+	};
+
+	class StripeLock
+	{
+	private:
+		CThreadSpinlock& m_lock;
+
+	public:
+		explicit StripeLock(CThreadSpinlock& lock) : m_lock(lock) { m_lock.Lock(); }
+		~StripeLock() { m_lock.Unlock(); }
+	};
+
+	CEpochDomain&	      m_domain; /* GlobalEpochDomain(), looked up once */
+	std::atomic<Table_t*> m_table;
+	std::atomic<size_t>   m_size;
+	Stripe_t	      m_stripes[NUM_STRIPES];
+	Hash		      m_hash;
+	Equal		      m_equal;
+
+	static Node_t* Moved() { return reinterpret_cast<Node_t*>((uintptr_t)1); }
+
+	CThreadSpinlock& StripeFor(size_t hash) { return m_stripes[hash & (NUM_STRIPES - 1)].lock; }
+
+	template <class K> Node_t* FindNode(const K& key, size_t hash) const
+	{
+		Table_t* t = m_table.load(std::memory_order_acquire);
+		for (;;)
+		{
+			Node_t* n = t->buckets[hash & t->mask].load(std::memory_order_acquire);
+			if (n == Moved())
+			{
+				t = t->next.load(std::memory_order_acquire);
+				continue;
+			}
+			for (; n; n = n->next.load(std::memory_order_acquire))
+			{
+				if (n->hash == hash && m_equal(n->key, key))
+					return n;
+			}
+			return nullptr;
+		}
+	}
+
+	/* Copies bucket b of t into t->next and marks it MOVED. Called with b's stripe locked */
+	void MigrateBucket(Table_t* t, size_t b)
+	{
+		Table_t* to = t->next.load(std::memory_order_acquire);
+		for (Node_t* n = t->buckets[b].load(std::memory_order_relaxed); n;)
+		{
+			std::atomic<Node_t*>& dst = to->buckets[n->hash & to->mask];
+			dst.store(new Node_t(dst.load(std::memory_order_relaxed), n->hash, n->key, n->value), std::memory_order_release);
+			Node_t* next = n->next.load(std::memory_order_relaxed);
+			m_domain.RetireDelete(n);
+			n = next;
+		}
+		/* Copies are published before the marker, so a reader that sees MOVED also sees them */
+		t->buckets[b].store(Moved(), std::memory_order_release);
+
+		if (t->migrated.fetch_add(1, std::memory_order_acq_rel) + 1 == t->mask + 1)
+		{
+			Table_t* expected = t;
+			m_table.compare_exchange_strong(expected, to, std::memory_order_acq_rel);
+			m_domain.RetireDelete(t);
+		}
+	}
+
+	/* Newest table, with hash's bucket moved into it if a resize is running. Called with hash's stripe locked */
+	Table_t* WritableTable(size_t hash)
+	{
+		Table_t* t = m_table.load(std::memory_order_acquire);
+		for (;;)
+		{
+			size_t	 b    = hash & t->mask;
+			Table_t* next = t->next.load(std::memory_order_acquire);
+			if (t->buckets[b].load(std::memory_order_relaxed) != Moved())
+			{
+				if (!next)
+					return t;
+				MigrateBucket(t, b);
+			}
+			t = next;
+		}
+	}
+
+	/* Called after every insert, outside the stripe lock: starts a resize when needed and helps one along */
+	void MaybeResize()
+	{
+		Table_t* t    = m_table.load(std::memory_order_acquire);
+		Table_t* next = t->next.load(std::memory_order_acquire);
+		if (!next)
+		{
+			if (m_size.load(std::memory_order_relaxed) <= (t->mask + 1) * MAX_LOAD)
+				return;
+			next		  = new Table_t((t->mask + 1) * 2);
+			Table_t* expected = nullptr;
+			if (!t->next.compare_exchange_strong(expected, next, std::memory_order_acq_rel))
+			{
+				delete next;
+				next = expected;
+			}
+		}
+
+		for (size_t i = 0; i < MIGRATE_BATCH; i++)
+		{
+			size_t b = t->migrateCursor.fetch_add(1, std::memory_order_relaxed);
+			if (b > t->mask)
+				return;
+			StripeLock lock(m_stripes[b & (NUM_STRIPES - 1)].lock);
+			if (t->buckets[b].load(std::memory_order_relaxed) != Moved())
+				MigrateBucket(t, b);
+		}
+	}
+
+	/* Unlinks the node matching key from t's bucket. Called with the stripe locked */
+	template <class K> Node_t* Unlink(Table_t* t, const K& key, size_t hash)
+	{
+		std::atomic<Node_t*>* link = &t->buckets[hash & t->mask];
+		for (Node_t* n = link->load(std::memory_order_relaxed); n; n = link->load(std::memory_order_relaxed))
+		{
+			if (n->hash == hash && m_equal(n->key, key))
+			{
+				link->store(n->next.load(std::memory_order_relaxed), std::memory_order_release);
+				return n;
+			}
+			link = &n->next;
+		}
+		return nullptr;
+	}
+
+	template <class Fn> static void ForEachInBucket(const Table_t* t, size_t b, Fn& fn)
+	{
+		const Node_t* n = t->buckets[b].load(std::memory_order_acquire);
+		if (n == Moved())
+		{
+			/* Its nodes went to every bucket of the next table that shares b's low bits. After clear() the next
+			 * table can be smaller, in which case only one of the old buckets that fold onto it visits it */
+			const Table_t* next = t->next.load(std::memory_order_acquire);
+			if (next->mask >= t->mask)
+			{
+				for (size_t j = b; j <= next->mask; j += t->mask + 1)
+					ForEachInBucket(next, j, fn);
+			}
+			else if (b <= next->mask)
+				ForEachInBucket(next, b, fn);
+			return;
+		}
+		for (; n; n = n->next.load(std::memory_order_acquire))
+			fn(n->key, n->value);
+	}
+
+	static void FreeTables(Table_t* t)
+	{
+		while (t)
+		{
+			for (size_t b = 0; b <= t->mask; b++)
+			{
+				Node_t* n = t->buckets[b].load(std::memory_order_relaxed);
+				if (n == Moved())
+					continue;
+				while (n)
+				{
+					Node_t* next = n->next.load(std::memory_order_relaxed);
+					delete n;
+					n = next;
+				}
+			}
+			Table_t* next = t->next.load(std::memory_order_relaxed);
+			delete t;
+			t = next;
+		}
+	}
+
+public:
+	ConcurrentHashMap() : m_domain(GlobalEpochDomain()), m_table(new Table_t(MIN_BUCKETS)), m_size(0)
+	{
+		for (auto& stripe : m_stripes)
+			stripe.lock.SetProfileName("ConcurrentHashMap::stripe");
+	}
+
+	/* No other thread may be using the map */
+	~ConcurrentHashMap() { FreeTables(m_table.load(std::memory_order_relaxed)); }
+
+	ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+	ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+	/* Approximate while other threads are writing */
+	size_t size() const { return m_size.load(std::memory_order_relaxed); }
+	bool   empty() const { return size() == 0; }
+
+	/* Copies the value for key into out. Lock-free */
+	template <class K> bool find(const K& key, ValT& out) const
+	{
+		CEpochGuard guard(m_domain);
+		Node_t*	    n = FindNode(key, m_hash(key));
+		if (!n)
+			return false;
+		out = n->value;
+		return true;
+	}
+
+	template <class K> bool contains(const K& key) const
+	{
+		CEpochGuard guard(m_domain);
+		return FindNode(key, m_hash(key)) != nullptr;
+	}
+
+	/* Pointer to the value for key, or nullptr. The caller must hold a CEpochGuard on GlobalEpochDomain() */
+	template <class K> const ValT* get(const K& key) const
+	{
+		Node_t* n = FindNode(key, m_hash(key));
+		return n ? &n->value : nullptr;
+	}
+
+	/* Adds key -> value. Returns false, leaving the map unchanged, if key is already there */
+	bool insert(const KeyT& key, const ValT& value)
+	{
+		CEpochGuard guard(m_domain);
+		size_t	    hash = m_hash(key);
+		{
+			StripeLock	      lock(StripeFor(hash));
+			Table_t*	      t	     = WritableTable(hash);
+			std::atomic<Node_t*>& bucket = t->buckets[hash & t->mask];
+			for (Node_t* n = bucket.load(std::memory_order_relaxed); n; n = n->next.load(std::memory_order_relaxed))
+			{
+				if (n->hash == hash && m_equal(n->key, key))
+					return false;
+			}
+			bucket.store(new Node_t(bucket.load(std::memory_order_relaxed), hash, key, value), std::memory_order_release);
+			m_size.fetch_add(1, std::memory_order_relaxed);
+		}
+		MaybeResize();
+		return true;
+	}
+
+	/* Returns the value already mapped to key, or adds value and returns it */
+	ValT get_or_add(const KeyT& key, const ValT& value)
+	{
+		CEpochGuard guard(m_domain);
+		size_t	    hash = m_hash(key);
+		if (Node_t* n = FindNode(key, hash))
+			return n->value;
+		{
+			StripeLock	      lock(StripeFor(hash));
+			Table_t*	      t	     = WritableTable(hash);
+			std::atomic<Node_t*>& bucket = t->buckets[hash & t->mask];
+			for (Node_t* n = bucket.load(std::memory_order_relaxed); n; n = n->next.load(std::memory_order_relaxed))
+			{
+				if (n->hash == hash && m_equal(n->key, key))
+					return n->value;
+			}
+			bucket.store(new Node_t(bucket.load(std::memory_order_relaxed), hash, key, value), std::memory_order_release);
+			m_size.fetch_add(1, std::memory_order_relaxed);
+		}
+		MaybeResize();
+		return value;
+	}
+
+	/* Adds key -> value, or replaces the value if key is already there. Readers see either the old or the new value */
+	void insert_or_assign(const KeyT& key, const ValT& value)
+	{
+		CEpochGuard guard(m_domain);
+		size_t	    hash = m_hash(key);
+		{
+			StripeLock	      lock(StripeFor(hash));
+			Table_t*	      t	   = WritableTable(hash);
+			std::atomic<Node_t*>* link = &t->buckets[hash & t->mask];
+			for (Node_t* n = link->load(std::memory_order_relaxed); n; n = link->load(std::memory_order_relaxed))
+			{
+				if (n->hash == hash && m_equal(n->key, key))
+				{
+					link->store(new Node_t(n->next.load(std::memory_order_relaxed), hash, key, value), std::memory_order_release);
+					m_domain.RetireDelete(n);
+					return;
+				}
+				link = &n->next;
+			}
+			std::atomic<Node_t*>& bucket = t->buckets[hash & t->mask];
+			bucket.store(new Node_t(bucket.load(std::memory_order_relaxed), hash, key, value), std::memory_order_release);
+			m_size.fetch_add(1, std::memory_order_relaxed);
+		}
+		MaybeResize();
+	}
+
+	/* Removes key. Returns false if it wasn't there */
+	template <class K> bool erase(const K& key)
+	{
+		CEpochGuard guard(m_domain);
+		size_t	    hash = m_hash(key);
+		StripeLock  lock(StripeFor(hash));
+		Node_t*	    n = Unlink(WritableTable(hash), key, hash);
+		if (!n)
+			return false;
+		m_size.fetch_sub(1, std::memory_order_relaxed);
+		m_domain.RetireDelete(n);
+		return true;
+	}
+
+	/**
+	 * Calls fn(const KeyT&, const ValT&) for every entry. Lock-free and weakly consistent: entries added or removed
+	 * while this runs may or may not be visited, but nothing is visited twice.
+	 */
+	template <class Fn> void ForEach(Fn fn) const
+	{
+		CEpochGuard guard(m_domain);
+		const Table_t* t = m_table.load(std::memory_order_acquire);
+		for (size_t b = 0; b <= t->mask; b++)
+			ForEachInBucket(t, b, fn);
+	}
+
+	/* Removes everything. Safe to call while other threads use the map */
+	void clear()
+	{
+		CEpochGuard guard(m_domain);
+		for (auto& stripe : m_stripes)
+			stripe.lock.Lock();
+
+		/* Every old bucket is marked MOVED and the chain ends in the fresh table, so stale readers land there.
+		 * The fresh table is linked in first so a reader never finds MOVED without a table after it. MaybeResize
+		 * can still append a table without the stripe locks, in which case fresh goes after that one */
+		Table_t* fresh = new Table_t(MIN_BUCKETS);
+		Table_t* last  = m_table.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Table_t* expected = nullptr;
+			if (last->next.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel))
+				break;
+			last = expected;
+		}
+
+		for (Table_t* t = m_table.load(std::memory_order_relaxed); t != fresh;)
+		{
+			for (size_t b = 0; b <= t->mask; b++)
+			{
+				Node_t* n = t->buckets[b].load(std::memory_order_relaxed);
+				if (n == Moved())
+					continue;
+				while (n)
+				{
+					Node_t* next = n->next.load(std::memory_order_relaxed);
+					m_domain.RetireDelete(n);
+					n = next;
+				}
+				t->buckets[b].store(Moved(), std::memory_order_release);
+			}
+			Table_t* next = t->next.load(std::memory_order_relaxed);
+			/* Helpers that already claimed buckets here will find them MOVED and skip them */
+			t->migrateCursor.store(t->mask + 1, std::memory_order_relaxed);
+			m_domain.RetireDelete(t);
+			t = next;
+		}
+		m_table.store(fresh, std::memory_order_release);
+		m_size.store(0, std::memory_order_relaxed);
+
+		for (auto& stripe : m_stripes)
+			stripe.lock.Unlock();
+	}
+};
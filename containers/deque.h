@@ -0,0 +1,396 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#pragma once
+#include "allocator.h"
+
+/* Standard includes */
+#undef min
+#undef max
+#include <new>
+#include <string.h>
+#include <utility>
+#include <iterator>
+#include <initializer_list>
+
+/**
+ * Double ended queue made of fixed size chunks
+ * Elements live in chunks of CHUNK_SIZE that are never moved, so pushing and popping at either end is O(1) and never
+ * invalidates pointers to the other elements. Only a small map of chunk pointers is ever reallocated.
+ * Iteration walks each chunk contiguously, and indexing is O(1).
+ * Same contains/remove/concat API as List. Like Array, remove and erase shift the elements after the removed one and
+ * so do move them.
+ */
+template <class T, size_t ChunkSize = 0, class AllocatorT = DefaultAllocator<T>> class Deque
+{
+public:
+	/* Roughly 1K per chunk unless told otherwise */
+	static constexpr size_t CHUNK_SIZE = ChunkSize ? ChunkSize : (1024 / sizeof(T) > 8 ? 1024 / sizeof(T) : 8);
+
+private:
+	T**		     m_map;	/* Chunk pointers. Only the chunks holding elements are allocated, the rest are null */
+	size_t		     m_mapSize;
+	size_t		     m_start; /* Index of the first element, counting from the first slot of m_map[0] */
+	size_t		     m_size;
+	T*		     m_spare; /* Last freed chunk, kept so push/pop across a chunk boundary doesn't thrash the allocator */
+	AllocatorT	     m_allocator;
+	DefaultAllocator<T*> m_mapAllocator;
+
+	T* Slot(size_t g) const { return m_map[g / CHUNK_SIZE] + g % CHUNK_SIZE; }
+
+	T* AllocChunk()
+	{
+		T* chunk = m_spare;
+		m_spare	 = nullptr;
+		return chunk ? chunk : m_allocator.allocate(CHUNK_SIZE * sizeof(T));
+	}
+
+	void FreeChunk(size_t c)
+	{
+		if (m_spare)
+			m_allocator.deallocate(m_map[c]);
+		else
+			m_spare = m_map[c];
+		m_map[c] = nullptr;
+	}
+
+	/* Moves the chunks to the middle of the map, growing the map if it's more than half full */
+	void Recentre()
+	{
+		size_t first = m_start / CHUNK_SIZE;
+		size_t used  = m_size ? (m_start + m_size - 1) / CHUNK_SIZE - first + 1 : 0;
+
+		size_t newSize = m_mapSize;
+		if (newSize < (used + 2) * 2)
+			newSize = (used + 2) * 2 < 8 ? 8 : (used + 2) * 2;
+		size_t newFirst = (newSize - used) / 2;
+
+		if (newSize == m_mapSize)
+		{
+			memmove(m_map + newFirst, m_map + first, used * sizeof(T*));
+			for (size_t i = 0; i < newSize; i++)
+			{
+				if (i < newFirst || i >= newFirst + used)
+					m_map[i] = nullptr;
+			}
+		}
+		else
+		{
+			T** map = m_mapAllocator.allocate(newSize * sizeof(T*));
+			memset(map, 0, newSize * sizeof(T*));
+			if (used)
+				memcpy(map + newFirst, m_map + first, used * sizeof(T*));
+			if (m_map)
+				m_mapAllocator.deallocate(m_map);
+			m_map	  = map;
+			m_mapSize = newSize;
+		}
+		m_start = newFirst * CHUNK_SIZE + m_start % CHUNK_SIZE;
+	}
+
+	/* Returns the slot for a new last element */
+	T* PrepareBack()
+	{
+		size_t g = m_start + m_size;
+		if (g / CHUNK_SIZE >= m_mapSize)
+		{
+			Recentre();
+			g = m_start + m_size;
+		}
+		size_t c = g / CHUNK_SIZE;
+		if (!m_map[c])
+			m_map[c] = AllocChunk();
+		return m_map[c] + g % CHUNK_SIZE;
+	}
+
+	/* Returns the slot for a new first element */
+	T* PrepareFront()
+	{
+		if (m_start == 0)
+			Recentre();
+		size_t c = (m_start - 1) / CHUNK_SIZE;
+		if (!m_map[c])
+			m_map[c] = AllocChunk();
+		return m_map[c] + (m_start - 1) % CHUNK_SIZE;
+	}
+
+	void Release()
+	{
+		clear();
+		if (m_spare)
+			m_allocator.deallocate(m_spare);
+		if (m_map)
+			m_mapAllocator.deallocate(m_map);
+		m_map	  = nullptr;
+		m_spare	  = nullptr;
+		m_mapSize = m_start = 0;
+	}
+
+	template <class ValueT, class DequeT> class Iterator
+	{
+	private:
+		DequeT* m_deque;
+		size_t	m_index; /* Same counting as m_start */
+		ValueT* m_cur;
+		ValueT* m_chunkEnd;
+
+		friend class Deque;
+
+		void Load()
+		{
+			if (m_index < m_deque->m_start + m_deque->m_size)
+			{
+				m_cur	   = m_deque->Slot(m_index);
+				m_chunkEnd = m_cur - m_index % CHUNK_SIZE + CHUNK_SIZE;
+			}
+			else
+				m_cur = m_chunkEnd = nullptr;
+		}
+
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef ValueT				value_type;
+		typedef ptrdiff_t			difference_type;
+		typedef ValueT*				pointer;
+		typedef ValueT&				reference;
+
+		Iterator() : m_deque(nullptr), m_index(0), m_cur(nullptr), m_chunkEnd(nullptr) {}
+		Iterator(DequeT* deque, size_t index) : m_deque(deque), m_index(index) { Load(); }
+		/* iterator -> const_iterator */
+		template <class V, class D> Iterator(const Iterator<V, D>& other) : m_deque(other.m_deque), m_index(other.m_index)
+		{
+			Load();
+		}
+
+		ValueT& operator*() const { return *m_cur; }
+		ValueT* operator->() const { return m_cur; }
+
+		Iterator& operator++()
+		{
+			m_index++;
+			if (++m_cur == m_chunkEnd)
+				Load();
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			Iterator old = *this;
+			++*this;
+			return old;
+		}
+
+		Iterator& operator--()
+		{
+			m_index--;
+			Load();
+			return *this;
+		}
+
+		Iterator operator--(int)
+		{
+			Iterator old = *this;
+			--*this;
+			return old;
+		}
+
+		bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+		bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+
+		template <class V, class D> friend class Iterator;
+	};
+
+public:
+	typedef T					  value_type;
+	typedef Iterator<T, Deque>			  iterator;
+	typedef Iterator<const T, const Deque>		  const_iterator;
+
+	Deque() : m_map(nullptr), m_mapSize(0), m_start(0), m_size(0), m_spare(nullptr) {}
+
+	Deque(std::initializer_list<T> ls) : Deque()
+	{
+		for (const auto& x : ls)
+			push_back(x);
+	}
+
+	Deque(const T* p, size_t n) : Deque()
+	{
+		for (size_t i = 0; i < n; i++)
+			push_back(p[i]);
+	}
+
+	Deque(const Deque& other) : Deque() { *this = other; }
+
+	Deque(Deque&& other) noexcept : Deque() { *this = std::move(other); }
+
+	~Deque() { Release(); }
+
+	Deque& operator=(const Deque& other)
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		other.ForEachChunk([this](const T* data, size_t n) {
+			for (size_t i = 0; i < n; i++)
+				push_back(data[i]);
+		});
+		return *this;
+	}
+
+	Deque& operator=(Deque&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		Release();
+		m_map		= other.m_map;
+		m_mapSize	= other.m_mapSize;
+		m_start		= other.m_start;
+		m_size		= other.m_size;
+		m_spare		= other.m_spare;
+		other.m_map	= nullptr;
+		other.m_spare	= nullptr;
+		other.m_mapSize = other.m_start = other.m_size = 0;
+		return *this;
+	}
+
+	size_t size() const { return m_size; }
+	bool   empty() const { return m_size == 0; }
+
+	iterator       begin() { return iterator(this, m_start); }
+	iterator       end() { return iterator(this, m_start + m_size); }
+	const_iterator begin() const { return const_iterator(this, m_start); }
+	const_iterator end() const { return const_iterator(this, m_start + m_size); }
+
+	T&	 operator[](size_t i) { return *Slot(m_start + i); }
+	const T& operator[](size_t i) const { return *Slot(m_start + i); }
+	T&	 front() { return *Slot(m_start); }
+	const T& front() const { return *Slot(m_start); }
+	T&	 back() { return *Slot(m_start + m_size - 1); }
+	const T& back() const { return *Slot(m_start + m_size - 1); }
+
+	template <class... Args> T& emplace_back(Args&&... args)
+	{
+		T* p = new (PrepareBack()) T(std::forward<Args>(args)...);
+		m_size++;
+		return *p;
+	}
+
+	template <class... Args> T& emplace_front(Args&&... args)
+	{
+		T* p = new (PrepareFront()) T(std::forward<Args>(args)...);
+		m_start--;
+		m_size++;
+		return *p;
+	}
+
+	void push_back(const T& t) { emplace_back(t); }
+	void push_back(T&& t) { emplace_back(std::move(t)); }
+	void push_front(const T& t) { emplace_front(t); }
+	void push_front(T&& t) { emplace_front(std::move(t)); }
+
+	void pop_back()
+	{
+		size_t g = m_start + --m_size;
+		Slot(g)->~T();
+		if (m_size == 0 || g % CHUNK_SIZE == 0)
+			FreeChunk(g / CHUNK_SIZE);
+	}
+
+	void pop_front()
+	{
+		size_t g = m_start++;
+		Slot(g)->~T();
+		m_size--;
+		if (m_size == 0 || m_start % CHUNK_SIZE == 0)
+			FreeChunk(g / CHUNK_SIZE);
+	}
+
+	/* Destroys the elements and frees their chunks. The map is kept */
+	void clear()
+	{
+		while (m_size)
+			pop_back();
+	}
+
+	/* Removes the element at pos by shifting the ones after it down. Returns an iterator to the next element */
+	iterator erase(const_iterator pos)
+	{
+		size_t index = pos.m_index - m_start;
+		for (size_t i = index; i + 1 < m_size; i++)
+			(*this)[i] = std::move((*this)[i + 1]);
+		pop_back();
+		return iterator(this, m_start + index);
+	}
+
+	/* Removes up to max occurrences of t */
+	void remove(const T& t, size_t max = 1)
+	{
+		for (size_t i = 0; i < m_size && max > 0;)
+		{
+			if ((*this)[i] == t)
+			{
+				erase(const_iterator(this, m_start + i));
+				max--;
+			}
+			else
+				i++;
+		}
+	}
+
+	bool contains(const T& t) const
+	{
+		for (const auto& x : *this)
+		{
+			if (x == t)
+				return true;
+		}
+		return false;
+	}
+
+	template <size_t M, class A> void concat(const Deque<T, M, A>& other)
+	{
+		/* Indexed so that concatenating a deque with itself works */
+		size_t n = other.size();
+		for (size_t i = 0; i < n; i++)
+			push_back(other[i]);
+	}
+
+	template <size_t M, class A> Deque& operator+=(const Deque<T, M, A>& o)
+	{
+		concat(o);
+		return *this;
+	}
+
+	/* Calls fn(T* data, size_t count) for each contiguous run of elements, in order */
+	template <class Fn> void ForEachChunk(Fn fn)
+	{
+		for (size_t g = m_start, end = m_start + m_size; g < end;)
+		{
+			size_t n = CHUNK_SIZE - g % CHUNK_SIZE;
+			n	 = n < end - g ? n : end - g;
+			fn(Slot(g), n);
+			g += n;
+		}
+	}
+
+	template <class Fn> void ForEachChunk(Fn fn) const
+	{
+		for (size_t g = m_start, end = m_start + m_size; g < end;)
+		{
+			size_t n = CHUNK_SIZE - g % CHUNK_SIZE;
+			n	 = n < end - g ? n : end - g;
+			fn(static_cast<const T*>(Slot(g)), n);
+			g += n;
+		}
+	}
+};
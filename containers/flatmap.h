@@ -0,0 +1,155 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#pragma once
+#include "flatset.h"
+
+/**
+ * Map stored as an array of key/value pairs sorted by key
+ * Same tradeoffs as FlatSet: compact, cache friendly lookups and iteration in key order, but single inserts and erases
+ * shift the elements after them, so build from a batch when possible.
+ * The lookup functions take any key type Compare can compare against KeyT, so a comparator that also accepts
+ * const char* lets a FlatMap<String, T> be searched without building a String.
+ *
+ * Inserting or erasing invalidates iterators and pointers into the map. Don't modify keys through an iterator.
+ */
+template <class KeyT, class ValT, class Compare = std::less<KeyT>> class FlatMap
+{
+public:
+	typedef std::pair<KeyT, ValT> value_type;
+
+private:
+	/* Compares elements by key, for FlatLowerBound */
+	struct ElementCompare
+	{
+		Compare comp;
+		template <class K> bool operator()(const value_type& a, const K& key) const { return comp(a.first, key); }
+	};
+
+	Array<value_type> m_data;
+	ElementCompare	  m_comp;
+
+	template <class K> size_t LowerIndex(const K& key) const { return FlatLowerBound(m_data.data(), m_data.size(), key, m_comp); }
+
+	template <class K> size_t FindIndex(const K& key) const
+	{
+		size_t i = LowerIndex(key);
+		return i < m_data.size() && !m_comp.comp(key, m_data[i].first) ? i : m_data.size();
+	}
+
+	/* Stable sort by key, then drop duplicate keys keeping the first of each run */
+	void Normalize(size_t sortedPrefix = 0)
+	{
+		auto byKey = [this](const value_type& a, const value_type& b) { return m_comp.comp(a.first, b.first); };
+		auto mid   = m_data.begin() + sortedPrefix;
+		std::stable_sort(mid, m_data.end(), byKey);
+		if (sortedPrefix)
+			std::inplace_merge(m_data.begin(), mid, m_data.end(), byKey);
+		m_data.erase(std::unique(m_data.begin(), m_data.end(),
+					 [this](const value_type& a, const value_type& b) {
+						 return !m_comp.comp(a.first, b.first) && !m_comp.comp(b.first, a.first);
+					 }),
+			     m_data.end());
+	}
+
+	template <class K, class... Args> std::pair<typename Array<value_type>::iterator, bool> Emplace(K&& key, Args&&... args)
+	{
+		size_t i = LowerIndex(key);
+		if (i < m_data.size() && !m_comp.comp(key, m_data[i].first))
+			return {m_data.begin() + i, false};
+		auto it = m_data.emplace(m_data.begin() + i, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+					 std::forward_as_tuple(std::forward<Args>(args)...));
+		return {it, true};
+	}
+
+public:
+	typedef typename Array<value_type>::iterator	   iterator;
+	typedef typename Array<value_type>::const_iterator const_iterator;
+
+	FlatMap() {}
+
+	/* Bulk construction from unsorted input. With duplicate keys the first one wins */
+	FlatMap(std::initializer_list<value_type> ls) : m_data(ls) { Normalize(); }
+	FlatMap(const value_type* p, size_t n) : m_data(p, n) { Normalize(); }
+
+	size_t size() const { return m_data.size(); }
+	bool   empty() const { return m_data.empty(); }
+	void   clear() { m_data.clear(); }
+	void   reserve(size_t n) { m_data.reserve(n); }
+
+	iterator       begin() { return m_data.begin(); }
+	iterator       end() { return m_data.end(); }
+	const_iterator begin() const { return m_data.begin(); }
+	const_iterator end() const { return m_data.end(); }
+
+	/* Inserts unless the key is already present. Existing values are never overwritten */
+	template <class... Args> std::pair<iterator, bool> emplace(const KeyT& k, Args&&... args) { return Emplace(k, std::forward<Args>(args)...); }
+	template <class... Args> std::pair<iterator, bool> emplace(KeyT&& k, Args&&... args) { return Emplace(std::move(k), std::forward<Args>(args)...); }
+
+	std::pair<iterator, bool> insert(const value_type& v) { return Emplace(v.first, v.second); }
+	std::pair<iterator, bool> insert(value_type&& v) { return Emplace(std::move(v.first), std::move(v.second)); }
+
+	/* Batch insert, sorted once and merged in. Keys already in the map keep their values */
+	void insert(const value_type* p, size_t n)
+	{
+		size_t old = m_data.size();
+		m_data.insert(m_data.end(), p, p + n);
+		Normalize(old);
+	}
+
+	void add(const KeyT& k, const ValT& v) { Emplace(k, v); }
+
+	ValT& operator[](const KeyT& k) { return Emplace(k).first->second; }
+	ValT& operator[](KeyT&& k) { return Emplace(std::move(k)).first->second; }
+
+	template <class K> iterator lower_bound(const K& key) { return m_data.begin() + LowerIndex(key); }
+	template <class K> const_iterator lower_bound(const K& key) const { return m_data.begin() + LowerIndex(key); }
+
+	template <class K> iterator	  find(const K& key) { return m_data.begin() + FindIndex(key); }
+	template <class K> const_iterator find(const K& key) const { return m_data.begin() + FindIndex(key); }
+
+	/* Pointer to the value for key, or nullptr */
+	template <class K> ValT* get(const K& key)
+	{
+		size_t i = FindIndex(key);
+		return i < m_data.size() ? &m_data[i].second : nullptr;
+	}
+
+	template <class K> const ValT* get(const K& key) const
+	{
+		size_t i = FindIndex(key);
+		return i < m_data.size() ? &m_data[i].second : nullptr;
+	}
+
+	template <class K> bool	  contains(const K& key) const { return FindIndex(key) < m_data.size(); }
+	template <class K> size_t count(const K& key) const { return contains(key) ? 1 : 0; }
+
+	template <class K> size_t erase(const K& key)
+	{
+		size_t i = FindIndex(key);
+		if (i == m_data.size())
+			return 0;
+		m_data.erase(m_data.begin() + i);
+		return 1;
+	}
+
+	iterator erase(const_iterator it) { return m_data.erase(it); }
+
+	/* Erases every element pred returns true for. Returns the number erased */
+	template <class Pred> size_t erase_if(Pred pred)
+	{
+		size_t old = m_data.size();
+		m_data.erase(std::remove_if(m_data.begin(), m_data.end(), pred), m_data.end());
+		return old - m_data.size();
+	}
+};
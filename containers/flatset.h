@@ -0,0 +1,251 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#pragma once
+#include "array.h"
+
+/* Standard includes */
+#undef min
+#undef max
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <initializer_list>
+
+/**
+ * Index of the first element of the sorted range data[0, n) that isn't less than key (n if there is none).
+ * Branchless: the loop runs a fixed number of times for a given n and the comparison becomes a conditional move, so
+ * there are no mispredicted branches. Both candidates for the next probe are prefetched while the current one resolves.
+ * comp(element, key) must return true when element orders before key.
+ */
+template <class T, class K, class Compare> inline size_t FlatLowerBound(const T* data, size_t n, const K& key, const Compare& comp)
+{
+	if (n == 0)
+		return 0;
+	const T* base = data;
+	while (n > 1)
+	{
+		size_t half = n / 2;
+#ifdef __GNUC__
+		__builtin_prefetch(base + half / 2);
+		__builtin_prefetch(base + half + half / 2);
+#endif
+		base = comp(base[half], key) ? base + half : base;
+		n -= half;
+	}
+	return (base - data) + (comp(*base, key) ? 1 : 0);
+}
+
+/**
+ * Set stored as a sorted array
+ * Lookups are a branchless binary search over contiguous memory, iteration is a plain array walk, and there's no per
+ * element allocation or node overhead. Single inserts and erases shift the elements after them, so prefer building
+ * from a batch (constructors, insert(p, n)) which sorts once.
+ * unify/intersect/subtract are linear merges over the two sorted arrays.
+ *
+ * Elements are kept const: changing one through data() would break the ordering.
+ * Inserting or erasing invalidates iterators and pointers, as with Array.
+ */
+template <class T, class Compare = std::less<T>> class FlatSet
+{
+private:
+	Array<T> m_data;
+	Compare	 m_comp;
+
+	bool Equivalent(const T& a, const T& b) const { return !m_comp(a, b) && !m_comp(b, a); }
+
+	/* Sorts, then drops duplicates keeping the first of each run */
+	void Normalize(size_t sortedPrefix = 0)
+	{
+		auto mid = m_data.begin() + sortedPrefix;
+		std::sort(mid, m_data.end(), m_comp);
+		if (sortedPrefix)
+			std::inplace_merge(m_data.begin(), mid, m_data.end(), m_comp);
+		m_data.erase(std::unique(m_data.begin(), m_data.end(), [this](const T& a, const T& b) { return Equivalent(a, b); }), m_data.end());
+	}
+
+public:
+	typedef T					value_type;
+	typedef typename Array<T>::const_iterator	iterator;
+	typedef typename Array<T>::const_iterator	const_iterator;
+
+	FlatSet() {}
+
+	FlatSet(std::initializer_list<T> ls) : m_data(ls) { Normalize(); }
+
+	/* Bulk construction from unsorted input, duplicates allowed */
+	FlatSet(const T* p, size_t n) : m_data(p, n) { Normalize(); }
+
+	/* Takes over data that is already sorted by Compare and duplicate free. Not checked */
+	static FlatSet FromSorted(Array<T>&& sorted)
+	{
+		FlatSet set;
+		set.m_data = std::move(sorted);
+		return set;
+	}
+
+	size_t	 size() const { return m_data.size(); }
+	bool	 empty() const { return m_data.empty(); }
+	void	 clear() { m_data.clear(); }
+	void	 reserve(size_t n) { m_data.reserve(n); }
+	const T* data() const { return m_data.data(); }
+
+	const_iterator begin() const { return m_data.begin(); }
+	const_iterator end() const { return m_data.end(); }
+
+	/* i-th smallest element */
+	const T& operator[](size_t i) const { return m_data[i]; }
+	const T& front() const { return m_data.front(); }
+	const T& back() const { return m_data.back(); }
+
+	template <class K> const_iterator lower_bound(const K& key) const
+	{
+		return m_data.begin() + FlatLowerBound(m_data.data(), m_data.size(), key, m_comp);
+	}
+
+	template <class K> const_iterator find(const K& key) const
+	{
+		auto it = lower_bound(key);
+		return it != m_data.end() && !m_comp(key, *it) ? it : m_data.end();
+	}
+
+	template <class K> bool	  contains(const K& key) const { return find(key) != m_data.end(); }
+	template <class K> size_t count(const K& key) const { return contains(key) ? 1 : 0; }
+
+	/* Inserts unless an equivalent element is already present */
+	std::pair<const_iterator, bool> insert(const T& v)
+	{
+		size_t i = FlatLowerBound(m_data.data(), m_data.size(), v, m_comp);
+		if (i < m_data.size() && !m_comp(v, m_data[i]))
+			return {m_data.begin() + i, false};
+		return {m_data.insert(m_data.begin() + i, v), true};
+	}
+
+	std::pair<const_iterator, bool> insert(T&& v)
+	{
+		size_t i = FlatLowerBound(m_data.data(), m_data.size(), v, m_comp);
+		if (i < m_data.size() && !m_comp(v, m_data[i]))
+			return {m_data.begin() + i, false};
+		return {m_data.insert(m_data.begin() + i, std::move(v)), true};
+	}
+
+	/* Batch insert: the new elements are sorted on their own and merged in, O(n + k log k) rather than k single inserts */
+	void insert(const T* p, size_t n)
+	{
+		size_t old = m_data.size();
+		m_data.insert(m_data.end(), p, p + n);
+		Normalize(old);
+	}
+
+	template <class It> void insert(It first, It last)
+	{
+		size_t old = m_data.size();
+		m_data.insert(m_data.end(), first, last);
+		Normalize(old);
+	}
+
+	template <class K> size_t erase(const K& key)
+	{
+		auto it = find(key);
+		if (it == m_data.end())
+			return 0;
+		m_data.erase(it);
+		return 1;
+	}
+
+	const_iterator erase(const_iterator it) { return m_data.erase(it); }
+
+	/* Erases every element pred returns true for. Returns the number erased */
+	template <class Pred> size_t erase_if(Pred pred)
+	{
+		size_t old = m_data.size();
+		m_data.erase(std::remove_if(m_data.begin(), m_data.end(), pred), m_data.end());
+		return old - m_data.size();
+	}
+
+	/* Set union with other */
+	void unify(const FlatSet& other)
+	{
+		if (other.empty() || this == &other)
+			return;
+		Array<T> out;
+		out.reserve(m_data.size() + other.m_data.size());
+		std::set_union(m_data.begin(), m_data.end(), other.m_data.begin(), other.m_data.end(), std::back_inserter(out), m_comp);
+		m_data.swap(out);
+	}
+
+	/* Set intersection with other, in place */
+	void intersect(const FlatSet& other)
+	{
+		const T* o  = other.m_data.data();
+		size_t	 on = other.m_data.size(), w = 0, j = 0;
+		/* Against a much bigger set, searching beats walking it */
+		bool search = on > 16 * m_data.size();
+		for (size_t i = 0; i < m_data.size(); i++)
+		{
+			if (search)
+				j += FlatLowerBound(o + j, on - j, m_data[i], m_comp);
+			else
+			{
+				while (j < on && m_comp(o[j], m_data[i]))
+					j++;
+			}
+			if (j == on)
+				break;
+			if (!m_comp(m_data[i], o[j]))
+			{
+				if (w != i)
+					m_data[w] = std::move(m_data[i]);
+				w++;
+			}
+		}
+		m_data.erase(m_data.begin() + w, m_data.end());
+	}
+
+	/* Removes every element that is also in other, in place */
+	void subtract(const FlatSet& other)
+	{
+		if (this == &other)
+		{
+			clear();
+			return;
+		}
+		const T* o  = other.m_data.data();
+		size_t	 on = other.m_data.size(), w = 0, j = 0;
+		for (size_t i = 0; i < m_data.size(); i++)
+		{
+			while (j < on && m_comp(o[j], m_data[i]))
+				j++;
+			if (j < on && !m_comp(m_data[i], o[j]))
+				continue;
+			if (w != i)
+				m_data[w] = std::move(m_data[i]);
+			w++;
+		}
+		m_data.erase(m_data.begin() + w, m_data.end());
+	}
+
+	bool operator==(const FlatSet& other) const
+	{
+		if (size() != other.size())
+			return false;
+		for (size_t i = 0; i < size(); i++)
+		{
+			if (!Equivalent(m_data[i], other.m_data[i]))
+				return false;
+		}
+		return true;
+	}
+
+	bool operator!=(const FlatSet& other) const { return !(*this == other); }
+};
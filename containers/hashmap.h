@@ -13,13 +13,27 @@ GNU General Public License for more details.
 */
 #pragma once
 
-#include "public/containers/allocator.h"
+#include "allocator.h"
+#include "string.h"
+#include "../build.h"
 
 /* Standard includes */
 #undef min
 #undef max
 #include <unordered_map>
 #include <map>
+#include <new>
+#include <tuple>
+#include <utility>
+#include <initializer_list>
+#include <string.h>
+
+#if USE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 template <class KeyT, class ValT> class Map : public std::map<KeyT, ValT>
 {
@@ -33,14 +47,507 @@ public:
 	void add(const KeyT& k, const ValT& v) { this->insert(std::pair<KeyT, ValT>(k, v)); }
 };
 
-template <class KeyT, class ValT, class Hash = std::hash<KeyT>> class HashMap : public std::unordered_map<KeyT, ValT>
+template <class KeyT, class ValT, class Hash = std::hash<KeyT>> class HashMultiMap : public std::unordered_multimap<KeyT, ValT, Hash>
 {
 public:
 	void add(const KeyT& k, const ValT& v) { this->insert(std::pair<KeyT, ValT>(k, v)); }
 };
 
-template <class KeyT, class ValT, class Hash = std::hash<KeyT>> class HasMultiMap
+/* Hashes len bytes, 8 at a time */
+inline unsigned long long HashBytes(const void* data, size_t len)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	unsigned long long   h = 0x9E3779B97F4A7C15ULL ^ (len * 0xFF51AFD7ED558CCDULL);
+	auto		     mix = [](unsigned long long k) {
+		      k *= 0x87C37B91114253D5ULL;
+		      k = (k << 31) | (k >> 33);
+		      return k * 0x4CF5AD432745937FULL;
+	};
+
+	for (; len >= 8; p += 8, len -= 8)
+	{
+		unsigned long long k;
+		memcpy(&k, p, 8);
+		h ^= mix(k);
+		h = ((h << 27) | (h >> 37)) * 5 + 0x52DCE729;
+	}
+	if (len)
+	{
+		unsigned long long k = 0;
+		memcpy(&k, p, len);
+		h ^= mix(k);
+	}
+	return h;
+}
+
+/* Hash and equality for string keys. Any of const char*, String and StringView can be used to look up any other */
+struct HashMapStringHash
+{
+	size_t operator()(const char* s) const { return (size_t)HashBytes(s, strlen(s)); }
+	size_t operator()(const String& s) const { return (size_t)HashBytes(s.c_str(), s.length()); }
+	size_t operator()(const StringView& s) const { return (size_t)HashBytes(s.c_str(), s.length()); }
+};
+
+struct HashMapStringEqual
+{
+	static const char* Str(const char* s) { return s; }
+	static const char* Str(const String& s) { return s.c_str(); }
+	static const char* Str(const StringView& s) { return s.c_str(); }
+	static size_t	   Len(const char* s) { return strlen(s); }
+	static size_t	   Len(const String& s) { return s.length(); }
+	static size_t	   Len(const StringView& s) { return s.length(); }
+
+	template <class A, class B> bool operator()(const A& a, const B& b) const
+	{
+		size_t len = Len(a);
+		return len == Len(b) && (len == 0 || memcmp(Str(a), Str(b), len) == 0);
+	}
+};
+
+template <class T> struct HashMapHash : std::hash<T>
+{
+};
+template <> struct HashMapHash<String> : HashMapStringHash
+{
+};
+template <> struct HashMapHash<StringView> : HashMapStringHash
+{
+};
+template <> struct HashMapHash<const char*> : HashMapStringHash
+{
+};
+
+template <class T> struct HashMapEqual
+{
+	template <class A, class B> bool operator()(const A& a, const B& b) const { return a == b; }
+};
+template <> struct HashMapEqual<String> : HashMapStringEqual
+{
+};
+template <> struct HashMapEqual<StringView> : HashMapStringEqual
+{
+};
+template <> struct HashMapEqual<const char*> : HashMapStringEqual
+{
+};
+
+/**
+ * Open addressing hash map
+ * Elements live directly in one flat slot array. A parallel array of control bytes holds 7 bits of each element's hash
+ * (or EMPTY), and lookups compare 16 control bytes at a time (SSE2 where available) before touching any key.
+ * Probing is linear and erase shifts the following elements back, so there are no tombstones and erase-heavy maps
+ * don't degrade. The table grows at 7/8 load.
+ *
+ * find/contains/count/get/erase accept any key type the Hash and Equal functors accept, so a HashMap<String, T> can be
+ * searched with a const char* or StringView without building a String.
+ *
+ * Unlike std::unordered_map, inserting or erasing moves elements around, which invalidates all iterators and pointers
+ * into the map. Don't modify keys through an iterator.
+ */
+template <class KeyT, class ValT, class Hash = HashMapHash<KeyT>, class Equal = HashMapEqual<KeyT>> class HashMap
 {
 public:
-	void add(const KeyT& k, const ValT& v) { this->insert(std::pair<KeyT, ValT>(k, v)); }
-};
\ No newline at end of file
+	typedef std::pair<KeyT, ValT> value_type;
+
+	static constexpr size_t GROUP_WIDTH  = 16;
+	static constexpr size_t MIN_CAPACITY = 16;
+
+private:
+	static constexpr signed char CTRL_EMPTY = -128;
+	static constexpr size_t	     NPOS	= ~(size_t)0;
+
+	/* m_capacity + GROUP_WIDTH - 1 bytes. The tail mirrors the first bytes so a group can be loaded at any slot */
+	signed char* m_ctrl;
+	value_type*  m_slots;
+	size_t	     m_capacity;
+	size_t	     m_size;
+	Hash	     m_hash;
+	Equal	     m_equal;
+
+	template <class MapT, class RefT> class IteratorBase
+	{
+	private:
+		MapT*  m_map;
+		size_t m_index;
+
+		void Skip()
+		{
+			while (m_index < m_map->m_capacity && m_map->m_ctrl[m_index] < 0)
+				m_index++;
+		}
+
+		friend class HashMap;
+
+	public:
+		IteratorBase(MapT* map, size_t index) : m_map(map), m_index(index) { Skip(); }
+
+		operator IteratorBase<const HashMap, const value_type>() const { return {m_map, m_index}; }
+
+		RefT& operator*() const { return m_map->m_slots[m_index]; }
+		RefT* operator->() const { return &m_map->m_slots[m_index]; }
+
+		IteratorBase& operator++()
+		{
+			m_index++;
+			Skip();
+			return *this;
+		}
+
+		bool operator==(const IteratorBase& other) const { return m_index == other.m_index; }
+		bool operator!=(const IteratorBase& other) const { return m_index != other.m_index; }
+	};
+
+public:
+	typedef IteratorBase<HashMap, value_type>		iterator;
+	typedef IteratorBase<const HashMap, const value_type> const_iterator;
+
+private:
+	static unsigned int LowestBit(unsigned int mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (unsigned int)index;
+#else
+		return (unsigned int)__builtin_ctz(mask);
+#endif
+	}
+
+	/* Bit i is set when control byte i of the group starting at ctrl equals b */
+	static unsigned int MatchGroup(const signed char* ctrl, signed char b)
+	{
+#if USE_SSE2
+		__m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+		return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(b)));
+#else
+		unsigned int mask = 0;
+		for (size_t i = 0; i < GROUP_WIDTH; i++)
+			mask |= (unsigned int)(ctrl[i] == b) << i;
+		return mask;
+#endif
+	}
+
+	/* User hashes (std::hash on integers is the identity) are mixed so both the low and high bits are usable */
+	template <class K> unsigned long long HashOf(const K& key) const
+	{
+		unsigned long long h = (unsigned long long)m_hash(key);
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	static signed char H2(unsigned long long hash) { return (signed char)(hash >> 57); }
+
+	static size_t MaxLoad(size_t capacity) { return capacity - capacity / 8; }
+
+	static size_t CapacityFor(size_t count)
+	{
+		size_t cap = MIN_CAPACITY;
+		while (MaxLoad(cap) < count)
+			cap <<= 1;
+		return cap;
+	}
+
+	void SetCtrl(size_t index, signed char c)
+	{
+		m_ctrl[index] = c;
+		if (index < GROUP_WIDTH - 1)
+			m_ctrl[m_capacity + index] = c;
+	}
+
+	void Allocate(size_t capacity)
+	{
+		m_capacity = capacity;
+		m_ctrl	   = new signed char[capacity + GROUP_WIDTH - 1];
+		memset(m_ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH - 1);
+		m_slots = static_cast<value_type*>(::operator new(capacity * sizeof(value_type), std::align_val_t(alignof(value_type))));
+	}
+
+	void Free()
+	{
+		for (size_t i = 0; i < m_capacity; i++)
+		{
+			if (m_ctrl[i] >= 0)
+				m_slots[i].~value_type();
+		}
+		delete[] m_ctrl;
+		::operator delete(m_slots, std::align_val_t(alignof(value_type)));
+		m_ctrl	   = nullptr;
+		m_slots	   = nullptr;
+		m_capacity = 0;
+		m_size	   = 0;
+	}
+
+	template <class K> size_t FindIndex(const K& key, unsigned long long hash) const
+	{
+		if (!m_size)
+			return NPOS;
+
+		const signed char h2   = H2(hash);
+		const size_t	  mask = m_capacity - 1;
+		for (size_t pos = hash & mask;; pos = (pos + GROUP_WIDTH) & mask)
+		{
+			const signed char* group = m_ctrl + pos;
+			for (unsigned int match = MatchGroup(group, h2); match; match &= match - 1)
+			{
+				size_t index = (pos + LowestBit(match)) & mask;
+				if (m_equal(m_slots[index].first, key))
+					return index;
+			}
+			/* Everything between an element's home slot and the element itself is occupied */
+			if (MatchGroup(group, CTRL_EMPTY))
+				return NPOS;
+		}
+	}
+
+	size_t FindEmpty(unsigned long long hash) const
+	{
+		const size_t mask = m_capacity - 1;
+		for (size_t pos = hash & mask;; pos = (pos + GROUP_WIDTH) & mask)
+		{
+			unsigned int match = MatchGroup(m_ctrl + pos, CTRL_EMPTY);
+			if (match)
+				return (pos + LowestBit(match)) & mask;
+		}
+	}
+
+	void Resize(size_t capacity)
+	{
+		signed char* oldCtrl	 = m_ctrl;
+		value_type*  oldSlots	 = m_slots;
+		size_t	     oldCapacity = m_capacity;
+
+		Allocate(capacity);
+		for (size_t i = 0; i < oldCapacity; i++)
+		{
+			if (oldCtrl[i] < 0)
+				continue;
+			unsigned long long hash	 = HashOf(oldSlots[i].first);
+			size_t		   index = FindEmpty(hash);
+			new (&m_slots[index]) value_type(std::move(oldSlots[i]));
+			oldSlots[i].~value_type();
+			SetCtrl(index, H2(hash));
+		}
+
+		delete[] oldCtrl;
+		::operator delete(oldSlots, std::align_val_t(alignof(value_type)));
+	}
+
+	template <class K, class... Args> std::pair<iterator, bool> Emplace(K&& key, Args&&... args)
+	{
+		unsigned long long hash	 = HashOf(key);
+		size_t		   index = FindIndex(key, hash);
+		if (index != NPOS)
+			return {iterator(this, index), false};
+
+		if (m_size + 1 > MaxLoad(m_capacity))
+			Resize(m_capacity ? m_capacity * 2 : MIN_CAPACITY);
+
+		index = FindEmpty(hash);
+		new (&m_slots[index])
+			value_type(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+		SetCtrl(index, H2(hash));
+		m_size++;
+		return {iterator(this, index), true};
+	}
+
+	/* Backward shift deletion: pull following elements into the hole as long as that doesn't move them before their home slot */
+	void EraseIndex(size_t index)
+	{
+		const size_t mask = m_capacity - 1;
+		size_t	     hole = index;
+		m_slots[hole].~value_type();
+
+		for (size_t i = (hole + 1) & mask; m_ctrl[i] != CTRL_EMPTY; i = (i + 1) & mask)
+		{
+			size_t home = HashOf(m_slots[i].first) & mask;
+			if (((i - home) & mask) < ((i - hole) & mask))
+				continue;
+			new (&m_slots[hole]) value_type(std::move(m_slots[i]));
+			m_slots[i].~value_type();
+			SetCtrl(hole, m_ctrl[i]);
+			hole = i;
+		}
+		SetCtrl(hole, CTRL_EMPTY);
+		m_size--;
+	}
+
+	void CopyFrom(const HashMap& other)
+	{
+		m_hash	= other.m_hash;
+		m_equal = other.m_equal;
+		if (!other.m_capacity)
+			return;
+		Allocate(other.m_capacity);
+		for (size_t i = 0; i < m_capacity; i++)
+		{
+			if (other.m_ctrl[i] >= 0)
+				new (&m_slots[i]) value_type(other.m_slots[i]);
+		}
+		memcpy(m_ctrl, other.m_ctrl, m_capacity + GROUP_WIDTH - 1);
+		m_size = other.m_size;
+	}
+
+public:
+	HashMap() : m_ctrl(nullptr), m_slots(nullptr), m_capacity(0), m_size(0) {}
+
+	HashMap(std::initializer_list<value_type> ls) : HashMap()
+	{
+		reserve(ls.size());
+		for (const auto& x : ls)
+			insert(x);
+	}
+
+	HashMap(const HashMap& other) : HashMap() { CopyFrom(other); }
+
+	HashMap(HashMap&& other) noexcept : HashMap() { swap(other); }
+
+	~HashMap() { Free(); }
+
+	HashMap& operator=(const HashMap& other)
+	{
+		if (this != &other)
+		{
+			Free();
+			CopyFrom(other);
+		}
+		return *this;
+	}
+
+	HashMap& operator=(HashMap&& other) noexcept
+	{
+		swap(other);
+		return *this;
+	}
+
+	void swap(HashMap& other) noexcept
+	{
+		std::swap(m_ctrl, other.m_ctrl);
+		std::swap(m_slots, other.m_slots);
+		std::swap(m_capacity, other.m_capacity);
+		std::swap(m_size, other.m_size);
+		std::swap(m_hash, other.m_hash);
+		std::swap(m_equal, other.m_equal);
+	}
+
+	size_t size() const { return m_size; }
+	bool   empty() const { return m_size == 0; }
+	size_t capacity() const { return m_capacity; }
+	float  load_factor() const { return m_capacity ? (float)m_size / (float)m_capacity : 0.f; }
+
+	/* Makes room for count elements without further rehashing */
+	void reserve(size_t count)
+	{
+		if (count > MaxLoad(m_capacity))
+			Resize(CapacityFor(count));
+	}
+
+	/* Rebuilds the table with at least buckets slots, or shrinks it to fit the current size. rehash(0) on an
+	 * empty map frees the table entirely */
+	void rehash(size_t buckets)
+	{
+		if (!m_size && !buckets)
+		{
+			Free();
+			return;
+		}
+		size_t cap = CapacityFor(m_size);
+		while (cap < buckets)
+			cap <<= 1;
+		if (cap != m_capacity)
+			Resize(cap);
+	}
+
+	/* Destroys all elements but keeps the table */
+	void clear()
+	{
+		for (size_t i = 0; i < m_capacity; i++)
+		{
+			if (m_ctrl[i] >= 0)
+				m_slots[i].~value_type();
+		}
+		if (m_ctrl)
+			memset(m_ctrl, CTRL_EMPTY, m_capacity + GROUP_WIDTH - 1);
+		m_size = 0;
+	}
+
+	iterator       begin() { return iterator(this, 0); }
+	iterator       end() { return iterator(this, m_capacity); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, m_capacity); }
+
+	/* Inserts unless the key is already present. Existing values are never overwritten */
+	template <class... Args> std::pair<iterator, bool> emplace(const KeyT& k, Args&&... args) { return Emplace(k, std::forward<Args>(args)...); }
+	template <class... Args> std::pair<iterator, bool> emplace(KeyT&& k, Args&&... args) { return Emplace(std::move(k), std::forward<Args>(args)...); }
+
+	std::pair<iterator, bool> insert(const value_type& v) { return Emplace(v.first, v.second); }
+	std::pair<iterator, bool> insert(value_type&& v) { return Emplace(std::move(v.first), std::move(v.second)); }
+
+	void add(const KeyT& k, const ValT& v) { Emplace(k, v); }
+
+	ValT& operator[](const KeyT& k) { return Emplace(k).first->second; }
+	ValT& operator[](KeyT&& k) { return Emplace(std::move(k)).first->second; }
+
+	template <class K> iterator find(const K& key)
+	{
+		size_t index = FindIndex(key, HashOf(key));
+		return index == NPOS ? end() : iterator(this, index);
+	}
+
+	template <class K> const_iterator find(const K& key) const
+	{
+		size_t index = FindIndex(key, HashOf(key));
+		return index == NPOS ? end() : const_iterator(this, index);
+	}
+
+	/* Pointer to the value for key, or nullptr */
+	template <class K> ValT* get(const K& key)
+	{
+		size_t index = FindIndex(key, HashOf(key));
+		return index == NPOS ? nullptr : &m_slots[index].second;
+	}
+
+	template <class K> const ValT* get(const K& key) const
+	{
+		size_t index = FindIndex(key, HashOf(key));
+		return index == NPOS ? nullptr : &m_slots[index].second;
+	}
+
+	template <class K> bool	  contains(const K& key) const { return FindIndex(key, HashOf(key)) != NPOS; }
+	template <class K> size_t count(const K& key) const { return contains(key) ? 1 : 0; }
+
+	template <class K> size_t erase(const K& key)
+	{
+		size_t index = FindIndex(key, HashOf(key));
+		if (index == NPOS)
+			return 0;
+		EraseIndex(index);
+		return 1;
+	}
+
+	/* Returns the iterator to continue from. Elements shifted back across the end of the table
+	 * can be visited a second time */
+	iterator erase(iterator it)
+	{
+		EraseIndex(it.m_index);
+		return iterator(this, it.m_index);
+	}
+
+	/* Erases every element pred returns true for. Returns the number erased */
+	template <class Pred> size_t erase_if(Pred pred)
+	{
+		size_t erased = 0;
+		for (size_t i = 0; i < m_capacity;)
+		{
+			if (m_ctrl[i] >= 0 && pred(m_slots[i]))
+			{
+				EraseIndex(i);
+				erased++;
+			}
+			else
+				i++;
+		}
+		return erased;
+	}
+};
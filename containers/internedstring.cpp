@@ -0,0 +1,164 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#include "internedstring.h"
+#include "array.h"
+#include "../threadtools.h"
+
+#include <mutex>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_SHARD_BITS 4
+#define INTERN_NUM_SHARDS (1 << INTERN_SHARD_BITS)
+#define INTERN_BLOCK_SIZE 16384
+
+/* Lookup key. Points at the caller's characters during a lookup and at the entry once stored */
+struct InternKey_t
+{
+	const char*	   str;
+	size_t		   length;
+	unsigned long long hash;
+};
+
+struct InternKeyHash
+{
+	size_t operator()(const InternKey_t& k) const { return (size_t)k.hash; }
+};
+
+struct InternKeyEqual
+{
+	bool operator()(const InternKey_t& a, const InternKey_t& b) const
+	{
+		return a.hash == b.hash && a.length == b.length && memcmp(a.str, b.str, a.length) == 0;
+	}
+};
+
+/* Strings are sharded by hash so unrelated lookups don't contend on one lock */
+struct alignas(64) InternShard_t
+{
+	CThreadRWMutex									  mutex;
+	HashMap<InternKey_t, const InternedStringEntry_t*, InternKeyHash, InternKeyEqual> table;
+	Array<char*>									  blocks;
+	size_t										  blockUsed = INTERN_BLOCK_SIZE;
+
+	~InternShard_t()
+	{
+		for (auto block : blocks)
+			free(block);
+	}
+
+	/* Entries are bump allocated out of blocks and never freed individually */
+	InternedStringEntry_t* AllocEntry(size_t length)
+	{
+		size_t size = (offsetof(InternedStringEntry_t, str) + length + 1 + 7) & ~(size_t)7;
+		if (size > INTERN_BLOCK_SIZE / 4)
+		{
+			/* Big strings get their own block instead of wasting the rest of the current one */
+			char* block = static_cast<char*>(malloc(size));
+			blocks.push_back(block);
+			return reinterpret_cast<InternedStringEntry_t*>(block);
+		}
+		if (blockUsed + size > INTERN_BLOCK_SIZE)
+		{
+			blocks.push_back(static_cast<char*>(malloc(INTERN_BLOCK_SIZE)));
+			blockUsed = 0;
+		}
+		char* p = blocks.back() + blockUsed;
+		blockUsed += size;
+		return reinterpret_cast<InternedStringEntry_t*>(p);
+	}
+};
+
+/* Never freed on purpose. InternedStrings hand out c_str() pointers into the shards' blocks, and ones with static
+ * storage (or cached by other static objects) can still be read after any exit-time cleanup of ours has run */
+static InternShard_t* g_internShards = nullptr;
+
+static InternShard_t* InternShards()
+{
+	static std::once_flag once;
+	std::call_once(once, []() {
+		g_internShards = new InternShard_t[INTERN_NUM_SHARDS];
+		for (int i = 0; i < INTERN_NUM_SHARDS; i++)
+			g_internShards[i].mutex.SetProfileName("InternShard_t::mutex");
+	});
+	return g_internShards;
+}
+
+static const InternedStringEntry_t* Intern(const char* str, size_t len, bool add)
+{
+	InternShard_t* shards = InternShards();
+	if (!str)
+		return nullptr;
+
+	InternKey_t    key   = {str, len, HashBytes(str, len)};
+	InternShard_t& shard = shards[key.hash >> (64 - INTERN_SHARD_BITS)];
+
+	shard.mutex.RLock();
+	auto found = shard.table.get(key);
+	shard.mutex.RUnlock();
+	if (found || !add)
+		return found ? *found : nullptr;
+
+	shard.mutex.WLock();
+	/* Someone may have beaten us to it */
+	found = shard.table.get(key);
+	if (found)
+	{
+		shard.mutex.WUnlock();
+		return *found;
+	}
+
+	InternedStringEntry_t* entry = shard.AllocEntry(len);
+	entry->hash		     = key.hash;
+	entry->length		     = len;
+	memcpy(entry->str, str, len);
+	entry->str[len] = 0;
+
+	key.str = entry->str;
+	shard.table.add(key, entry);
+	shard.mutex.WUnlock();
+	return entry;
+}
+
+//===========================================
+//
+//      InternedString
+//
+//===========================================
+
+InternedString::InternedString(const char* str) : m_entry(str ? Intern(str, strlen(str), true) : nullptr) {}
+
+InternedString::InternedString(const char* str, size_t len) : m_entry(Intern(str, len, true)) {}
+
+InternedString::InternedString(const String& str) : m_entry(Intern(str.c_str(), str.length(), true)) {}
+
+InternedString::InternedString(const StringView& str) : m_entry(Intern(str.c_str(), str.length(), true)) {}
+
+InternedString InternedString::Find(const char* str) { return InternedString(str ? Intern(str, strlen(str), false) : nullptr); }
+
+InternedString InternedString::Find(const char* str, size_t len) { return InternedString(Intern(str, len, false)); }
+
+size_t InternedString::NumInterned()
+{
+	InternShard_t* shards = InternShards();
+	size_t	       total  = 0;
+	for (int i = 0; i < INTERN_NUM_SHARDS; i++)
+	{
+		shards[i].mutex.RLock();
+		total += shards[i].table.size();
+		shards[i].mutex.RUnlock();
+	}
+	return total;
+}
@@ -0,0 +1,82 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * internedstring.h
+ * 	Global string interning
+ *
+ * Every distinct string is stored once in a global, thread-safe table and handed out as an InternedString handle.
+ * Two handles are equal exactly when their pointers are, and each carries its precomputed hash, so interned names can
+ * be compared and used as HashMap keys without touching the characters.
+ * Interned strings live until the library is unloaded.
+ *
+ * USAGE:
+ * 	static InternedString s_name("General");
+ * 	InternedString key = InternedString::Find(userInput); // Doesn't add anything
+ * 	if (key == s_name)
+ * 		...
+ */
+#pragma once
+
+#include "../public.h"
+#include "string.h"
+#include "hashmap.h"
+
+struct InternedStringEntry_t
+{
+	unsigned long long hash;
+	size_t		   length;
+	char		   str[1]; /* Actually length + 1 bytes */
+};
+
+class EXPORT InternedString
+{
+private:
+	const InternedStringEntry_t* m_entry;
+
+	explicit InternedString(const InternedStringEntry_t* entry) : m_entry(entry) {}
+
+public:
+	/* Null handle. Compares unequal to every interned string, including "" */
+	InternedString() : m_entry(nullptr) {}
+
+	/* Interns str, adding it to the table if needed */
+	explicit InternedString(const char* str);
+	InternedString(const char* str, size_t len);
+	explicit InternedString(const String& str);
+	explicit InternedString(const StringView& str);
+
+	/* Returns the handle for str if it was interned before, otherwise a null handle. Never adds to the table */
+	static InternedString Find(const char* str);
+	static InternedString Find(const char* str, size_t len);
+
+	const char*	   c_str() const { return m_entry ? m_entry->str : ""; }
+	size_t		   length() const { return m_entry ? m_entry->length : 0; }
+	unsigned long long hash() const { return m_entry ? m_entry->hash : 0; }
+	bool		   valid() const { return m_entry != nullptr; }
+
+	explicit operator bool() const { return m_entry != nullptr; }
+
+	bool operator==(const InternedString& other) const { return m_entry == other.m_entry; }
+	bool operator!=(const InternedString& other) const { return m_entry != other.m_entry; }
+	/* Arbitrary but stable order, for ordered containers */
+	bool operator<(const InternedString& other) const { return m_entry < other.m_entry; }
+
+	/* Number of distinct strings interned so far */
+	static size_t NumInterned();
+};
+
+template <> struct HashMapHash<InternedString>
+{
+	size_t operator()(const InternedString& s) const { return (size_t)s.hash(); }
+};
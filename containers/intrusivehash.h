@@ -0,0 +1,251 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#pragma once
+
+#include "allocator.h"
+#include "hashmap.h"
+#include "platformspec.h"
+
+/* Standard includes */
+#undef min
+#undef max
+#include <string.h>
+
+/**
+ * Chain link and cached hash embedded in an object so it can sit in an IntrusiveHashTable.
+ * next is null while the object is not in a table (or is the last of its chain).
+ */
+template <class T> struct IntrusiveHashHook
+{
+	T*     next = nullptr;
+	size_t hash = 0;
+};
+
+/**
+ * Chained hash table threaded through an IntrusiveHashHook member of T
+ * Objects are linked into their bucket's chain through the hook, so inserting never allocates a node and erasing
+ * never frees one; the only allocation is the bucket array, which doubles once there are more objects than buckets.
+ * Call reserve() up front to keep inserts allocation free. Objects never move, so pointers stay valid, and the
+ * table must be emptied before its objects are destroyed.
+ *
+ * KeyOf is a functor returning the key of an object, e.g. its name or its own address. Hash and Equal default to the
+ * ones HashMap uses, and lookups accept any key type they accept. Hashes are cached in the hook and spread with a
+ * multiplicative mix before picking a bucket, so identity hashes of aligned pointers distribute fine.
+ *
+ * USAGE:
+ * 	struct Entity_t
+ * 	{
+ * 		IntrusiveHashHook<Entity_t> byName;
+ * 		String			    name;
+ * 	};
+ * 	struct EntityName { const String& operator()(const Entity_t& e) const { return e.name; } };
+ * 	IntrusiveHashTable<Entity_t, String, &Entity_t::byName, EntityName> entities;
+ * 	entities.insert(ent);
+ * 	Entity_t* found = entities.find("player");
+ */
+template <class T, class KeyT, IntrusiveHashHook<T> T::*Hook, class KeyOf, class Hash = HashMapHash<KeyT>, class Equal = HashMapEqual<KeyT>,
+	  class AllocatorT = DefaultAllocator<T*>>
+class IntrusiveHashTable
+{
+public:
+	static constexpr size_t MIN_BUCKETS = 16;
+
+private:
+	T**	   m_buckets;
+	size_t	   m_bits; /* log2 of the bucket count, 0 while nothing is allocated */
+	size_t	   m_size;
+	KeyOf	   m_keyOf;
+	Hash	   m_hash;
+	Equal	   m_equal;
+	AllocatorT m_allocator;
+
+	static IntrusiveHashHook<T>& H(T* t) { return t->*Hook; }
+
+	size_t NumBuckets() const { return m_bits ? (size_t)1 << m_bits : 0; }
+
+	size_t BucketOf(size_t hash) const { return (size_t)(((unsigned long long)hash * 0x9E3779B97F4A7C15ULL) >> (64 - m_bits)); }
+
+	/* Returns false, leaving the table as it was, if the new bucket array can't be allocated */
+	bool Rehash(size_t bits)
+	{
+		size_t n       = (size_t)1 << bits;
+		T**    buckets = m_allocator.allocate(n * sizeof(T*));
+		if (!buckets)
+			return false;
+		memset(buckets, 0, n * sizeof(T*));
+
+		size_t oldCount = NumBuckets();
+		T**    old	= m_buckets;
+		m_buckets	= buckets;
+		m_bits		= bits;
+		for (size_t b = 0; b < oldCount; b++)
+		{
+			for (T* t = old[b]; t;)
+			{
+				T*     next = H(t).next;
+				size_t i    = BucketOf(H(t).hash);
+				H(t).next   = m_buckets[i];
+				m_buckets[i] = t;
+				t	     = next;
+			}
+		}
+		if (old)
+			m_allocator.deallocate(old);
+		return true;
+	}
+
+	/* Link that points at the first object matching key in its chain, or at the chain's terminating null */
+	template <class K> T** FindLink(const K& key, size_t hash) const
+	{
+		T** link = &m_buckets[BucketOf(hash)];
+		for (; *link; link = &H(*link).next)
+		{
+			if (H(*link).hash == hash && m_equal(m_keyOf(**link), key))
+				break;
+		}
+		return link;
+	}
+
+public:
+	IntrusiveHashTable() : m_buckets(nullptr), m_bits(0), m_size(0) {}
+
+	IntrusiveHashTable(const IntrusiveHashTable&) = delete;
+	IntrusiveHashTable& operator=(const IntrusiveHashTable&) = delete;
+
+	IntrusiveHashTable(IntrusiveHashTable&& other) noexcept : m_buckets(other.m_buckets), m_bits(other.m_bits), m_size(other.m_size)
+	{
+		other.m_buckets = nullptr;
+		other.m_bits	= 0;
+		other.m_size	= 0;
+	}
+
+	IntrusiveHashTable& operator=(IntrusiveHashTable&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		if (m_buckets)
+			m_allocator.deallocate(m_buckets);
+		m_buckets	= other.m_buckets;
+		m_bits		= other.m_bits;
+		m_size		= other.m_size;
+		other.m_buckets = nullptr;
+		other.m_bits	= 0;
+		other.m_size	= 0;
+		return *this;
+	}
+
+	~IntrusiveHashTable()
+	{
+		clear();
+		if (m_buckets)
+			m_allocator.deallocate(m_buckets);
+	}
+
+	size_t size() const { return m_size; }
+	bool   empty() const { return m_size == 0; }
+
+	/* Makes room for n objects so the next inserts don't allocate. Returns false if the buckets couldn't be allocated */
+	bool reserve(size_t n)
+	{
+		if (n > ((size_t)-1 / sizeof(T*)) / 2)
+			return false;
+		size_t bits = 4;
+		while (((size_t)1 << bits) < n)
+			bits++;
+		return bits <= m_bits || Rehash(bits);
+	}
+
+	/* Links t in. Returns false, leaving t unlinked, if an object with an equal key is already in the table */
+	bool insert(T* t)
+	{
+		/* Failing to grow only makes the chains longer, but nothing can be linked before the first bucket array exists */
+		if (m_size >= NumBuckets() && !Rehash(m_bits ? m_bits + 1 : 4) && !m_buckets)
+			platform::FatalError("IntrusiveHashTable: out of memory allocating %zu buckets\n", MIN_BUCKETS);
+		size_t hash = m_hash(m_keyOf(*t));
+		T**    link = FindLink(m_keyOf(*t), hash);
+		if (*link)
+			return false;
+		H(t).hash = hash;
+		H(t).next = nullptr;
+		*link	  = t;
+		m_size++;
+		return true;
+	}
+
+	template <class K> T* find(const K& key) const
+	{
+		if (!m_size)
+			return nullptr;
+		return *FindLink(key, m_hash(key));
+	}
+
+	template <class K> bool contains(const K& key) const { return find(key) != nullptr; }
+
+	/* Unlinks and returns the object matching key, or nullptr */
+	template <class K> T* erase(const K& key)
+	{
+		if (!m_size)
+			return nullptr;
+		T** link = FindLink(key, m_hash(key));
+		T*  t	 = *link;
+		if (t)
+		{
+			*link	  = H(t).next;
+			H(t).next = nullptr;
+			m_size--;
+		}
+		return t;
+	}
+
+	/* Unlinks t. Returns false if t isn't in the table */
+	bool remove(T* t)
+	{
+		if (!m_size)
+			return false;
+		T** link = &m_buckets[BucketOf(H(t).hash)];
+		for (; *link && *link != t; link = &H(*link).next)
+			;
+		if (!*link)
+			return false;
+		*link	  = H(t).next;
+		H(t).next = nullptr;
+		m_size--;
+		return true;
+	}
+
+	/* Unlinks everything. The bucket array is kept */
+	void clear()
+	{
+		for (size_t b = 0; b < NumBuckets() && m_size; b++)
+		{
+			while (T* t = m_buckets[b])
+			{
+				m_buckets[b] = H(t).next;
+				H(t).next    = nullptr;
+				m_size--;
+			}
+		}
+	}
+
+	/* Calls fn(T*) for every object, in no particular order. fn must not insert or remove */
+	template <class Fn> void ForEach(Fn fn) const
+	{
+		for (size_t b = 0; b < NumBuckets(); b++)
+		{
+			for (T* t = m_buckets[b]; t; t = H(t).next)
+				fn(t);
+		}
+	}
+};
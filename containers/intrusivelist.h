@@ -0,0 +1,194 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Links embedded in an object so it can sit in an IntrusiveList without a separate node allocation.
+ * Both pointers are null while the object is not in a list.
+ */
+template <class T> struct IntrusiveListHook
+{
+	T* next = nullptr;
+	T* prev = nullptr;
+};
+
+/**
+ * Doubly linked list threaded through an IntrusiveListHook member of T
+ * The list doesn't own or allocate anything: linking and unlinking only rewrite the hooks, so insertion and removal
+ * are O(1) and can't fail. An object can be in as many lists at once as it has hooks, but only in one list per hook.
+ * The list must be emptied before its objects are destroyed.
+ *
+ * An empty list is all zeroes and the constructor is constexpr, so a global list is usable during static
+ * initialization and can live in memset-cleared memory.
+ *
+ * USAGE:
+ * 	struct Job_t
+ * 	{
+ * 		IntrusiveListHook<Job_t> link;
+ * 		...
+ * 	};
+ * 	IntrusiveList<Job_t, &Job_t::link> queue;
+ * 	queue.push_back(job);
+ * 	queue.remove(job);
+ */
+template <class T, IntrusiveListHook<T> T::*Hook> class IntrusiveList
+{
+private:
+	T*     m_head;
+	T*     m_tail;
+	size_t m_size;
+
+	static IntrusiveListHook<T>& H(T* t) { return t->*Hook; }
+	static const IntrusiveListHook<T>& H(const T* t) { return t->*Hook; }
+
+public:
+	class iterator
+	{
+	private:
+		T* m_node;
+
+	public:
+		iterator(T* node) : m_node(node) {}
+
+		T* operator*() const { return m_node; }
+		T* operator->() const { return m_node; }
+
+		iterator& operator++()
+		{
+			m_node = H(m_node).next;
+			return *this;
+		}
+
+		bool operator==(const iterator& other) const { return m_node == other.m_node; }
+		bool operator!=(const iterator& other) const { return m_node != other.m_node; }
+	};
+
+	constexpr IntrusiveList() : m_head(nullptr), m_tail(nullptr), m_size(0) {}
+
+	IntrusiveList(const IntrusiveList&) = delete;
+	IntrusiveList& operator=(const IntrusiveList&) = delete;
+
+	IntrusiveList(IntrusiveList&& other) noexcept : m_head(other.m_head), m_tail(other.m_tail), m_size(other.m_size)
+	{
+		other.m_head = other.m_tail = nullptr;
+		other.m_size		    = 0;
+	}
+
+	IntrusiveList& operator=(IntrusiveList&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		m_head	     = other.m_head;
+		m_tail	     = other.m_tail;
+		m_size	     = other.m_size;
+		other.m_head = other.m_tail = nullptr;
+		other.m_size		    = 0;
+		return *this;
+	}
+
+	size_t size() const { return m_size; }
+	bool   empty() const { return m_head == nullptr; }
+
+	T* front() const { return m_head; }
+	T* back() const { return m_tail; }
+
+	static T* next(const T* t) { return H(t).next; }
+	static T* prev(const T* t) { return H(t).prev; }
+
+	iterator begin() const { return iterator(m_head); }
+	iterator end() const { return iterator(nullptr); }
+
+	/* Links t in front of pos. pos == nullptr appends */
+	void insert(T* pos, T* t)
+	{
+		IntrusiveListHook<T>& h = H(t);
+		h.next			= pos;
+		h.prev			= pos ? H(pos).prev : m_tail;
+		if (h.prev)
+			H(h.prev).next = t;
+		else
+			m_head = t;
+		if (pos)
+			H(pos).prev = t;
+		else
+			m_tail = t;
+		m_size++;
+	}
+
+	void push_front(T* t) { insert(m_head, t); }
+	void push_back(T* t) { insert(nullptr, t); }
+
+	/* Unlinks t, which must be in this list */
+	void remove(T* t)
+	{
+		IntrusiveListHook<T>& h = H(t);
+		if (h.prev)
+			H(h.prev).next = h.next;
+		else
+			m_head = h.next;
+		if (h.next)
+			H(h.next).prev = h.prev;
+		else
+			m_tail = h.prev;
+		h.next = h.prev = nullptr;
+		m_size--;
+	}
+
+	T* pop_front()
+	{
+		T* t = m_head;
+		if (t)
+			remove(t);
+		return t;
+	}
+
+	T* pop_back()
+	{
+		T* t = m_tail;
+		if (t)
+			remove(t);
+		return t;
+	}
+
+	/**
+	 * True if t is linked into this list. O(1): checks that t's neighbours (or the list ends) point back at it.
+	 * t must be an object whose hook is either unlinked or in some list of this type.
+	 */
+	bool contains(const T* t) const
+	{
+		const IntrusiveListHook<T>& h = H(t);
+		return (h.prev ? H(h.prev).next == t : m_head == t) && (h.next ? H(h.next).prev == t : m_tail == t);
+	}
+
+	/* Unlinks everything, resetting each hook */
+	void clear()
+	{
+		while (m_head)
+			pop_front();
+	}
+
+	/* Calls fn(T*) for each object in order. fn may remove the object it was passed */
+	template <class Fn> void ForEach(Fn fn) const
+	{
+		for (T* t = m_head; t;)
+		{
+			T* n = H(t).next;
+			fn(t);
+			t = n;
+		}
+	}
+};
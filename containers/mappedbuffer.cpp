@@ -0,0 +1,167 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#include "mappedbuffer.h"
+
+#include <stdio.h>
+#include <utility>
+
+#ifdef _POSIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//===========================================
+//
+//      MappedBuffer
+//
+//===========================================
+
+MappedBuffer::MappedBuffer() : m_map(nullptr), m_mapSize(0), m_open(false) {}
+
+MappedBuffer::~MappedBuffer() { Close(); }
+
+MappedBuffer::MappedBuffer(MappedBuffer&& other) noexcept
+	: Buffer(std::move(other)), m_map(other.m_map), m_mapSize(other.m_mapSize), m_open(other.m_open)
+{
+	other.m_map	= nullptr;
+	other.m_mapSize = 0;
+	other.m_open	= false;
+}
+
+MappedBuffer& MappedBuffer::operator=(MappedBuffer&& other) noexcept
+{
+	if (this == &other)
+		return *this;
+	Close();
+	Buffer::operator=(std::move(other));
+	m_map		= other.m_map;
+	m_mapSize	= other.m_mapSize;
+	m_open		= other.m_open;
+	other.m_map	= nullptr;
+	other.m_mapSize = 0;
+	other.m_open	= false;
+	return *this;
+}
+
+bool MappedBuffer::Open(const char* path, bool hugePages)
+{
+	Close();
+	if (!path)
+		return false;
+
+#ifdef _POSIX
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		close(fd);
+		return false;
+	}
+
+	/* mmap refuses zero length mappings, an empty file is just an empty buffer */
+	if (st.st_size > 0)
+	{
+		void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+		m_map	  = map;
+		m_mapSize = (size_t)st.st_size;
+#ifdef MADV_HUGEPAGE
+		if (hugePages)
+			madvise(m_map, m_mapSize, MADV_HUGEPAGE);
+#endif
+	}
+	/* The mapping keeps the file alive */
+	close(fd);
+
+	Buffer::operator=(Buffer::Borrow(static_cast<const unsigned char*>(m_map), (BufferSize)m_mapSize));
+	m_open = true;
+	return true;
+#else
+	(void)hugePages;
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	Buffer::operator=(Buffer(size > 0 ? size : 0));
+	read_from_stream(fp, size > 0 ? size : 0);
+	fclose(fp);
+	seek_start();
+	m_open = true;
+	return true;
+#endif
+}
+
+void MappedBuffer::Close()
+{
+	/* Drop the borrowed view before the memory behind it goes away */
+	Buffer::operator=(Buffer());
+#ifdef _POSIX
+	if (m_map)
+		munmap(m_map, m_mapSize);
+#endif
+	m_map	  = nullptr;
+	m_mapSize = 0;
+	m_open	  = false;
+}
+
+bool MappedBuffer::Advise(EMapAdvice advice, size_t offset, size_t length)
+{
+#ifdef _POSIX
+	if (!m_map || offset >= m_mapSize)
+		return false;
+	if (length == 0 || length > m_mapSize - offset)
+		length = m_mapSize - offset;
+
+	/* madvise wants a page aligned start */
+	size_t page	= (size_t)sysconf(_SC_PAGESIZE);
+	size_t aligned	= offset & ~(page - 1);
+	length		+= offset - aligned;
+
+	int flag = MADV_NORMAL;
+	switch (advice)
+	{
+	case EMapAdvice::SEQUENTIAL:
+		flag = MADV_SEQUENTIAL;
+		break;
+	case EMapAdvice::RANDOM:
+		flag = MADV_RANDOM;
+		break;
+	case EMapAdvice::WILLNEED:
+		flag = MADV_WILLNEED;
+		break;
+	case EMapAdvice::DONTNEED:
+		flag = MADV_DONTNEED;
+		break;
+	default:
+		break;
+	}
+	return madvise(static_cast<char*>(m_map) + aligned, length, flag) == 0;
+#else
+	(void)advice;
+	(void)offset;
+	(void)length;
+	return false;
+#endif
+}
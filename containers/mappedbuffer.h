@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * mappedbuffer.h
+ * 	Read-only Buffer over a memory mapped file
+ *
+ * MappedBuffer maps a whole file and exposes it through the usual Buffer read API (gets, peeks, read_le, ...) without
+ * copying it to the heap. Pages are faulted in as they are touched; Advise() passes access pattern hints on to the kernel.
+ * The mapping is read-only: writing through the Buffer API copies the data to the heap first, like any borrowed Buffer.
+ *
+ * Where mmap isn't available, Open falls back to reading the file into memory.
+ *
+ * USAGE:
+ * 	MappedBuffer file;
+ * 	if (file.Open("maps/de_dust.bsp"))
+ * 	{
+ * 		file.Advise(EMapAdvice::SEQUENTIAL);
+ * 		unsigned int version = file.read_le<unsigned int>();
+ * 		...
+ * 	}
+ */
+#pragma once
+
+#include "../public.h"
+#include "buffer.h"
+#include "string.h"
+
+enum class EMapAdvice
+{
+	NORMAL = 0, /* No special treatment */
+	SEQUENTIAL, /* Read ahead aggressively, drop pages soon after they're read */
+	RANDOM,	    /* Don't bother reading ahead */
+	WILLNEED,   /* Start reading the range in now */
+	DONTNEED,   /* The range won't be needed soon, pages may be dropped */
+};
+
+class EXPORT MappedBuffer : public Buffer
+{
+private:
+	void*  m_map;
+	size_t m_mapSize;
+	bool   m_open;
+
+public:
+	MappedBuffer();
+	~MappedBuffer() override;
+
+	MappedBuffer(const MappedBuffer&) = delete;
+	MappedBuffer& operator=(const MappedBuffer&) = delete;
+	MappedBuffer(MappedBuffer&& other) noexcept;
+	MappedBuffer& operator=(MappedBuffer&& other) noexcept;
+
+	/**
+	 * @brief Maps the whole file, closing anything that was open before
+	 * @param path File to map
+	 * @param hugePages Ask for the mapping to be backed by huge pages where the kernel supports it. Just a hint
+	 * @return False if the file couldn't be opened or mapped
+	 */
+	bool Open(const char* path, bool hugePages = false);
+	void Close();
+	bool IsOpen() const { return m_open; }
+
+	/**
+	 * @brief Tells the kernel how [offset, offset + length) is going to be accessed
+	 * @param length Number of bytes, 0 for everything from offset to the end of the file
+	 * @return False if the hint was rejected or isn't supported on this platform
+	 */
+	bool Advise(EMapAdvice advice, size_t offset = 0, size_t length = 0);
+
+	/* The file contents. Not null terminated */
+	StringView string_view() const { return StringView(static_cast<const char*>(data()), (size_t)size()); }
+};
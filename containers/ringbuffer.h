@@ -11,142 +11,311 @@ but WITHOUT ANY WARRANTY; without even the implied warranty of
 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 GNU General Public License for more details.
 */
+/**
+ * ringbuffer.h
+ * 	Fixed capacity FIFO ring for telemetry and other sampled data
+ *
+ * The capacity is rounded up to a power of two and elements are addressed by free running counters, so indexing is a
+ * mask and full/empty never need a spare slot. When the ring is full, writes either drop the oldest element
+ * (ERingMode::OVERWRITE) or fail (ERingMode::REJECT).
+ *
+ * Threading: writes take MutexT (a no-op by default, so one writer thread), everything else is lock-free.
+ * 	read()		Pops the oldest elements. Any number of consumers, races with overwrites are detected and retried.
+ * 	snapshot()	Copies the newest elements without consuming them, so another thread can drain telemetry while the
+ * 			writer keeps going. Slots overwritten during the copy are detected and dropped from the result.
+ * 	spans()		Direct access to the stored elements as at most two contiguous runs (two when they wrap). Only
+ * 			safe while nothing overwrites them: in REJECT mode with a single consumer, or with the writer
+ * 			stopped through lock(). Follow up with consume().
+ *
+ * Elements are moved with memcpy, so T must be trivially copyable.
+ *
+ * USAGE:
+ * 	RingBuffer<XProfFrameData> frames(1024);
+ * 	frames.write(sample);				  // Frame thread
+ * 	size_t n = frames.snapshot(out, 64);		  // Any thread, oldest first
+ */
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
 
-#include "crtlib.h"
-#include "threadtools.h"
+#include "../crtlib.h"
+#include "../threadtools.h"
+
+/* Standard includes */
+#undef min
+#undef max
+#include <atomic>
+#include <type_traits>
+
+enum class ERingMode
+{
+	OVERWRITE = 0, /* A full ring drops its oldest element to make room */
+	REJECT,	       /* A full ring refuses new elements */
+};
 
 template <class T, class MutexT = CFakeMutex, class I = unsigned int> class RingBuffer final
 {
-private:
-	T*	  m_data;
+	static_assert(std::is_trivially_copyable<T>::value, "RingBuffer copies elements with memcpy");
+	static_assert(std::is_unsigned<I>::value, "RingBuffer counters must be unsigned so they can wrap");
+
+public:
 	typedef I IndexType;
-	MutexT	  m_mutex;
 
-	size_t	       m_size;
-	std::atomic<I> m_readIndex;
-	std::atomic<I> m_writeIndex;
+	/* Stored elements as up to two contiguous runs, oldest first */
+	struct Spans_t
+	{
+		const T* first;
+		size_t	 firstLen;
+		const T* second;
+		size_t	 secondLen;
 
-public:
-	RingBuffer()
+		size_t size() const { return firstLen + secondLen; }
+	};
+
+private:
+	T*		  m_data;
+	size_t		  m_capacity; /* Power of two, or 0 before anything is allocated */
+	ERingMode	  m_mode;
+	mutable MutexT	  m_mutex; /* Serializes writers */
+	std::atomic<I>	  m_head;  /* Elements ever written */
+	std::atomic<I>	  m_tail;  /* Elements ever consumed or dropped */
+	std::atomic<I>	  m_claim; /* m_head + 1 while a write is in progress, m_head otherwise */
+
+	static size_t RoundCapacity(size_t n)
 	{
-		m_size = 0;
-		m_readIndex.store(0);
-		m_writeIndex.store(0);
-		m_data = nullptr;
+		size_t cap = 1;
+		while (cap < n)
+			cap <<= 1;
+		return cap;
 	}
 
-	explicit RingBuffer(size_t size) : m_size(size)
+	size_t Slot(I index) const { return (size_t)index & (m_capacity - 1); }
+
+	/* Copies n elements starting at counter start out of a ring buffer, in at most two memcpys */
+	static void CopyOut(const T* data, size_t capacity, T* out, I start, size_t n)
 	{
-		m_readIndex.store(0);
-		m_writeIndex.store(0);
-		m_data = Q_malloc(sizeof(T) * size);
+		size_t slot  = (size_t)start & (capacity - 1);
+		size_t first = capacity - slot;
+		if (first > n)
+			first = n;
+		memcpy((void*)out, data + slot, first * sizeof(T));
+		memcpy((void*)(out + first), data, (n - first) * sizeof(T));
 	}
 
-	~RingBuffer()
+	void Allocate(size_t capacity)
 	{
-		if (m_data)
-			Q_free(m_data);
+		m_capacity = capacity ? RoundCapacity(capacity) : 0;
+		m_data	   = m_capacity ? static_cast<T*>(Q_malloc(m_capacity * sizeof(T))) : nullptr;
 	}
 
-	size_t size() const { return m_size; }
-
-	/* SIZE is in number of elements */
-	void resize(size_t newsize)
+public:
+	explicit RingBuffer(size_t capacity = 0, ERingMode mode = ERingMode::OVERWRITE) : m_mode(mode), m_head(0), m_tail(0), m_claim(0)
 	{
-		auto lck = m_mutex.RAIILock();
-		if (newsize <= 0)
-			return;
-
-		T* tmp = (T*)Q_malloc(sizeof(T) * newsize);
+		Allocate(capacity);
+	}
 
-		/* Copy in the new stuff, taking into account the new size */
-		memcpy(tmp, m_data, (m_size > newsize ? newsize : m_size) * sizeof(T));
+	RingBuffer(const RingBuffer& other) : m_data(nullptr), m_capacity(0), m_mode(other.m_mode), m_head(0), m_tail(0), m_claim(0) { *this = other; }
 
-		m_size = newsize;
-		m_data = tmp;
+	RingBuffer(RingBuffer&& other) noexcept : m_data(nullptr), m_capacity(0), m_mode(other.m_mode), m_head(0), m_tail(0), m_claim(0)
+	{
+		*this = std::move(other);
 	}
 
-	void lock() { m_mutex.Lock(); }
+	~RingBuffer()
+	{
+		if (m_data)
+			Q_free(m_data);
+	}
 
-	void unlock() { m_mutex.Unlock(); }
+	/* Copies the stored elements. Neither ring may be written to concurrently */
+	RingBuffer& operator=(const RingBuffer& other)
+	{
+		if (this == &other)
+			return *this;
+		if (m_data)
+			Q_free(m_data);
+		Allocate(other.m_capacity);
+		m_mode = other.m_mode;
+		I head = other.m_head.load(std::memory_order_acquire);
+		I tail = other.m_tail.load(std::memory_order_acquire);
+		if (m_capacity)
+			CopyOut(other.m_data, other.m_capacity, m_data, tail, (size_t)(I)(head - tail));
+		m_tail.store(0, std::memory_order_relaxed);
+		m_claim.store(head - tail, std::memory_order_relaxed);
+		m_head.store(head - tail, std::memory_order_release);
+		return *this;
+	}
 
-	const T* data() const { return m_data; }
+	RingBuffer& operator=(RingBuffer&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		if (m_data)
+			Q_free(m_data);
+		m_data	   = other.m_data;
+		m_capacity = other.m_capacity;
+		m_mode	   = other.m_mode;
+		m_head.store(other.m_head.load(std::memory_order_acquire), std::memory_order_relaxed);
+		m_tail.store(other.m_tail.load(std::memory_order_acquire), std::memory_order_relaxed);
+		m_claim.store(m_head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		other.m_data	 = nullptr;
+		other.m_capacity = 0;
+		other.m_head.store(0, std::memory_order_relaxed);
+		other.m_tail.store(0, std::memory_order_relaxed);
+		other.m_claim.store(0, std::memory_order_relaxed);
+		return *this;
+	}
 
-	IndexType read_index() const { return m_readIndex.load(); }
+	size_t	  capacity() const { return m_capacity; }
+	ERingMode mode() const { return m_mode; }
+	void	  set_mode(ERingMode mode) { m_mode = mode; }
 
-	IndexType write_index() const { return m_writeIndex.load(); }
+	/* Number of stored elements. Only a hint while other threads are using the ring */
+	size_t size() const
+	{
+		I tail = m_tail.load(std::memory_order_acquire);
+		return (size_t)(I)(m_head.load(std::memory_order_acquire) - tail);
+	}
 
-	void set_read_index(IndexType i) { m_readIndex.store(i); }
+	bool empty() const { return size() == 0; }
+	bool full() const { return m_capacity && size() >= m_capacity; }
 
-	void set_writeIndex(IndexType i) { m_writeIndex.store(i); }
+	/* Elements ever written, including ones that were dropped or consumed since */
+	I total_written() const { return m_head.load(std::memory_order_acquire); }
 
-	T read()
+	/**
+	 * Changes the capacity (rounded up to a power of two), keeping the newest elements that still fit.
+	 * No other thread may use the ring while this runs.
+	 */
+	void resize(size_t capacity)
 	{
-		auto	  lck	= m_mutex.RAIILock();
-		IndexType index = m_readIndex.load();
-
-		const T* t = &m_data[index];
-		if (index >= m_size)
-			m_readIndex.store(0);
-		else
-			m_readIndex.store(index + 1);
-		return *t;
+		auto lck  = m_mutex.RAIILock();
+		T*   old  = m_data;
+		I    head = m_head.load(std::memory_order_relaxed);
+		I    tail = m_tail.load(std::memory_order_relaxed);
+		size_t n  = (size_t)(I)(head - tail);
+
+		size_t oldCapacity = m_capacity;
+		Allocate(capacity);
+		if (n > m_capacity)
+			n = m_capacity;
+		if (n)
+			CopyOut(old, oldCapacity, m_data, head - (I)n, n);
+		if (old)
+			Q_free(old);
+		m_tail.store(0, std::memory_order_relaxed);
+		m_claim.store((I)n, std::memory_order_relaxed);
+		m_head.store((I)n, std::memory_order_release);
 	}
 
-	void write(const T& elem)
+	/* Drops every element */
+	void clear()
 	{
-		auto	  lck	= m_mutex.RAIILock();
-		IndexType index = m_writeIndex.load();
-
-		m_data[index] = elem;
-		if (index >= m_size)
-			m_writeIndex.store(0);
-		else
-			m_writeIndex.store(index + 1);
+		auto lck = m_mutex.RAIILock();
+		m_tail.store(m_head.load(std::memory_order_relaxed), std::memory_order_release);
 	}
 
-	RingBuffer& operator=(const RingBuffer& buf)
+	/* Appends elem. Returns false if the ring has no storage, or is full in REJECT mode */
+	bool write(const T& elem)
 	{
-		buf.m_mutex.Lock();
-		this->m_mutex.Lock();
-
-		if (m_data)
-			Q_free(m_data);
-		m_data = Q_malloc(buf.m_size * sizeof(T));
-		memcpy(m_data, buf.m_data, sizeof(T) * buf.m_size);
-		m_writeIndex = buf.m_writeIndex;
-		m_readIndex  = buf.m_readIndex;
-		m_size	     = buf.m_size;
+		auto lck = m_mutex.RAIILock();
+		if (!m_capacity)
+			return false;
+
+		I head = m_head.load(std::memory_order_relaxed);
+		for (I tail = m_tail.load(std::memory_order_acquire); (size_t)(I)(head - tail) >= m_capacity;)
+		{
+			if (m_mode == ERingMode::REJECT)
+				return false;
+			/* Drop the oldest element. A consumer may beat us to it, in which case there's room now */
+			if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+				break;
+		}
+
+		/* Like a seqlock: announce the write, then overwrite the slot, then publish it */
+		m_claim.store(head + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy((void*)&m_data[Slot(head)], &elem, sizeof(T));
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
 
-		buf.m_mutex.Unlock();
-		this->m_mutex.Unlock();
+	/* Pops the oldest element into out. Returns false if the ring is empty */
+	bool read(T& out) { return read(&out, 1) == 1; }
 
-		return *this;
+	/* Pops up to max of the oldest elements into out, oldest first. Returns the number popped */
+	size_t read(T* out, size_t max)
+	{
+		I tail = m_tail.load(std::memory_order_acquire);
+		for (;;)
+		{
+			size_t n = (size_t)(I)(m_head.load(std::memory_order_acquire) - tail);
+			/* tail may be stale by a few overwrites, the CAS below catches that */
+			if (n > m_capacity)
+				n = m_capacity;
+			if (n > max)
+				n = max;
+			if (!n)
+				return 0;
+			CopyOut(m_data, m_capacity, out, tail, n);
+			/* If an overwrite dropped any of these while we copied, tail moved and the copy is discarded */
+			if (m_tail.compare_exchange_weak(tail, tail + (I)n, std::memory_order_acq_rel, std::memory_order_acquire))
+				return n;
+		}
 	}
 
-	RingBuffer& operator=(RingBuffer&& buf) noexcept
+	/**
+	 * Copies up to max of the newest elements into out, oldest first, without consuming anything.
+	 * Lock-free and safe to call from any thread while the writer keeps writing. Returns the number copied.
+	 */
+	size_t snapshot(T* out, size_t max) const
 	{
-		buf.m_mutex.Lock();
-		m_mutex.Lock();
-
-		m_data	     = buf.m_data;
-		m_readIndex  = buf.m_readIndex;
-		m_writeIndex = buf.m_writeIndex;
-		m_size	     = buf.m_size;
-
-		m_mutex.Unlock();
-		buf.m_mutex.Unlock();
+		if (!m_capacity)
+			return 0;
+		I	   head = m_head.load(std::memory_order_acquire);
+		size_t n    = (size_t)(I)(head - m_tail.load(std::memory_order_acquire));
+		if (n > m_capacity)
+			n = m_capacity;
+		if (n > max)
+			n = max;
+		I start = head - (I)n;
+		CopyOut(m_data, m_capacity, out, start, n);
+
+		/* Writing counter c overwrites the slot of c - capacity, and every write that could have touched our copy
+		 * is below claim. So anything older than claim - capacity may be torn */
+		std::atomic_thread_fence(std::memory_order_acquire);
+		I      claim = m_claim.load(std::memory_order_relaxed);
+		size_t span  = (size_t)(I)(claim - start);
+		size_t lost  = span > m_capacity ? span - m_capacity : 0;
+		if (lost >= n)
+			return 0;
+		if (lost)
+			memmove((void*)out, out + lost, (n - lost) * sizeof(T));
+		return n - lost;
 	}
 
-	T operator[](IndexType index) const
+	/* Stored elements as at most two contiguous runs. See the notes at the top about when this is safe */
+	Spans_t spans() const
 	{
-		auto lck = m_mutex.RAIILock();
-
-		return m_data[index];
+		I      tail  = m_tail.load(std::memory_order_acquire);
+		size_t n     = (size_t)(I)(m_head.load(std::memory_order_acquire) - tail);
+		size_t first = n ? m_capacity - Slot(tail) : 0;
+		if (first > n)
+			first = n;
+		return {m_data + (n ? Slot(tail) : 0), first, m_data, n - first};
 	}
+
+	/* Drops the n oldest elements, after processing them through spans() */
+	void consume(size_t n) { m_tail.fetch_add((I)n, std::memory_order_acq_rel); }
+
+	/* Element i, counting from the oldest. Same caveats as spans() */
+	T operator[](size_t i) const { return m_data[Slot(m_tail.load(std::memory_order_acquire) + (I)i)]; }
+
+	/* Stops writers, e.g. around spans() in OVERWRITE mode. Does nothing with the default CFakeMutex */
+	void lock() { m_mutex.Lock(); }
+	void unlock() { m_mutex.Unlock(); }
 };
 
-template <class T, class I> using RingBufferTS = RingBuffer<T, CThreadSpinlock, I>;
+/* Ring that any number of threads can write to */
+template <class T, class I = unsigned int> using RingBufferTS = RingBuffer<T, CThreadSpinlock, I>;
@@ -27,10 +27,12 @@ public:
 	Set(const T* p, size_t n)
 	{
 		for(size_t i = 0; i < n; i++) {
-			insert(p[i]);
+			this->insert(p[i]);
 		}
 	}
 
+	Set() {}
+
 	Set(std::initializer_list<T> ls) :
 		std::set<T,C,A>(ls)
 	{
@@ -42,23 +44,26 @@ public:
 		return this->find(e) != this->end();
 	}
 
-	/* Set intersection with other */
-	/* WARNING: SLOW */
+	/* Set intersection with other. Linear, both sets are already sorted */
 	void intersect(const Set<T,C,A> &other)
 	{
-		Set<T,C,A> tmp;
-		for(const auto& x : *this) {
-			if(other.contains(x)) {
-				tmp.insert(x);
+		auto a = this->begin();
+		auto b = other.begin();
+		while(a != this->end() && b != other.end()) {
+			if(this->key_comp()(*a, *b))
+				a = this->erase(a);
+			else {
+				if(!this->key_comp()(*b, *a))
+					++a;
+				++b;
 			}
 		}
-		this->clear();
-		merge(tmp);
+		this->erase(a, this->end());
 	}
 
 	/* Set union */
 	void unify(const Set<T,C,A>& other)
 	{
-		merge(other);
+		this->insert(other.begin(), other.end());
 	}
 };
@@ -0,0 +1,281 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#pragma once
+#include "allocator.h"
+
+/* Standard includes */
+#undef min
+#undef max
+#include <new>
+#include <utility>
+#include <initializer_list>
+
+/**
+ * Array with room for N elements inside the object itself
+ * Nothing is allocated until the array grows past N elements, at which point it moves to the heap through AllocatorT.
+ * AllocatorT is a (private) base class, so a stateless allocator like the default MallocAllocator adds no size.
+ * Meant for the many small, short lists that would otherwise cost one allocation each.
+ * Same contains/remove/concat API as Array. Like std::vector, growing invalidates pointers and iterators.
+ */
+template <class T, size_t N, class AllocatorT = MallocAllocator<T>> class SmallArray : private AllocatorT
+{
+	static_assert(N > 0, "SmallArray needs at least one inline element, use Array instead");
+
+private:
+	T*	   m_data;
+	size_t	   m_size;
+	size_t	   m_capacity;
+	alignas(T) unsigned char m_inline[N * sizeof(T)];
+
+	T* InlineData() { return reinterpret_cast<T*>(m_inline); }
+
+	AllocatorT& Allocator() { return *this; }
+
+	/* Moves the elements into a buffer of newCap elements, inline if it fits */
+	void Reallocate(size_t newCap)
+	{
+		T* newData = newCap <= N ? InlineData() : Allocator().allocate(newCap * sizeof(T));
+		if (newData == m_data)
+			return;
+		for (size_t i = 0; i < m_size; i++)
+		{
+			new (&newData[i]) T(std::move(m_data[i]));
+			m_data[i].~T();
+		}
+		if (!is_inline())
+			Allocator().deallocate(m_data);
+		m_data	   = newData;
+		m_capacity = newCap <= N ? N : newCap;
+	}
+
+	void Grow(size_t needed)
+	{
+		size_t cap = m_capacity * 2;
+		Reallocate(cap < needed ? needed : cap);
+	}
+
+	void Release()
+	{
+		clear();
+		if (!is_inline())
+			Allocator().deallocate(m_data);
+		m_data	   = InlineData();
+		m_capacity = N;
+	}
+
+public:
+	typedef T	 value_type;
+	typedef T*	 iterator;
+	typedef const T* const_iterator;
+
+	SmallArray() : m_data(InlineData()), m_size(0), m_capacity(N) {}
+
+	SmallArray(std::initializer_list<T> ls) : SmallArray()
+	{
+		reserve(ls.size());
+		for (const auto& x : ls)
+			push_back(x);
+	}
+
+	SmallArray(const T* p, size_t n) : SmallArray()
+	{
+		reserve(n);
+		for (size_t i = 0; i < n; i++)
+			push_back(p[i]);
+	}
+
+	SmallArray(const SmallArray& other) : SmallArray() { *this = other; }
+
+	SmallArray(SmallArray&& other) noexcept : SmallArray() { *this = std::move(other); }
+
+	~SmallArray() { Release(); }
+
+	SmallArray& operator=(const SmallArray& other)
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		reserve(other.m_size);
+		for (size_t i = 0; i < other.m_size; i++)
+			new (&m_data[i]) T(other.m_data[i]);
+		m_size = other.m_size;
+		return *this;
+	}
+
+	SmallArray& operator=(SmallArray&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		Release();
+		if (other.is_inline())
+		{
+			for (size_t i = 0; i < other.m_size; i++)
+				new (&m_data[i]) T(std::move(other.m_data[i]));
+			m_size = other.m_size;
+			other.clear();
+		}
+		else
+		{
+			/* Steal the heap buffer */
+			m_data		 = other.m_data;
+			m_size		 = other.m_size;
+			m_capacity	 = other.m_capacity;
+			other.m_data	 = other.InlineData();
+			other.m_size	 = 0;
+			other.m_capacity = N;
+		}
+		return *this;
+	}
+
+	size_t size() const { return m_size; }
+	bool   empty() const { return m_size == 0; }
+	size_t capacity() const { return m_capacity; }
+	/* True while the elements are still stored inside the object */
+	bool is_inline() const { return m_data == reinterpret_cast<const T*>(m_inline); }
+
+	T*	 data() { return m_data; }
+	const T* data() const { return m_data; }
+
+	iterator       begin() { return m_data; }
+	iterator       end() { return m_data + m_size; }
+	const_iterator begin() const { return m_data; }
+	const_iterator end() const { return m_data + m_size; }
+
+	T&	 operator[](size_t i) { return m_data[i]; }
+	const T& operator[](size_t i) const { return m_data[i]; }
+	T&	 front() { return m_data[0]; }
+	const T& front() const { return m_data[0]; }
+	T&	 back() { return m_data[m_size - 1]; }
+	const T& back() const { return m_data[m_size - 1]; }
+
+	void reserve(size_t n)
+	{
+		if (n > m_capacity)
+			Reallocate(n);
+	}
+
+	/* Moves back into inline storage when the elements fit, otherwise trims the heap buffer */
+	void shrink_to_fit()
+	{
+		if (!is_inline() && m_size < m_capacity)
+			Reallocate(m_size);
+	}
+
+	template <class... Args> T& emplace_back(Args&&... args)
+	{
+		if (m_size == m_capacity)
+		{
+			/* args may refer to an element of this array, so construct before growing */
+			T tmp(std::forward<Args>(args)...);
+			Grow(m_size + 1);
+			new (&m_data[m_size]) T(std::move(tmp));
+		}
+		else
+			new (&m_data[m_size]) T(std::forward<Args>(args)...);
+		return m_data[m_size++];
+	}
+
+	void push_back(const T& t) { emplace_back(t); }
+	void push_back(T&& t) { emplace_back(std::move(t)); }
+
+	void pop_back() { m_data[--m_size].~T(); }
+
+	iterator insert(const_iterator pos, const T& t)
+	{
+		size_t index = pos - m_data;
+		emplace_back(t);
+		for (size_t i = m_size - 1; i > index; i--)
+			std::swap(m_data[i], m_data[i - 1]);
+		return m_data + index;
+	}
+
+	iterator erase(const_iterator first, const_iterator last)
+	{
+		size_t index = first - m_data, count = last - first;
+		for (size_t i = index; i + count < m_size; i++)
+			m_data[i] = std::move(m_data[i + count]);
+		for (size_t i = m_size - count; i < m_size; i++)
+			m_data[i].~T();
+		m_size -= count;
+		return m_data + index;
+	}
+
+	iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+
+	void resize(size_t n)
+	{
+		reserve(n);
+		while (m_size > n)
+			pop_back();
+		while (m_size < n)
+			new (&m_data[m_size++]) T();
+	}
+
+	void resize(size_t n, const T& t)
+	{
+		reserve(n);
+		while (m_size > n)
+			pop_back();
+		while (m_size < n)
+			new (&m_data[m_size++]) T(t);
+	}
+
+	/* Destroys the elements but keeps the storage */
+	void clear()
+	{
+		for (size_t i = 0; i < m_size; i++)
+			m_data[i].~T();
+		m_size = 0;
+	}
+
+	/* Removes up to max occurrences of t */
+	void remove(const T& t, size_t max = 1)
+	{
+		for (size_t i = 0; i < m_size && max > 0;)
+		{
+			if (m_data[i] == t)
+			{
+				erase(m_data + i);
+				max--;
+			}
+			else
+				i++;
+		}
+	}
+
+	bool contains(const T& t) const
+	{
+		for (const auto& x : *this)
+		{
+			if (x == t)
+				return true;
+		}
+		return false;
+	}
+
+	template <size_t M, class A> void concat(const SmallArray<T, M, A>& other)
+	{
+		/* Indexed so that concatenating an array with itself works */
+		size_t n = other.size();
+		reserve(m_size + n);
+		for (size_t i = 0; i < n; i++)
+			push_back(other[i]);
+	}
+
+	template <size_t M, class A> SmallArray& operator+=(const SmallArray<T, M, A>& o)
+	{
+		concat(o);
+		return *this;
+	}
+};
@@ -0,0 +1,618 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * soaarray.h
+ * 	Structure-of-arrays storage for large arrays of plain structs
+ *
+ * SoAArray<T> stores every field listed for T in its own contiguous column instead of storing whole structs one after
+ * the other. A loop that only reads positions and velocities then streams through those two columns and never pulls
+ * the other fields into cache, and each column is a plain aligned array that SIMD kernels can load directly.
+ *
+ * The fields are listed once with SOA_FIELDS, at global scope. The same list produces reflection info
+ * (SFieldInfo_t, see reflection.h) describing the AoS layout of T.
+ * Fields are named by member pointer, so a typo or a type mismatch is a compile error.
+ *
+ * Elements can still be used as if they were structs: operator[] returns a proxy that reads/writes single fields,
+ * converts to T and can be assigned a T or another element (arr[i] = arr[j] copies every column).
+ * get()/set() gather and scatter whole elements. Listed fields can't be C arrays.
+ * Like Array, growing moves the columns and invalidates column pointers, spans and proxies.
+ *
+ * USAGE:
+ * 	struct Particle_t { float x, y, vx, vy; int flags; };
+ * 	SOA_FIELDS(Particle_t, x, y, vx, vy, flags);
+ *
+ * 	SoAArray<Particle_t> particles;
+ * 	particles.push_back({0, 0, 1, 1, 0});
+ * 	particles[0].get<&Particle_t::flags>() |= 1;
+ * 	particles.ForEach<&Particle_t::x, &Particle_t::vx>([dt](float& x, float vx) { x += vx * dt; });
+ * 	auto xs = particles.column<&Particle_t::x>(); // SoASpan<float> for SIMD kernels
+ */
+#pragma once
+
+#include "allocator.h"
+#include "../reflection.h"
+
+/* Standard includes */
+#undef min
+#undef max
+#include <new>
+#include <tuple>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <typeinfo>
+
+/* Every column starts on its own cache line */
+#define SOA_COLUMN_ALIGN 64
+
+/* Specialized by SOA_FIELDS. There is deliberately no generic definition */
+template <class T> struct SoAFields;
+
+/**
+ * Compile-time field list for T, given as member pointers
+ */
+template <class T, auto... Members> struct SoAFieldList
+{
+	static_assert(sizeof...(Members) > 0, "SoA field lists need at least one field");
+	static_assert((!std::is_array<std::remove_reference_t<decltype(std::declval<T&>().*Members)>>::value && ...),
+		      "C array fields can't be stored as a column, wrap them in a struct (e.g. Vector3)");
+
+	typedef T StructType;
+
+	static constexpr size_t NumFields = sizeof...(Members);
+
+	template <size_t I> static constexpr auto Member() { return std::get<I>(std::tuple<decltype(Members)...>(Members...)); }
+
+	template <size_t I> using FieldType = std::remove_reference_t<decltype(std::declval<T&>().*Member<I>())>;
+
+	/* Column index of member pointer M, or NumFields when M isn't in the list */
+	template <auto M> static constexpr size_t IndexOf()
+	{
+		constexpr bool match[] = {SameMember<M, Members>()...};
+		for (size_t i = 0; i < NumFields; i++)
+		{
+			if (match[i])
+				return i;
+		}
+		return NumFields;
+	}
+
+private:
+	template <auto A, auto B> static constexpr bool SameMember()
+	{
+		if constexpr (std::is_same<decltype(A), decltype(B)>::value)
+			return A == B;
+		else
+			return false;
+	}
+};
+
+/* Contiguous run of one column */
+template <class F> struct SoASpan
+{
+	F*     data;
+	size_t size;
+
+	F*   begin() const { return data; }
+	F*   end() const { return data + size; }
+	F&   operator[](size_t i) const { return data[i]; }
+	bool empty() const { return size == 0; }
+};
+
+/* Preprocessor helpers for SOA_FIELDS. _SOA_EXPAND works around MSVC passing __VA_ARGS__ on as a single argument */
+#define _SOA_EXPAND(x)		     x
+#define _SOA_PTR(_struct, _x)	     &_struct::_x
+#define _SOA_NAME(_struct, _x)	     #_x
+#define _SOA_MAP1(m, s, x)	     m(s, x)
+#define _SOA_MAP2(m, s, x, ...)	     m(s, x), _SOA_EXPAND(_SOA_MAP1(m, s, __VA_ARGS__))
+#define _SOA_MAP3(m, s, x, ...)	     m(s, x), _SOA_EXPAND(_SOA_MAP2(m, s, __VA_ARGS__))
+#define _SOA_MAP4(m, s, x, ...)	     m(s, x), _SOA_EXPAND(_SOA_MAP3(m, s, __VA_ARGS__))
+#define _SOA_MAP5(m, s, x, ...)	     m(s, x), _SOA_EXPAND(_SOA_MAP4(m, s, __VA_ARGS__))
+#define _SOA_MAP6(m, s, x, ...)	     m(s, x), _SOA_EXPAND(_SOA_MAP5(m, s, __VA_ARGS__))
+#define _SOA_MAP7(m, s, x, ...)	     m(s, x), _SOA_EXPAND(_SOA_MAP6(m, s, __VA_ARGS__))
+#define _SOA_MAP8(m, s, x, ...)	     m(s, x), _SOA_EXPAND(_SOA_MAP7(m, s, __VA_ARGS__))
+#define _SOA_MAP9(m, s, x, ...)	     m(s, x), _SOA_EXPAND(_SOA_MAP8(m, s, __VA_ARGS__))
+#define _SOA_MAP10(m, s, x, ...)     m(s, x), _SOA_EXPAND(_SOA_MAP9(m, s, __VA_ARGS__))
+#define _SOA_MAP11(m, s, x, ...)     m(s, x), _SOA_EXPAND(_SOA_MAP10(m, s, __VA_ARGS__))
+#define _SOA_MAP12(m, s, x, ...)     m(s, x), _SOA_EXPAND(_SOA_MAP11(m, s, __VA_ARGS__))
+#define _SOA_MAP13(m, s, x, ...)     m(s, x), _SOA_EXPAND(_SOA_MAP12(m, s, __VA_ARGS__))
+#define _SOA_MAP14(m, s, x, ...)     m(s, x), _SOA_EXPAND(_SOA_MAP13(m, s, __VA_ARGS__))
+#define _SOA_MAP15(m, s, x, ...)     m(s, x), _SOA_EXPAND(_SOA_MAP14(m, s, __VA_ARGS__))
+#define _SOA_MAP16(m, s, x, ...)     m(s, x), _SOA_EXPAND(_SOA_MAP15(m, s, __VA_ARGS__))
+#define _SOA_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, N, ...) N
+#define _SOA_MAP(m, s, ...)                                                                                                                          \
+	_SOA_EXPAND(_SOA_PICK(__VA_ARGS__, _SOA_MAP16, _SOA_MAP15, _SOA_MAP14, _SOA_MAP13, _SOA_MAP12, _SOA_MAP11, _SOA_MAP10, _SOA_MAP9,     \
+			      _SOA_MAP8, _SOA_MAP7, _SOA_MAP6, _SOA_MAP5, _SOA_MAP4, _SOA_MAP3, _SOA_MAP2, _SOA_MAP1)(m, s, __VA_ARGS__))
+
+/**
+ * Lists the fields of _struct that SoAArray stores, up to 16. Fields that aren't listed aren't stored.
+ * Must be used at global scope. GetFieldInfo returns the reflection info for the listed fields
+ */
+#define SOA_FIELDS(_struct, ...)                                                                                                                     \
+	template <> struct SoAFields<_struct> : SoAFieldList<_struct, _SOA_MAP(_SOA_PTR, _struct, __VA_ARGS__)>                                    \
+	{                                                                                                                                            \
+		static constexpr const char* ClassName	= #_struct;                                                                                  \
+		static constexpr const char* Names[]	= {_SOA_MAP(_SOA_NAME, _struct, __VA_ARGS__)};                                               \
+		static const SFieldInfo_t*   GetFieldInfo(unsigned long long& num)                                                                   \
+		{                                                                                                                                    \
+			static const auto infos = soa::BuildFieldInfo<SoAFields<_struct>>(std::make_index_sequence<NumFields>());                    \
+			num			= NumFields;                                                                                         \
+			return infos.fields;                                                                                                         \
+		}                                                                                                                                    \
+	}
+
+namespace soa
+{
+template <size_t N> struct FieldInfoTable_t
+{
+	SFieldInfo_t fields[N];
+};
+
+/* Offset of a member inside an AoS T. Member pointers can't go through offsetof, so measure it on raw storage */
+template <class T, class M> inline unsigned long long MemberOffset(M member)
+{
+	alignas(T) static unsigned char storage[sizeof(T)];
+	T*				p = reinterpret_cast<T*>(storage);
+	return (unsigned long long)(reinterpret_cast<unsigned char*>(&(p->*member)) - storage);
+}
+
+template <class FieldsT, size_t... I> FieldInfoTable_t<FieldsT::NumFields> BuildFieldInfo(std::index_sequence<I...>)
+{
+	typedef typename FieldsT::StructType T;
+	return {{{FieldsT::ClassName, FieldsT::Names[I], MemberOffset<T>(FieldsT::template Member<I>()),
+		  sizeof(typename FieldsT::template FieldType<I>), typeid(typename FieldsT::template FieldType<I>),
+		  reflection::ComputeTypeFlags<typename FieldsT::template FieldType<I>>(), nullptr}...}};
+}
+} // namespace soa
+
+template <class T, class AllocatorT = DefaultAllocator<unsigned char>> class SoAArray
+{
+public:
+	typedef SoAFields<T> Fields;
+
+	static constexpr size_t NumFields = Fields::NumFields;
+
+	template <size_t I> using FieldType = typename Fields::template FieldType<I>;
+
+	/* Column index of member pointer M, checked at compile time */
+	template <auto M> static constexpr size_t IndexOf()
+	{
+		constexpr size_t i = Fields::template IndexOf<M>();
+		static_assert(i < NumFields, "Member is not listed in SOA_FIELDS for this type");
+		return i;
+	}
+
+private:
+	unsigned char* m_block; /* All columns live in one allocation */
+	void*	       m_columns[NumFields];
+	size_t	       m_size;
+	size_t	       m_capacity;
+	AllocatorT     m_allocator;
+
+	/* Calls fn(std::integral_constant<size_t, I>) for every column */
+	template <class Fn, size_t... I> static void ForEachColumnIndex(Fn&& fn, std::index_sequence<I...>)
+	{
+		(fn(std::integral_constant<size_t, I>()), ...);
+	}
+
+	template <class Fn> static void ForEachColumnIndex(Fn&& fn)
+	{
+		ForEachColumnIndex(std::forward<Fn>(fn), std::make_index_sequence<NumFields>());
+	}
+
+	static size_t AlignUp(size_t n) { return (n + SOA_COLUMN_ALIGN - 1) & ~(size_t)(SOA_COLUMN_ALIGN - 1); }
+
+	/* Moves the columns into a new block with room for newCap elements */
+	void Reallocate(size_t newCap)
+	{
+		size_t offsets[NumFields];
+		size_t total = 0;
+		ForEachColumnIndex([&](auto idx) {
+			constexpr size_t I = decltype(idx)::value;
+			offsets[I]	   = total;
+			total		   = AlignUp(total + newCap * sizeof(FieldType<I>));
+		});
+
+		/* The allocator only promises malloc alignment, so over-allocate and align the first column by hand */
+		unsigned char* block   = m_allocator.allocate(total + SOA_COLUMN_ALIGN);
+		unsigned char* aligned = reinterpret_cast<unsigned char*>(AlignUp(reinterpret_cast<uintptr_t>(block + 1)));
+		aligned[-1]	       = (unsigned char)(aligned - block);
+
+		ForEachColumnIndex([&](auto idx) {
+			constexpr size_t I = decltype(idx)::value;
+			typedef FieldType<I> F;
+			F*		     dst = reinterpret_cast<F*>(aligned + offsets[I]);
+			F*		     src = column_data<I>();
+			if constexpr (std::is_trivially_copyable<F>::value)
+			{
+				if (m_size)
+					memcpy(dst, src, m_size * sizeof(F));
+			}
+			else
+			{
+				for (size_t i = 0; i < m_size; i++)
+				{
+					new (&dst[i]) F(std::move(src[i]));
+					src[i].~F();
+				}
+			}
+			m_columns[I] = dst;
+		});
+
+		FreeBlock();
+		m_block	   = aligned;
+		m_capacity = newCap;
+	}
+
+	void FreeBlock()
+	{
+		if (m_block)
+			m_allocator.deallocate(m_block - m_block[-1]);
+		m_block = nullptr;
+	}
+
+	void Grow(size_t needed)
+	{
+		size_t cap = m_capacity ? m_capacity * 2 : 16;
+		Reallocate(cap < needed ? needed : cap);
+	}
+
+	void DestroyRange(size_t from, size_t to)
+	{
+		ForEachColumnIndex([&](auto idx) {
+			constexpr size_t I = decltype(idx)::value;
+			typedef FieldType<I> F;
+			if constexpr (!std::is_trivially_destructible<F>::value)
+			{
+				F* col = column_data<I>();
+				for (size_t i = from; i < to; i++)
+					col[i].~F();
+			}
+		});
+	}
+
+	/* Constructs element i from the fields of t */
+	template <class U> void ScatterNew(size_t i, U&& t)
+	{
+		ForEachColumnIndex([&](auto idx) {
+			constexpr size_t I = decltype(idx)::value;
+			typedef FieldType<I> F;
+			if constexpr (std::is_rvalue_reference<U&&>::value)
+				new (&column_data<I>()[i]) F(std::move(t.*Fields::template Member<I>()));
+			else
+				new (&column_data<I>()[i]) F(t.*Fields::template Member<I>());
+		});
+	}
+
+	template <class Fn, class... P> static void ForEachRow(Fn& fn, size_t n, P*... cols)
+	{
+		for (size_t i = 0; i < n; i++)
+			fn(cols[i]...);
+	}
+
+public:
+	/**
+	 * AoS-style handle to element index. Reads and writes go straight to the columns
+	 */
+	template <bool IsConst> class ElementRef
+	{
+		typedef std::conditional_t<IsConst, const SoAArray, SoAArray> ArrayT;
+
+		ArrayT* m_array;
+		size_t	m_index;
+
+		template <bool> friend class ElementRef;
+
+		/* Copies every column of element o into this one */
+		template <bool C> void Assign(const ElementRef<C>& o) const
+		{
+			static_assert(!IsConst, "Can't assign through a ConstRef");
+			ForEachColumnIndex([&](auto idx) {
+				constexpr size_t I				    = decltype(idx)::value;
+				m_array->template column_data<I>()[m_index] = o.m_array->template column_data<I>()[o.m_index];
+			});
+		}
+
+	public:
+		ElementRef(ArrayT* array, size_t index) : m_array(array), m_index(index) {}
+		ElementRef(const ElementRef&) = default;
+
+		/* Assigning one proxy to another copies the element, like assigning structs would. It never rebinds */
+		const ElementRef& operator=(const ElementRef& o) const
+		{
+			Assign(o);
+			return *this;
+		}
+
+		template <bool C> const ElementRef& operator=(const ElementRef<C>& o) const
+		{
+			Assign(o);
+			return *this;
+		}
+
+		size_t index() const { return m_index; }
+
+		template <auto M> auto& get() const { return m_array->template column_data<IndexOf<M>()>()[m_index]; }
+
+		/* Gathers the listed fields into a T */
+		operator T() const { return m_array->get(m_index); }
+
+		template <bool C = IsConst, class = std::enable_if_t<!C>> const ElementRef& operator=(const T& t) const
+		{
+			m_array->set(m_index, t);
+			return *this;
+		}
+	};
+
+	typedef ElementRef<false> Ref;
+	typedef ElementRef<true>  ConstRef;
+
+	template <bool IsConst> class Iterator
+	{
+		typedef std::conditional_t<IsConst, const SoAArray, SoAArray> ArrayT;
+
+		ArrayT* m_array;
+		size_t	m_index;
+
+	public:
+		Iterator(ArrayT* array, size_t index) : m_array(array), m_index(index) {}
+
+		ElementRef<IsConst> operator*() const { return ElementRef<IsConst>(m_array, m_index); }
+		Iterator&	    operator++()
+		{
+			m_index++;
+			return *this;
+		}
+		bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+		bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+	};
+
+	typedef Iterator<false> iterator;
+	typedef Iterator<true>	const_iterator;
+
+	SoAArray() : m_block(nullptr), m_size(0), m_capacity(0)
+	{
+		for (size_t i = 0; i < NumFields; i++)
+			m_columns[i] = nullptr;
+	}
+
+	SoAArray(const SoAArray& other) : SoAArray() { *this = other; }
+
+	SoAArray(SoAArray&& other) noexcept : SoAArray() { *this = std::move(other); }
+
+	~SoAArray()
+	{
+		clear();
+		FreeBlock();
+	}
+
+	SoAArray& operator=(const SoAArray& other)
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		reserve(other.m_size);
+		ForEachColumnIndex([&](auto idx) {
+			constexpr size_t I = decltype(idx)::value;
+			typedef FieldType<I> F;
+			F*		     dst = column_data<I>();
+			const F*	     src = other.template column_data<I>();
+			if constexpr (std::is_trivially_copyable<F>::value)
+			{
+				if (other.m_size)
+					memcpy(dst, src, other.m_size * sizeof(F));
+			}
+			else
+			{
+				for (size_t i = 0; i < other.m_size; i++)
+					new (&dst[i]) F(src[i]);
+			}
+		});
+		m_size = other.m_size;
+		return *this;
+	}
+
+	SoAArray& operator=(SoAArray&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		FreeBlock();
+		m_block	   = other.m_block;
+		m_size	   = other.m_size;
+		m_capacity = other.m_capacity;
+		for (size_t i = 0; i < NumFields; i++)
+		{
+			m_columns[i]	   = other.m_columns[i];
+			other.m_columns[i] = nullptr;
+		}
+		other.m_block	 = nullptr;
+		other.m_size	 = 0;
+		other.m_capacity = 0;
+		return *this;
+	}
+
+	size_t size() const { return m_size; }
+	bool   empty() const { return m_size == 0; }
+	size_t capacity() const { return m_capacity; }
+
+	/* Raw column pointers. Each column is SOA_COLUMN_ALIGN aligned */
+	template <size_t I> FieldType<I>*	column_data() { return static_cast<FieldType<I>*>(m_columns[I]); }
+	template <size_t I> const FieldType<I>* column_data() const { return static_cast<const FieldType<I>*>(m_columns[I]); }
+
+	/* Column of member M as a span, for kernels that want the whole array of one field */
+	template <auto M> SoASpan<FieldType<IndexOf<M>()>> column() { return {column_data<IndexOf<M>()>(), m_size}; }
+	template <auto M> SoASpan<const FieldType<IndexOf<M>()>> column() const { return {column_data<IndexOf<M>()>(), m_size}; }
+
+	Ref	 operator[](size_t i) { return Ref(this, i); }
+	ConstRef operator[](size_t i) const { return ConstRef(this, i); }
+	Ref	 front() { return Ref(this, 0); }
+	ConstRef front() const { return ConstRef(this, 0); }
+	Ref	 back() { return Ref(this, m_size - 1); }
+	ConstRef back() const { return ConstRef(this, m_size - 1); }
+
+	iterator       begin() { return iterator(this, 0); }
+	iterator       end() { return iterator(this, m_size); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, m_size); }
+
+	/* Gathers element i into a T. Fields that aren't listed are left default initialized */
+	T get(size_t i) const
+	{
+		T t{};
+		ForEachColumnIndex([&](auto idx) {
+			constexpr size_t I		 = decltype(idx)::value;
+			t.*Fields::template Member<I>() = column_data<I>()[i];
+		});
+		return t;
+	}
+
+	/* Scatters the listed fields of t into element i */
+	void set(size_t i, const T& t)
+	{
+		ForEachColumnIndex([&](auto idx) {
+			constexpr size_t I  = decltype(idx)::value;
+			column_data<I>()[i] = t.*Fields::template Member<I>();
+		});
+	}
+
+	void reserve(size_t n)
+	{
+		if (n > m_capacity)
+			Reallocate(n);
+	}
+
+	void shrink_to_fit()
+	{
+		if (m_size < m_capacity)
+		{
+			if (m_size)
+				Reallocate(m_size);
+			else
+				release();
+		}
+	}
+
+	void push_back(const T& t)
+	{
+		if (m_size == m_capacity)
+		{
+			/* t may have been gathered from this array, but get() returns a copy so growing first is fine */
+			Grow(m_size + 1);
+		}
+		ScatterNew(m_size++, t);
+	}
+
+	void push_back(T&& t)
+	{
+		if (m_size == m_capacity)
+			Grow(m_size + 1);
+		ScatterNew(m_size++, std::move(t));
+	}
+
+	/* Appends a value initialized element and returns a handle to it */
+	Ref emplace_back()
+	{
+		resize(m_size + 1);
+		return back();
+	}
+
+	void pop_back()
+	{
+		DestroyRange(m_size - 1, m_size);
+		m_size--;
+	}
+
+	/* Value initializes new elements, so arithmetic fields start at zero */
+	void resize(size_t n)
+	{
+		if (n < m_size)
+		{
+			DestroyRange(n, m_size);
+			m_size = n;
+			return;
+		}
+		if (n > m_capacity)
+			Grow(n);
+		ForEachColumnIndex([&](auto idx) {
+			constexpr size_t I = decltype(idx)::value;
+			typedef FieldType<I> F;
+			F*		     col = column_data<I>();
+			for (size_t i = m_size; i < n; i++)
+				new (&col[i]) F();
+		});
+		m_size = n;
+	}
+
+	/* Removes element i, keeping the order of the rest */
+	void erase(size_t i)
+	{
+		ForEachColumnIndex([&](auto idx) {
+			constexpr size_t I   = decltype(idx)::value;
+			FieldType<I>*	 col = column_data<I>();
+			for (size_t j = i; j + 1 < m_size; j++)
+				col[j] = std::move(col[j + 1]);
+		});
+		pop_back();
+	}
+
+	/* Removes element i by moving the last element into its place. O(1) per column, but doesn't keep the order */
+	void swap_erase(size_t i)
+	{
+		if (i + 1 != m_size)
+		{
+			ForEachColumnIndex([&](auto idx) {
+				constexpr size_t I   = decltype(idx)::value;
+				FieldType<I>*	 col = column_data<I>();
+				col[i]		     = std::move(col[m_size - 1]);
+			});
+		}
+		pop_back();
+	}
+
+	/* Destroys the elements but keeps the storage */
+	void clear()
+	{
+		DestroyRange(0, m_size);
+		m_size = 0;
+	}
+
+	/* Destroys the elements and frees the storage */
+	void release()
+	{
+		clear();
+		FreeBlock();
+		for (size_t i = 0; i < NumFields; i++)
+			m_columns[i] = nullptr;
+		m_capacity = 0;
+	}
+
+	/**
+	 * Calls fn(field&...) for every element, passing only the fields named by Ms.
+	 * Only those columns are touched, which is the point of storing things this way
+	 */
+	template <auto... Ms, class Fn> void ForEach(Fn fn)
+	{
+		static_assert(sizeof...(Ms) > 0, "Name at least one field");
+		ForEachRow(fn, m_size, column_data<IndexOf<Ms>()>()...);
+	}
+
+	template <auto... Ms, class Fn> void ForEach(Fn fn) const
+	{
+		static_assert(sizeof...(Ms) > 0, "Name at least one field");
+		ForEachRow(fn, m_size, column_data<IndexOf<Ms>()>()...);
+	}
+};
@@ -23,93 +23,209 @@ GNU General Public License for more details.
 #include <string.h>
 #include <stdlib.h>
 
-String::String()
+static inline bool BytesEqual(const char* a, size_t alen, const char* b, size_t blen)
 {
-	this->m_length = 0;
-	this->m_string = nullptr;
+	return alen == blen && (alen == 0 || memcmp(a, b, alen) == 0);
 }
 
-String::String(const String& other)
+static inline bool BytesIEqual(const char* a, size_t alen, const char* b, size_t blen)
 {
-	this->m_length = other.m_length;
-	this->m_string = Q_strdup(other.m_string);
+	return alen == blen && (alen == 0 || Q_strnicmp(a, b, (int)alen) == 0);
 }
 
-String::String(String&& other)
+/* memchr for the first character, memcmp for the rest. memchr is vectorized in every libc we care about */
+static const char* FindBytes(const char* hay, size_t hlen, const char* needle, size_t nlen)
 {
-	this->m_length = other.m_length;
-	this->m_string = other.m_string;
-	other.m_string = nullptr;
-	other.m_length = 0;
+	if (nlen == 0)
+		return hay;
+	if (nlen > hlen)
+		return nullptr;
+
+	const char* last = hay + (hlen - nlen);
+	for (const char* p = hay; p <= last;)
+	{
+		p = static_cast<const char*>(memchr(p, needle[0], (last - p) + 1));
+		if (!p)
+			return nullptr;
+		if (memcmp(p + 1, needle + 1, nlen - 1) == 0)
+			return p;
+		p++;
+	}
+	return nullptr;
 }
 
-String::String(const char* str) :
-	String()
+static inline bool StartsWith(const char* s, size_t len, const char* subst, size_t slen)
 {
-	if(!str)
-		return;
-	this->m_length = strlen(str);
-	this->m_string = Q_strdup(str);
+	return slen <= len && (slen == 0 || memcmp(s, subst, slen) == 0);
+}
+
+static inline bool EndsWith(const char* s, size_t len, const char* subst, size_t slen)
+{
+	return slen <= len && (slen == 0 || memcmp(s + len - slen, subst, slen) == 0);
+}
+
+static inline size_t FindFirst(const char* s, size_t len, char c)
+{
+	const void* p = len ? memchr(s, c, len) : nullptr;
+	return p ? static_cast<const char*>(p) - s : len;
+}
+
+static inline size_t FindLast(const char* s, size_t len, char c)
+{
+	for (size_t i = len; i > 0; i--)
+	{
+		if (s[i - 1] == c)
+			return i - 1;
+	}
+	return len;
+}
+
+//===========================================
+//
+//      String
+//
+//===========================================
+
+String::String()
+{
+	m_string = m_sso;
+	m_length = 0;
+	m_sso[0] = 0;
+}
+
+String::String(const String& other) : String() { Assign(other.m_string, other.m_length); }
+
+String::String(String&& other) : String() { *this = static_cast<String&&>(other); }
+
+String::String(const char* str) : String()
+{
+	if (str)
+		Assign(str, strlen(str));
+}
+
+String::String(const char* str, size_t len) : String()
+{
+	if (str)
+		Assign(str, len);
 }
 
 String::~String()
 {
-	if (this->m_string)
+	if (!IsInline())
 		Q_free(m_string);
 }
 
-const char* String::c_str() const { return this->m_string; }
+/* Moves the contents into a buffer that holds capacity characters, inline if they fit */
+void String::Reallocate(size_t capacity)
+{
+	if (capacity <= SSO_CAPACITY)
+	{
+		if (IsInline())
+			return;
+		char* old = m_string;
+		memcpy(m_sso, old, m_length + 1);
+		Q_free(old);
+		m_string = m_sso;
+		return;
+	}
 
-size_t String::length() const { return this->m_length; }
+	char* buf = static_cast<char*>(Q_malloc(capacity + 1));
+	memcpy(buf, m_string, m_length + 1);
+	if (!IsInline())
+		Q_free(m_string);
+	m_string   = buf;
+	m_capacity = capacity;
+}
 
-bool String::equals(const String& other) const
+void String::Assign(const char* str, size_t len)
 {
-	if (!this->m_string || !other.m_string)
-		return false;
-	return Q_strcmp(this->m_string, other.m_string) == 0;
+	/* str may point into our own buffer, in which case it always fits */
+	if (len > capacity())
+	{
+		m_length = 0;
+		Reallocate(len);
+	}
+	memmove(m_string, str, len);
+	m_length      = len;
+	m_string[len] = 0;
 }
 
-bool String::equals(const char* other) const
+const char* String::c_str() const { return this->m_string; }
+
+size_t String::length() const { return this->m_length; }
+
+size_t String::capacity() const { return IsInline() ? SSO_CAPACITY : (size_t)m_capacity; }
+
+bool String::empty() const { return this->m_length == 0; }
+
+void String::reserve(size_t n)
 {
-	if (!this->m_string || !other)
-		return false;
-	return Q_strcmp(other, this->m_string) == 0;
+	if (n > capacity())
+		Reallocate(n);
 }
 
-bool String::iequals(const String& other) const
+void String::clear()
 {
-	if (!this->m_string || !other.m_string)
-		return false;
-	return Q_strcasecmp(other.m_string, this->m_string);
+	m_length    = 0;
+	m_string[0] = 0;
 }
 
-bool String::iequals(const char* other) const
+String& String::append(const char* str, size_t len)
 {
-	if (!this->m_string || !other)
-		return false;
-	return Q_strcasecmp(other, this->m_string);
+	if (!str || !len)
+		return *this;
+
+	size_t needed = m_length + len;
+	if (needed > capacity())
+	{
+		/* Appending part of ourselves, find it again after the move */
+		bool   self	= str >= m_string && str <= m_string + m_length;
+		size_t offset	= self ? str - m_string : 0;
+		size_t geometric = capacity() * 2;
+		Reallocate(needed > geometric ? needed : geometric);
+		if (self)
+			str = m_string + offset;
+	}
+	memmove(m_string + m_length, str, len);
+	m_length	 = needed;
+	m_string[needed] = 0;
+	return *this;
 }
 
+String& String::append(const char* str) { return str ? append(str, strlen(str)) : *this; }
+
+String& String::append(const String& str) { return append(str.m_string, str.m_length); }
+
+String& String::append(const StringView& str) { return append(str.m_string, str.m_length); }
+
+String& String::append(char c) { return append(&c, 1); }
+
+bool String::equals(const String& other) const { return BytesEqual(m_string, m_length, other.m_string, other.m_length); }
+
+bool String::equals(const StringView& other) const { return BytesEqual(m_string, m_length, other.m_string, other.m_length); }
+
+bool String::equals(const char* other) const { return other && BytesEqual(m_string, m_length, other, strlen(other)); }
+
+bool String::iequals(const String& other) const { return BytesIEqual(m_string, m_length, other.m_string, other.m_length); }
+
+bool String::iequals(const StringView& other) const { return BytesIEqual(m_string, m_length, other.m_string, other.m_length); }
+
+bool String::iequals(const char* other) const { return other && BytesIEqual(m_string, m_length, other, strlen(other)); }
+
 void String::to_lower()
 {
-	if (!this->m_string)
-		return;
-	for (int i = 0; i < this->m_length; i++)
+	for (size_t i = 0; i < this->m_length; i++)
 		this->m_string[i] = Q_tolower(this->m_string[i]);
 }
 
 void String::to_upper()
 {
-	if (!this->m_string)
-		return;
-	for (int i = 0; i < this->m_length; i++)
+	for (size_t i = 0; i < this->m_length; i++)
 		this->m_string[i] = Q_toupper(this->m_string[i]);
 }
 
 size_t String::replace(char c, char n, size_t max)
 {
-	if (!this->m_string)
-		return 0;
 	size_t num = 0;
 	max	   = max > 0 ? max : SIZE_MAX;
 	for (size_t i = 0; i < this->m_length && max > 0; i++)
@@ -123,9 +239,14 @@ size_t String::replace(char c, char n, size_t max)
 	return num;
 }
 
-bool String::empty() const { return (!this->m_string) && (this->m_length == 0); }
-
-String String::substr(size_t start, size_t end) { return String(); }
+String String::substr(size_t start, size_t end) const
+{
+	if (end > m_length)
+		end = m_length;
+	if (start >= end)
+		return String();
+	return String(m_string + start, end - start);
+}
 
 char String::operator[](size_t i) const
 {
@@ -136,91 +257,98 @@ char String::operator[](size_t i) const
 
 String& String::operator=(const String& other)
 {
-	if (this->m_string)
-		Q_free(this->m_string);
-	this->m_string = Q_strdup(other.m_string);
-	this->m_length = other.m_length;
+	if (this != &other)
+		Assign(other.m_string, other.m_length);
 	return *this;
 }
 
 String& String::operator=(String&& other)
 {
-	this->m_string = other.m_string;
-	this->m_length = other.m_length;
+	if (this == &other)
+		return *this;
+
+	if (other.IsInline())
+	{
+		Assign(other.m_string, other.m_length);
+		other.clear();
+		return *this;
+	}
+
+	/* Steal the heap block */
+	if (!IsInline())
+		Q_free(m_string);
+	m_string	 = other.m_string;
+	m_length	 = other.m_length;
+	m_capacity	 = other.m_capacity;
+	other.m_string	 = other.m_sso;
+	other.m_length	 = 0;
+	other.m_sso[0]	 = 0;
 	return *this;
 }
 
-bool String::operator==(const String& other) const { return this->equals(other); }
+String& String::operator=(const StringView& other)
+{
+	if (other.m_string)
+		Assign(other.m_string, other.m_length);
+	else
+		clear();
+	return *this;
+}
 
-bool String::operator!=(const String& other) const { return !this->equals(other); }
+String& String::operator=(const char* other)
+{
+	if (other)
+		Assign(other, strlen(other));
+	else
+		clear();
+	return *this;
+}
 
-String::operator StringView() const { return StringView(*this); }
+bool String::operator==(const String& other) const { return this->equals(other); }
 
-StringView String::string_view() const { return StringView(*this); }
+bool String::operator==(const char* other) const { return this->equals(other); }
 
-bool String::contains(const char* subst) const { return Q_strstr(m_string, subst) != nullptr; }
+bool String::operator==(const StringView& other) const { return this->equals(other); }
 
-bool String::contains(const String& subst) const { return Q_strstr(m_string, subst.m_string) != nullptr; }
+bool String::operator!=(const String& other) const { return !this->equals(other); }
 
-bool String::contains(const StringView& subst) const { return Q_strstr(m_string, subst.m_string) != nullptr; }
+bool String::operator!=(const char* other) const { return !this->equals(other); }
 
-bool String::equals(const StringView& other) const { return Q_strcmp(m_string, other.m_string) == 0; }
+bool String::operator!=(const StringView& other) const { return !this->equals(other); }
 
-bool String::iequals(const StringView& other) const { return Q_strcasecmp(m_string, other.m_string) == 0; }
+String::operator StringView() const { return StringView(*this); }
 
-String& String::operator=(const StringView& other)
-{
-	if (m_string)
-		Q_free(m_string);
-	m_length = other.m_length;
-	m_string = Q_strdup(other.m_string);
-	return *this;
-}
+StringView String::string_view() const { return StringView(*this); }
 
-String& String::operator=(const char* other)
-{
-	if (m_string)
-		Q_free(m_string);
-	m_length = strlen(other);
-	m_string = Q_strdup(other);
-	return *this;
-}
+bool String::contains(const char* subst) const { return subst && FindBytes(m_string, m_length, subst, strlen(subst)) != nullptr; }
 
-bool String::operator!=(const char* other) const { return Q_strcmp(other, m_string) != 0; }
+bool String::contains(const String& subst) const { return FindBytes(m_string, m_length, subst.m_string, subst.m_length) != nullptr; }
 
-bool String::operator!=(const StringView& other) const { return Q_strcmp(other.m_string, m_string) != 0; }
+bool String::contains(const StringView& subst) const { return FindBytes(m_string, m_length, subst.m_string, subst.m_length) != nullptr; }
 
-bool String::operator==(const StringView& other) { return Q_strcmp(m_string, other.m_string) == 0; }
+bool String::startswith(const char* subst) const { return subst && StartsWith(m_string, m_length, subst, strlen(subst)); }
 
-bool String::operator==(const char* other) const { return Q_strcmp(m_string, other) == 0; }
+bool String::startswith(const String& subst) const { return StartsWith(m_string, m_length, subst.m_string, subst.m_length); }
 
-bool String::startswith(const char* subst) const { return Q_startswith(m_string, subst); }
+bool String::startswith(const StringView& subst) const { return StartsWith(m_string, m_length, subst.m_string, subst.m_length); }
 
-bool String::startswith(const String& subst) const { return Q_startswith(m_string, subst.m_string); }
+bool String::endswith(const char* subst) const { return subst && EndsWith(m_string, m_length, subst, strlen(subst)); }
 
-bool String::startswith(const StringView& subst) const { return Q_startswith(m_string, subst.m_string); }
+bool String::endswith(const String& subst) const { return EndsWith(m_string, m_length, subst.m_string, subst.m_length); }
 
-bool String::endswith(const char* subst) const { return Q_endswith(m_string, subst); }
+bool String::endswith(const StringView& subst) const { return EndsWith(m_string, m_length, subst.m_string, subst.m_length); }
 
-bool String::endswith(const String& subst) const { return Q_endswith(m_string, subst.m_string); }
+size_t String::find_first_of(char c) const { return FindFirst(m_string, m_length, c); }
 
-bool String::endswith(const StringView& subst) const { return Q_endswith(m_string, subst.m_string); }
+size_t String::find_last_of(char c) const { return FindLast(m_string, m_length, c); }
 
-size_t String::find_first_of(char c) const
-{
-	for (size_t i = 0; i < m_length; i++)
-		if (m_string[i] == c)
-			return i;
-	return m_length;
-}
+//===========================================
+//
+//      StringView
+//
+//===========================================
 
-size_t String::find_last_of(char c) const
-{
-	for (size_t i = m_length - 1; i >= 0; i--)
-		if (m_string[i] == c)
-			return i;
-	return m_length;
-}
+StringView::StringView() : m_string(""), m_length(0) {}
 
 StringView::StringView(const StringView& other) : m_string(other.m_string), m_length(other.m_length) {}
 
@@ -228,31 +356,33 @@ StringView::StringView(const StringView&& other) noexcept : m_string(other.m_str
 
 StringView::StringView(const char* str) : m_string(str), m_length(Q_strlen(str)) {}
 
+StringView::StringView(const char* str, size_t len) : m_string(str ? str : ""), m_length(str ? len : 0) {}
+
 StringView::StringView(const String& str) : m_string(str.m_string), m_length(str.m_length) {}
 
 StringView::~StringView() {}
 
 bool StringView::empty() const { return m_string == nullptr || m_length == 0; }
 
-String StringView::to_string() const { return String(m_string); }
+String StringView::to_string() const { return String(m_string, m_length); }
 
 const char* StringView::string() const { return m_string; }
 
 const char* StringView::c_str() const { return m_string; }
 
-bool StringView::equals(const StringView& other) const { return Q_strcmp(m_string, other.m_string) == 0; }
+bool StringView::equals(const StringView& other) const { return BytesEqual(m_string, m_length, other.m_string, other.m_length); }
 
-bool StringView::equals(const String& other) const { return Q_strcmp(m_string, other.m_string) == 0; }
+bool StringView::equals(const String& other) const { return BytesEqual(m_string, m_length, other.m_string, other.m_length); }
 
-bool StringView::equals(const char* other) const { return Q_strcmp(m_string, other) == 0; }
+bool StringView::equals(const char* other) const { return other && BytesEqual(m_string, m_length, other, strlen(other)); }
 
-bool StringView::iequals(const StringView& other) const { return Q_strcasecmp(m_string, other.m_string) == 0; }
+bool StringView::iequals(const StringView& other) const { return BytesIEqual(m_string, m_length, other.m_string, other.m_length); }
 
-bool StringView::iequals(const String& other) const { return Q_strcasecmp(m_string, other.m_string) == 0; }
+bool StringView::iequals(const String& other) const { return BytesIEqual(m_string, m_length, other.m_string, other.m_length); }
 
-bool StringView::iequals(const char* other) const { return Q_strcasecmp(m_string, other) == 0; }
+bool StringView::iequals(const char* other) const { return other && BytesIEqual(m_string, m_length, other, strlen(other)); }
 
-StringView::operator String() const { return String(m_string); }
+StringView::operator String() const { return String(m_string, m_length); }
 
 char StringView::operator[](size_t i) const
 {
@@ -284,50 +414,103 @@ StringView& StringView::operator=(StringView&& other) noexcept
 	return *this;
 }
 
-bool StringView::operator==(const StringView& other) const { return Q_strcmp(other.m_string, m_string) == 0; }
+bool StringView::operator==(const StringView& other) const { return equals(other); }
+
+bool StringView::operator==(const String& other) const { return equals(other); }
+
+bool StringView::operator==(const char* other) const { return equals(other); }
+
+bool StringView::operator!=(const StringView& other) const { return !equals(other); }
+
+bool StringView::operator!=(const String& other) const { return !equals(other); }
+
+bool StringView::operator!=(const char* other) const { return !equals(other); }
 
-bool StringView::operator==(const String& other) const { return Q_strcmp(other.m_string, m_string) == 0; }
+String StringView::copy() const { return String(m_string, m_length); }
 
-bool StringView::operator==(const char* other) const { return Q_strcmp(other, m_string) == 0; }
+bool StringView::contains(const char* subst) const { return subst && FindBytes(m_string, m_length, subst, strlen(subst)) != nullptr; }
 
-bool StringView::operator!=(const StringView& other) const { return Q_strcmp(other.m_string, m_string) != 0; }
+bool StringView::contains(const String& subst) const { return FindBytes(m_string, m_length, subst.m_string, subst.m_length) != nullptr; }
 
-bool StringView::operator!=(const String& other) const { return Q_strcmp(other.m_string, m_string) != 0; }
+bool StringView::contains(const StringView& subst) const { return FindBytes(m_string, m_length, subst.m_string, subst.m_length) != nullptr; }
 
-bool StringView::operator!=(const char* other) const { return Q_strcmp(other, m_string) != 0; }
+bool StringView::startswith(const char* subst) const { return subst && StartsWith(m_string, m_length, subst, strlen(subst)); }
 
-String StringView::copy() const { return String(m_string); }
+bool StringView::startswith(const String& subst) const { return StartsWith(m_string, m_length, subst.m_string, subst.m_length); }
 
-bool StringView::contains(const char* subst) const { return Q_strstr(m_string, subst) != nullptr; }
+bool StringView::startswith(const StringView& subst) const { return StartsWith(m_string, m_length, subst.m_string, subst.m_length); }
 
-bool StringView::contains(const String& subst) const { return Q_strstr(m_string, subst.m_string); }
+bool StringView::endswith(const char* subst) const { return subst && EndsWith(m_string, m_length, subst, strlen(subst)); }
 
-bool StringView::contains(const StringView& subst) const { return Q_strstr(m_string, subst.m_string); }
+bool StringView::endswith(const String& subst) const { return EndsWith(m_string, m_length, subst.m_string, subst.m_length); }
 
-bool StringView::startswith(const char* subst) const { return Q_startswith(m_string, subst); }
+bool StringView::endswith(const StringView& subst) const { return EndsWith(m_string, m_length, subst.m_string, subst.m_length); }
 
-bool StringView::startswith(const String& subst) const { return Q_startswith(m_string, subst.m_string); }
+size_t StringView::find_first_of(char c) const { return FindFirst(m_string, m_length, c); }
 
-bool StringView::startswith(const StringView& subst) const { return Q_startswith(m_string, subst.m_string); }
+size_t StringView::find_last_of(char c) const { return FindLast(m_string, m_length, c); }
 
-bool StringView::endswith(const char* subst) const { return Q_endswith(m_string, subst); }
+size_t StringView::find(char c, size_t start) const
+{
+	if (start >= m_length)
+		return m_length;
+	return start + FindFirst(m_string + start, m_length - start, c);
+}
+
+size_t StringView::find(const StringView& subst, size_t start) const
+{
+	if (start > m_length)
+		return m_length;
+	const char* p = FindBytes(m_string + start, m_length - start, subst.m_string, subst.m_length);
+	return p ? p - m_string : m_length;
+}
 
-bool StringView::endswith(const String& subst) const { return Q_endswith(m_string, subst.m_string); }
+StringView StringView::substr(size_t start, size_t end) const
+{
+	if (end > m_length)
+		end = m_length;
+	if (start >= end)
+		return StringView(m_string + (start < m_length ? start : m_length), 0);
+	return StringView(m_string + start, end - start);
+}
 
-bool StringView::endswith(const StringView& subst) const { return Q_endswith(m_string, subst.m_string); }
+StringView StringView::ltrim() const
+{
+	size_t i = 0;
+	while (i < m_length && isspace((unsigned char)m_string[i]))
+		i++;
+	return StringView(m_string + i, m_length - i);
+}
 
-size_t StringView::find_first_of(char c) const
+StringView StringView::rtrim() const
 {
-	for (size_t i = 0; i < m_length; i++)
-		if (m_string[i] == c)
-			return i;
-	return m_length;
+	size_t n = m_length;
+	while (n > 0 && isspace((unsigned char)m_string[n - 1]))
+		n--;
+	return StringView(m_string, n);
 }
 
-size_t StringView::find_last_of(char c) const
+StringView StringView::trim() const { return ltrim().rtrim(); }
+
+/* Points an exhausted tokenizer view somewhere no other view can, so it can be told apart from the empty token
+ * that follows a trailing delimiter */
+static const char s_tokensDone[1] = {0};
+
+bool StringView::next_token(StringView& token, char delim)
 {
-	for (size_t i = m_length - 1; i >= 0; i--)
-		if (m_string[i] == c)
-			return i;
-	return m_length;
+	if (m_string == s_tokensDone)
+		return false;
+	size_t i = FindFirst(m_string, m_length, delim);
+	token	 = StringView(m_string, i);
+	if (i == m_length)
+	{
+		m_string = s_tokensDone;
+		m_length = 0;
+	}
+	else
+	{
+		m_string += i + 1;
+		m_length -= i + 1;
+	}
+	return true;
 }
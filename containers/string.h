@@ -20,28 +20,58 @@ GNU General Public License for more details.
 class EXPORT String;
 class EXPORT StringView;
 
+/**
+ * Owning, null-terminated string
+ * Strings of up to SSO_CAPACITY characters are stored inside the object itself and never allocate.
+ * Comparisons use the stored length, so mismatched lengths are rejected without reading the characters.
+ * Appending grows the buffer geometrically.
+ */
 class EXPORT String
 {
+public:
+	static constexpr size_t SSO_CAPACITY = 23;
+
 private:
-	char*		   m_string;
+	char*		   m_string; /* Points at m_sso or a heap block. Never null */
 	unsigned long long m_length;
+	union
+	{
+		unsigned long long m_capacity; /* Heap capacity, not counting the terminator */
+		char		   m_sso[SSO_CAPACITY + 1];
+	};
 
 	friend class StringView;
 
+	bool IsInline() const { return m_string == m_sso; }
+	void Assign(const char* str, size_t len);
+	void Reallocate(size_t capacity);
+
 public:
 	String();
 	String(const String& other);
 	String(String&& other);
 	String(const char* str);
+	String(const char* str, size_t len);
 
 	~String();
 
 	const char* c_str() const;
 
 	size_t length() const;
+	size_t capacity() const;
 
 	bool empty() const;
 
+	/* Makes room for n characters without further allocations */
+	void reserve(size_t n);
+	void clear();
+
+	String& append(const char* str);
+	String& append(const char* str, size_t len);
+	String& append(const String& str);
+	String& append(const StringView& str);
+	String& append(char c);
+
 	/* Equality tests */
 	bool equals(const String& other) const;
 	bool equals(const StringView& other) const;
@@ -71,7 +101,8 @@ public:
 	void   to_upper();
 	size_t replace(char c, char n, size_t max = 0);
 
-	String substr(size_t start, size_t end);
+	/* Characters [start, end), clamped to the string */
+	String substr(size_t start, size_t end) const;
 
 		 operator const char*() const { return m_string; };
 	explicit operator char*() { return m_string; };
@@ -81,9 +112,14 @@ public:
 	String&	 operator=(const char* other);
 	String&	 operator=(const StringView& other);
 
+	String& operator+=(const char* other) { return append(other); }
+	String& operator+=(const String& other) { return append(other); }
+	String& operator+=(const StringView& other) { return append(other); }
+	String& operator+=(char c) { return append(c); }
+
 	bool operator==(const String& other) const;
 	bool operator==(const char* other) const;
-	bool operator==(const StringView& other);
+	bool operator==(const StringView& other) const;
 	bool operator!=(const String& other) const;
 	bool operator!=(const char* other) const;
 	bool operator!=(const StringView& other) const;
@@ -95,6 +131,8 @@ public:
 
 /* Simply maintains a pointer to a character string */
 /* Useful if you don't want to be doing malloc and stuff constantly */
+/* A view may be a slice of a larger string (see substr, trim, next_token), in which case the characters are NOT null
+ * terminated at length(). Always pair string()/c_str() with length() */
 class StringView
 {
 private:
@@ -104,9 +142,11 @@ private:
 	friend class String;
 
 public:
+	StringView();
 	StringView(const StringView& other);
 	StringView(const StringView&& other) noexcept;
 	StringView(const char* str);
+	StringView(const char* str, size_t len);
 	StringView(const String& str);
 
 	~StringView();
@@ -117,13 +157,17 @@ public:
 	String to_string() const;
 	String copy() const;
 
-	/* Returns a pointer to the internal string buffer */
+	/* Returns a pointer to the internal string buffer. Not null terminated for slices */
 	const char* string() const;
 	const char* c_str() const;
+	const char* data() const { return m_string; }
 
 	/* returns the length */
 	size_t length() const { return m_length; }
 
+	const char* begin() const { return m_string; }
+	const char* end() const { return m_string + m_length; }
+
 	/* Equality tests */
 	bool equals(const StringView& other) const;
 	bool equals(const String& other) const;
@@ -149,6 +193,36 @@ public:
 	size_t find_first_of(char c) const;
 	size_t find_last_of(char c) const;
 
+	/* Index of the first match at or after start, or length() if there is none */
+	size_t find(char c, size_t start = 0) const;
+	size_t find(const StringView& subst, size_t start = 0) const;
+
+	/* Slices. These point into the same characters and never copy */
+
+	/* Characters [start, end), clamped to the view */
+	StringView substr(size_t start, size_t end = (size_t)-1) const;
+
+	/* Strip leading and/or trailing whitespace */
+	StringView trim() const;
+	StringView ltrim() const;
+	StringView rtrim() const;
+
+	/* Splits off everything up to the next delim into token and advances past the delimiter.
+	 * Returns false once the last token has been taken. N delimiters always give N + 1 tokens: consecutive, leading
+	 * and trailing delimiters produce empty tokens, and an empty view produces a single empty token */
+	bool next_token(StringView& token, char delim);
+
+	/* Appends each delim separated token to out, returns the number of tokens.
+	 * ArrayT is anything with push_back(StringView), e.g. Array<StringView> or SmallArray<StringView, N> */
+	template <class ArrayT> size_t split(char delim, ArrayT& out) const
+	{
+		StringView rest = *this, token;
+		size_t	   n	= 0;
+		for (; rest.next_token(token, delim); n++)
+			out.push_back(token);
+		return n;
+	}
+
 	/* Casting operators */
 	explicit operator const char*() const { return m_string; }
 	explicit operator String() const;
@@ -0,0 +1,409 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#include "stringbuilder.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#undef min
+#undef max
+#include <charconv>
+
+#ifdef _POSIX
+#include <sys/uio.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#else
+#include <io.h>
+#endif
+
+static const char s_digitPairs[] = "00010203040506070809"
+				   "10111213141516171819"
+				   "20212223242526272829"
+				   "30313233343536373839"
+				   "40414243444546474849"
+				   "50515253545556575859"
+				   "60616263646566676869"
+				   "70717273747576777879"
+				   "80818283848586878889"
+				   "90919293949596979899";
+
+/* Writes v right-aligned so it ends at end, two digits at a time. Returns the first character */
+static char* FormatUnsigned(char* end, unsigned long long v)
+{
+	char* p = end;
+	while (v >= 100)
+	{
+		unsigned idx = (unsigned)(v % 100) * 2;
+		v /= 100;
+		*--p = s_digitPairs[idx + 1];
+		*--p = s_digitPairs[idx];
+	}
+	if (v >= 10)
+	{
+		*--p = s_digitPairs[v * 2 + 1];
+		*--p = s_digitPairs[v * 2];
+	}
+	else
+		*--p = (char)('0' + v);
+	return p;
+}
+
+//===========================================
+//
+//      StringBuilder
+//
+//===========================================
+
+StringBuilder::StringBuilder(size_t chunkSize) : m_head(nullptr), m_tail(nullptr), m_length(0), m_nextChunkSize(chunkSize ? chunkSize : DEFAULT_CHUNK_SIZE)
+{
+}
+
+StringBuilder::~StringBuilder() { FreeChunks(m_head); }
+
+StringBuilder::StringBuilder(StringBuilder&& other) noexcept
+	: m_head(other.m_head), m_tail(other.m_tail), m_length(other.m_length), m_nextChunkSize(other.m_nextChunkSize)
+{
+	other.m_head = other.m_tail = nullptr;
+	other.m_length		    = 0;
+}
+
+StringBuilder& StringBuilder::operator=(StringBuilder&& other) noexcept
+{
+	if (this == &other)
+		return *this;
+	FreeChunks(m_head);
+	m_head		= other.m_head;
+	m_tail		= other.m_tail;
+	m_length	= other.m_length;
+	m_nextChunkSize = other.m_nextChunkSize;
+	other.m_head = other.m_tail = nullptr;
+	other.m_length		    = 0;
+	return *this;
+}
+
+void StringBuilder::FreeChunks(Chunk_t* chunk)
+{
+	while (chunk)
+	{
+		Chunk_t* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+}
+
+void StringBuilder::clear()
+{
+	if (!m_head)
+		return;
+	FreeChunks(m_head->next);
+	m_head->next = nullptr;
+	m_head->used = 0;
+	m_tail	     = m_head;
+	m_length     = 0;
+}
+
+char* StringBuilder::Reserve(size_t n)
+{
+	if (m_tail && m_tail->size - m_tail->used >= n)
+		return m_tail->data + m_tail->used;
+
+	/* Chunks double up to MAX_CHUNK_SIZE, so big outputs don't end up as thousands of tiny chunks */
+	size_t size = m_nextChunkSize > n ? m_nextChunkSize : n;
+	if (m_nextChunkSize < MAX_CHUNK_SIZE)
+		m_nextChunkSize *= 2;
+
+	Chunk_t* chunk = static_cast<Chunk_t*>(malloc(offsetof(Chunk_t, data) + size));
+	chunk->next    = nullptr;
+	chunk->size    = size;
+	chunk->used    = 0;
+	if (m_tail)
+		m_tail->next = chunk;
+	else
+		m_head = chunk;
+	m_tail = chunk;
+	return chunk->data;
+}
+
+StringBuilder& StringBuilder::append(const char* str, size_t len)
+{
+	if (!str)
+		return *this;
+	/* Fill whatever is left of the tail first, then start a new chunk with the rest */
+	if (m_tail)
+	{
+		size_t room = m_tail->size - m_tail->used;
+		size_t n    = room < len ? room : len;
+		memcpy(m_tail->data + m_tail->used, str, n);
+		Commit(n);
+		str += n;
+		len -= n;
+	}
+	if (len)
+	{
+		memcpy(Reserve(len), str, len);
+		Commit(len);
+	}
+	return *this;
+}
+
+StringBuilder& StringBuilder::append(const char* str) { return str ? append(str, strlen(str)) : *this; }
+
+StringBuilder& StringBuilder::append(const String& str) { return append(str.c_str(), str.length()); }
+
+StringBuilder& StringBuilder::append(const StringView& str) { return append(str.c_str(), str.length()); }
+
+StringBuilder& StringBuilder::append(char c)
+{
+	*Reserve(1) = c;
+	Commit(1);
+	return *this;
+}
+
+StringBuilder& StringBuilder::append(char c, size_t count)
+{
+	while (count)
+	{
+		size_t room = m_tail ? m_tail->size - m_tail->used : 0;
+		if (!room)
+		{
+			Reserve(count);
+			room = m_tail->size - m_tail->used;
+		}
+		size_t n = room < count ? room : count;
+		memset(m_tail->data + m_tail->used, c, n);
+		Commit(n);
+		count -= n;
+	}
+	return *this;
+}
+
+StringBuilder& StringBuilder::append(long long v)
+{
+	char* p = Reserve(20);
+	char  tmp[20];
+	char* end   = tmp + sizeof(tmp);
+	char* start = FormatUnsigned(end, v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v);
+	if (v < 0)
+		*--start = '-';
+	memcpy(p, start, end - start);
+	Commit(end - start);
+	return *this;
+}
+
+StringBuilder& StringBuilder::append(unsigned long long v)
+{
+	char* p = Reserve(20);
+	char  tmp[20];
+	char* end   = tmp + sizeof(tmp);
+	char* start = FormatUnsigned(end, v);
+	memcpy(p, start, end - start);
+	Commit(end - start);
+	return *this;
+}
+
+StringBuilder& StringBuilder::append(float v)
+{
+	char* p = Reserve(32);
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+	auto res = std::to_chars(p, p + 32, v);
+	Commit(res.ptr - p);
+#else
+	Commit(snprintf(p, 32, "%.9g", v));
+#endif
+	return *this;
+}
+
+StringBuilder& StringBuilder::append(double v)
+{
+	char* p = Reserve(32);
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+	auto res = std::to_chars(p, p + 32, v);
+	Commit(res.ptr - p);
+#else
+	Commit(snprintf(p, 32, "%.17g", v));
+#endif
+	return *this;
+}
+
+StringBuilder& StringBuilder::append_json(const char* v)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	append('"');
+	if (!v)
+		return append('"');
+
+	const char* run = v;
+	for (const char* s = v; *s; s++)
+	{
+		unsigned char c = (unsigned char)*s;
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		/* Flush the plain run before the escape */
+		append(run, s - run);
+		run = s + 1;
+		switch (c)
+		{
+		case '"':
+			append("\\\"", 2);
+			break;
+		case '\\':
+			append("\\\\", 2);
+			break;
+		case '\n':
+			append("\\n", 2);
+			break;
+		case '\r':
+			append("\\r", 2);
+			break;
+		case '\t':
+			append("\\t", 2);
+			break;
+		default:
+		{
+			char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+			append(esc, 6);
+			break;
+		}
+		}
+	}
+	append(run, strlen(run));
+	return append('"');
+}
+
+StringBuilder& StringBuilder::appendf(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	vappendf(fmt, args);
+	va_end(args);
+	return *this;
+}
+
+StringBuilder& StringBuilder::vappendf(const char* fmt, va_list args)
+{
+	/* Try the space left in the tail first. If it doesn't fit, vsnprintf told us exactly how much to reserve */
+	size_t room = m_tail ? m_tail->size - m_tail->used : 0;
+	char*  p    = m_tail ? m_tail->data + m_tail->used : nullptr;
+
+	va_list copy;
+	va_copy(copy, args);
+	int n = vsnprintf(p, room, fmt, copy);
+	va_end(copy);
+	if (n < 0)
+		return *this;
+
+	/* vsnprintf needs room for its terminator too, which we don't keep */
+	if ((size_t)n >= room)
+	{
+		p = Reserve(n + 1);
+		vsnprintf(p, n + 1, fmt, args);
+	}
+	Commit(n);
+	return *this;
+}
+
+String StringBuilder::str() const
+{
+	String s;
+	s.reserve(m_length);
+	ForEachChunk([&](const char* data, size_t len) { s.append(data, len); });
+	return s;
+}
+
+size_t StringBuilder::CopyTo(char* buf, size_t size) const
+{
+	if (!size)
+		return 0;
+	size_t copied = 0;
+	for (Chunk_t* c = m_head; c && copied < size - 1; c = c->next)
+	{
+		size_t n = c->used < size - 1 - copied ? c->used : size - 1 - copied;
+		memcpy(buf + copied, c->data, n);
+		copied += n;
+	}
+	buf[copied] = 0;
+	return copied;
+}
+
+bool StringBuilder::WriteTo(FILE* fp) const
+{
+	if (!fp)
+		return false;
+	for (Chunk_t* c = m_head; c; c = c->next)
+	{
+		if (c->used && fwrite(c->data, 1, c->used, fp) != c->used)
+			return false;
+	}
+	return true;
+}
+
+bool StringBuilder::WriteTo(int fd) const
+{
+#ifdef _POSIX
+	/* Gather all chunks into as few writev calls as possible */
+	struct iovec iov[64];
+	Chunk_t*     c = m_head;
+	while (c)
+	{
+		int count = 0;
+		for (; c && count < 64 && count < IOV_MAX; c = c->next)
+		{
+			if (!c->used)
+				continue;
+			iov[count].iov_base = c->data;
+			iov[count].iov_len  = c->used;
+			count++;
+		}
+
+		/* Handle short writes by advancing through the vector */
+		struct iovec* v = iov;
+		while (count > 0)
+		{
+			ssize_t written = writev(fd, v, count);
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			while (count > 0 && (size_t)written >= v->iov_len)
+			{
+				written -= v->iov_len;
+				v++;
+				count--;
+			}
+			if (count > 0)
+			{
+				v->iov_base = static_cast<char*>(v->iov_base) + written;
+				v->iov_len -= written;
+			}
+		}
+	}
+	return true;
+#else
+	for (Chunk_t* c = m_head; c; c = c->next)
+	{
+		if (c->used && _write(fd, c->data, (unsigned)c->used) != (int)c->used)
+			return false;
+	}
+	return true;
+#endif
+}
@@ -0,0 +1,133 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * stringbuilder.h
+ * 	Chunked string builder for generating large amounts of text
+ *
+ * Text is appended into a chain of chunks that are never moved or reallocated, so appending is a memcpy into the tail
+ * chunk and nothing is ever copied twice. Numbers are formatted straight into the chunk, appendf runs vsnprintf
+ * straight into the chunk, and the result can be written out chunk by chunk (WriteTo uses writev for file
+ * descriptors) without flattening it first. Call str() when a contiguous copy is really needed.
+ *
+ * USAGE:
+ * 	StringBuilder sb;
+ * 	sb << "{\"count\": " << count << ", \"avg\": " << avg << "}";
+ * 	sb.appendf("%-16s|", name);
+ * 	sb.WriteTo(stdout);
+ */
+#pragma once
+
+#include "../public.h"
+#include "string.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifdef __GNUC__
+#define STRINGBUILDER_FORMAT(x) __attribute__((format(printf, x, x + 1)))
+#else
+#define STRINGBUILDER_FORMAT(x)
+#endif
+
+class EXPORT StringBuilder
+{
+public:
+	static constexpr size_t DEFAULT_CHUNK_SIZE = 4096;
+	static constexpr size_t MAX_CHUNK_SIZE	   = 65536;
+
+private:
+	struct Chunk_t
+	{
+		Chunk_t* next;
+		size_t	 size;
+		size_t	 used;
+		char	 data[1]; /* Actually size bytes */
+	};
+
+	Chunk_t* m_head;
+	Chunk_t* m_tail;
+	size_t	 m_length;
+	size_t	 m_nextChunkSize;
+
+	/* Returns room for at least n bytes at the end of the tail chunk */
+	char* Reserve(size_t n);
+	void  Commit(size_t n)
+	{
+		m_tail->used += n;
+		m_length += n;
+	}
+	void FreeChunks(Chunk_t* chunk);
+
+public:
+	explicit StringBuilder(size_t chunkSize = DEFAULT_CHUNK_SIZE);
+	~StringBuilder();
+
+	StringBuilder(const StringBuilder&) = delete;
+	StringBuilder& operator=(const StringBuilder&) = delete;
+	StringBuilder(StringBuilder&& other) noexcept;
+	StringBuilder& operator=(StringBuilder&& other) noexcept;
+
+	size_t length() const { return m_length; }
+	bool   empty() const { return m_length == 0; }
+
+	/* Forgets the contents. The first chunk is kept for reuse */
+	void clear();
+
+	StringBuilder& append(const char* str);
+	StringBuilder& append(const char* str, size_t len);
+	StringBuilder& append(const String& str);
+	StringBuilder& append(const StringView& str);
+	StringBuilder& append(char c);
+	StringBuilder& append(char c, size_t count);
+
+	StringBuilder& append(int v) { return append((long long)v); }
+	StringBuilder& append(long v) { return append((long long)v); }
+	StringBuilder& append(long long v);
+	StringBuilder& append(unsigned int v) { return append((unsigned long long)v); }
+	StringBuilder& append(unsigned long v) { return append((unsigned long long)v); }
+	StringBuilder& append(unsigned long long v);
+	StringBuilder& append(bool v) { return v ? append("true", 4) : append("false", 5); }
+	/* Shortest representation that reads back to the same value */
+	StringBuilder& append(float v);
+	StringBuilder& append(double v);
+
+	/* Appends v as a JSON string literal, quotes included */
+	StringBuilder& append_json(const char* v);
+
+	/* printf into the builder. Formats directly into chunk memory */
+	StringBuilder& appendf(const char* fmt, ...) STRINGBUILDER_FORMAT(2);
+	StringBuilder& vappendf(const char* fmt, va_list args);
+
+	template <class T> StringBuilder& operator<<(const T& v) { return append(v); }
+	StringBuilder&			  operator<<(const char* v) { return append(v); }
+
+	/* Contiguous copy of the contents */
+	String str() const;
+	/* Copies up to size - 1 bytes into buf and null terminates. Returns the number of bytes copied */
+	size_t CopyTo(char* buf, size_t size) const;
+
+	/* Writes everything out chunk by chunk. Returns false on write errors */
+	bool WriteTo(FILE* fp) const;
+	bool WriteTo(int fd) const;
+
+	/* Calls fn(const char* data, size_t len) for each chunk in order */
+	template <class Fn> void ForEachChunk(Fn fn) const
+	{
+		for (Chunk_t* c = m_head; c; c = c->next)
+		{
+			if (c->used)
+				fn(c->data, c->used);
+		}
+	}
+};
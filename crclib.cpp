@@ -15,6 +15,7 @@ GNU General Public License for more details.
 
 #include "crclib.h"
 #include "crtlib.h"
+#include "containers/mappedbuffer.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -432,3 +433,61 @@ uint COM_HashKey(const char* string, uint hashSize)
 
 	return (hashKey % hashSize);
 }
+
+/*
+=================
+CRC32_File
+
+CRC of a whole file, finalized
+=================
+*/
+bool CRC32_File(dword* pulCRC, const char* path)
+{
+	MappedBuffer file;
+	if (!file.Open(path))
+		return false;
+	file.Advise(EMapAdvice::SEQUENTIAL);
+
+	/* CRC32_ProcessBuffer takes an int length */
+	const byte* data = static_cast<const byte*>(file.data());
+	size_t	    left = (size_t)file.size();
+	CRC32_Init(pulCRC);
+	while (left > 0)
+	{
+		int n = left > (1u << 30) ? (1 << 30) : (int)left;
+		CRC32_ProcessBuffer(pulCRC, data, n);
+		data += n;
+		left -= n;
+	}
+	*pulCRC = CRC32_Final(*pulCRC);
+	return true;
+}
+
+/*
+=================
+MD5_File
+
+MD5 digest of a whole file
+=================
+*/
+bool MD5_File(byte digest[16], const char* path)
+{
+	MappedBuffer file;
+	if (!file.Open(path))
+		return false;
+	file.Advise(EMapAdvice::SEQUENTIAL);
+
+	MD5Context_t ctx;
+	const byte*  data = static_cast<const byte*>(file.data());
+	size_t	     left = (size_t)file.size();
+	MD5Init(&ctx);
+	while (left > 0)
+	{
+		uint n = left > (1u << 30) ? (1u << 30) : (uint)left;
+		MD5Update(&ctx, data, n);
+		data += n;
+		left -= n;
+	}
+	MD5Final(digest, &ctx);
+	return true;
+}
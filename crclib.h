@@ -37,4 +37,8 @@ EXPORT void  MD5Final(byte digest[16], MD5Context_t* ctx);
 EXPORT uint  COM_HashKey(const char* string, uint hashSize);
 EXPORT char* MD5_Print(byte hash[16]);
 
+/* Hash a whole file. The file is memory mapped and hashed in place. Return false if it can't be opened */
+EXPORT bool CRC32_File(dword* pulCRC, const char* path);
+EXPORT bool MD5_File(byte digest[16], const char* path);
+
 #endif // CRCLIB_H
@@ -95,6 +95,25 @@ bool Q_endswith(const char* str, const char* subst)
 	return Q_strncmp(&str[sztr - sz], subst, sz) == 0;
 }
 
+bool Q_startswith(const char* str, size_t len, const char* subst, size_t sublen)
+{
+	return str && subst && StringView(str, len).startswith(StringView(subst, sublen));
+}
+
+bool Q_endswith(const char* str, size_t len, const char* subst, size_t sublen)
+{
+	return str && subst && StringView(str, len).endswith(StringView(subst, sublen));
+}
+
+const char* Q_strnstr(const char* str, size_t len, const char* subst, size_t sublen)
+{
+	if (!str || !subst)
+		return nullptr;
+	StringView view(str, len);
+	size_t	   pos = view.find(StringView(subst, sublen));
+	return pos < len || sublen == 0 ? str + pos : nullptr;
+}
+
 void Q_strnupr(const char* in, char* out, size_t size_out)
 {
 	if (size_out == 0)
@@ -1389,79 +1408,142 @@ bool Q_strbool(const char* str, bool& out)
 	return true;
 }
 
+/* Copies a view into a null terminated, size limited buffer */
+static char* CopyView(const StringView& view, char* out, size_t len)
+{
+	size_t n = view.length() < len ? view.length() : len - 1;
+	memcpy(out, view.data(), n);
+	out[n] = 0;
+	return out;
+}
+
+/* Index of the last path separator in path, or length() if there isn't one */
+static size_t LastPathSeparator(const StringView& path)
+{
+	for (size_t i = path.length(); i > 0; i--)
+	{
+		char c = path[i - 1];
+		if (c == '/' || c == '\\' || c == ':')
+			return i - 1;
+	}
+	return path.length();
+}
+
+/* Index of the dot starting the extension, or length() if there's no extension.
+ * A leading dot in the file name marks a hidden file, not an extension: ".bashrc" and "dir/.vimrc" have none */
+static size_t ExtensionDot(const StringView& path)
+{
+	size_t sep   = LastPathSeparator(path);
+	size_t start = sep == path.length() ? 0 : sep + 1;
+	size_t dot   = path.find_last_of('.');
+	if (dot == path.length() || dot <= start)
+		return path.length();
+	return dot;
+}
+
+StringView Q_FileExtension(const StringView& path)
+{
+	size_t dot = ExtensionDot(path);
+	return path.substr(dot == path.length() ? dot : dot + 1);
+}
+
+StringView Q_FileName(const StringView& path)
+{
+	size_t sep = LastPathSeparator(path);
+	return sep == path.length() ? path : path.substr(sep + 1);
+}
+
+StringView Q_BaseDirectory(const StringView& path)
+{
+	/* The last character is never taken as the separator, so "foo/bar/" gives "foo". Only slashes count, not ':' */
+	for (size_t i = path.length() > 0 ? path.length() - 1 : 0; i > 0; i--)
+	{
+		char c = path[i - 1];
+		if (c == '/' || c == '\\')
+			return path.substr(0, i - 1);
+	}
+	return path.substr(0, 0);
+}
+
+StringView Q_StripExtension(const StringView& path) { return path.substr(0, ExtensionDot(path)); }
+
+/* Runs fn on a null terminated copy of str. Short strings (all sane numbers) are copied onto the stack */
+template <class Fn> static bool WithTerminatedCopy(const char* str, size_t len, Fn fn)
+{
+	if (!str)
+		return false;
+	char  buf[128];
+	char* p = len < sizeof(buf) ? buf : static_cast<char*>(malloc(len + 1));
+	memcpy(p, str, len);
+	p[len]	 = 0;
+	bool ret = fn(p);
+	if (p != buf)
+		free(p);
+	return ret;
+}
+
+bool Q_strint(const char* str, size_t len, int& out, int base)
+{
+	return WithTerminatedCopy(str, len, [&](const char* s) { return Q_strint(s, out, base); });
+}
+
+bool Q_strfloat(const char* str, size_t len, float& out)
+{
+	return WithTerminatedCopy(str, len, [&](const char* s) { return Q_strfloat(s, out); });
+}
+
+bool Q_strdouble(const char* str, size_t len, double& out)
+{
+	return WithTerminatedCopy(str, len, [&](const char* s) { return Q_strdouble(s, out); });
+}
+
+bool Q_strlong(const char* str, size_t len, long long& out, int base)
+{
+	return WithTerminatedCopy(str, len, [&](const char* s) { return Q_strlong(s, out, base); });
+}
+
+bool Q_strbool(const char* str, size_t len, bool& out)
+{
+	if (!str)
+		return false;
+	StringView view(str, len);
+	out = !(view.iequals("FALSE") || view.equals("0"));
+	return true;
+}
+
 char* Q_FileExtension(const char* s, char* out, size_t len)
 {
 	if (!s || !out || len == 0)
 		return nullptr;
-	const char* ext	 = COM_FileExtension(s);
-	size_t	    _len = Q_strlen(ext);
-	_len		 = _len > len ? len : _len;
-	memcpy(out, ext, _len);
-	if (_len != len)
-		out[_len] = 0;
-	else
-		out[_len - 1] = 0;
-	return out;
+	return CopyView(Q_FileExtension(StringView(s)), out, len);
 }
 
 char* Q_FileName(const char* s, char* out, size_t len)
 {
 	if (!s || !out || len == 0)
 		return nullptr;
-	const char* file = COM_FileWithoutPath(s);
-	size_t	    _len = Q_strlen(file);
-	_len		 = _len > len ? len : _len;
-	memcpy(out, file, _len);
-	if (_len != len)
-		out[_len] = 0;
-	else
-		out[_len - 1] = 0;
-	return out;
+	return CopyView(Q_FileName(StringView(s)), out, len);
 }
 
 char* Q_BaseDirectory(const char* path, char* dest, size_t len)
 {
-	const char* src = path + strlen(path) - 1;
-
-	// back up until a \ or the start
-	while (src != path && !(*(src - 1) == '\\' || *(src - 1) == '/'))
-		src--;
-
-	if (src != path)
-	{
-		size_t max = src - path;
-		memcpy(dest, path, max > len ? len : max);
-		dest[src - path - 1] = 0; // cutoff backslash
-	}
-	else
-		strncpy(dest, "", len);
-	return dest;
+	if (!path || !dest || len == 0)
+		return nullptr;
+	return CopyView(Q_BaseDirectory(StringView(path)), dest, len);
 }
 
 char* Q_StripExtension(const char* s, char* out, size_t len)
 {
 	if (!s || !out || len == 0)
 		return nullptr;
-	size_t _len = Q_strlen(s);
-	_len	    = _len > len ? len : _len;
-	memcpy(out, s, _len);
-	COM_StripExtension(out);
-	return out;
+	return CopyView(Q_StripExtension(StringView(s)), out, len);
 }
 
 char* Q_StripDirectory(const char* s, char* out, size_t len)
 {
 	if (!s || !out || len == 0)
 		return nullptr;
-	const char* file = COM_FileWithoutPath(s);
-	size_t	    _len = Q_strlen(s);
-	_len		 = _len > len ? len : _len;
-	memcpy(out, file, _len);
-	if (_len != len)
-		out[_len] = 0;
-	else
-		out[_len - 1] - 0;
-	return out;
+	return CopyView(Q_FileName(StringView(s)), out, len);
 }
 
 char* Q_FixSlashes(const char* s, char* out, size_t len)
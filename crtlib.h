@@ -170,6 +170,13 @@ EXPORT bool Q_strdouble(const char* str, double& out);
 EXPORT bool Q_strlong(const char* str, long long& out, int base = 10);
 EXPORT bool Q_strbool(const char* str, bool& out);
 
+/* Length-taking versions for strings that aren't null terminated, e.g. StringView slices */
+EXPORT bool Q_strint(const char* str, size_t len, int& out, int base = 10);
+EXPORT bool Q_strfloat(const char* str, size_t len, float& out);
+EXPORT bool Q_strdouble(const char* str, size_t len, double& out);
+EXPORT bool Q_strlong(const char* str, size_t len, long long& out, int base = 10);
+EXPORT bool Q_strbool(const char* str, size_t len, bool& out);
+
 /* Path operations */
 EXPORT char* Q_FileExtension(const char* s, char* out, size_t len);
 EXPORT char* Q_FileName(const char* s, char* out, size_t len);
@@ -181,8 +188,18 @@ EXPORT char* Q_FixSlashesInPlace(char* s);
 EXPORT String& Q_FixSlashesInPlace(String& s);
 EXPORT char*   Q_MakeAbsolute(const char* s, char* out, size_t len);
 
+/* Path operations on views. The result is a slice of path, nothing is copied */
+EXPORT StringView Q_FileExtension(const StringView& path);
+EXPORT StringView Q_FileName(const StringView& path);
+EXPORT StringView Q_BaseDirectory(const StringView& path);
+EXPORT StringView Q_StripExtension(const StringView& path);
+
 EXPORT bool Q_startswith(const char* string, const char* startingString);
 EXPORT bool Q_endswith(const char* str, const char* subst);
+EXPORT bool Q_startswith(const char* str, size_t len, const char* subst, size_t sublen);
+EXPORT bool Q_endswith(const char* str, size_t len, const char* subst, size_t sublen);
+/* Q_strstr for strings that aren't null terminated. Returns nullptr if subst isn't in the first len characters */
+EXPORT const char* Q_strnstr(const char* str, size_t len, const char* subst, size_t sublen);
 
 /* Other C std functions which might not be portable */
 EXPORT char* Q_getcwd(char* buf, size_t sz);
@@ -18,6 +18,7 @@ GNU General Public License for more details.
 #include "threadtools.h"
 #include "crtlib.h"
 #include "containers/array.h"
+#include "containers/concurrenthashmap.h"
 #include "cmdline.h"
 
 #include <signal.h>
@@ -26,8 +27,29 @@ GNU General Public License for more details.
 
 using namespace dbg;
 
-/* TODO: Organize this by file to speed up searches */
-Array<CAssert>* g_passertions = nullptr;
+/* Asserts are looked up by file and line without locking. Entries are never freed, so the pointers stay valid */
+struct AssertKey_t
+{
+	const char* file;
+	int	    line;
+};
+
+struct AssertKeyHash
+{
+	size_t operator()(const AssertKey_t& k) const
+	{
+		return (size_t)(HashBytes(k.file, Q_strlen(k.file)) ^ ((unsigned long long)k.line * 0x9E3779B97F4A7C15ULL));
+	}
+};
+
+struct AssertKeyEqual
+{
+	bool operator()(const AssertKey_t& a, const AssertKey_t& b) const { return a.line == b.line && Q_strcmp(a.file, b.file) == 0; }
+};
+
+/* Creation order, for GetAssertList. Only touched with g_passert_mutex held */
+Array<CAssert*>* g_passertions = nullptr;
+ConcurrentHashMap<AssertKey_t, CAssert*, AssertKeyHash, AssertKeyEqual>* g_passertindex = nullptr;
 
 CThreadMutex* g_passert_mutex = nullptr;
 
@@ -58,7 +80,9 @@ static void DbgInit()
 	if (!g_passert_mutex)
 		g_passert_mutex = new CThreadMutex();
 	if (!g_passertions)
-		g_passertions = new Array<CAssert>();
+		g_passertions = new Array<CAssert*>();
+	if (!g_passertindex)
+		g_passertindex = new ConcurrentHashMap<AssertKey_t, CAssert*, AssertKeyHash, AssertKeyEqual>();
 	binit = true;
 }
 
@@ -75,36 +99,30 @@ static const char* _CleanName(const char* file)
 	return file;
 }
 
-/* Internal functions (No locking done) */
-static CAssert& _FindOrCreateAssert(const char* file, int line, const char* exp)
+/* Lock-free, but the returned assert's fields may only be touched with g_passert_mutex held */
+static CAssert* _FindAssert(const char* file, int line)
 {
-	const char* cleanName = _CleanName(file);
-	for (auto& x : *g_passertions)
-	{
-		if (Q_strcmp(cleanName, x.File()) == 0 && line == x.m_line)
-			return x;
-	}
-	CAssert assert(line, _CleanName(file), "");
-	g_passertions->push_back(assert);
-	return (*g_passertions)[g_passertions->size() - 1];
+	CAssert* ass;
+	return g_passertindex->find(AssertKey_t{_CleanName(file), line}, ass) ? ass : nullptr;
 }
 
+/* Internal functions (g_passert_mutex must be held) */
 static CAssert& _CreateAssert(const char* file, int line, const char* exp)
 {
-	CAssert assert(line, _CleanName(file), exp);
-	g_passertions->push_back(assert);
-	return (*g_passertions)[g_passertions->size() - 1];
+	/* Asserts are unique per file/line. A second registration gets the existing one */
+	CAssert* ass = _FindAssert(file, line);
+	if (ass)
+		return *ass;
+	ass = new CAssert(line, _CleanName(file), exp);
+	g_passertions->push_back(ass);
+	g_passertindex->insert(AssertKey_t{ass->File(), line}, ass);
+	return *ass;
 }
 
-static CAssert* _FindAssert(const char* file, int line)
+static CAssert& _FindOrCreateAssert(const char* file, int line, const char* exp)
 {
-	const char* cleanName = _CleanName(file);
-	for (auto& x : *g_passertions)
-	{
-		if (Q_strcmp(cleanName, x.m_file) == 0 && x.m_line == line)
-			return &x;
-	}
-	return nullptr;
+	CAssert* ass = _FindAssert(file, line);
+	return ass ? *ass : _CreateAssert(file, line, "");
 }
 
 CAssert dbg::FindOrCreateAssert(const char* file, int line, const char* exp)
@@ -117,41 +135,40 @@ CAssert dbg::FindOrCreateAssert(const char* file, int line, const char* exp)
 void dbg::DisableAssert(const char* file, int line)
 {
 	DbgInit();
-	auto lock = g_passert_mutex->RAIILock();
-
 	CAssert* ass = _FindAssert(file, line);
-	if (ass)
-		ass->m_ignored = true;
+	if (!ass)
+		return;
+	auto lock = g_passert_mutex->RAIILock();
+	ass->m_ignored = true;
 }
 
 void dbg::EnableAssert(const char* file, int line)
 {
 	DbgInit();
-	auto lock = g_passert_mutex->RAIILock();
-
 	CAssert* ass = _FindAssert(file, line);
-	if (ass)
-		ass->m_ignored = false;
+	if (!ass)
+		return;
+	auto lock = g_passert_mutex->RAIILock();
+	ass->m_ignored = false;
 }
 
 CAssert dbg::FindAssert(const char* file, int line)
 {
 	DbgInit();
-	auto	 lock = g_passert_mutex->RAIILock();
-	CAssert* ass  = _FindAssert(file, line);
+	CAssert* ass = _FindAssert(file, line);
 	if (!ass)
 		return CAssert(0, "", "");
+	auto lock = g_passert_mutex->RAIILock();
 	return *ass;
 }
 
 bool dbg::IsAssertEnabled(const char* file, int line)
 {
 	DbgInit();
-	auto lock = g_passert_mutex->RAIILock();
-
 	CAssert* ass = _FindAssert(file, line);
 	if (!ass)
 		return false;
+	auto lock = g_passert_mutex->RAIILock();
 	return !ass->m_ignored;
 }
 
@@ -206,11 +223,10 @@ void dbg::UnBreakAssert(const char* file, int line)
 bool dbg::WasAssertHit(const char* file, int line)
 {
 	DbgInit();
-	auto lock = g_passert_mutex->RAIILock();
-
 	CAssert* ass = _FindAssert(file, line);
 	if (!ass)
 		return false;
+	auto lock = g_passert_mutex->RAIILock();
 	return ass->m_timesHit != 0;
 }
 
@@ -218,7 +234,12 @@ Array<CAssert> dbg::GetAssertList()
 {
 	DbgInit();
 	auto lock = g_passert_mutex->RAIILock();
-	return *g_passertions;
+
+	Array<CAssert> list;
+	list.reserve(g_passertions->size());
+	for (auto ass : *g_passertions)
+		list.push_back(*ass);
+	return list;
 }
 
 void dbg::EnableAssertBreak() { g_asserts_break = true; }
@@ -0,0 +1,596 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#include "fiber.h"
+#include "threadpool.h"
+#include "static_helpers.h"
+
+#ifdef _WIN32
+#include "winplatform.h"
+#include <io.h>
+#else
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <algorithm>
+
+enum class EFiberState
+{
+	READY = 0,
+	RUNNING,
+	PARKED,	 /* Waiting on something that will call Wake */
+	YIELDED, /* Wants to go to the back of the run queue */
+	FINISHED,
+};
+
+class CFiber
+{
+public:
+	CFiberScheduler*	   sched;
+	CFiberScheduler::FiberFn_t fn;
+	EFiberState		   state;
+
+	/* Called by the worker once the fiber is fully switched out. Used to drop the lock that guards the wait list,
+	 * so nobody can try to resume the fiber while it's still running on its old stack */
+	void (*parkUnlock)(void*);
+	void* parkArg;
+
+#ifdef _WIN32
+	void* handle;
+#else
+	ucontext_t ctx;
+	void*	   stack;
+	size_t	   stackSize;
+#endif
+};
+
+struct FiberWorker_t
+{
+	CFiberScheduler* sched;
+	CFiber*		 current;
+#ifdef _WIN32
+	void* handle;
+#else
+	ucontext_t ctx;
+#endif
+};
+
+static thread_local FiberWorker_t* s_fiberWorker = nullptr;
+
+/* Fibers can resume on another thread, so the TLS slot has to be looked up again after every switch.
+ * Keeping this out of line stops the compiler from caching the TLS address across a context switch */
+#ifdef _MSC_VER
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+static FiberWorker_t* CurrentWorker()
+{
+	return s_fiberWorker;
+}
+
+static CFiber* CurrentFiber()
+{
+	FiberWorker_t* worker = CurrentWorker();
+	return worker ? worker->current : nullptr;
+}
+
+static unsigned long long SteadyNowNs()
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void UnlockStdMutex(void* mutex) { static_cast<std::mutex*>(mutex)->unlock(); }
+
+/* Switches from the running fiber back to its worker */
+static void SwitchToWorker(CFiber* fiber)
+{
+	FiberWorker_t* worker = CurrentWorker();
+#ifdef _WIN32
+	SwitchToFiber(worker->handle);
+#else
+	swapcontext(&fiber->ctx, &worker->ctx);
+#endif
+}
+
+/* Suspends the running fiber. unlock(arg) is called once it's switched out */
+static void Park(void (*unlock)(void*), void* arg)
+{
+	CFiber* fiber	   = CurrentFiber();
+	fiber->parkUnlock  = unlock;
+	fiber->parkArg	   = arg;
+	fiber->state	   = EFiberState::PARKED;
+	SwitchToWorker(fiber);
+}
+
+#ifdef _WIN32
+static void WINAPI FiberEntry(void*)
+#else
+static void FiberEntry()
+#endif
+{
+	CFiber* fiber = CurrentFiber();
+	fiber->fn();
+	fiber->fn    = nullptr;
+	fiber->state = EFiberState::FINISHED;
+	SwitchToWorker(fiber);
+}
+
+static CFiber* CreateFiberObject(CFiberScheduler* sched, CFiberScheduler::FiberFn_t&& fn, size_t stackSize)
+{
+	CFiber* fiber	  = new CFiber();
+	fiber->sched	  = sched;
+	fiber->fn	  = std::move(fn);
+	fiber->state	  = EFiberState::READY;
+	fiber->parkUnlock = nullptr;
+	fiber->parkArg	  = nullptr;
+#ifdef _WIN32
+	fiber->handle = CreateFiber(stackSize, FiberEntry, nullptr);
+	if (!fiber->handle)
+	{
+		delete fiber;
+		return nullptr;
+	}
+#else
+	/* Stacks get a guard page at the bottom so an overflow faults instead of trashing the heap */
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	stackSize   = ((stackSize + page - 1) / page) * page + page;
+	void* stack = mmap(nullptr, stackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (stack == MAP_FAILED)
+	{
+		delete fiber;
+		return nullptr;
+	}
+	mprotect(stack, page, PROT_NONE);
+
+	fiber->stack	 = stack;
+	fiber->stackSize = stackSize;
+	getcontext(&fiber->ctx);
+	fiber->ctx.uc_stack.ss_sp   = stack;
+	fiber->ctx.uc_stack.ss_size = stackSize;
+	fiber->ctx.uc_link	    = nullptr;
+	makecontext(&fiber->ctx, FiberEntry, 0);
+#endif
+	return fiber;
+}
+
+static void DestroyFiberObject(CFiber* fiber)
+{
+#ifdef _WIN32
+	DeleteFiber(fiber->handle);
+#else
+	munmap(fiber->stack, fiber->stackSize);
+#endif
+	delete fiber;
+}
+
+//===========================================
+//
+//      CFiberScheduler
+//
+//===========================================
+
+CFiberScheduler::CFiberScheduler(int numThreads, int numIoThreads) : m_shutdown(false), m_liveFibers(0)
+{
+	if (numThreads <= 0)
+		numThreads = threadtools::GetCPUCount();
+	if (numThreads < 1)
+		numThreads = 1;
+
+	m_ioPool = new CThreadPool(numIoThreads > 0 ? numIoThreads : 1, "fiberio");
+
+	for (int i = 0; i < numThreads; i++)
+	{
+		char threadName[64];
+		snprintf(threadName, sizeof(threadName), "fiber%d", i);
+
+		ThreadOptions_t opts;
+		opts.name = threadName;
+
+		CThread* thread = new CThread(WorkerThread, opts);
+		if (!thread->Run(this))
+		{
+			delete thread;
+			continue;
+		}
+		m_threads.push_back(thread);
+	}
+}
+
+/* NOTE: Fibers that are still suspended when the scheduler goes away are leaked */
+CFiberScheduler::~CFiberScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+	}
+	m_cond.notify_all();
+
+	for (auto thread : m_threads)
+	{
+		thread->Join();
+		delete thread;
+	}
+	m_threads.clear();
+
+	delete m_ioPool;
+}
+
+void* CFiberScheduler::WorkerThread(void* sched)
+{
+	static_cast<CFiberScheduler*>(sched)->WorkerLoop();
+	return nullptr;
+}
+
+void CFiberScheduler::WorkerLoop()
+{
+	FiberWorker_t worker;
+	worker.sched   = this;
+	worker.current = nullptr;
+#ifdef _WIN32
+	worker.handle = ConvertThreadToFiber(nullptr);
+#endif
+	s_fiberWorker = &worker;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		FireTimers(SteadyNowNs());
+
+		if (!m_runQueue.empty())
+		{
+			CFiber* fiber = m_runQueue.front();
+			m_runQueue.pop_front();
+			lock.unlock();
+
+			worker.current = fiber;
+			fiber->state   = EFiberState::RUNNING;
+#ifdef _WIN32
+			SwitchToFiber(fiber->handle);
+#else
+			swapcontext(&worker.ctx, &fiber->ctx);
+#endif
+			worker.current = nullptr;
+
+			switch (fiber->state)
+			{
+			case EFiberState::FINISHED:
+				DestroyFiberObject(fiber);
+				lock.lock();
+				if (--m_liveFibers == 0)
+					m_idleCond.notify_all();
+				continue;
+			case EFiberState::PARKED:
+			{
+				/* Must not touch the fiber after this, someone else may already be resuming it */
+				void (*unlock)(void*) = fiber->parkUnlock;
+				void* arg	      = fiber->parkArg;
+				if (unlock)
+					unlock(arg);
+				break;
+			}
+			case EFiberState::YIELDED:
+			default:
+				lock.lock();
+				fiber->state = EFiberState::READY;
+				m_runQueue.push_back(fiber);
+				continue;
+			}
+			lock.lock();
+			continue;
+		}
+
+		if (m_shutdown)
+			break;
+
+		if (!m_timers.empty())
+		{
+			unsigned long long now	    = SteadyNowNs();
+			unsigned long long deadline = m_timers.front().deadline;
+			if (deadline > now)
+				m_cond.wait_for(lock, std::chrono::nanoseconds(deadline - now));
+		}
+		else
+			m_cond.wait(lock);
+	}
+
+	s_fiberWorker = nullptr;
+#ifdef _WIN32
+	ConvertFiberToThread();
+#endif
+}
+
+bool CFiberScheduler::TimerLater(const Timer_t& a, const Timer_t& b) { return a.deadline > b.deadline; }
+
+void CFiberScheduler::PushTimer(unsigned long long deadline, CFiber* fiber)
+{
+	m_timers.push_back({deadline, fiber});
+	std::push_heap(m_timers.begin(), m_timers.end(), TimerLater);
+}
+
+void CFiberScheduler::FireTimers(unsigned long long now)
+{
+	while (!m_timers.empty() && m_timers.front().deadline <= now)
+	{
+		std::pop_heap(m_timers.begin(), m_timers.end(), TimerLater);
+		CFiber* fiber = m_timers.back().fiber;
+		m_timers.pop_back();
+		fiber->state = EFiberState::READY;
+		m_runQueue.push_back(fiber);
+	}
+}
+
+void CFiberScheduler::Spawn(FiberFn_t fn, size_t stackSize)
+{
+	CFiber* fiber = CreateFiberObject(this, std::move(fn), stackSize ? stackSize : FIBER_DEFAULT_STACK_SIZE);
+	if (!fiber)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_liveFibers++;
+		m_runQueue.push_back(fiber);
+	}
+	m_cond.notify_one();
+}
+
+void CFiberScheduler::Wake(CFiber* fiber)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		fiber->state = EFiberState::READY;
+		m_runQueue.push_back(fiber);
+	}
+	m_cond.notify_one();
+}
+
+void CFiberScheduler::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idleCond.wait(lock, [this]() { return m_liveFibers == 0; });
+}
+
+int CFiberScheduler::NumLiveFibers()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_liveFibers;
+}
+
+void FiberSleepInternal(CFiberScheduler& sched, unsigned long long ms)
+{
+	sched.m_mutex.lock();
+	/* No need to notify, this worker re-checks the timers as soon as we're switched out */
+	sched.PushTimer(SteadyNowNs() + ms * 1000000ULL, CurrentFiber());
+	Park(UnlockStdMutex, &sched.m_mutex);
+}
+
+//===========================================
+//
+//      CFiberSemaphore
+//
+//===========================================
+
+void CFiberSemaphore::Wait()
+{
+	if (!fiber::InFiber())
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cond.wait(lock, [this]() { return m_count > 0; });
+		m_count--;
+		return;
+	}
+
+	m_mutex.lock();
+	if (m_count > 0)
+	{
+		m_count--;
+		m_mutex.unlock();
+		return;
+	}
+	/* Signal hands the count straight to us, so there's nothing to do after waking */
+	m_waiters.push_back(CurrentFiber());
+	Park(UnlockStdMutex, &m_mutex);
+}
+
+bool CFiberSemaphore::TryWait()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_count <= 0)
+		return false;
+	m_count--;
+	return true;
+}
+
+void CFiberSemaphore::Signal(int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		CFiber* waiter = nullptr;
+		m_mutex.lock();
+		if (!m_waiters.empty())
+		{
+			waiter = m_waiters.front();
+			m_waiters.pop_front();
+		}
+		else
+		{
+			m_count++;
+			m_cond.notify_one();
+		}
+		m_mutex.unlock();
+
+		if (waiter)
+			waiter->sched->Wake(waiter);
+	}
+}
+
+//===========================================
+//
+//      CFiberEvent
+//
+//===========================================
+
+void CFiberEvent::Wait()
+{
+	if (!fiber::InFiber())
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cond.wait(lock, [this]() { return m_set; });
+		return;
+	}
+
+	m_mutex.lock();
+	if (m_set)
+	{
+		m_mutex.unlock();
+		return;
+	}
+	m_waiters.push_back(CurrentFiber());
+	Park(UnlockStdMutex, &m_mutex);
+}
+
+void CFiberEvent::Set()
+{
+	std::deque<CFiber*> waiters;
+	m_mutex.lock();
+	m_set = true;
+	waiters.swap(m_waiters);
+	/* Notify under the lock: a waiter is allowed to destroy the event as soon as it wakes */
+	m_cond.notify_all();
+	m_mutex.unlock();
+
+	for (auto waiter : waiters)
+		waiter->sched->Wake(waiter);
+}
+
+void CFiberEvent::Reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_set = false;
+}
+
+bool CFiberEvent::IsSet()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_set;
+}
+
+//===========================================
+//
+//      fiber:: helpers
+//
+//===========================================
+
+bool fiber::InFiber() { return CurrentFiber() != nullptr; }
+
+void fiber::Yield()
+{
+	CFiber* fiber = CurrentFiber();
+	if (!fiber)
+		return;
+	fiber->state = EFiberState::YIELDED;
+	SwitchToWorker(fiber);
+}
+
+void fiber::Sleep(unsigned long long ms)
+{
+	CFiber* fiber = CurrentFiber();
+	if (!fiber)
+	{
+		threadtools::sleep(ms);
+		return;
+	}
+	FiberSleepInternal(*fiber->sched, ms);
+}
+
+void fiber::Await(const std::function<void()>& blockingFn)
+{
+	CFiber* fiber = CurrentFiber();
+	if (!fiber)
+	{
+		blockingFn();
+		return;
+	}
+
+	/* Both of these live on the fiber's stack, which stays put while we're parked */
+	CFiberEvent done;
+	fiber->sched->IOPool().Submit(
+		[&blockingFn, &done]()
+		{
+			blockingFn();
+			done.Set();
+		});
+	done.Wait();
+}
+
+long long fiber::Read(int fd, void* buf, size_t size, long long offset)
+{
+	long long result = -1;
+	fiber::Await(
+		[&]()
+		{
+#ifdef _WIN32
+			if (_lseeki64(fd, offset, SEEK_SET) < 0)
+				return;
+			result = _read(fd, buf, (unsigned int)size);
+#else
+			result = pread(fd, buf, size, (off_t)offset);
+#endif
+		});
+	return result;
+}
+
+bool fiber::ReadFile(const char* path, Array<char>& out)
+{
+	bool ok = false;
+	fiber::Await(
+		[&]()
+		{
+			FILE* fp = fopen(path, "rb");
+			if (!fp)
+				return;
+			fseek(fp, 0, SEEK_END);
+			long size = ftell(fp);
+			fseek(fp, 0, SEEK_SET);
+			if (size >= 0)
+			{
+				out.resize((size_t)size);
+				ok = fread(out.data(), 1, (size_t)size, fp) == (size_t)size;
+			}
+			fclose(fp);
+		});
+	return ok;
+}
+
+//===========================================
+//
+//      Global scheduler
+//
+//===========================================
+
+static CFiberScheduler* g_pFiberScheduler = nullptr;
+
+CFiberScheduler& GlobalFiberScheduler()
+{
+	static std::once_flag once;
+	std::call_once(once, []() { g_pFiberScheduler = new CFiberScheduler(); });
+	return *g_pFiberScheduler;
+}
+
+static void KillFiberScheduler() { delete g_pFiberScheduler; }
+
+static CStaticDestructionWrapper<KillFiberScheduler> g_fiberSchedulerKiller;
@@ -0,0 +1,169 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * fiber.h
+ * 	Lightweight user-mode tasks (fibers) scheduled on a small set of worker threads
+ *
+ * A fiber is a function with its own stack. When it waits on one of the primitives below it is
+ * switched out and the worker thread goes on to run something else, so thousands of fibers can be
+ * blocked on long-latency operations without tying up thousands of OS threads.
+ * Fibers may resume on a different worker than the one they were suspended on.
+ *
+ * Backends: ucontext on POSIX, the Win32 fiber API on Windows.
+ *
+ * USAGE:
+ * 	GlobalFiberScheduler().Spawn([]() {
+ * 		Array<char> data;
+ * 		if (fiber::ReadFile("config.kv", data))
+ * 			...
+ * 		fiber::Sleep(100);
+ * 	});
+ */
+#pragma once
+
+#include "public.h"
+#include "threadtools.h"
+#include "containers/array.h"
+
+#undef min
+#undef max
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/* Default stack size for new fibers */
+#define FIBER_DEFAULT_STACK_SIZE (64 * 1024)
+
+class CFiber;
+class CThreadPool;
+
+class EXPORT CFiberScheduler
+{
+public:
+	typedef std::function<void()> FiberFn_t;
+
+private:
+	struct Timer_t
+	{
+		unsigned long long deadline; /* ns, steady clock */
+		CFiber*		   fiber;
+	};
+
+	Array<CThread*>		m_threads;
+	std::deque<CFiber*>	m_runQueue;
+	Array<Timer_t>		m_timers; /* Min-heap on deadline */
+	std::mutex		m_mutex;
+	std::condition_variable m_cond;
+	std::condition_variable m_idleCond;
+	bool			m_shutdown;
+	int			m_liveFibers;
+	CThreadPool*		m_ioPool;
+
+	static bool  TimerLater(const Timer_t& a, const Timer_t& b);
+	static void* WorkerThread(void* sched);
+	void	     WorkerLoop();
+	void	     PushTimer(unsigned long long deadline, CFiber* fiber);
+	void	     FireTimers(unsigned long long now);
+
+	friend class CFiber;
+	friend void  FiberSleepInternal(CFiberScheduler& sched, unsigned long long ms);
+
+public:
+	/* numThreads <= 0 picks one worker per CPU. numIoThreads is the number of threads used for blocking I/O */
+	explicit CFiberScheduler(int numThreads = 0, int numIoThreads = 2);
+	~CFiberScheduler();
+
+	CFiberScheduler(const CFiberScheduler&) = delete;
+	CFiberScheduler(CFiberScheduler&&)	= delete;
+
+	/* Starts a new fiber running fn */
+	void Spawn(FiberFn_t fn, size_t stackSize = FIBER_DEFAULT_STACK_SIZE);
+
+	/* Makes a suspended fiber runnable again. Used by the wait primitives */
+	void Wake(CFiber* fiber);
+
+	/* Blocks the calling OS thread until every fiber has finished. Must not be called from a fiber */
+	void WaitIdle();
+
+	/* Pool used by fiber::Await to run blocking work */
+	CThreadPool& IOPool() { return *m_ioPool; }
+
+	int NumThreads() const { return (int)m_threads.size(); }
+	int NumLiveFibers();
+};
+
+/**
+ * Counting semaphore. Fibers that wait are suspended, plain threads block
+ */
+class EXPORT CFiberSemaphore
+{
+private:
+	std::mutex		m_mutex;
+	std::condition_variable m_cond;
+	std::deque<CFiber*>	m_waiters;
+	int			m_count;
+
+public:
+	explicit CFiberSemaphore(int initial = 0) : m_count(initial) {}
+
+	void Wait();
+	bool TryWait();
+	void Signal(int count = 1);
+};
+
+/**
+ * Manual-reset event. Wait returns immediately while the event is set
+ */
+class EXPORT CFiberEvent
+{
+private:
+	std::mutex		m_mutex;
+	std::condition_variable m_cond;
+	std::deque<CFiber*>	m_waiters;
+	bool			m_set;
+
+public:
+	explicit CFiberEvent(bool set = false) : m_set(set) {}
+
+	void Wait();
+	void Set();
+	void Reset();
+	bool IsSet();
+};
+
+namespace fiber
+{
+/* Returns true if the caller is running inside a fiber */
+EXPORT bool InFiber();
+
+/* Lets other fibers run. No-op outside of a fiber */
+EXPORT void Yield();
+
+/* Suspends the fiber for at least ms milliseconds. Outside of a fiber this just sleeps the thread */
+EXPORT void Sleep(unsigned long long ms);
+
+/* Runs a blocking function on the scheduler's I/O pool and suspends the fiber until it returns.
+ * Outside of a fiber the function is just called directly */
+EXPORT void Await(const std::function<void()>& blockingFn);
+
+/* Reads up to size bytes from fd at offset. Returns the number of bytes read or -1 on error */
+EXPORT long long Read(int fd, void* buf, size_t size, long long offset);
+
+/* Reads a whole file into out. Returns false if the file could not be read */
+EXPORT bool ReadFile(const char* path, Array<char>& out);
+} // namespace fiber
+
+/* Scheduler shared by everything in libpublic. Created on first use */
+EXPORT CFiberScheduler& GlobalFiberScheduler();
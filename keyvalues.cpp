@@ -24,13 +24,15 @@ GNU General Public License for more details.
 #include "xprof.h"
 #include "public.h"
 #include "crtlib.h"
+#include "containers/stringbuilder.h"
+#include "containers/mappedbuffer.h"
 
 inline bool _internal_isspace(char c) { return (c == ' ' || c == '\t' || c == '\n' || c == '\r'); }
 
 KeyValues::KeyValues(const KeyValues& kv)
 {
 	this->child_sections = kv.child_sections;
-	this->name	     = Q_strdup(kv.name);
+	this->name	     = kv.name;
 	this->good	     = kv.good;
 	this->quoted	     = kv.quoted;
 	this->keys	     = kv.keys;
@@ -45,25 +47,22 @@ KeyValues::KeyValues(KeyValues&& kv)
 	this->keys	     = kv.keys;
 	kv.keys.clear();
 	kv.child_sections.clear();
-	kv.name	  = nullptr;
+	kv.name	  = InternedString();
 	kv.quoted = false;
 	kv.good	  = false;
 }
 
 KeyValues::KeyValues(const char* name) : pCallback(NULL)
 {
-	this->name = Q_strdup(name);
+	this->name = InternedString(name);
 	this->keys.reserve(10);
 	this->quoted = false;
 }
 
-KeyValues::KeyValues() : pCallback(NULL), name(nullptr), quoted(false) { this->keys.reserve(10); }
+KeyValues::KeyValues() : pCallback(NULL), quoted(false) { this->keys.reserve(10); }
 
 KeyValues::~KeyValues()
 {
-	if (this->name)
-		Q_free(name);
-
 	/* Free the keys */
 	for (auto key : this->keys)
 	{
@@ -109,29 +108,16 @@ void KeyValues::ParseFile(const char* file, bool use_escape_codes)
 {
 	XPROF_NODE(XPROF_CATEGORY_KVPARSE);
 
-	FILE* fs = fopen(file, "r");
-	if (!fs)
+	/* Parse straight out of the mapped file, ParseString is bounded by the length so no terminator is needed */
+	MappedBuffer fs;
+	if (!fs.Open(file))
 	{
 		this->good = false;
 		return;
 	}
+	fs.Advise(EMapAdvice::SEQUENTIAL);
 
-	/* Get file size */
-	fseek(fs, 0, SEEK_END);
-	long int size = ftell(fs);
-
-	/* Read the entire file */
-	char* buffer = static_cast<char*>(Q_malloc(size + 1));
-	memset(buffer, 0, size);
-	fseek(fs, 0, SEEK_SET);
-	fread(buffer, size, 1, fs);
-	fclose(fs);
-	buffer[size] = 0;
-
-	this->ParseString(buffer, use_escape_codes, size);
-
-	/* Free the allocated buffer */
-	Q_free(buffer);
+	this->ParseString(static_cast<const char*>(fs.data()), use_escape_codes, fs.size());
 }
 
 void KeyValues::ParseString(const char* string, bool escape, long long len)
@@ -339,39 +325,43 @@ void KeyValues::DumpToStream(FILE* fs) { this->DumpToStreamInternal(fs, 0); }
 
 void KeyValues::DumpToStreamInternal(FILE* fs, int indent)
 {
-	/* Ensure indent < 128 or fail */
-	if (!fs || indent >= 127)
+	if (!fs)
 		return;
 
-	char buf[128];
-	for (int i = 0; i < indent; i++)
-		buf[i] = '\t';
-	buf[indent] = 0;
+	/* Built in memory and written out in one go, rather than one fprintf per key */
+	StringBuilder sb;
+	this->DumpToBuilder(sb, indent);
+	sb.WriteTo(fs);
+}
+
+void KeyValues::DumpToBuilder(StringBuilder& sb, int indent)
+{
+	int inner = indent;
 	if (this->name)
 	{
+		sb.append('\t', indent);
 		if (this->quoted)
-			fprintf(fs, "%s\"%s\"\n%s{\n", buf, this->name, buf);
+			sb.append('"').append(this->name.c_str(), this->name.length()).append('"');
 		else
-			fprintf(fs, "%s%s\n%s{\n", buf, this->name, buf);
-		buf[indent]	= '\t';
-		buf[indent + 1] = 0;
+			sb.append(this->name.c_str(), this->name.length());
+		sb.append('\n').append('\t', indent).append("{\n", 2);
+		inner++;
 	}
 
-	for (auto key : this->keys)
+	for (auto& key : this->keys)
 	{
+		sb.append('\t', inner);
 		if (key.quoted)
-			fprintf(fs, "%s\"%s\" \"%s\"\n", buf, key.key, key.value);
+			sb.append('"').append(key.key).append("\" \"", 3);
 		else
-			fprintf(fs, "%s%s \"%s\"\n", buf, key.key, key.value);
+			sb.append(key.key).append(" \"", 2);
+		sb.append(key.value).append("\"\n", 2);
 	}
 	for (auto section : this->child_sections)
-	{
-		section->DumpToStreamInternal(fs, indent + 1);
-	}
+		section->DumpToBuilder(sb, indent + 1);
 
-	buf[indent] = 0;
 	if (this->name)
-		fprintf(fs, "%s}\n", buf);
+		sb.append('\t', indent).append("}\n", 2);
 }
 
 bool KeyValues::GetBool(const char* key, bool _default)
@@ -543,12 +533,14 @@ double KeyValues::key_t::ReadFloat(bool& ok)
 
 KeyValues* KeyValues::GetChild(const char* name)
 {
+	/* A name that was never interned can't be the name of any section */
+	InternedString key = InternedString::Find(name);
+	if (!key)
+		return nullptr;
 	for (auto _child : this->child_sections)
 	{
-		if (_child->name && Q_strcmp(name, _child->name) == 0)
-		{
+		if (_child->name == key)
 			return _child;
-		}
 	}
 	return nullptr;
 }
@@ -644,7 +636,7 @@ KeyValues& KeyValues::operator=(KeyValues&& kv)
 	this->keys	     = kv.keys;
 	kv.keys.clear();
 	kv.child_sections.clear();
-	kv.name	  = nullptr;
+	kv.name	  = InternedString();
 	kv.quoted = false;
 	kv.good	  = false;
 	return *this;
@@ -653,7 +645,7 @@ KeyValues& KeyValues::operator=(KeyValues&& kv)
 KeyValues& KeyValues::operator=(const KeyValues& kv)
 {
 	this->child_sections = kv.child_sections;
-	this->name	     = Q_strdup(kv.name);
+	this->name	     = kv.name;
 	this->good	     = kv.good;
 	this->quoted	     = kv.quoted;
 	this->keys	     = kv.keys;
@@ -20,6 +20,7 @@ GNU General Public License for more details.
 #include <stdio.h>
 
 #include "public.h"
+#include "containers/internedstring.h"
 
 class EXPORT KeyValues
 {
@@ -60,9 +61,9 @@ public:
 	};
 
 private:
-	char* name;
-	bool  good;
-	bool  quoted;
+	InternedString name; /* Section names repeat a lot, so they're interned. GetChild compares handles */
+	bool	       good;
+	bool	       quoted;
 
 public:
 	KeyValues(const KeyValues& kv);
@@ -97,7 +98,7 @@ public:
 	void ParseString(const char* string, bool use_escape_codes = false, long long len = -1);
 
 	const std::vector<key_t>& Keys() const { return keys; };
-	const char*		  Name() const { return name; };
+	const char*		  Name() const { return name ? name.c_str() : nullptr; };
 	bool			  Quoted() const { return quoted; };
 
 	/* Clears a key's value setting it to "" */
@@ -109,6 +110,7 @@ public:
 	/* Dumps this to stdout */
 	void DumpToStream(FILE* fs);
 	void DumpToStreamInternal(FILE* fs, int indent);
+	void DumpToBuilder(class StringBuilder& sb, int indent = 0);
 
 	/* Set Good bit is set if parsing went OK */
 	bool IsGood() const { return this->good; };
@@ -15,6 +15,8 @@ GNU General Public License for more details.
 #include "containers/array.h"
 #include "threadtools.h"
 #include "containers/buffer.h"
+#include "containers/concurrenthashmap.h"
+#include "containers/internedstring.h"
 #include "crtlib.h"
 #include "globalproperties.h"
 
@@ -30,18 +32,27 @@ CThreadRecursiveMutex* GlobalLogMutex()
 	return &gMut;
 }
 
+/* Channel name -> id. Written with GlobalLogMutex held, read without it */
+static ConcurrentHashMap<InternedString, LogChannel>& GlobalChannelIndex()
+{
+	static ConcurrentHashMap<InternedString, LogChannel> gIndex;
+	return gIndex;
+}
+
 Array<LogChannelDescription_t>& GlobalChannelList()
 {
 	static Array<LogChannelDescription_t> gChannels;
 	/* init channels list with the channels we need */
 	if (gChannels.empty())
 	{
+		GlobalLogMutex()->SetProfileName("GlobalLogMutex");
 		auto lock = GlobalLogMutex()->RAIILock();
 
 		LogChannelDescription_t generalDesc;
 		generalDesc.defaultColor = {255, 255, 255};
 		generalDesc.name	 = "General";
 		gChannels.push_back(generalDesc);
+		GlobalChannelIndex().insert(InternedString("General"), Log::GENERAL_CHANNEL_ID);
 
 		/* Add the default logging listener */
 		Log::DefaultLogBackend* backend = new Log::DefaultLogBackend(true);
@@ -81,16 +92,14 @@ const LogChannelDescription_t* Log::GetChannelDescription(LogChannel chan) { ret
 
 LogChannel Log::GetChannelByName(const char* name)
 {
-	auto lock = GlobalLogMutex()->RAIILock();
-
-	auto& channels = GlobalChannelList();
-	int   i	       = 0;
-	for (auto it = channels.begin(); it != channels.end(); ++it, i++)
-	{
-		if (it->name.equals(name))
-			return i;
-	}
-	return INVALID_CHANNEL_ID;
+	GlobalChannelList();
+	/* Names that were never interned can't belong to a channel */
+	InternedString key = InternedString::Find(name);
+	if (!key)
+		return INVALID_CHANNEL_ID;
+	/* Channels are added to the list before they are indexed, so whatever we find here is valid */
+	LogChannel chan;
+	return GlobalChannelIndex().find(key, chan) ? chan : INVALID_CHANNEL_ID;
 }
 
 LogChannel Log::CreateChannel(const char* name, LogColor color)
@@ -99,11 +108,10 @@ LogChannel Log::CreateChannel(const char* name, LogColor color)
 	auto& channels = GlobalChannelList();
 
 	/* if already registered, just return the existing channel */
-	for (int i = 0; i < channels.size(); i++)
-	{
-		if (channels[i].name.equals(name))
-			return i;
-	}
+	InternedString key = InternedString(name);
+	LogChannel existing;
+	if (GlobalChannelIndex().find(key, existing))
+		return existing;
 
 	LogChannelDescription_t chan;
 	chan.name	  = name;
@@ -112,11 +120,12 @@ LogChannel Log::CreateChannel(const char* name, LogColor color)
 	auto& backendlist = GlobalBackendList();
 	for (LogChannel c = 0; c < backendlist.size(); c++)
 	{
-		if (backendlist[c]->m_enabledForAll && !chan.backends.contains(c))
-			chan.backends.push_back(c);
+		if (backendlist[c]->m_enabledForAll)
+			chan.backends.set(c);
 	}
 
 	channels.push_back(chan);
+	GlobalChannelIndex().insert(key, channels.size() - 1);
 	return channels.size() - 1;
 }
 
@@ -162,7 +171,7 @@ void Log::DisableBackendForChannel(LogChannel chan, LogBackend backend)
 	auto lock = GlobalLogMutex()->RAIILock();
 
 	auto desc = GetChanDesc(chan);
-	desc->backends.remove(backend);
+	desc->backends.reset(backend);
 }
 
 void Log::EnableBackendForChannel(LogChannel chan, LogBackend backend)
@@ -173,7 +182,7 @@ void Log::EnableBackendForChannel(LogChannel chan, LogBackend backend)
 	auto lock = GlobalLogMutex()->RAIILock();
 
 	auto desc = GetChanDesc(chan);
-	desc->backends.push_back(backend);
+	desc->backends.set(backend);
 }
 
 void Log::DisableBackend(LogBackend backend)
@@ -185,7 +194,7 @@ void Log::DisableBackend(LogBackend backend)
 
 	for (auto& c : GlobalChannelList())
 	{
-		c.backends.remove(backend);
+		c.backends.reset(backend);
 	}
 }
 
@@ -198,8 +207,7 @@ void Log::EnableBackend(LogBackend backend)
 
 	for (auto& c : GlobalChannelList())
 	{
-		if (!c.backends.contains(backend))
-			c.backends.push_back(backend);
+		c.backends.set(backend);
 	}
 }
 
@@ -209,15 +217,15 @@ static void LogInternal(LogChannel chan, LogChannelDescription_t* desc, ELogLeve
 		desc = GetChanDesc(chan);
 
 	/* Invoke all backends */
-	for (auto& backend : desc->backends)
-	{
-		ILogBackend* b = GlobalBackendList()[backend];
+	auto& backendlist = GlobalBackendList();
+	desc->backends.ForEachSet([&](size_t backend) {
+		ILogBackend* b = backend < backendlist.size() ? backendlist[backend] : nullptr;
 
 		if (!b)
-			continue;
+			return;
 
 		b->Log(chan, level, color, message);
-	}
+	});
 }
 
 void Log::Log(LogChannel chan, ELogLevel level, LogColor color, const char* fmt, ...)
@@ -301,7 +309,7 @@ void Log::AddChannelToGroup(LogChannel chan, LogGroup group)
 	auto lock = GlobalLogMutex()->RAIILock();
 
 	auto desc = GetChanDesc(chan);
-	desc->groups.push_back(group);
+	desc->groups.set(group);
 }
 
 void Log::RemoveChannelFromGroup(LogChannel chan, LogGroup group)
@@ -312,7 +320,7 @@ void Log::RemoveChannelFromGroup(LogChannel chan, LogGroup group)
 	auto lock = GlobalLogMutex()->RAIILock();
 
 	auto desc = GetChanDesc(chan);
-	desc->groups.remove(group);
+	desc->groups.reset(group);
 }
 
 bool Log::IsChannelInGroup(LogChannel chan, LogGroup group)
@@ -324,7 +332,7 @@ bool Log::IsChannelInGroup(LogChannel chan, LogGroup group)
 
 	auto desc = GetChanDesc(chan);
 
-	return desc->groups.contains(group);
+	return desc->groups.test(group);
 }
 
 int Log::NumChannelsInGroup(LogGroup grp)
@@ -17,8 +17,11 @@ GNU General Public License for more details.
  */
 #pragma once
 
+#include <stdarg.h>
+
 #include "public.h"
 #include "containers/list.h"
+#include "containers/bitset.h"
 #include "containers/string.h"
 
 #define COLOR_NORMAL "^1"
@@ -55,8 +58,8 @@ struct LogChannelDescription_t
 {
 	String		 name;
 	LogColor	 defaultColor;
-	List<LogGroup>	 groups;
-	List<LogBackend> backends;
+	BitSet		 groups;   /* Indexed by LogGroup */
+	BitSet		 backends; /* Indexed by LogBackend */
 };
 
 class ILogBackend
@@ -29,9 +29,12 @@ GNU General Public License for more details.
 #include "platformspec.h"
 #include "xprof.h"
 #include "logger.h"
+#include "containers/intrusivelist.h"
+#include "containers/intrusivehash.h"
 
 #include <stdlib.h>
 #include <memory.h>
+#include <new>
 
 /* Allocator global */
 CZoneAllocator* g_pZoneAllocator = NULL;
@@ -42,9 +45,9 @@ LogChannel gMemLogger;
 
 typedef struct memheader_s
 {
-	struct memheader_s* next; // next and previous memheaders in chain belonging to pool
-	struct memheader_s* prev;
-	struct mempool_s*   pool;     // pool this memheader belongs to
+	IntrusiveListHook<memheader_s> link;   // next and previous memheaders in chain belonging to pool
+	IntrusiveHashHook<memheader_s> byAddr; // entry in the pool's address table
+	struct mempool_s*	       pool;   // pool this memheader belongs to
 	size_t		    size;     // size of the memory after the header (excluding header and sentinel2)
 	const char*	    filename; // file name and line where Mem_Alloc was called
 	uint		    fileline;
@@ -53,21 +56,32 @@ typedef struct memheader_s
 	// immediately followed by data, which is followed by a MEMHEADER_SENTINEL2 byte
 } memheader_t;
 
+/* Headers are keyed by their own address, so checking a pointer never dereferences it */
+struct MemHeaderAddr
+{
+	const memheader_t* operator()(const memheader_t& mem) const { return &mem; }
+};
+
+typedef IntrusiveList<memheader_t, &memheader_t::link>						      MemHeaderList;
+typedef IntrusiveHashTable<memheader_t, const memheader_t*, &memheader_t::byAddr, MemHeaderAddr> MemHeaderTable;
+
 typedef struct mempool_s
 {
 	uint		    sentinel1;	   // should always be MEMHEADER_SENTINEL1
-	struct memheader_s* chain;	   // chain of individual memory allocations
+	MemHeaderList	    chain;	   // chain of individual memory allocations
+	MemHeaderTable	    headers;	   // the same allocations, by address
 	size_t		    totalsize;	   // total memory allocated in this pool (inside memheaders)
 	size_t		    realsize;	   // total memory allocated in this pool (actual malloc total)
 	size_t		    lastchecksize; // updated each time the pool is displayed by memlist
-	struct mempool_s*   next;	   // linked into global mempool list
+	IntrusiveListHook<mempool_s> link; // linked into global mempool list
 	const char*	    filename;	   // file name and line where Mem_AllocPool was called
 	int		    fileline;
 	char		    name[64];  // name of the pool
 	uint		    sentinel2; // should always be MEMHEADER_SENTINEL1
 } mempool_t;
 
-mempool_t* poolchain = NULL; // critical stuff
+/* Constant initialized, so pools can be created from other static initializers */
+static IntrusiveList<mempool_t, &mempool_t::link> poolchain; // critical stuff
 
 EXPORT CZoneAllocator& GlobalAllocator()
 {
@@ -102,11 +116,8 @@ void* CZoneAllocator::_Mem_Alloc(byte* poolptr, size_t size, bool clear, const c
 	// and some platforms can't use unaligned accesses
 	*((byte*)mem + sizeof(memheader_t) + mem->size) = MEMHEADER_SENTINEL2;
 	// append to head of list
-	mem->next   = pool->chain;
-	mem->prev   = NULL;
-	pool->chain = mem;
-	if (mem->next)
-		mem->next->prev = mem;
+	pool->chain.push_front(mem);
+	pool->headers.insert(mem);
 	if (clear)
 		memset((void*)((byte*)mem + sizeof(memheader_t)), 0, mem->size);
 
@@ -153,16 +164,11 @@ static void Mem_FreeBlock(memheader_t* mem, const char* filename, int fileline)
 
 	pool = mem->pool;
 	// unlink memheader from doubly linked list
-	if ((mem->prev ? mem->prev->next != mem : pool->chain != mem) || (mem->next && mem->next->prev != mem))
+	if (!pool->chain.contains(mem))
 		platform::FatalError("Mem_Free: not allocated or double freed (free at %s:%i)\n", filename, fileline);
 
-	if (mem->prev)
-		mem->prev->next = mem->next;
-	else
-		pool->chain = mem->next;
-
-	if (mem->next)
-		mem->next->prev = mem->prev;
+	pool->chain.remove(mem);
+	pool->headers.remove(mem);
 
 	// memheader has been unlinked, do the actual free now
 	pool->totalsize -= mem->size;
@@ -216,7 +222,9 @@ byte* CZoneAllocator::_Mem_AllocPool(const char* name, const char* filename, int
 	pool = (mempool_t*)malloc(sizeof(mempool_t));
 	if (pool == NULL)
 		platform::FatalError("Mem_AllocPool: out of memory (allocpool at %s:%i)\n", filename, fileline);
-	memset(pool, 0, sizeof(mempool_t));
+	memset((void*)pool, 0, sizeof(mempool_t));
+	new (&pool->chain) MemHeaderList();
+	new (&pool->headers) MemHeaderTable();
 
 	Log::DevMsg(gMemLogger, "Mem_AllocPool: Created pool %s (allocpool at %s:%i)\n", name, filename, fileline);
 
@@ -225,27 +233,22 @@ byte* CZoneAllocator::_Mem_AllocPool(const char* name, const char* filename, int
 	pool->sentinel2 = MEMHEADER_SENTINEL1;
 	pool->filename	= filename;
 	pool->fileline	= fileline;
-	pool->chain	= NULL;
 	pool->totalsize = 0;
 	pool->realsize	= sizeof(mempool_t);
 	Q_strncpy(pool->name, name, sizeof(pool->name));
-	pool->next = poolchain;
-	poolchain  = pool;
+	poolchain.push_front(pool);
 
 	return (byte*)pool;
 }
 
 void CZoneAllocator::_Mem_FreePool(byte** poolptr, const char* filename, int fileline)
 {
-	mempool_t*  pool = (mempool_t*)*poolptr;
-	mempool_t** chainaddress;
+	mempool_t* pool = (mempool_t*)*poolptr;
 
 	if (pool)
 	{
 		// unlink pool from chain
-		for (chainaddress = &poolchain; *chainaddress && *chainaddress != pool; chainaddress = &((*chainaddress)->next))
-			;
-		if (*chainaddress != pool)
+		if (!poolchain.contains(pool))
 			platform::FatalError("Mem_FreePool: pool already free (freepool at %s:%i)\n", filename, fileline);
 		if (pool->sentinel1 != MEMHEADER_SENTINEL1)
 			platform::FatalError("Mem_FreePool: trashed pool sentinel 1 (allocpool at %s:%i, freepool at %s:%i)\n", pool->filename,
@@ -253,13 +256,15 @@ void CZoneAllocator::_Mem_FreePool(byte** poolptr, const char* filename, int fil
 		if (pool->sentinel2 != MEMHEADER_SENTINEL1)
 			platform::FatalError("Mem_FreePool: trashed pool sentinel 2 (allocpool at %s:%i, freepool at %s:%i)\n", pool->filename,
 					     pool->fileline, filename, fileline);
-		*chainaddress = pool->next;
+		poolchain.remove(pool);
 
 		// free memory owned by the pool
-		while (pool->chain)
-			Mem_FreeBlock(pool->chain, filename, fileline);
+		while (!pool->chain.empty())
+			Mem_FreeBlock(pool->chain.front(), filename, fileline);
 		// free the pool itself
-		memset(pool, 0xBF, sizeof(mempool_t));
+		pool->headers.~MemHeaderTable();
+		pool->chain.~MemHeaderList();
+		memset((void*)pool, 0xBF, sizeof(mempool_t));
 		free(pool);
 		*poolptr = NULL;
 	}
@@ -279,29 +284,22 @@ void CZoneAllocator::_Mem_EmptyPool(byte* poolptr, const char* filename, int fil
 				     pool->fileline, filename, fileline);
 
 	// free memory owned by the pool
-	while (pool->chain)
-		Mem_FreeBlock(pool->chain, filename, fileline);
+	while (!pool->chain.empty())
+		Mem_FreeBlock(pool->chain.front(), filename, fileline);
 }
 
 qboolean Mem_CheckAlloc(mempool_t* pool, void* data)
 {
-	memheader_t *header, *target;
-
 	if (pool)
 	{
-		// search only one pool
-		target = (memheader_t*)((byte*)data - sizeof(memheader_t));
-		for (header = pool->chain; header; header = header->next)
-			if (header == target)
-				return true;
-	}
-	else
-	{
-		// search all pools
-		for (pool = poolchain; pool; pool = pool->next)
-			if (Mem_CheckAlloc(pool, data))
-				return true;
+		// search only one pool. The address table is only compared against, data is never dereferenced
+		return pool->headers.contains((const memheader_t*)((byte*)data - sizeof(memheader_t)));
 	}
+
+	// search all pools
+	for (mempool_t* p : poolchain)
+		if (Mem_CheckAlloc(p, data))
+			return true;
 	return false;
 }
 
@@ -345,10 +343,7 @@ void Mem_CheckHeaderSentinels(void* data, const char* filename, int fileline)
 
 void CZoneAllocator::_Mem_Check(const char* filename, int fileline)
 {
-	memheader_t* mem;
-	mempool_t*   pool;
-
-	for (pool = poolchain; pool; pool = pool->next)
+	for (mempool_t* pool : poolchain)
 	{
 		if (pool->sentinel1 != MEMHEADER_SENTINEL1)
 			platform::FatalError("Mem_CheckSentinelsGlobal: trashed pool sentinel 1 (allocpool at %s:%i, sentinel check at %s:%i)\n",
@@ -358,18 +353,17 @@ void CZoneAllocator::_Mem_Check(const char* filename, int fileline)
 					     pool->filename, pool->fileline, filename, fileline);
 	}
 
-	for (pool = poolchain; pool; pool = pool->next)
-		for (mem = pool->chain; mem; mem = mem->next)
+	for (mempool_t* pool : poolchain)
+		for (memheader_t* mem : pool->chain)
 			Mem_CheckHeaderSentinels((void*)((byte*)mem + sizeof(memheader_t)), filename, fileline);
 }
 
 void CZoneAllocator::Mem_PrintStats(void)
 {
-	size_t	   count = 0, size = 0, realsize = 0;
-	mempool_t* pool;
+	size_t count = 0, size = 0, realsize = 0;
 
 	_Mem_Check(__FILE__, __LINE__);
-	for (pool = poolchain; pool; pool = pool->next)
+	for (mempool_t* pool : poolchain)
 	{
 		count++;
 		size += pool->totalsize;
@@ -382,14 +376,11 @@ void CZoneAllocator::Mem_PrintStats(void)
 
 void CZoneAllocator::Mem_PrintList(size_t minallocationsize)
 {
-	mempool_t*   pool;
-	memheader_t* mem;
-
 	_Mem_Check(__FILE__, __LINE__);
 
 	Log::Msg(gMemLogger, "memory pool list:\n"
 	       "  ^3size                          name\n");
-	for (pool = poolchain; pool; pool = pool->next)
+	for (mempool_t* pool : poolchain)
 	{
 		long changed_size = (long)pool->totalsize - (long)pool->lastchecksize;
 
@@ -407,7 +398,7 @@ void CZoneAllocator::Mem_PrintList(size_t minallocationsize)
 		}
 
 		pool->lastchecksize = pool->totalsize;
-		for (mem = pool->chain; mem; mem = mem->next)
+		for (memheader_t* mem : pool->chain)
 			if (mem->size >= minallocationsize)
 				Log::Msg(gMemLogger, "%10s allocated at %s:%i\n", Q_memprint(mem->size), mem->filename, mem->fileline);
 	}
@@ -419,7 +410,6 @@ void CZoneAllocator::Memory_Init(void)
 	if (bInit)
 		return;
 	bInit	  = true;
-	poolchain = NULL;
 	gMemLogger = Log::CreateChannel("MemCrtOverride", {255, 150, 150});
 #ifdef USE_CUSTOM_ALLOCATOR
 	Log::Msg(gMemLogger, "USE_CUSTOM_ALLOCATOR IS set, using custom zone allocator.\n");
@@ -0,0 +1,419 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * parallel.h
+ * 	Parallel versions of common bulk algorithms, running on GlobalThreadPool()
+ *
+ * Everything here takes iterator pairs, so Array, List, raw pointer + count and anything else with
+ * iterators works. Random access iterators are split by index, other iterators are walked once to find
+ * chunk boundaries. Ranges smaller than the grain size run serially on the calling thread.
+ *
+ * The grain size is the minimum number of elements handed to a single task. Pass 0 to pick one
+ * automatically (about 4 chunks per thread, never below PARALLEL_MIN_GRAIN).
+ *
+ * All functions block until the work is done. Functors are called concurrently and must be thread-safe.
+ */
+#pragma once
+
+#include "threadpool.h"
+#include "containers/array.h"
+
+#undef min
+#undef max
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <exception>
+
+#define PARALLEL_MIN_GRAIN	 1024
+#define PARALLEL_CHUNKS_PER_THREAD 4
+
+namespace threadtools
+{
+namespace detail
+{
+template <class It> using IsRandomAccess = std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>;
+
+inline size_t ComputeGrain(size_t count, size_t grain, CThreadPool& pool)
+{
+	if (grain)
+		return grain;
+	size_t chunks = (size_t)pool.Concurrency() * PARALLEL_CHUNKS_PER_THREAD;
+	grain	      = (count + chunks - 1) / chunks;
+	return grain < PARALLEL_MIN_GRAIN ? PARALLEL_MIN_GRAIN : grain;
+}
+
+/* Runs fn(chunk) for chunk in [0, numChunks). Chunk 0 runs on the caller.
+ * If any chunk throws, every other chunk still finishes (they reference the caller's stack) and the first
+ * exception is rethrown on the caller */
+template <class F> void RunChunks(size_t numChunks, F& fn, CThreadPool& pool)
+{
+	if (numChunks == 0)
+		return;
+	if (numChunks == 1)
+	{
+		fn((size_t)0);
+		return;
+	}
+
+	CTaskCounter	   counter;
+	std::exception_ptr error;
+	AtomicBool	   failed(false);
+	auto		   run = [&](size_t c)
+	{
+		try
+		{
+			fn(c);
+		}
+		catch (...)
+		{
+			if (!failed.exchange(true))
+				error = std::current_exception();
+		}
+	};
+
+	counter.Add((int)numChunks - 1);
+	for (size_t i = 1; i < numChunks; i++)
+	{
+		pool.Submit(
+			[&run, &counter, i]()
+			{
+				run(i);
+				counter.Done();
+			});
+	}
+	run((size_t)0);
+	counter.Wait(pool);
+	if (error)
+		std::rethrow_exception(error);
+}
+
+/* Splits [first, last) into chunks of at least grain elements. bounds receives numChunks + 1 iterators */
+template <class It> void SplitRange(It first, It last, size_t count, size_t grain, Array<It>& bounds)
+{
+	size_t numChunks = (count + grain - 1) / grain;
+	bounds.reserve(numChunks + 1);
+	bounds.push_back(first);
+	for (size_t i = 1; i < numChunks; i++)
+	{
+		/* Spread the remainder evenly instead of leaving a tiny last chunk */
+		size_t step = count / numChunks + ((i - 1) < count % numChunks ? 1 : 0);
+		std::advance(first, step);
+		bounds.push_back(first);
+	}
+	bounds.push_back(last);
+}
+} // namespace detail
+
+/**
+ * Calls fn(i) for every i in [begin, end)
+ */
+template <class F> void parallel_for(size_t begin, size_t end, F fn, size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	if (end <= begin)
+		return;
+	size_t count = end - begin;
+	grain	     = detail::ComputeGrain(count, grain, pool);
+	if (count <= grain)
+	{
+		for (size_t i = begin; i < end; i++)
+			fn(i);
+		return;
+	}
+
+	size_t numChunks = (count + grain - 1) / grain;
+	auto   chunk	 = [&](size_t c)
+	{
+		size_t b = begin + (count * c) / numChunks;
+		size_t e = begin + (count * (c + 1)) / numChunks;
+		for (size_t i = b; i < e; i++)
+			fn(i);
+	};
+	detail::RunChunks(numChunks, chunk, pool);
+}
+
+/**
+ * Calls fn(first, last) on consecutive sub-ranges of [first, last). Useful when per-chunk setup is expensive
+ */
+template <class It, class F> void parallel_for_range(It first, It last, F fn, size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	size_t count = (size_t)std::distance(first, last);
+	if (count == 0)
+		return;
+	grain = detail::ComputeGrain(count, grain, pool);
+	if (count <= grain)
+	{
+		fn(first, last);
+		return;
+	}
+
+	Array<It> bounds;
+	detail::SplitRange(first, last, count, grain, bounds);
+	auto chunk = [&](size_t c) { fn(bounds[c], bounds[c + 1]); };
+	detail::RunChunks(bounds.size() - 1, chunk, pool);
+}
+
+/**
+ * Calls fn(elem) for every element in [first, last)
+ */
+template <class It, class F> void parallel_for_each(It first, It last, F fn, size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	parallel_for_range(
+		first, last,
+		[&fn](It b, It e)
+		{
+			for (; b != e; ++b)
+				fn(*b);
+		},
+		grain, pool);
+}
+
+template <class C, class F> void parallel_for_each(C& container, F fn, size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	parallel_for_each(container.begin(), container.end(), fn, grain, pool);
+}
+
+template <class T, class F> void parallel_for_each(T* data, size_t count, F fn, size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	parallel_for_each(data, data + count, fn, grain, pool);
+}
+
+/**
+ * Writes fn(*in) to out for every element in [first, last). out must have room for the whole range and may alias first
+ */
+template <class InIt, class OutIt, class F>
+void parallel_transform(InIt first, InIt last, OutIt out, F fn, size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	size_t count = (size_t)std::distance(first, last);
+	if (count == 0)
+		return;
+	grain = detail::ComputeGrain(count, grain, pool);
+	if (count <= grain)
+	{
+		std::transform(first, last, out, fn);
+		return;
+	}
+
+	Array<InIt>  inBounds;
+	Array<OutIt> outBounds;
+	detail::SplitRange(first, last, count, grain, inBounds);
+	outBounds.reserve(inBounds.size());
+	outBounds.push_back(out);
+	for (size_t i = 1; i < inBounds.size() - 1; i++)
+	{
+		std::advance(out, std::distance(inBounds[i - 1], inBounds[i]));
+		outBounds.push_back(out);
+	}
+
+	auto chunk = [&](size_t c) { std::transform(inBounds[c], inBounds[c + 1], outBounds[c], fn); };
+	detail::RunChunks(inBounds.size() - 1, chunk, pool);
+}
+
+template <class C, class F> void parallel_transform(C& container, F fn, size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	parallel_transform(container.begin(), container.end(), container.begin(), fn, grain, pool);
+}
+
+/**
+ * Folds [first, last) with op, starting from init. op must be associative; chunks are combined in order,
+ * so it doesn't need to be commutative
+ */
+template <class It, class T, class Op = std::plus<T>>
+T parallel_reduce(It first, It last, T init, Op op = Op(), size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	size_t count = (size_t)std::distance(first, last);
+	if (count == 0)
+		return init;
+	grain = detail::ComputeGrain(count, grain, pool);
+	if (count <= grain)
+	{
+		for (; first != last; ++first)
+			init = op(init, *first);
+		return init;
+	}
+
+	Array<It> bounds;
+	detail::SplitRange(first, last, count, grain, bounds);
+
+	size_t	 numChunks = bounds.size() - 1;
+	Array<T> partials;
+	partials.resize(numChunks);
+
+	auto chunk = [&](size_t c)
+	{
+		It b = bounds[c];
+		T  v = *b;
+		for (++b; b != bounds[c + 1]; ++b)
+			v = op(v, *b);
+		partials[c] = v;
+	};
+	detail::RunChunks(numChunks, chunk, pool);
+
+	for (auto& p : partials)
+		init = op(init, p);
+	return init;
+}
+
+template <class C, class T, class Op = std::plus<T>>
+T parallel_reduce(const C& container, T init, Op op = Op(), size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	return parallel_reduce(container.begin(), container.end(), init, op, grain, pool);
+}
+
+/**
+ * Inclusive prefix scan: out[i] = in[0] op in[1] op ... op in[i]. out may alias first.
+ * Three passes: per-chunk totals in parallel, a serial scan of the totals, then a parallel rescan with offsets
+ */
+template <class InIt, class OutIt, class Op = std::plus<typename std::iterator_traits<InIt>::value_type>>
+void parallel_scan(InIt first, InIt last, OutIt out, Op op = Op(), size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	/* Accumulate in whatever op produces, so e.g. summing ints into long longs doesn't overflow */
+	typedef typename std::iterator_traits<InIt>::value_type				ValueT;
+	typedef typename std::decay<typename std::invoke_result<Op&, ValueT, ValueT>::type>::type T;
+
+	size_t count = (size_t)std::distance(first, last);
+	if (count == 0)
+		return;
+	grain = detail::ComputeGrain(count, grain, pool);
+	if (count <= grain)
+	{
+		T acc = *first;
+		*out  = acc;
+		for (++first, ++out; first != last; ++first, ++out)
+			*out = acc = op(acc, *first);
+		return;
+	}
+
+	Array<InIt>  inBounds;
+	Array<OutIt> outBounds;
+	detail::SplitRange(first, last, count, grain, inBounds);
+	outBounds.reserve(inBounds.size());
+	outBounds.push_back(out);
+	for (size_t i = 1; i < inBounds.size() - 1; i++)
+	{
+		std::advance(out, std::distance(inBounds[i - 1], inBounds[i]));
+		outBounds.push_back(out);
+	}
+
+	size_t	 numChunks = inBounds.size() - 1;
+	Array<T> totals;
+	totals.resize(numChunks);
+
+	auto sum = [&](size_t c)
+	{
+		InIt b = inBounds[c];
+		T    v = *b;
+		for (++b; b != inBounds[c + 1]; ++b)
+			v = op(v, *b);
+		totals[c] = v;
+	};
+	detail::RunChunks(numChunks, sum, pool);
+
+	/* totals[c] becomes the sum of everything before chunk c (undefined for chunk 0) */
+	T running = totals[0];
+	for (size_t c = 1; c < numChunks; c++)
+	{
+		T t	  = totals[c];
+		totals[c] = running;
+		running	  = op(running, t);
+	}
+
+	auto scan = [&](size_t c)
+	{
+		InIt  b	  = inBounds[c];
+		OutIt o	  = outBounds[c];
+		T     acc = c == 0 ? *b : op(totals[c], *b);
+		*o	  = acc;
+		for (++b, ++o; b != inBounds[c + 1]; ++b, ++o)
+			*o = acc = op(acc, *b);
+	};
+	detail::RunChunks(numChunks, scan, pool);
+}
+
+/**
+ * Exclusive prefix scan: out[0] = init, out[i] = init op in[0] op ... op in[i - 1]. out may NOT alias first
+ */
+template <class InIt, class OutIt, class T, class Op = std::plus<T>>
+void parallel_exclusive_scan(InIt first, InIt last, OutIt out, T init, Op op = Op(), size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	size_t count = (size_t)std::distance(first, last);
+	if (count == 0)
+		return;
+
+	/* Inclusive scan shifted by one, then fold init in */
+	*out = init;
+	if (count == 1)
+		return;
+	OutIt shifted = out;
+	++shifted;
+	InIt stop = first;
+	std::advance(stop, count - 1);
+	parallel_scan(first, stop, shifted, op, grain, pool);
+	parallel_for_each(shifted, std::next(shifted, count - 1), [&](auto& v) { v = op(init, v); }, grain, pool);
+}
+
+/**
+ * Sorts [first, last). Chunks are sorted in parallel with std::sort, then merged pairwise in parallel rounds.
+ * Requires random access iterators. Not stable.
+ */
+template <class It, class Compare = std::less<typename std::iterator_traits<It>::value_type>>
+void parallel_sort(It first, It last, Compare comp = Compare(), size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	static_assert(detail::IsRandomAccess<It>::value, "parallel_sort requires random access iterators");
+
+	size_t count = (size_t)(last - first);
+	if (count < 2)
+		return;
+	grain = detail::ComputeGrain(count, grain, pool);
+	if (count <= grain)
+	{
+		std::sort(first, last, comp);
+		return;
+	}
+
+	/* Use a power of two number of runs so the merge tree is balanced */
+	size_t numRuns = 1;
+	while (numRuns * 2 <= (count + grain - 1) / grain && numRuns * 2 <= (size_t)pool.Concurrency() * PARALLEL_CHUNKS_PER_THREAD)
+		numRuns *= 2;
+
+	Array<size_t> bounds;
+	bounds.resize(numRuns + 1);
+	for (size_t i = 0; i <= numRuns; i++)
+		bounds[i] = (count * i) / numRuns;
+
+	auto sortRun = [&](size_t r) { std::sort(first + bounds[r], first + bounds[r + 1], comp); };
+	detail::RunChunks(numRuns, sortRun, pool);
+
+	for (size_t width = 1; width < numRuns; width *= 2)
+	{
+		size_t numMerges = numRuns / (width * 2);
+		auto   merge	 = [&](size_t m)
+		{
+			size_t lo  = bounds[m * width * 2];
+			size_t mid = bounds[m * width * 2 + width];
+			size_t hi  = bounds[m * width * 2 + width * 2];
+			std::inplace_merge(first + lo, first + mid, first + hi, comp);
+		};
+		detail::RunChunks(numMerges, merge, pool);
+	}
+}
+
+template <class C, class Compare = std::less<typename C::value_type>>
+void parallel_sort(C& container, Compare comp = Compare(), size_t grain = 0, CThreadPool& pool = GlobalThreadPool())
+{
+	parallel_sort(container.begin(), container.end(), comp, grain, pool);
+}
+
+} // namespace threadtools
@@ -0,0 +1,452 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#include "reclaim.h"
+#include "mem.h"
+#include "platformspec.h"
+
+#undef min
+#undef max
+#include <algorithm>
+#include <mutex>
+
+void ReclaimZoneDeleter(void* ptr) { GlobalAllocator()._Mem_Free(ptr, __FILE__, __LINE__); }
+
+/* Per-thread records are looked up by thread index. Returns nullptr if the calling thread couldn't get one.
+ * When an index is released its record is emptied (see ReleaseReclaimRecords) and left for the index's next owner */
+template <class Record_t> static Record_t* GetRecord(std::atomic<Record_t*>* records)
+{
+	int index = threadtools::GetThreadIndex();
+	if (index == threadtools::INVALID_THREAD_INDEX)
+		return nullptr;
+
+	Record_t* rec = records[index].load(std::memory_order_acquire);
+	if (!rec)
+	{
+		/* Only the owning thread creates its own record */
+		rec = new Record_t();
+		records[index].store(rec, std::memory_order_release);
+	}
+	return rec;
+}
+
+/* Every live domain, so a thread's records can be cleaned up when its index is released */
+static std::mutex     s_domainMutex;
+static CEpochDomain*  s_epochDomains  = nullptr;
+static CHazardDomain* s_hazardDomains = nullptr;
+
+void ReleaseReclaimRecords(int index)
+{
+	std::lock_guard<std::mutex> guard(s_domainMutex);
+	for (CEpochDomain* it = s_epochDomains; it; it = it->m_nextDomain)
+		it->ReleaseRecord(index);
+	for (CHazardDomain* it = s_hazardDomains; it; it = it->m_nextDomain)
+		it->ReleaseRecord(index);
+}
+
+static void RegisterReleaseCallback()
+{
+	static std::once_flag once;
+	std::call_once(once, []() { threadtools::AddThreadIndexReleaseCallback(ReleaseReclaimRecords); });
+}
+
+//===========================================
+//
+//      CEpochDomain
+//
+//===========================================
+
+CEpochDomain::CEpochDomain()
+{
+	/* Starts at 2 so that "retired at epoch E, free at E + 2" never needs special casing */
+	m_epoch.store(2, std::memory_order_relaxed);
+	m_overflowReaders.store(0, std::memory_order_relaxed);
+	for (auto& rec : m_records)
+		rec.store(nullptr, std::memory_order_relaxed);
+	RegisterReleaseCallback();
+	std::lock_guard<std::mutex> guard(s_domainMutex);
+	m_nextDomain   = s_epochDomains;
+	s_epochDomains = this;
+}
+
+CEpochDomain::~CEpochDomain()
+{
+	{
+		std::lock_guard<std::mutex> guard(s_domainMutex);
+		for (CEpochDomain** it = &s_epochDomains; *it; it = &(*it)->m_nextDomain)
+		{
+			if (*it == this)
+			{
+				*it = m_nextDomain;
+				break;
+			}
+		}
+	}
+	for (auto& r : m_orphans)
+		r.deleter(r.ptr);
+	for (auto& slot : m_records)
+	{
+		Record_t* rec = slot.load(std::memory_order_acquire);
+		if (!rec)
+			continue;
+		for (auto& r : rec->retired)
+			r.deleter(r.ptr);
+		delete rec;
+	}
+}
+
+CEpochDomain::Record_t* CEpochDomain::LocalRecord() { return GetRecord(m_records); }
+
+void CEpochDomain::Enter()
+{
+	Record_t* rec = LocalRecord();
+	if (!rec)
+	{
+		/* No record to announce an epoch in, so hold the epoch still instead. Nesting just counts twice */
+		m_overflowReaders.fetch_add(1, std::memory_order_seq_cst);
+		return;
+	}
+	if (rec->depth++ > 0)
+		return;
+
+	/* Re-check after announcing, otherwise the epoch could move past us before the announcement is visible */
+	unsigned long long epoch = m_epoch.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		rec->state.store((epoch << 1) | 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		unsigned long long check = m_epoch.load(std::memory_order_acquire);
+		if (check == epoch)
+			break;
+		epoch = check;
+	}
+}
+
+void CEpochDomain::Leave()
+{
+	Record_t* rec = LocalRecord();
+	if (!rec)
+	{
+		m_overflowReaders.fetch_sub(1, std::memory_order_release);
+		return;
+	}
+	if (--rec->depth > 0)
+		return;
+	rec->state.store(0, std::memory_order_release);
+
+	/* Objects retired inside the critical section couldn't be collected by Retire(), do it on the way out */
+	if (rec->retired.size() >= RECLAIM_THRESHOLD)
+	{
+		TryAdvance();
+		Collect(rec->retired);
+	}
+}
+
+bool CEpochDomain::TryAdvance()
+{
+	unsigned long long epoch = m_epoch.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (m_overflowReaders.load(std::memory_order_acquire) > 0)
+		return false;
+
+	int max = threadtools::ThreadIndexHighWater();
+	for (int i = 0; i < max; i++)
+	{
+		Record_t* rec = m_records[i].load(std::memory_order_acquire);
+		if (!rec)
+			continue;
+		unsigned long long state = rec->state.load(std::memory_order_acquire);
+		if ((state & 1) && (state >> 1) != epoch)
+			return false;
+	}
+	return m_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+}
+
+size_t CEpochDomain::Collect(Array<Retired_t>& retired)
+{
+	unsigned long long epoch = m_epoch.load(std::memory_order_acquire);
+
+	/* Deleters may retire more objects, so pull out the expired ones first */
+	Array<Retired_t> expired;
+	size_t		 kept = 0;
+	for (size_t i = 0; i < retired.size(); i++)
+	{
+		if (retired[i].epoch + 2 <= epoch)
+			expired.push_back(retired[i]);
+		else
+			retired[kept++] = retired[i];
+	}
+	retired.resize(kept);
+
+	for (auto& r : expired)
+		r.deleter(r.ptr);
+	return expired.size();
+}
+
+size_t CEpochDomain::CollectOrphans()
+{
+	Array<Retired_t> orphans;
+	{
+		std::lock_guard<std::mutex> guard(m_orphanMutex);
+		if (m_orphans.empty())
+			return 0;
+		orphans.swap(m_orphans);
+	}
+
+	size_t freed = Collect(orphans);
+	if (!orphans.empty())
+	{
+		std::lock_guard<std::mutex> guard(m_orphanMutex);
+		for (auto& r : orphans)
+			m_orphans.push_back(r);
+	}
+	return freed;
+}
+
+void CEpochDomain::Retire(void* ptr, ReclaimDeleter_t deleter)
+{
+	Record_t* rec = LocalRecord();
+	if (!rec)
+	{
+		size_t count;
+		{
+			std::lock_guard<std::mutex> guard(m_orphanMutex);
+			m_orphans.push_back({ptr, deleter, m_epoch.load(std::memory_order_acquire)});
+			count = m_orphans.size();
+		}
+		if (count >= RECLAIM_THRESHOLD)
+		{
+			TryAdvance();
+			CollectOrphans();
+		}
+		return;
+	}
+
+	rec->retired.push_back({ptr, deleter, m_epoch.load(std::memory_order_acquire)});
+
+	if (rec->retired.size() >= RECLAIM_THRESHOLD && rec->depth == 0)
+	{
+		TryAdvance();
+		Collect(rec->retired);
+	}
+}
+
+size_t CEpochDomain::Reclaim()
+{
+	/* Twice, since an object needs the epoch to move by two */
+	TryAdvance();
+	TryAdvance();
+
+	size_t	  freed = CollectOrphans();
+	Record_t* rec	= LocalRecord();
+	if (rec && rec->depth == 0)
+		freed += Collect(rec->retired);
+	return freed;
+}
+
+void CEpochDomain::ReleaseRecord(int index)
+{
+	Record_t* rec = m_records[index].load(std::memory_order_acquire);
+	if (!rec || rec->retired.empty())
+		return;
+
+	TryAdvance();
+	TryAdvance();
+	Collect(rec->retired);
+
+	/* Whatever is left can't be freed yet. Nobody else will look at this record until the index is reused */
+	std::lock_guard<std::mutex> guard(m_orphanMutex);
+	for (auto& r : rec->retired)
+		m_orphans.push_back(r);
+	rec->retired.clear();
+}
+
+//===========================================
+//
+//      CHazardDomain
+//
+//===========================================
+
+CHazardDomain::CHazardDomain()
+{
+	for (auto& rec : m_records)
+		rec.store(nullptr, std::memory_order_relaxed);
+	RegisterReleaseCallback();
+	std::lock_guard<std::mutex> guard(s_domainMutex);
+	m_nextDomain	= s_hazardDomains;
+	s_hazardDomains = this;
+}
+
+CHazardDomain::~CHazardDomain()
+{
+	{
+		std::lock_guard<std::mutex> guard(s_domainMutex);
+		for (CHazardDomain** it = &s_hazardDomains; *it; it = &(*it)->m_nextDomain)
+		{
+			if (*it == this)
+			{
+				*it = m_nextDomain;
+				break;
+			}
+		}
+	}
+	for (auto& r : m_orphans)
+		r.deleter(r.ptr);
+	for (auto& slot : m_records)
+	{
+		Record_t* rec = slot.load(std::memory_order_acquire);
+		if (!rec)
+			continue;
+		for (auto& r : rec->retired)
+			r.deleter(r.ptr);
+		delete rec;
+	}
+}
+
+CHazardDomain::Record_t* CHazardDomain::LocalRecord() { return GetRecord(m_records); }
+
+CHazardDomain::Record_t* CHazardDomain::HazardRecord()
+{
+	Record_t* rec = LocalRecord();
+	if (!rec)
+		platform::FatalError("Out of thread indices, hazard pointers need one per thread. Raise THREADTOOLS_MAX_THREADS\n");
+	return rec;
+}
+
+size_t CHazardDomain::Scan(Array<Retired_t>& retired)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	Array<void*> hazards;
+	int	     max = threadtools::ThreadIndexHighWater();
+	for (int i = 0; i < max; i++)
+	{
+		Record_t* other = m_records[i].load(std::memory_order_acquire);
+		if (!other)
+			continue;
+		for (auto& hazard : other->hazards)
+		{
+			void* ptr = hazard.load(std::memory_order_acquire);
+			if (ptr)
+				hazards.push_back(ptr);
+		}
+	}
+	std::sort(hazards.begin(), hazards.end());
+
+	Array<Retired_t> safe;
+	size_t		 kept = 0;
+	for (size_t i = 0; i < retired.size(); i++)
+	{
+		if (std::binary_search(hazards.begin(), hazards.end(), retired[i].ptr))
+			retired[kept++] = retired[i];
+		else
+			safe.push_back(retired[i]);
+	}
+	retired.resize(kept);
+
+	for (auto& r : safe)
+		r.deleter(r.ptr);
+	return safe.size();
+}
+
+size_t CHazardDomain::ScanOrphans()
+{
+	Array<Retired_t> orphans;
+	{
+		std::lock_guard<std::mutex> guard(m_orphanMutex);
+		if (m_orphans.empty())
+			return 0;
+		orphans.swap(m_orphans);
+	}
+
+	size_t freed = Scan(orphans);
+	if (!orphans.empty())
+	{
+		std::lock_guard<std::mutex> guard(m_orphanMutex);
+		for (auto& r : orphans)
+			m_orphans.push_back(r);
+	}
+	return freed;
+}
+
+void CHazardDomain::Retire(void* ptr, ReclaimDeleter_t deleter)
+{
+	Record_t* rec = LocalRecord();
+	if (!rec)
+	{
+		/* Hazards are all published by indexed threads, so a scan right away frees ptr unless someone holds it */
+		{
+			std::lock_guard<std::mutex> guard(m_orphanMutex);
+			m_orphans.push_back({ptr, deleter});
+		}
+		ScanOrphans();
+		return;
+	}
+
+	rec->retired.push_back({ptr, deleter});
+	if (rec->retired.size() >= RECLAIM_THRESHOLD)
+		Scan(rec->retired);
+}
+
+size_t CHazardDomain::Reclaim()
+{
+	size_t	  freed = ScanOrphans();
+	Record_t* rec	= LocalRecord();
+	if (rec)
+		freed += Scan(rec->retired);
+	return freed;
+}
+
+void CHazardDomain::ReleaseRecord(int index)
+{
+	Record_t* rec = m_records[index].load(std::memory_order_acquire);
+	if (!rec)
+		return;
+
+	for (auto& hazard : rec->hazards)
+		hazard.store(nullptr, std::memory_order_release);
+	if (rec->retired.empty())
+		return;
+	Scan(rec->retired);
+
+	std::lock_guard<std::mutex> guard(m_orphanMutex);
+	for (auto& r : rec->retired)
+		m_orphans.push_back(r);
+	rec->retired.clear();
+}
+
+//===========================================
+//
+//      Global domains
+//
+//===========================================
+
+/* Never freed on purpose. Lock-free containers cache a reference to their domain, and the ones with static storage
+ * (ConcurrentHashMap in the logger, xprof...) can be destroyed after any exit-time cleanup of ours has run */
+static CEpochDomain*  g_pEpochDomain  = nullptr;
+static CHazardDomain* g_pHazardDomain = nullptr;
+
+CEpochDomain& GlobalEpochDomain()
+{
+	static std::once_flag once;
+	std::call_once(once, []() { g_pEpochDomain = new CEpochDomain(); });
+	return *g_pEpochDomain;
+}
+
+CHazardDomain& GlobalHazardDomain()
+{
+	static std::once_flag once;
+	std::call_once(once, []() { g_pHazardDomain = new CHazardDomain(); });
+	return *g_pHazardDomain;
+}
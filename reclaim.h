@@ -0,0 +1,242 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * reclaim.h
+ * 	Safe memory reclamation for lock-free data structures
+ *
+ * When a node is unlinked from a lock-free structure, other threads may still be reading it. Instead of freeing it
+ * right away, hand it to Retire() and it will be freed once no reader can possibly hold a reference anymore.
+ *
+ * Two schemes are provided:
+ * 	CEpochDomain	Epoch based reclamation. Readers pay almost nothing (one store + fence on entry), but a reader
+ * 			that stalls inside a critical section holds back all reclamation.
+ * 	CHazardDomain	Hazard pointers. Readers publish each pointer they dereference, which costs more per access,
+ * 			but the amount of unreclaimed memory stays bounded no matter what readers do.
+ *
+ * Deleters for objects allocated with new (RetireDelete) and with the zone allocator (RetireZone) are provided.
+ * Deleters run on whichever thread triggers the reclaim pass.
+ *
+ * Per-thread state lives in flat arrays indexed by the threadtools thread index. When a thread exits, whatever it
+ * retired is handed to a shared orphan list that any thread's Reclaim() frees. Threads that couldn't get an index
+ * (more than THREADTOOLS_MAX_THREADS alive at once) fall back to shared state: they can still enter epoch critical
+ * sections and retire objects, but can't publish hazard pointers.
+ *
+ * USAGE:
+ * 	// Reader
+ * 	{
+ * 		CEpochGuard guard(GlobalEpochDomain());
+ * 		Node_t* n = head.load();
+ * 		...
+ * 	}
+ * 	// Writer, after unlinking n
+ * 	GlobalEpochDomain().RetireDelete(n);
+ */
+#pragma once
+
+#include "public.h"
+#include "threadtools.h"
+#include "containers/array.h"
+
+#include <atomic>
+#include <mutex>
+
+typedef void (*ReclaimDeleter_t)(void* ptr);
+
+/* Frees memory that was allocated through g_pZoneAllocator */
+EXPORT void ReclaimZoneDeleter(void* ptr);
+
+/**
+ * Epoch based reclamation domain
+ * Objects retired while the global epoch is E are freed once the epoch reaches E + 2, which can only happen after
+ * every thread that was inside a critical section during E has left it.
+ */
+class EXPORT CEpochDomain
+{
+public:
+	/* Retired objects a thread accumulates before it tries to advance the epoch and free things */
+	static constexpr size_t RECLAIM_THRESHOLD = 64;
+
+private:
+	struct Retired_t
+	{
+		void*		   ptr;
+		ReclaimDeleter_t   deleter;
+		unsigned long long epoch;
+	};
+
+	struct alignas(64) Record_t
+	{
+		std::atomic<unsigned long long> state; /* (epoch << 1) | 1 while inside a critical section, 0 otherwise */
+		int				depth;
+		Array<Retired_t>		retired;
+	};
+
+	alignas(64) std::atomic<unsigned long long> m_epoch;
+	std::atomic<Record_t*> m_records[THREADTOOLS_MAX_THREADS];
+
+	/* Threads without a thread index inside a critical section. The epoch can't advance while any exist */
+	alignas(64) std::atomic<int> m_overflowReaders;
+
+	/* Retired by exited threads and by threads without a thread index */
+	std::mutex	 m_orphanMutex;
+	Array<Retired_t> m_orphans;
+
+	CEpochDomain* m_nextDomain;
+
+	friend void ReleaseReclaimRecords(int index);
+
+	Record_t* LocalRecord();
+	bool	  TryAdvance();
+	size_t	  Collect(Array<Retired_t>& retired);
+	size_t	  CollectOrphans();
+	void	  ReleaseRecord(int index);
+
+public:
+	CEpochDomain();
+	/* Frees everything that is still retired. No thread may be inside a critical section */
+	~CEpochDomain();
+
+	CEpochDomain(const CEpochDomain&) = delete;
+	CEpochDomain(CEpochDomain&&)	  = delete;
+
+	/* Critical sections nest. Leaving the outermost one also frees what this thread retired if enough has piled up */
+	void Enter();
+	void Leave();
+
+	/* Frees ptr with deleter once no reader can see it anymore */
+	void Retire(void* ptr, ReclaimDeleter_t deleter);
+	void RetireZone(void* ptr) { Retire(ptr, ReclaimZoneDeleter); }
+	template <class T> void RetireDelete(T* ptr)
+	{
+		Retire(ptr, [](void* p) { delete static_cast<T*>(p); });
+	}
+
+	/* Tries to advance the epoch and frees whatever the calling thread (and exited threads) retired that has expired.
+	 * Returns the number of objects freed */
+	size_t Reclaim();
+
+	unsigned long long Epoch() const { return m_epoch.load(std::memory_order_relaxed); }
+};
+
+/* RAII critical section */
+class EXPORT CEpochGuard
+{
+private:
+	CEpochDomain& m_domain;
+
+public:
+	explicit CEpochGuard(CEpochDomain& domain) : m_domain(domain) { m_domain.Enter(); }
+	~CEpochGuard() { m_domain.Leave(); }
+
+	CEpochGuard(const CEpochGuard&) = delete;
+};
+
+/**
+ * Hazard pointer domain
+ * Each thread has HAZARDS_PER_THREAD slots. A pointer published in a slot is never freed until the slot is cleared
+ */
+class EXPORT CHazardDomain
+{
+public:
+	static constexpr int	HAZARDS_PER_THREAD = 4;
+	static constexpr size_t RECLAIM_THRESHOLD  = 64;
+
+private:
+	struct Retired_t
+	{
+		void*		 ptr;
+		ReclaimDeleter_t deleter;
+	};
+
+	struct alignas(64) Record_t
+	{
+		std::atomic<void*> hazards[HAZARDS_PER_THREAD];
+		Array<Retired_t>   retired;
+	};
+
+	std::atomic<Record_t*> m_records[THREADTOOLS_MAX_THREADS];
+
+	/* Retired by exited threads and by threads without a thread index */
+	std::mutex	 m_orphanMutex;
+	Array<Retired_t> m_orphans;
+
+	CHazardDomain* m_nextDomain;
+
+	friend void ReleaseReclaimRecords(int index);
+
+	Record_t* LocalRecord();
+	/* Like LocalRecord, but hazards can't be published without a thread index */
+	Record_t* HazardRecord();
+	size_t	  Scan(Array<Retired_t>& retired);
+	size_t	  ScanOrphans();
+	void	  ReleaseRecord(int index);
+
+public:
+	CHazardDomain();
+	/* Frees everything that is still retired. No hazards may be set */
+	~CHazardDomain();
+
+	CHazardDomain(const CHazardDomain&) = delete;
+	CHazardDomain(CHazardDomain&&)	    = delete;
+
+	/* Loads src and publishes it in the given slot, retrying until the published value is still current */
+	template <class T> T* Protect(int slot, const std::atomic<T*>& src)
+	{
+		std::atomic<void*>& hazard = HazardRecord()->hazards[slot];
+		T*		    ptr	   = src.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			hazard.store(ptr, std::memory_order_seq_cst);
+			T* check = src.load(std::memory_order_acquire);
+			if (check == ptr)
+				return ptr;
+			ptr = check;
+		}
+	}
+
+	/* Publishes a pointer that the caller already knows is safe */
+	void Set(int slot, void* ptr) { HazardRecord()->hazards[slot].store(ptr, std::memory_order_seq_cst); }
+	void Clear(int slot) { HazardRecord()->hazards[slot].store(nullptr, std::memory_order_release); }
+
+	void Retire(void* ptr, ReclaimDeleter_t deleter);
+	void RetireZone(void* ptr) { Retire(ptr, ReclaimZoneDeleter); }
+	template <class T> void RetireDelete(T* ptr)
+	{
+		Retire(ptr, [](void* p) { delete static_cast<T*>(p); });
+	}
+
+	/* Frees every object retired by the calling thread (and by exited threads) that isn't hazardous.
+	 * Returns the number of objects freed */
+	size_t Reclaim();
+};
+
+/* RAII hazard slot. Clears the slot when it goes out of scope */
+class EXPORT CHazardGuard
+{
+private:
+	CHazardDomain& m_domain;
+	int	       m_slot;
+
+public:
+	CHazardGuard(CHazardDomain& domain, int slot) : m_domain(domain), m_slot(slot) {}
+	~CHazardGuard() { m_domain.Clear(m_slot); }
+
+	CHazardGuard(const CHazardGuard&) = delete;
+
+	template <class T> T* Protect(const std::atomic<T*>& src) { return m_domain.Protect(m_slot, src); }
+};
+
+/* Domains shared by everything in libpublic. Created on first use */
+EXPORT CEpochDomain&  GlobalEpochDomain();
+EXPORT CHazardDomain& GlobalHazardDomain();
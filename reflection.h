@@ -173,15 +173,7 @@ template <int MaxT = 8> void ArrayToBigEndian(void* dst, size_t sz)
 	memcpy(dst, tmp, sz);
 }
 
-template <class T> inline T Deserialize(Buffer& buffer)
-{
-	char data[sizeof(T)];
-	buffer.gets(data, sizeof(T));
-#ifndef XASH_LITTLE_ENDIAN
-	ArrayToBigEndian<sizeof(T)>(data);
-#endif
-	return (T)data;
-}
+template <class T> inline T Deserialize(Buffer& buffer) { return buffer.read_le<T>(); }
 } // namespace reflection
 
 //=====================================================================================//
@@ -0,0 +1,420 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#include "shmchannel.h"
+
+#ifdef _POSIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <new>
+#include <chrono>
+
+#define SHMCHANNEL_MAGIC       0x4353504C /* "LPSC" */
+#define SHMCHANNEL_HEADER_SIZE 4096
+#define SHMCHANNEL_MIN_SIZE    4096
+
+enum
+{
+	CHANNEL_INITIALIZING = 0,
+	CHANNEL_READY	     = 1,
+};
+
+/* Every message is preceded by one of these and padded to a multiple of its size */
+struct ShmRecordHeader_t
+{
+	std::atomic<unsigned int> type;
+	unsigned int		  length;
+};
+
+enum
+{
+	RECORD_EMPTY = 0, /* Not written yet. Free space is always zeroed */
+	RECORD_DATA,
+	RECORD_PAD, /* Filler up to the end of the ring, the next message starts at offset 0 */
+};
+
+struct ShmChannelHeader_t
+{
+	unsigned int		  magic;
+	unsigned int		  version;
+	unsigned int		  headerSize; /* sizeof(ShmChannelHeader_t), catches layout differences between builds */
+	unsigned int		  mode;
+	std::atomic<unsigned int> state;
+	unsigned long long	  capacity;
+
+	alignas(64) std::atomic<unsigned long long> writePos; /* Total bytes ever reserved by producers */
+	alignas(64) std::atomic<unsigned long long> readPos;  /* Total bytes ever released by the consumer */
+	alignas(64) CEventCount dataEvent;		      /* Consumer waits here for messages */
+	alignas(64) CEventCount spaceEvent;		      /* Producers wait here for space */
+};
+
+static_assert(sizeof(ShmChannelHeader_t) <= SHMCHANNEL_HEADER_SIZE, "Channel header doesn't fit in its page");
+static_assert(std::atomic<unsigned long long>::is_always_lock_free, "Shared memory atomics must be lock-free");
+
+static inline size_t RecordSize(size_t length)
+{
+	const size_t align = sizeof(ShmRecordHeader_t);
+	return (sizeof(ShmRecordHeader_t) + length + align - 1) & ~(align - 1);
+}
+
+static unsigned long long NowMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline unsigned long long Deadline(int timeoutMs) { return timeoutMs < 0 ? 0 : NowMs() + timeoutMs; }
+
+/* Waits on an event count prepared with key. Returns false once the deadline (0 for none) has passed */
+static bool WaitUntil(CEventCount& event, CEventCount::Key_t key, unsigned long long deadline)
+{
+	if (!deadline)
+	{
+		event.CommitWait(key);
+		return true;
+	}
+	unsigned long long now = NowMs();
+	if (now >= deadline)
+	{
+		event.CancelWait();
+		return false;
+	}
+	event.CommitWaitFor(key, (int)(deadline - now));
+	return true;
+}
+
+//===========================================
+//
+//      CShmChannel
+//
+//===========================================
+
+CShmChannel::CShmChannel() : m_header(nullptr), m_data(nullptr), m_capacity(0), m_mapSize(0), m_readLen(0), m_owner(false)
+{
+	m_name[0] = 0;
+}
+
+CShmChannel::~CShmChannel() { Close(); }
+
+bool CShmChannel::Map(int fd, size_t size)
+{
+#ifdef _POSIX
+	void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+		return false;
+	m_header  = static_cast<ShmChannelHeader_t*>(base);
+	m_data	  = static_cast<unsigned char*>(base) + SHMCHANNEL_HEADER_SIZE;
+	m_mapSize = size;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool CShmChannel::Create(const char* name, size_t capacity, EShmChannelMode mode)
+{
+#ifdef _POSIX
+	Close();
+	if (!name || strlen(name) >= sizeof(m_name))
+		return false;
+
+	size_t cap = SHMCHANNEL_MIN_SIZE;
+	while (cap < capacity)
+		cap <<= 1;
+
+	/* Left behind by a crashed server */
+	shm_unlink(name);
+
+	int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+		return false;
+
+	/* ftruncate zero fills, which is exactly the empty state the ring needs */
+	if (ftruncate(fd, SHMCHANNEL_HEADER_SIZE + cap) != 0 || !Map(fd, SHMCHANNEL_HEADER_SIZE + cap))
+	{
+		close(fd);
+		shm_unlink(name);
+		return false;
+	}
+	close(fd);
+
+	m_header->magic	     = SHMCHANNEL_MAGIC;
+	m_header->version    = SHMCHANNEL_VERSION;
+	m_header->headerSize = sizeof(ShmChannelHeader_t);
+	m_header->mode	     = (unsigned int)mode;
+	m_header->capacity   = cap;
+	m_header->writePos.store(0, std::memory_order_relaxed);
+	m_header->readPos.store(0, std::memory_order_relaxed);
+	new (&m_header->dataEvent) CEventCount(true);
+	new (&m_header->spaceEvent) CEventCount(true);
+	m_header->state.store(CHANNEL_READY, std::memory_order_release);
+
+	m_capacity = cap;
+	m_owner	   = true;
+	snprintf(m_name, sizeof(m_name), "%s", name);
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool CShmChannel::Open(const char* name, int timeoutMs)
+{
+#ifdef _POSIX
+	Close();
+	if (!name || strlen(name) >= sizeof(m_name))
+		return false;
+
+	unsigned long long deadline = NowMs() + (timeoutMs > 0 ? timeoutMs : 0);
+
+	/* Wait for the creator to make the object and size it */
+	int	    fd = -1;
+	struct stat st;
+	for (;;)
+	{
+		fd = shm_open(name, O_RDWR, 0);
+		if (fd >= 0)
+		{
+			if (fstat(fd, &st) == 0 && st.st_size >= SHMCHANNEL_HEADER_SIZE + SHMCHANNEL_MIN_SIZE)
+				break;
+			close(fd);
+			fd = -1;
+		}
+		if (NowMs() >= deadline)
+			return false;
+		threadtools::sleep(1);
+	}
+
+	/* Version handshake. Only the header is mapped until we know the layout matches */
+	ShmChannelHeader_t* header =
+		static_cast<ShmChannelHeader_t*>(mmap(nullptr, SHMCHANNEL_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+	if ((void*)header == MAP_FAILED)
+	{
+		close(fd);
+		return false;
+	}
+
+	while (header->state.load(std::memory_order_acquire) != CHANNEL_READY && NowMs() < deadline)
+		threadtools::sleep(1);
+
+	bool valid = header->state.load(std::memory_order_acquire) == CHANNEL_READY && header->magic == SHMCHANNEL_MAGIC &&
+		     header->version == SHMCHANNEL_VERSION && header->headerSize == sizeof(ShmChannelHeader_t);
+	size_t cap = valid ? (size_t)header->capacity : 0;
+	munmap(header, SHMCHANNEL_HEADER_SIZE);
+
+	if (!valid || (cap & (cap - 1)) != 0 || (size_t)st.st_size < SHMCHANNEL_HEADER_SIZE + cap || !Map(fd, SHMCHANNEL_HEADER_SIZE + cap))
+	{
+		close(fd);
+		return false;
+	}
+	close(fd);
+
+	m_capacity = cap;
+	m_owner	   = false;
+	snprintf(m_name, sizeof(m_name), "%s", name);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CShmChannel::Close()
+{
+#ifdef _POSIX
+	if (!m_header)
+		return;
+	munmap(m_header, m_mapSize);
+	if (m_owner)
+		shm_unlink(m_name);
+#endif
+	m_header   = nullptr;
+	m_data	   = nullptr;
+	m_capacity = 0;
+	m_mapSize  = 0;
+	m_readLen  = 0;
+	m_owner	   = false;
+	m_name[0]  = 0;
+}
+
+EShmChannelMode CShmChannel::Mode() const { return m_header ? (EShmChannelMode)m_header->mode : EShmChannelMode::SPSC; }
+
+size_t CShmChannel::MaxMessageSize() const { return m_capacity ? m_capacity - sizeof(ShmRecordHeader_t) : 0; }
+
+unsigned long long CShmChannel::ReserveWrite(size_t need, unsigned long long deadline, bool& ok)
+{
+	const bool mpsc = m_header->mode == (unsigned int)EShmChannelMode::MPSC;
+
+	auto advance = [&](unsigned long long& pos, unsigned long long newPos) {
+		if (mpsc)
+			return m_header->writePos.compare_exchange_weak(pos, newPos, std::memory_order_acq_rel);
+		m_header->writePos.store(newPos, std::memory_order_release);
+		return true;
+	};
+
+	for (;;)
+	{
+		unsigned long long pos	  = m_header->writePos.load(std::memory_order_acquire);
+		unsigned long long read	  = m_header->readPos.load(std::memory_order_acquire);
+		unsigned long long free	  = m_capacity - (pos - read);
+		size_t		   offset = (size_t)(pos & (m_capacity - 1));
+		size_t		   tail	  = m_capacity - offset;
+
+		if (tail < need)
+		{
+			/* Doesn't fit before the end of the ring. Pad out the tail as a record of its own, then try again at offset 0 */
+			if (free >= tail)
+			{
+				if (advance(pos, pos + tail))
+				{
+					ShmRecordHeader_t* pad = reinterpret_cast<ShmRecordHeader_t*>(m_data + offset);
+					pad->length	       = (unsigned int)(tail - sizeof(ShmRecordHeader_t));
+					pad->type.store(RECORD_PAD, std::memory_order_release);
+					m_header->dataEvent.Notify();
+				}
+				continue;
+			}
+		}
+		else if (free >= need)
+		{
+			if (advance(pos, pos + need))
+			{
+				ok = true;
+				return pos;
+			}
+			continue;
+		}
+
+		/* Full, wait for the consumer to release something */
+		auto key = m_header->spaceEvent.PrepareWait();
+		if (m_header->readPos.load(std::memory_order_acquire) != read || m_header->writePos.load(std::memory_order_acquire) != pos)
+		{
+			m_header->spaceEvent.CancelWait();
+			continue;
+		}
+		if (!WaitUntil(m_header->spaceEvent, key, deadline))
+		{
+			ok = false;
+			return 0;
+		}
+	}
+}
+
+void* CShmChannel::BeginWrite(size_t size, int timeoutMs)
+{
+	if (!m_header)
+		return nullptr;
+	size_t need = RecordSize(size);
+	if (need > m_capacity)
+		return nullptr;
+
+	bool		   ok;
+	unsigned long long pos = ReserveWrite(need, Deadline(timeoutMs), ok);
+	if (!ok)
+		return nullptr;
+
+	ShmRecordHeader_t* rec = reinterpret_cast<ShmRecordHeader_t*>(m_data + (pos & (m_capacity - 1)));
+	rec->length	       = (unsigned int)size;
+	return rec + 1;
+}
+
+void CShmChannel::CommitWrite(void* msg)
+{
+	ShmRecordHeader_t* rec = static_cast<ShmRecordHeader_t*>(msg) - 1;
+	rec->type.store(RECORD_DATA, std::memory_order_release);
+	m_header->dataEvent.Notify();
+}
+
+bool CShmChannel::Write(const void* data, size_t size, int timeoutMs)
+{
+	void* msg = BeginWrite(size, timeoutMs);
+	if (!msg)
+		return false;
+	memcpy(msg, data, size);
+	CommitWrite(msg);
+	return true;
+}
+
+const void* CShmChannel::BeginRead(size_t* size, int timeoutMs)
+{
+	if (!m_header)
+		return nullptr;
+
+	unsigned long long deadline = Deadline(timeoutMs);
+	for (;;)
+	{
+		unsigned long long read	  = m_header->readPos.load(std::memory_order_relaxed);
+		size_t		   offset = (size_t)(read & (m_capacity - 1));
+		ShmRecordHeader_t* rec	  = reinterpret_cast<ShmRecordHeader_t*>(m_data + offset);
+
+		unsigned int type = rec->type.load(std::memory_order_acquire);
+		if (type == RECORD_DATA)
+		{
+			m_readLen = RecordSize(rec->length);
+			if (size)
+				*size = rec->length;
+			return rec + 1;
+		}
+		if (type == RECORD_PAD)
+		{
+			size_t len = m_capacity - offset;
+			memset((void*)rec, 0, len);
+			m_header->readPos.store(read + len, std::memory_order_release);
+			m_header->spaceEvent.Notify();
+			continue;
+		}
+
+		/* Nothing committed yet */
+		auto key = m_header->dataEvent.PrepareWait();
+		if (rec->type.load(std::memory_order_acquire) != RECORD_EMPTY)
+		{
+			m_header->dataEvent.CancelWait();
+			continue;
+		}
+		if (!WaitUntil(m_header->dataEvent, key, deadline))
+			return nullptr;
+	}
+}
+
+void CShmChannel::EndRead()
+{
+	if (!m_header || !m_readLen)
+		return;
+
+	unsigned long long read = m_header->readPos.load(std::memory_order_relaxed);
+	/* Producers rely on free space being zeroed, see RECORD_EMPTY */
+	memset(m_data + (read & (m_capacity - 1)), 0, m_readLen);
+	m_header->readPos.store(read + m_readLen, std::memory_order_release);
+	m_readLen = 0;
+	m_header->spaceEvent.Notify();
+}
+
+long long CShmChannel::Read(void* buf, size_t maxSize, int timeoutMs)
+{
+	size_t	    size;
+	const void* msg = BeginRead(&size, timeoutMs);
+	if (!msg)
+		return 0;
+	if (size > maxSize)
+	{
+		EndRead();
+		return -1;
+	}
+	memcpy(buf, msg, size);
+	EndRead();
+	return (long long)size;
+}
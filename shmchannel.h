@@ -0,0 +1,109 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * shmchannel.h
+ * 	Cross-process message ring in shared memory
+ *
+ * One process creates the channel, others open it by name. Messages are variable sized and written straight into the
+ * shared ring (BeginWrite/CommitWrite) and read straight out of it (BeginRead/EndRead), so nothing is copied on the
+ * way through. Readers and writers that have to wait sleep on process-shared futexes.
+ * A single consumer is supported. With EShmChannelMode::MPSC any number of producers (threads or processes) may write.
+ *
+ * When opening, the header is checked against SHMCHANNEL_VERSION and the layout of this build, so mismatched
+ * binaries fail to open instead of corrupting each other.
+ *
+ * Only available on POSIX, Create/Open fail elsewhere.
+ *
+ * USAGE:
+ * 	// Server
+ * 	CShmChannel chan;
+ * 	chan.Create("/server_stats", 1 << 20, EShmChannelMode::MPSC);
+ * 	chan.Write(&stats, sizeof(stats));
+ *
+ * 	// Monitor
+ * 	CShmChannel chan;
+ * 	chan.Open("/server_stats", 5000);
+ * 	size_t len;
+ * 	while (const void* msg = chan.BeginRead(&len))
+ * 	{
+ * 		...
+ * 		chan.EndRead();
+ * 	}
+ */
+#pragma once
+
+#include "public.h"
+#include "threadtools.h"
+
+/* Bump whenever the shared layout changes */
+#define SHMCHANNEL_VERSION 1
+
+enum class EShmChannelMode
+{
+	SPSC = 0, /* One producer, one consumer */
+	MPSC,	  /* Many producers, one consumer */
+};
+
+class EXPORT CShmChannel
+{
+private:
+	struct ShmChannelHeader_t* m_header;
+	unsigned char*		   m_data;
+	size_t			   m_capacity;
+	size_t			   m_mapSize;
+	size_t			   m_readLen; /* Bytes the current BeginRead will release */
+	bool			   m_owner;
+	char			   m_name[256];
+
+	bool		   Map(int fd, size_t size);
+	unsigned long long ReserveWrite(size_t need, unsigned long long deadline, bool& ok);
+
+public:
+	CShmChannel();
+	~CShmChannel();
+
+	CShmChannel(const CShmChannel&) = delete;
+	CShmChannel(CShmChannel&&)	= delete;
+
+	/* Creates a channel with room for capacity bytes of messages (rounded up to a power of two).
+	 * Any stale channel with the same name is replaced. The channel is removed when the creator closes it */
+	bool Create(const char* name, size_t capacity, EShmChannelMode mode = EShmChannelMode::SPSC);
+
+	/* Opens a channel created by another process, waiting up to timeoutMs for it to appear and finish initializing */
+	bool Open(const char* name, int timeoutMs = 0);
+
+	void Close();
+	bool IsOpen() const { return m_header != nullptr; }
+
+	/* Producer side. BeginWrite reserves space for a message of size bytes and returns where to write it,
+	 * or nullptr if it timed out (timeoutMs = -1 waits forever) or the message can never fit.
+	 * Every BeginWrite must be followed by CommitWrite with the returned pointer */
+	void* BeginWrite(size_t size, int timeoutMs = -1);
+	void  CommitWrite(void* msg);
+	bool  Write(const void* data, size_t size, int timeoutMs = -1);
+
+	/* Consumer side. BeginRead returns the next message and its size, or nullptr if it timed out.
+	 * The message stays valid until EndRead */
+	const void* BeginRead(size_t* size, int timeoutMs = -1);
+	void	    EndRead();
+
+	/* Copies the next message into buf. Returns its size, 0 on timeout or -1 if buf is too small (the message is dropped) */
+	long long Read(void* buf, size_t maxSize, int timeoutMs = -1);
+
+	/* Largest message that can be written */
+	size_t		MaxMessageSize() const;
+	size_t		Capacity() const { return m_capacity; }
+	const char*	Name() const { return m_name; }
+	EShmChannelMode Mode() const;
+};
@@ -0,0 +1,58 @@
+/**
+ * bench_flat.cpp
+ * 	Lookups in a 1000-element FlatSet<int> vs std::set<int>. Not run by ctest
+ */
+#include "unittestlib.h"
+#include "containers/flatset.h"
+
+#include <set>
+#include <vector>
+
+#define NUM_ELEMENTS 1000
+#define NUM_LOOKUPS  1000000
+#define ITERATIONS   10
+
+template <class SetT> static void Bench(CUnitTestSuite* suite, const char* name, const SetT& set, const std::vector<int>& probes)
+{
+	auto		   test = suite->CreateTimedTest(name);
+	volatile long long sink = 0;
+	test->IteratedTest(
+		[&]()
+		{
+			long long found = 0;
+			for (int p : probes)
+				found += set.count(p);
+			sink = found;
+		},
+		ITERATIONS, "lookup");
+	/* Every other probe is a hit */
+	test->MustBeEqual((long long)sink, (long long)NUM_LOOKUPS / 2, "hits");
+	suite->Submit(test);
+}
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("flat benchmark");
+
+	/* Even numbers are in the set, odd probes miss */
+	std::vector<int> values;
+	for (int i = 0; i < NUM_ELEMENTS; i++)
+		values.push_back(i * 2);
+
+	std::vector<int> probes(NUM_LOOKUPS);
+	unsigned	 seed = 1;
+	for (size_t i = 0; i < probes.size(); i++)
+	{
+		seed	  = seed * 1103515245u + 12345u;
+		probes[i] = (int)((seed >> 8) % NUM_ELEMENTS) * 2 + (int)(i & 1);
+	}
+
+	FlatSet<int>  flat(values.data(), values.size());
+	std::set<int> tree(values.begin(), values.end());
+	Bench(suite, "FlatSet", flat, probes);
+	Bench(suite, "std::set", tree, probes);
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
@@ -0,0 +1,72 @@
+/**
+ * bench_hashmap.cpp
+ * 	HashMap vs std::unordered_map lookups on 1M u64 keys. Not run by ctest
+ */
+#include "unittestlib.h"
+#include "containers/hashmap.h"
+
+#include <unordered_map>
+#include <vector>
+
+#define NUM_KEYS   1000000
+#define ITERATIONS 5
+
+static unsigned long long Scramble(unsigned long long x)
+{
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDULL;
+	x ^= x >> 33;
+	return x;
+}
+
+template <class MapT> static void Bench(CUnitTestSuite* suite, const char* name, const std::vector<unsigned long long>& keys)
+{
+	MapT map;
+	map.reserve(keys.size());
+	for (auto k : keys)
+		map[k] = k;
+
+	auto		   test = suite->CreateTimedTest(std::string(name) + " hits");
+	volatile long long sink = 0;
+	test->IteratedTest(
+		[&]()
+		{
+			long long found = 0;
+			for (auto k : keys)
+				found += map.count(k);
+			sink = sink + found;
+		},
+		ITERATIONS, "hits");
+	test->MustBeEqual((long long)sink, (long long)keys.size() * ITERATIONS, "hits found");
+	suite->Submit(test);
+
+	test = suite->CreateTimedTest(std::string(name) + " misses");
+	sink = 0;
+	test->IteratedTest(
+		[&]()
+		{
+			long long found = 0;
+			for (auto k : keys)
+				found += map.count(~k);
+			sink = sink + found;
+		},
+		ITERATIONS, "misses");
+	test->MustBeEqual((long long)sink, 0LL, "misses found");
+	suite->Submit(test);
+}
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("hashmap benchmark");
+
+	std::vector<unsigned long long> keys(NUM_KEYS);
+	for (size_t i = 0; i < keys.size(); i++)
+		keys[i] = Scramble(i) & ~(1ULL << 63); /* Keep ~k out of the key set */
+
+	Bench<HashMap<unsigned long long, unsigned long long>>(suite, "HashMap", keys);
+	Bench<std::unordered_map<unsigned long long, unsigned long long>>(suite, "std::unordered_map", keys);
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
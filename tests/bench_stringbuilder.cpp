@@ -0,0 +1,68 @@
+/**
+ * bench_stringbuilder.cpp
+ * 	StringBuilder vs std::ostringstream building 200k small JSON records. Not run by ctest
+ */
+#include "unittestlib.h"
+#include "containers/stringbuilder.h"
+
+#include <sstream>
+
+#define NUM_RECORDS 200000
+#define ITERATIONS  5
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("stringbuilder benchmark");
+
+	/* Values stay under 6 significant digits so both sides print floats the same way */
+	char name[32];
+	auto makeName = [&](int i) { snprintf(name, sizeof(name), "entry%d", i); };
+
+	String builderOut;
+	auto   test = suite->CreateTimedTest("StringBuilder");
+	test->IteratedTest(
+		[&]()
+		{
+			StringBuilder sb;
+			for (int i = 0; i < NUM_RECORDS; i++)
+			{
+				makeName(i);
+				sb.append("{\"name\":", 8).append_json(name);
+				sb.append(",\"id\":", 6).append(i);
+				sb.append(",\"value\":", 9).append((i % 1000) * 0.25);
+				sb.append(",\"ok\":", 6).append(i % 3 == 0);
+				sb.append("}\n", 2);
+			}
+			builderOut = sb.str();
+		},
+		ITERATIONS, "build");
+	suite->Submit(test);
+
+	std::string streamOut;
+	test = suite->CreateTimedTest("std::ostringstream");
+	test->IteratedTest(
+		[&]()
+		{
+			std::ostringstream ss;
+			for (int i = 0; i < NUM_RECORDS; i++)
+			{
+				makeName(i);
+				ss << "{\"name\":\"" << name << "\"";
+				ss << ",\"id\":" << i;
+				ss << ",\"value\":" << (i % 1000) * 0.25;
+				ss << ",\"ok\":" << (i % 3 == 0 ? "true" : "false");
+				ss << "}\n";
+			}
+			streamOut = ss.str();
+		},
+		ITERATIONS, "build");
+	suite->Submit(test);
+
+	auto check = suite->CreateTest("outputs match");
+	check->MustBeEqual(std::string(builderOut.c_str(), builderOut.length()), streamOut, "output");
+	suite->Submit(check);
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
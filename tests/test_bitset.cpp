@@ -0,0 +1,145 @@
+/**
+ * test_bitset.cpp
+ * 	Tests for BitSet and SparseBitSet, mostly serialization
+ */
+#include "unittestlib.h"
+#include "containers/bitset.h"
+#include "containers/buffer.h"
+
+#include <initializer_list>
+
+/* Deserializes hand-crafted input made of the given little endian words */
+template <class SetT> static bool DeserializeWords(SetT& set, std::initializer_list<unsigned long long> words)
+{
+	Buffer buf;
+	for (auto w : words)
+		buf.write_le(w);
+	buf.seek_start();
+	return set.Deserialize(buf);
+}
+
+static bool RoundTrip(const BitSet& in, BitSet& out)
+{
+	Buffer buf;
+	in.Serialize(buf);
+	buf.seek_start();
+	return out.Deserialize(buf) && buf.current_pos() == buf.size();
+}
+
+static bool RoundTrip(const SparseBitSet& in, SparseBitSet& out)
+{
+	Buffer buf;
+	in.Serialize(buf);
+	buf.seek_start();
+	return out.Deserialize(buf) && buf.current_pos() == buf.size();
+}
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("bitset");
+
+	{
+		auto test = suite->CreateTest("BitSet basics");
+		BitSet bits;
+		bits.set(3);
+		bits.set(64);
+		bits.set(200);
+		test->MustBeEqual(bits.size(), (size_t)201, "grows on set");
+		test->MustBeEqual(bits.count(), (size_t)3, "count");
+		test->MustBeEqual(bits.find_first(), (size_t)3, "find_first");
+		test->MustBeEqual(bits.find_next(3), (size_t)64, "find_next");
+		test->MustBeEqual(bits.find_next(200), BitSet::NPOS, "find_next at end");
+		bits.flip(64);
+		test->AssertFalse(bits.test(64), "flip");
+		bits.resize(100);
+		test->MustBeEqual(bits.count(), (size_t)1, "truncated");
+
+		/* NPOS is the "nothing found" value, it must not be treated as a bit to grow to */
+		BitSet empty;
+		empty.set(empty.find_first());
+		empty.flip(BitSet::NPOS);
+		test->MustBeEqual(empty.size(), (size_t)0, "set(NPOS) ignored");
+		SparseBitSet sparse;
+		sparse.set(SparseBitSet::NPOS);
+		test->MustBeEqual(sparse.count(), (size_t)0, "sparse set(NPOS) ignored");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("BitSet round trip");
+		bool ok = true;
+		for (size_t size : {0, 1, 63, 64, 65, 1000})
+		{
+			BitSet in(size), out;
+			for (size_t i = 0; i < size; i += 7)
+				in.set(i);
+			if (size)
+				in.set(size - 1);
+			ok &= RoundTrip(in, out) && in == out && out.size() == size && out.count() == in.count();
+		}
+		test->AssertTrue(ok, "sizes 0..1000");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("BitSet rejects crafted input");
+		BitSet bits;
+
+		test->AssertFalse(DeserializeWords(bits, {}), "empty buffer");
+		test->AssertFalse(DeserializeWords(bits, {130, 1, 2}), "fewer words than the size needs");
+
+		/* Would wrap to a tiny word count if computed as (bits + 63) / 64 */
+		test->AssertFalse(DeserializeWords(bits, {~0ULL - 10, 1}), "size near 2^64");
+		test->AssertFalse(DeserializeWords(bits, {1ULL << 62}), "huge size");
+
+		/* Bits past the declared size are dropped */
+		test->AssertTrue(DeserializeWords(bits, {3, ~0ULL}), "valid with junk tail bits");
+		test->MustBeEqual(bits.count(), (size_t)3, "tail bits trimmed");
+		suite->Submit(test);
+	}
+
+	{
+		auto	     test = suite->CreateTest("SparseBitSet round trip");
+		SparseBitSet in, out;
+		const size_t indices[] = {0, 1, 63, 64, 4095, 4096, 100000, 5000000, 123456789};
+		for (size_t i : indices)
+			in.set(i);
+		test->AssertTrue(RoundTrip(in, out), "deserialized");
+		test->AssertTrue(in == out, "equal");
+		test->MustBeEqual(out.count(), sizeof(indices) / sizeof(indices[0]), "count");
+		bool ok = true;
+		for (size_t i : indices)
+			ok &= out.test(i);
+		test->AssertTrue(ok, "bits");
+
+		SparseBitSet empty, emptyOut;
+		emptyOut.set(5);
+		test->AssertTrue(RoundTrip(empty, emptyOut) && emptyOut.none(), "empty replaces previous contents");
+		suite->Submit(test);
+	}
+
+	{
+		auto	     test = suite->CreateTest("SparseBitSet rejects crafted input");
+		SparseBitSet bits;
+
+		test->AssertFalse(DeserializeWords(bits, {1ULL << 60}), "block count larger than the input");
+		test->AssertFalse(DeserializeWords(bits, {1, 0, 1}), "truncated block");
+		test->AssertFalse(DeserializeWords(bits, {1, 0, 0, 0}), "empty summary");
+		test->AssertFalse(DeserializeWords(bits, {1, 0, 1, 0}), "zero word listed in the summary");
+		test->AssertFalse(DeserializeWords(bits, {2, 5, 1, 1, 5, 1, 1}), "duplicate block");
+		test->AssertFalse(DeserializeWords(bits, {2, 5, 1, 1, 4, 1, 1}), "decreasing blocks");
+
+		/* One block index could otherwise demand a block table of gigabytes */
+		test->AssertFalse(DeserializeWords(bits, {1, SparseBitSet::MAX_SERIALIZED_BLOCKS, 1, 1}), "block index too large");
+		test->AssertTrue(DeserializeWords(bits, {1, SparseBitSet::MAX_SERIALIZED_BLOCKS - 1, 1, 1}), "last allowed block");
+		test->AssertTrue(bits.test((SparseBitSet::MAX_SERIALIZED_BLOCKS - 1) * SparseBitSet::BLOCK_BITS), "bit in last block");
+
+		bits.set(42);
+		test->AssertTrue(DeserializeWords(bits, {1, 0, 1, 1, 2, 0, 1, 1}) && bits.count() == 1 && !bits.test(42), "trailing data ignored, old contents dropped");
+		suite->Submit(test);
+	}
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
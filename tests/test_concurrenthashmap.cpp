@@ -0,0 +1,107 @@
+/**
+ * test_concurrenthashmap.cpp
+ * 	Tests for ConcurrentHashMap, mostly that replaced nodes actually get freed
+ */
+#include "unittestlib.h"
+#include "containers/concurrenthashmap.h"
+#include "reclaim.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+static std::atomic<int> s_liveValues(0);
+
+struct Tracked_t
+{
+	int value;
+	Tracked_t(int v = 0) : value(v) { s_liveValues++; }
+	Tracked_t(const Tracked_t& other) : value(other.value) { s_liveValues++; }
+	Tracked_t& operator=(const Tracked_t& other) = default;
+	~Tracked_t() { s_liveValues--; }
+};
+
+#define NUM_KEYS    16
+#define NUM_ASSIGNS 100000
+#define NUM_THREADS 4
+
+/* Retired nodes still waiting for the epoch to move on. A few batches per thread is fine, growing with the
+ * number of assignments is not */
+static constexpr int MAX_PENDING = 4 * (int)CEpochDomain::RECLAIM_THRESHOLD;
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("concurrenthashmap");
+
+	{
+		auto test = suite->CreateTest("replaced values are reclaimed");
+		{
+			ConcurrentHashMap<int, Tracked_t> map;
+			int				  peak = 0;
+			for (int i = 0; i < NUM_ASSIGNS; i++)
+			{
+				map.insert_or_assign(i % NUM_KEYS, Tracked_t(i));
+				peak = std::max(peak, s_liveValues.load());
+			}
+			test->MustBeEqual(map.size(), (size_t)NUM_KEYS, "size");
+			test->AssertTrue(peak <= NUM_KEYS + MAX_PENDING, "live values stay bounded while assigning");
+
+			Tracked_t out;
+			test->AssertTrue(map.find(3, out) && out.value == NUM_ASSIGNS - NUM_KEYS + 3, "latest value wins");
+
+			GlobalEpochDomain().Reclaim();
+			test->AssertTrue(s_liveValues.load() <= NUM_KEYS + 1 + MAX_PENDING, "after Reclaim");
+
+			for (int k = 0; k < NUM_KEYS; k++)
+				map.erase(k);
+			test->AssertTrue(map.empty(), "erased");
+		}
+		GlobalEpochDomain().Reclaim();
+		test->AssertTrue(s_liveValues.load() <= MAX_PENDING, "erased values are reclaimed");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("concurrent assign and find");
+		{
+			ConcurrentHashMap<int, Tracked_t> map;
+			std::atomic<int>		  peak(0);
+			std::atomic<int>		  badReads(0);
+			std::vector<std::thread>	  threads;
+			for (int t = 0; t < NUM_THREADS; t++)
+			{
+				threads.emplace_back(
+					[&, t]()
+					{
+						for (int i = 0; i < NUM_ASSIGNS / NUM_THREADS; i++)
+						{
+							int key = (i + t) % NUM_KEYS;
+							map.insert_or_assign(key, Tracked_t(key));
+							Tracked_t out;
+							if (map.find(key, out) && out.value != key)
+								badReads++;
+							int live = s_liveValues.load();
+							if (live > peak.load())
+								peak.store(live);
+						}
+					});
+			}
+			for (auto& th : threads)
+				th.join();
+			test->MustBeEqual(badReads.load(), 0, "reads see whole values");
+			test->MustBeEqual(map.size(), (size_t)NUM_KEYS, "size");
+			/* A thread descheduled inside a critical section holds the epoch back for its whole time slice, so this
+			 * is loose. Without reclamation it would be every assignment */
+			test->AssertTrue(peak.load() <= NUM_ASSIGNS / 10, "live values stay bounded");
+		}
+		GlobalEpochDomain().Reclaim();
+		/* Whatever the exited threads still had retired went to the orphan list, which Reclaim collects */
+		test->AssertTrue(s_liveValues.load() <= NUM_THREADS * MAX_PENDING, "after the threads exit");
+		suite->Submit(test);
+	}
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
@@ -0,0 +1,183 @@
+/**
+ * test_deque.cpp
+ * 	Tests for Deque
+ */
+#include "unittestlib.h"
+#include "containers/deque.h"
+
+#include <deque>
+#include <vector>
+
+static int s_liveValues = 0;
+
+struct Counted_t
+{
+	int value;
+	Counted_t(int v = 0) : value(v) { s_liveValues++; }
+	Counted_t(const Counted_t& other) : value(other.value) { s_liveValues++; }
+	~Counted_t() { s_liveValues--; }
+};
+
+/* Tiny chunks so every test crosses plenty of chunk boundaries and recentres the map */
+template <class T> using SmallDeque = Deque<T, 4>;
+
+template <class A, class B> static bool SameContents(const A& a, const B& b)
+{
+	if (a.size() != b.size())
+		return false;
+	size_t i = 0;
+	for (auto& v : a)
+	{
+		if (v != b[i] || a[i] != b[i])
+			return false;
+		i++;
+	}
+	return i == b.size();
+}
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("deque");
+
+	{
+		auto test = suite->CreateTest("growth at both ends");
+		SmallDeque<int> d;
+		std::deque<int> ref;
+		for (int i = 0; i < 1000; i++)
+		{
+			if (i % 3 == 0)
+			{
+				d.push_front(i);
+				ref.push_front(i);
+			}
+			else
+			{
+				d.push_back(i);
+				ref.push_back(i);
+			}
+		}
+		test->AssertTrue(SameContents(d, ref), "mixed pushes");
+		test->MustBeEqual(d.front(), ref.front(), "front");
+		test->MustBeEqual(d.back(), ref.back(), "back");
+
+		/* Only ever growing one way has to keep recentring the map */
+		SmallDeque<int> front;
+		for (int i = 0; i < 1000; i++)
+			front.push_front(i);
+		bool ok = front.size() == 1000;
+		for (int i = 0; i < 1000; i++)
+			ok &= front[i] == 999 - i;
+		test->AssertTrue(ok, "front only");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("element addresses are stable");
+		SmallDeque<int>	  d;
+		std::vector<int*> ptrs;
+		for (int i = 0; i < 100; i++)
+			ptrs.push_back(&d.emplace_back(i));
+		for (int i = 0; i < 500; i++)
+		{
+			d.push_front(-i);
+			d.push_back(1000 + i);
+		}
+		bool ok = true;
+		for (int i = 0; i < 100; i++)
+			ok &= *ptrs[i] == i && &d[500 + i] == ptrs[i];
+		test->AssertTrue(ok, "pointers survive pushes at both ends");
+
+		for (int i = 0; i < 500; i++)
+		{
+			d.pop_front();
+			d.pop_back();
+		}
+		for (int i = 0; i < 100; i++)
+			ok &= *ptrs[i] == i && &d[i] == ptrs[i];
+		test->AssertTrue(ok, "pointers survive pops at both ends");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("queue usage");
+		SmallDeque<int> d;
+		std::deque<int> ref;
+		/* Push back, pop front at a steady size: the window slides through the map */
+		for (int i = 0; i < 10000; i++)
+		{
+			d.push_back(i);
+			ref.push_back(i);
+			if (d.size() > 10)
+			{
+				d.pop_front();
+				ref.pop_front();
+			}
+		}
+		test->AssertTrue(SameContents(d, ref), "sliding window");
+		while (!d.empty())
+			d.pop_back();
+		test->MustBeEqual(d.size(), (size_t)0, "drained");
+		d.push_front(7);
+		test->MustBeEqual(d.front(), 7, "reuse after drain");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("erase, remove, contains, concat");
+		SmallDeque<int> d = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+		auto it = d.begin();
+		++it;
+		++it;
+		d.erase(it);
+		d.remove(8);
+		test->AssertTrue(SameContents(d, std::vector<int>({1, 2, 4, 5, 6, 7, 9})), "after erase");
+		test->AssertTrue(d.contains(9), "contains");
+		test->AssertFalse(d.contains(3), "erased");
+
+		SmallDeque<int> other = {10, 11};
+		d += other;
+		test->MustBeEqual(d.back(), 11, "concat");
+		test->MustBeEqual(d.size(), (size_t)9, "concat size");
+
+		size_t total = 0;
+		d.ForEachChunk([&](int*, size_t n) { total += n; });
+		test->MustBeEqual(total, d.size(), "ForEachChunk covers everything");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("copy, move and destruction");
+		{
+			SmallDeque<Counted_t> d;
+			for (int i = 0; i < 50; i++)
+			{
+				d.emplace_back(i);
+				d.emplace_front(-i);
+			}
+			test->MustBeEqual(s_liveValues, 100, "after push");
+
+			SmallDeque<Counted_t> copy(d);
+			test->MustBeEqual(s_liveValues, 200, "after copy");
+			test->MustBeEqual(copy.front().value, -49, "copy front");
+			test->MustBeEqual(copy.back().value, 49, "copy back");
+
+			SmallDeque<Counted_t> moved(std::move(copy));
+			test->MustBeEqual(s_liveValues, 200, "move doesn't copy");
+
+			for (int i = 0; i < 25; i++)
+			{
+				d.pop_front();
+				d.pop_back();
+			}
+			test->MustBeEqual(s_liveValues, 150, "after pop");
+			d.clear();
+			test->MustBeEqual(s_liveValues, 100, "after clear");
+		}
+		test->MustBeEqual(s_liveValues, 0, "after destruction");
+		suite->Submit(test);
+	}
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
@@ -0,0 +1,165 @@
+/**
+ * test_flat.cpp
+ * 	Tests for FlatSet and FlatMap
+ */
+#include "unittestlib.h"
+#include "containers/flatset.h"
+#include "containers/flatmap.h"
+
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+/* Deterministic pseudo random values in [0, range) */
+static std::vector<int> RandomInts(size_t count, int range, unsigned seed)
+{
+	std::vector<int> out(count);
+	for (auto& v : out)
+	{
+		seed = seed * 1103515245u + 12345u;
+		v    = (int)((seed >> 8) % (unsigned)range);
+	}
+	return out;
+}
+
+template <class SetT> static std::vector<int> Elements(const SetT& set) { return std::vector<int>(set.begin(), set.end()); }
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("flat");
+
+	std::vector<int> a = RandomInts(500, 1000, 1);
+	std::vector<int> b = RandomInts(300, 1000, 2);
+	std::set<int>	 refA(a.begin(), a.end()), refB(b.begin(), b.end());
+
+	{
+		auto	     test = suite->CreateTest("construction sorts and dedups");
+		FlatSet<int> set(a.data(), a.size());
+		test->AssertTrue(Elements(set) == Elements(refA), "contents");
+		FlatSet<int> init = {5, 3, 5, 1, 3};
+		test->AssertTrue(Elements(init) == std::vector<int>({1, 3, 5}), "initializer list");
+		suite->Submit(test);
+	}
+
+	{
+		auto	     test = suite->CreateTest("lookup, insert, erase");
+		FlatSet<int> set(a.data(), a.size());
+		bool	     ok = true;
+		for (int i = 0; i < 1000; i++)
+			ok &= set.contains(i) == (refA.count(i) == 1);
+		test->AssertTrue(ok, "contains");
+
+		test->AssertFalse(set.insert(*refA.begin()).second, "duplicate insert");
+		test->AssertTrue(set.insert(-1).second, "new insert");
+		test->MustBeEqual(set.front(), -1, "front after insert");
+		test->MustBeEqual(set.erase(-1), (size_t)1, "erase");
+		test->MustBeEqual(set.erase(-1), (size_t)0, "erase missing");
+
+		set.insert(b.data(), b.size());
+		std::set<int> refUnion = refA;
+		refUnion.insert(b.begin(), b.end());
+		test->AssertTrue(Elements(set) == Elements(refUnion), "batch insert");
+		test->MustBeEqual(set.erase_if([](int v) { return v % 2 == 0; }), (size_t)std::count_if(refUnion.begin(), refUnion.end(), [](int v) { return v % 2 == 0; }), "erase_if");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("unify");
+		FlatSet<int> set(a.data(), a.size()), other(b.data(), b.size());
+		set.unify(other);
+		std::vector<int> expected;
+		std::set_union(refA.begin(), refA.end(), refB.begin(), refB.end(), std::back_inserter(expected));
+		test->AssertTrue(Elements(set) == expected, "union");
+
+		FlatSet<int> self(a.data(), a.size());
+		self.unify(self);
+		test->AssertTrue(Elements(self) == Elements(refA), "with itself");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("intersect");
+		FlatSet<int> set(a.data(), a.size()), other(b.data(), b.size());
+		set.intersect(other);
+		std::vector<int> expected;
+		std::set_intersection(refA.begin(), refA.end(), refB.begin(), refB.end(), std::back_inserter(expected));
+		test->AssertTrue(Elements(set) == expected, "intersection");
+
+		/* A small set against a much bigger one takes the searching path */
+		std::vector<int> bigValues = RandomInts(20000, 100000, 3);
+		std::vector<int> smallValues = {bigValues[5], bigValues[500], -7, 100001, bigValues[19999]};
+		FlatSet<int>	 big(bigValues.data(), bigValues.size()), small(smallValues.data(), smallValues.size());
+		small.intersect(big);
+		std::set<int>	 refSmall(smallValues.begin(), smallValues.end()), refBig(bigValues.begin(), bigValues.end());
+		expected.clear();
+		std::set_intersection(refSmall.begin(), refSmall.end(), refBig.begin(), refBig.end(), std::back_inserter(expected));
+		test->AssertTrue(Elements(small) == expected, "searching path");
+
+		FlatSet<int> self(a.data(), a.size());
+		self.intersect(self);
+		test->AssertTrue(Elements(self) == Elements(refA), "with itself");
+
+		FlatSet<int> empty;
+		self.intersect(empty);
+		test->AssertTrue(self.empty(), "with empty");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("subtract");
+		FlatSet<int> set(a.data(), a.size()), other(b.data(), b.size());
+		set.subtract(other);
+		std::vector<int> expected;
+		std::set_difference(refA.begin(), refA.end(), refB.begin(), refB.end(), std::back_inserter(expected));
+		test->AssertTrue(Elements(set) == expected, "difference");
+
+		FlatSet<int> self(a.data(), a.size());
+		self.subtract(self);
+		test->AssertTrue(self.empty(), "with itself");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("equality and custom order");
+		FlatSet<int> x = {1, 2, 3}, y = {3, 2, 1, 1};
+		test->AssertTrue(x == y, "equal");
+		y.insert(4);
+		test->AssertTrue(x != y, "not equal");
+
+		FlatSet<int, std::greater<int>> desc = {1, 3, 2};
+		test->AssertTrue(Elements(desc) == std::vector<int>({3, 2, 1}), "descending");
+		test->AssertTrue(desc.contains(2), "descending lookup");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("FlatMap");
+		std::pair<int, int> items[] = {{3, 30}, {1, 10}, {3, 99}, {2, 20}};
+		FlatMap<int, int>   map(items, 4);
+		test->MustBeEqual(map.size(), (size_t)3, "duplicates dropped");
+		test->MustBeEqual(*map.get(3), 30, "first duplicate wins");
+
+		std::pair<int, int> more[] = {{2, 99}, {5, 50}, {4, 40}};
+		map.insert(more, 3);
+		test->MustBeEqual(*map.get(2), 20, "batch insert keeps existing");
+		test->MustBeEqual(*map.get(5), 50, "batch insert adds");
+
+		std::vector<int> keys;
+		for (auto& kv : map)
+			keys.push_back(kv.first);
+		test->AssertTrue(keys == std::vector<int>({1, 2, 3, 4, 5}), "sorted iteration");
+
+		test->AssertFalse(map.emplace(1, 0).second, "emplace existing");
+		map[6] = 60;
+		test->MustBeEqual(map.erase(6), (size_t)1, "erase");
+		test->AssertTrue(map.get(6) == nullptr, "erased");
+		test->MustBeEqual(map.erase_if([](const std::pair<int, int>& kv) { return kv.second >= 40; }), (size_t)2, "erase_if");
+		test->AssertTrue(map.find(4) == map.end(), "find missing");
+		suite->Submit(test);
+	}
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
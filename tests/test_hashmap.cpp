@@ -0,0 +1,170 @@
+/**
+ * test_hashmap.cpp
+ * 	Tests for HashMap
+ */
+#include "unittestlib.h"
+#include "containers/hashmap.h"
+#include "containers/string.h"
+
+#include <vector>
+#include <algorithm>
+
+static int s_liveValues = 0;
+
+struct Counted_t
+{
+	int value;
+	Counted_t(int v = 0) : value(v) { s_liveValues++; }
+	Counted_t(const Counted_t& other) : value(other.value) { s_liveValues++; }
+	~Counted_t() { s_liveValues--; }
+};
+
+/* Sends every key to the same home slot, so lookups have to probe past everything else */
+struct CollideHash_t
+{
+	size_t operator()(int) const { return 0; }
+};
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("hashmap");
+
+	{
+		auto test = suite->CreateTest("insert, find, erase");
+		HashMap<int, int> map;
+		for (int i = 0; i < 10000; i++)
+			map[i] = i * 2;
+		test->MustBeEqual(map.size(), (size_t)10000, "size");
+
+		/* Erase every third key in a scrambled order */
+		std::vector<int> keys;
+		for (int i = 0; i < 10000; i += 3)
+			keys.push_back(i);
+		for (size_t i = 0; i < keys.size(); i++)
+			std::swap(keys[i], keys[(i * 7919) % keys.size()]);
+		for (int k : keys)
+			test->MustBeEqual(map.erase(k), (size_t)1, "erase present");
+		test->MustBeEqual(map.erase(0), (size_t)0, "erase missing");
+
+		bool ok = true;
+		for (int i = 0; i < 10000; i++)
+		{
+			const int* v = map.get(i);
+			if (i % 3 == 0)
+				ok &= v == nullptr;
+			else
+				ok &= v && *v == i * 2;
+		}
+		test->AssertTrue(ok, "lookups after erase");
+		test->MustBeEqual(map.size(), (size_t)(10000 - keys.size()), "size after erase");
+
+		size_t visited = 0;
+		for (auto& kv : map)
+		{
+			ok &= kv.first % 3 != 0;
+			visited++;
+		}
+		test->AssertTrue(ok, "iteration skips erased");
+		test->MustBeEqual(visited, map.size(), "iteration count");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("churn leaves no tombstones");
+		HashMap<int, int> map;
+		for (int i = 0; i < 16; i++)
+			map[i] = i;
+		size_t capacity = map.capacity();
+
+		/* A tombstone scheme would fill the table with deleted markers and either grow or degrade */
+		for (int i = 16; i < 200000; i++)
+		{
+			map.erase(i - 16);
+			map[i] = i;
+		}
+		test->MustBeEqual(map.capacity(), capacity, "capacity unchanged");
+		test->MustBeEqual(map.size(), (size_t)16, "size");
+		bool ok = true;
+		for (int i = 200000 - 16; i < 200000; i++)
+			ok &= map.contains(i);
+		test->AssertTrue(ok, "survivors found");
+		test->AssertFalse(map.contains(200000 - 17), "erased missing");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("backward shift with full collisions");
+		HashMap<int, int, CollideHash_t> map;
+		for (int i = 0; i < 100; i++)
+			map[i] = i;
+		for (int i = 0; i < 100; i += 2)
+			map.erase(i);
+		bool ok = true;
+		for (int i = 0; i < 100; i++)
+			ok &= map.contains(i) == (i % 2 == 1);
+		test->AssertTrue(ok, "odd keys remain");
+		for (int i = 0; i < 100; i += 2)
+			map[i] = i;
+		for (int i = 0; i < 100; i++)
+			ok &= map.contains(i);
+		test->AssertTrue(ok, "reinserted");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("erase_if and iterator erase");
+		HashMap<int, int> map;
+		for (int i = 0; i < 1000; i++)
+			map[i] = i;
+		test->MustBeEqual(map.erase_if([](const std::pair<const int, int>& kv) { return kv.second >= 500; }), (size_t)500, "erase_if");
+
+		for (auto it = map.begin(); it != map.end();)
+		{
+			if (it->first % 2)
+				it = map.erase(it);
+			else
+				++it;
+		}
+		bool ok = map.size() == 250;
+		for (int i = 0; i < 1000; i++)
+			ok &= map.contains(i) == (i < 500 && i % 2 == 0);
+		test->AssertTrue(ok, "remaining keys");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("values are destroyed");
+		{
+			HashMap<int, Counted_t> map;
+			for (int i = 0; i < 100; i++)
+				map.emplace(i, i);
+			test->MustBeEqual(s_liveValues, 100, "after insert");
+			for (int i = 0; i < 50; i++)
+				map.erase(i);
+			test->MustBeEqual(s_liveValues, 50, "after erase");
+			map.rehash(0);
+			test->MustBeEqual(s_liveValues, 50, "after shrink");
+			map.clear();
+			test->MustBeEqual(s_liveValues, 0, "after clear");
+			map.emplace(1, 1);
+		}
+		test->MustBeEqual(s_liveValues, 0, "after destruction");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("heterogeneous string lookup");
+		HashMap<String, int> map;
+		map[String("alpha")] = 1;
+		map[String("beta")]  = 2;
+		test->MustBeEqual(map.get("alpha") ? *map.get("alpha") : 0, 1, "const char*");
+		test->MustBeEqual(map.get(StringView("beta")) ? *map.get(StringView("beta")) : 0, 2, "StringView");
+		test->MustBeEqual(map.erase("alpha"), (size_t)1, "erase by const char*");
+		test->AssertFalse(map.contains("alpha"), "erased");
+		suite->Submit(test);
+	}
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
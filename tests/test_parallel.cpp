@@ -0,0 +1,125 @@
+/**
+ * test_parallel.cpp
+ * 	Tests for parallel.h
+ */
+#include "unittestlib.h"
+#include "parallel.h"
+
+#include <vector>
+#include <numeric>
+#include <stdexcept>
+
+using namespace threadtools;
+
+/* Small grain so even short inputs get split across several chunks */
+#define TEST_GRAIN 16
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("parallel");
+	CThreadPool pool(4);
+
+	std::vector<int> in(1000);
+	for (size_t i = 0; i < in.size(); i++)
+		in[i] = (int)(i % 7) - 3;
+
+	{
+		auto test = suite->CreateTest("exclusive_scan into a wider type");
+		std::vector<long> out(in.size());
+		parallel_exclusive_scan(in.begin(), in.end(), out.begin(), 0, std::plus<long>(), TEST_GRAIN, pool);
+		long expected = 0;
+		for (size_t i = 0; i < in.size(); i++)
+		{
+			if (!test->MustBeEqual(out[i], expected, "prefix value"))
+				break;
+			expected += in[i];
+		}
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("exclusive_scan with init");
+		std::vector<double> out(in.size());
+		parallel_exclusive_scan(in.begin(), in.end(), out.begin(), 10.0, std::plus<double>(), TEST_GRAIN, pool);
+		test->MustBeEqual(out[0], 10.0, "init");
+		test->MustBeEqual(out.back(), 10.0 + std::accumulate(in.begin(), in.end() - 1, 0), "last");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("inclusive scan into a wider type");
+		std::vector<long long> out(in.size());
+		parallel_scan(in.begin(), in.end(), out.begin(), std::plus<long long>(), TEST_GRAIN, pool);
+		long long expected = 0;
+		for (size_t i = 0; i < in.size(); i++)
+		{
+			expected += in[i];
+			if (!test->MustBeEqual(out[i], expected, "prefix value"))
+				break;
+		}
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("transform int to double");
+		std::vector<double> out(in.size());
+		parallel_transform(in.begin(), in.end(), out.begin(), [](int v) { return v * 0.5; }, TEST_GRAIN, pool);
+		bool ok = true;
+		for (size_t i = 0; i < in.size(); i++)
+			ok &= out[i] == in[i] * 0.5;
+		test->AssertTrue(ok, "values");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("reduce into a wider type");
+		std::vector<int> big(4096, 1 << 20);
+		long long sum = parallel_reduce(big.begin(), big.end(), 0LL, std::plus<long long>(), TEST_GRAIN, pool);
+		test->MustBeEqual(sum, 4096LL << 20, "sum");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("sort");
+		std::vector<int> v(5000);
+		for (size_t i = 0; i < v.size(); i++)
+			v[i] = (int)((i * 7919) % 5003);
+		parallel_sort(v.begin(), v.end(), std::less<int>(), TEST_GRAIN, pool);
+		test->AssertTrue(std::is_sorted(v.begin(), v.end()), "sorted");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("exception is rethrown after all chunks finish");
+		std::vector<char> visited(1000, 0);
+		bool		  caught = false;
+		try
+		{
+			parallel_for(
+				0, visited.size(),
+				[&](size_t i)
+				{
+					if (i == 500)
+						throw std::runtime_error("chunk failed");
+					visited[i] = 1;
+				},
+				TEST_GRAIN, pool);
+		}
+		catch (const std::runtime_error&)
+		{
+			caught = true;
+		}
+		test->AssertTrue(caught, "caught");
+		/* Only the tail of the chunk that threw may be skipped */
+		bool ok = true;
+		for (size_t i = 0; i < visited.size(); i++)
+			if (i < 500 - TEST_GRAIN * 2 || i > 500 + TEST_GRAIN * 2)
+				ok &= visited[i] == 1;
+		test->AssertTrue(ok, "other chunks finished");
+		suite->Submit(test);
+	}
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
@@ -0,0 +1,135 @@
+/**
+ * test_ringbuffer.cpp
+ * 	Tests for RingBuffer, mostly snapshot()
+ */
+#include "unittestlib.h"
+#include "containers/ringbuffer.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/* Big enough that a torn copy shows up as mismatched fields */
+struct Sample_t
+{
+	unsigned int seq;
+	unsigned int check[7];
+
+	static Sample_t Make(unsigned int seq)
+	{
+		Sample_t s;
+		s.seq = seq;
+		for (auto& c : s.check)
+			c = seq * 2654435761u;
+		return s;
+	}
+
+	bool Valid() const
+	{
+		for (auto c : check)
+		{
+			if (c != seq * 2654435761u)
+				return false;
+		}
+		return true;
+	}
+};
+
+/* The n elements in out are whole and consecutive, ending at last */
+static bool Consecutive(const std::vector<Sample_t>& out, size_t n, unsigned int last)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!out[i].Valid() || out[i].seq != last - (unsigned int)(n - 1 - i))
+			return false;
+	}
+	return true;
+}
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("ringbuffer");
+
+	{
+		auto test = suite->CreateTest("snapshot");
+		RingBuffer<Sample_t> ring(6);
+		test->MustBeEqual(ring.capacity(), (size_t)8, "capacity rounded up");
+
+		std::vector<Sample_t> out(16);
+		test->MustBeEqual(ring.snapshot(out.data(), out.size()), (size_t)0, "empty");
+
+		for (unsigned int i = 1; i <= 5; i++)
+			ring.write(Sample_t::Make(i));
+		test->MustBeEqual(ring.snapshot(out.data(), out.size()), (size_t)5, "partially filled");
+		test->AssertTrue(Consecutive(out, 5, 5), "oldest first");
+		test->MustBeEqual(ring.snapshot(out.data(), 2), (size_t)2, "limited to max");
+		test->AssertTrue(Consecutive(out, 2, 5), "newest ones when limited");
+		test->MustBeEqual(ring.size(), (size_t)5, "doesn't consume");
+
+		/* Wrapped: the copy comes out of both ends of the storage */
+		for (unsigned int i = 6; i <= 21; i++)
+			ring.write(Sample_t::Make(i));
+		test->MustBeEqual(ring.snapshot(out.data(), out.size()), (size_t)8, "full");
+		test->AssertTrue(Consecutive(out, 8, 21), "wrapped");
+
+		Sample_t popped;
+		ring.read(&popped, 1);
+		ring.read(&popped, 1);
+		test->MustBeEqual(popped.seq, 15u, "read pops the oldest");
+		test->MustBeEqual(ring.snapshot(out.data(), out.size()), (size_t)6, "after reads");
+		test->AssertTrue(Consecutive(out, 6, 21), "after reads");
+
+		RingBuffer<Sample_t> none;
+		test->MustBeEqual(none.snapshot(out.data(), out.size()), (size_t)0, "no storage");
+		test->AssertFalse(none.write(Sample_t::Make(1)), "no storage write");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("reject mode and resize");
+		RingBuffer<Sample_t> ring(4, ERingMode::REJECT);
+		for (unsigned int i = 1; i <= 4; i++)
+			ring.write(Sample_t::Make(i));
+		test->AssertFalse(ring.write(Sample_t::Make(5)), "full ring rejects");
+
+		std::vector<Sample_t> out(16);
+		test->AssertTrue(ring.snapshot(out.data(), out.size()) == 4 && Consecutive(out, 4, 4), "rejected write not stored");
+
+		ring.resize(2);
+		test->AssertTrue(ring.snapshot(out.data(), out.size()) == 2 && Consecutive(out, 2, 4), "shrinking keeps the newest");
+		ring.resize(16);
+		ring.write(Sample_t::Make(5));
+		test->AssertTrue(ring.snapshot(out.data(), out.size()) == 3 && Consecutive(out, 3, 5), "growing keeps everything");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("snapshot while writing");
+		RingBuffer<Sample_t> ring(64);
+		std::atomic<bool>    done(false);
+		auto		     writeAll = [&]()
+		{
+			for (unsigned int i = 1; i <= 2000000; i++)
+				ring.write(Sample_t::Make(i));
+			done = true;
+		};
+		std::thread writer(writeAll);
+
+		std::vector<Sample_t> out(64);
+		size_t		      bad = 0;
+		while (!done)
+		{
+			size_t n = ring.snapshot(out.data(), out.size());
+			if (n && !Consecutive(out, n, out[n - 1].seq))
+				bad++;
+		}
+		writer.join();
+		test->MustBeEqual(bad, (size_t)0, "never torn or out of order");
+		test->AssertTrue(ring.snapshot(out.data(), out.size()) == 64 && Consecutive(out, 64, 2000000), "final contents");
+		suite->Submit(test);
+	}
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
@@ -0,0 +1,137 @@
+/**
+ * test_stringview.cpp
+ * 	Tests for StringView slicing and tokenizing, and the path helpers built on them
+ */
+#include "unittestlib.h"
+#include "containers/string.h"
+#include "containers/array.h"
+#include "crtlib.h"
+
+#include <cstring>
+
+/* Tokens joined with '|', so a whole split can be compared in one go */
+static std::string Join(const Array<StringView>& tokens)
+{
+	std::string out;
+	for (size_t i = 0; i < tokens.size(); i++)
+	{
+		if (i)
+			out += '|';
+		out.append(tokens[i].data(), tokens[i].length());
+	}
+	return out;
+}
+
+static std::string Str(const StringView& v) { return std::string(v.data(), v.length()); }
+
+int main()
+{
+	auto suite = CUnitTestSuite::Create("stringview");
+
+	{
+		auto	   test = suite->CreateTest("substr");
+		StringView v("hello world");
+		test->MustBeEqual(Str(v.substr(0, 5)), std::string("hello"), "prefix");
+		test->MustBeEqual(Str(v.substr(6)), std::string("world"), "suffix");
+		test->MustBeEqual(Str(v.substr(6, 100)), std::string("world"), "end clamped");
+		test->MustBeEqual(v.substr(20).length(), (size_t)0, "start past end");
+		test->MustBeEqual(v.substr(5, 2).length(), (size_t)0, "end before start");
+		test->AssertTrue(v.substr(6).data() == v.data() + 6, "no copy");
+		suite->Submit(test);
+	}
+
+	{
+		auto	   test = suite->CreateTest("trim");
+		StringView v("  \t padded \n ");
+		test->MustBeEqual(Str(v.trim()), std::string("padded"), "trim");
+		test->MustBeEqual(Str(v.ltrim()), std::string("padded \n "), "ltrim");
+		test->MustBeEqual(Str(v.rtrim()), std::string("  \t padded"), "rtrim");
+		test->MustBeEqual(StringView("   ").trim().length(), (size_t)0, "all whitespace");
+		suite->Submit(test);
+	}
+
+	{
+		auto	   test = suite->CreateTest("find");
+		StringView v("a.b.c");
+		test->MustBeEqual(v.find_first_of('.'), (size_t)1, "first");
+		test->MustBeEqual(v.find_last_of('.'), (size_t)3, "last");
+		test->MustBeEqual(v.find('.', 2), (size_t)3, "from start");
+		test->MustBeEqual(v.find('x'), v.length(), "missing");
+		test->MustBeEqual(v.find(StringView("b.c")), (size_t)2, "substring");
+		/* Slices aren't null terminated, searches must stop at length() */
+		test->MustBeEqual(v.substr(0, 2).find('b'), (size_t)2, "stays inside slice");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("split");
+		auto split = [](const char* s)
+		{
+			Array<StringView> tokens;
+			StringView(s).split(',', tokens);
+			return Join(tokens);
+		};
+		test->MustBeEqual(split("a,b,c"), std::string("a|b|c"), "plain");
+		test->MustBeEqual(split("a,,b"), std::string("a||b"), "consecutive");
+		test->MustBeEqual(split(",a"), std::string("|a"), "leading");
+		test->MustBeEqual(split("a,b,"), std::string("a|b|"), "trailing");
+		test->MustBeEqual(split(","), std::string("|"), "only delimiter");
+		test->MustBeEqual(split("abc"), std::string("abc"), "no delimiter");
+
+		Array<StringView> tokens;
+		test->MustBeEqual(StringView("").split(',', tokens), (size_t)1, "empty view gives one token");
+		test->MustBeEqual(StringView("x,y,").split(',', tokens), (size_t)3, "trailing count");
+		suite->Submit(test);
+	}
+
+	{
+		auto	   test = suite->CreateTest("next_token");
+		StringView rest("key=value=more"), token;
+		test->AssertTrue(rest.next_token(token, '='), "first");
+		test->MustBeEqual(Str(token), std::string("key"), "first token");
+		test->MustBeEqual(Str(rest), std::string("value=more"), "rest advanced");
+		test->AssertTrue(rest.next_token(token, '='), "second");
+		test->AssertTrue(rest.next_token(token, '='), "third");
+		test->MustBeEqual(Str(token), std::string("more"), "last token");
+		test->AssertFalse(rest.next_token(token, '='), "exhausted");
+		test->AssertFalse(rest.next_token(token, '='), "stays exhausted");
+
+		/* Tokenizing a slice must not read past its end */
+		StringView slice = StringView("a;b;c;d").substr(0, 3);
+		Array<StringView> tokens;
+		slice.split(';', tokens);
+		test->MustBeEqual(Join(tokens), std::string("a|b"), "slice");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("path helpers");
+		test->MustBeEqual(Str(Q_FileExtension(StringView("dir/file.tar.gz"))), std::string("gz"), "extension");
+		test->MustBeEqual(Str(Q_StripExtension(StringView("dir/file.tar.gz"))), std::string("dir/file.tar"), "strip");
+		test->MustBeEqual(Str(Q_FileExtension(StringView("dir.d/file"))), std::string(""), "dot in directory");
+		test->MustBeEqual(Str(Q_StripExtension(StringView("dir.d/file"))), std::string("dir.d/file"), "strip dot in directory");
+		test->MustBeEqual(Str(Q_FileName(StringView("a/b\\c.txt"))), std::string("c.txt"), "file name");
+		test->MustBeEqual(Str(Q_BaseDirectory(StringView("foo/bar/"))), std::string("foo"), "base directory");
+		suite->Submit(test);
+	}
+
+	{
+		auto test = suite->CreateTest("dotfiles have no extension");
+		test->MustBeEqual(Str(Q_FileExtension(StringView(".bashrc"))), std::string(""), "extension");
+		test->MustBeEqual(Str(Q_StripExtension(StringView(".bashrc"))), std::string(".bashrc"), "strip");
+		test->MustBeEqual(Str(Q_StripExtension(StringView("dir/.vimrc"))), std::string("dir/.vimrc"), "strip in dir");
+		test->MustBeEqual(Str(Q_StripExtension(StringView("dir\\.vimrc"))), std::string("dir\\.vimrc"), "strip in dir, backslash");
+		test->MustBeEqual(Str(Q_FileExtension(StringView("dir/.config.bak"))), std::string("bak"), "hidden file with extension");
+
+		char buf[64];
+		test->MustBeEqual(std::string(Q_StripExtension(".bashrc", buf, sizeof(buf))), std::string(".bashrc"), "char* strip");
+		test->MustBeEqual(std::string(Q_StripExtension("dir/.vimrc", buf, sizeof(buf))), std::string("dir/.vimrc"), "char* strip in dir");
+		test->MustBeEqual(std::string(Q_FileExtension("dir/.vimrc", buf, sizeof(buf))), std::string(""), "char* extension");
+		test->MustBeEqual(std::string(Q_StripExtension("dir/a.txt", buf, sizeof(buf))), std::string("dir/a"), "char* normal");
+		suite->Submit(test);
+	}
+
+	int failed = suite->Report();
+	suite->Destroy();
+	return failed;
+}
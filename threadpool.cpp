@@ -0,0 +1,209 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#include "threadpool.h"
+#include "static_helpers.h"
+
+#include <stdio.h>
+
+//===========================================
+//
+//      CThreadPool
+//
+//===========================================
+
+CThreadPool::CThreadPool(int numThreads, const char* name)
+{
+	m_shutdown.store(false);
+	m_pending.store(0);
+	m_queued.store(0);
+
+	if (numThreads <= 0)
+		numThreads = threadtools::GetCPUCount() - 1;
+	if (numThreads < 1)
+		numThreads = 1;
+
+	for (int i = 0; i < numThreads; i++)
+	{
+		char threadName[64];
+		snprintf(threadName, sizeof(threadName), "%s%d", name ? name : "worker", i);
+
+		ThreadOptions_t opts;
+		opts.name = threadName;
+
+		CThread* thread = new CThread(WorkerThread, opts);
+		if (!thread->Run(this))
+		{
+			delete thread;
+			continue;
+		}
+		m_threads.push_back(thread);
+	}
+}
+
+CThreadPool::~CThreadPool()
+{
+	m_shutdown.store(true);
+	for (auto thread : m_threads)
+		thread->Terminate();
+	m_queueEvent.NotifyAll();
+
+	for (auto thread : m_threads)
+	{
+		thread->Join();
+		delete thread;
+	}
+	m_threads.clear();
+}
+
+void* CThreadPool::WorkerThread(void* pool)
+{
+	CThreadPool*	 self  = static_cast<CThreadPool*>(pool);
+	CThreadStopToken token = threadtools::CurrentStopToken();
+
+	Task_t task;
+	while (!token.StopRequested())
+	{
+		if (!self->PopTask(task, true))
+			continue;
+		task();
+		task = nullptr;
+		self->FinishTask();
+	}
+	return nullptr;
+}
+
+bool CThreadPool::TryPopTask(Task_t& task)
+{
+	/* Callers poll this while helping out, don't touch the lock when there's nothing to do */
+	if (m_queued.load(std::memory_order_acquire) <= 0)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	if (m_queue.empty())
+		return false;
+	task = std::move(m_queue.front());
+	m_queue.pop_front();
+	m_queued.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool CThreadPool::PopTask(Task_t& task, bool wait)
+{
+	for (;;)
+	{
+		if (TryPopTask(task))
+			return true;
+		if (!wait || m_shutdown.load())
+			return false;
+
+		auto key = m_queueEvent.PrepareWait();
+		if (m_queued.load(std::memory_order_acquire) > 0 || m_shutdown.load())
+		{
+			m_queueEvent.CancelWait();
+			continue;
+		}
+		m_queueEvent.CommitWait(key);
+	}
+}
+
+void CThreadPool::Submit(Task_t task)
+{
+	m_pending.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_queue.push_back(std::move(task));
+		m_queued.fetch_add(1, std::memory_order_release);
+	}
+	m_queueEvent.Notify();
+	/* Waiters help out, so there's something new for them to do */
+	m_progressEvent.NotifyAll();
+}
+
+void CThreadPool::FinishTask()
+{
+	m_pending.fetch_sub(1, std::memory_order_release);
+	m_progressEvent.NotifyAll();
+}
+
+bool CThreadPool::RunOne()
+{
+	Task_t task;
+	if (!TryPopTask(task))
+		return false;
+	task();
+	FinishTask();
+	return true;
+}
+
+void CThreadPool::WaitIdle()
+{
+	while (m_pending.load(std::memory_order_acquire) > 0)
+	{
+		if (RunOne())
+			continue;
+
+		/* Nothing to help with, sleep until a task finishes or more work shows up */
+		auto key = m_progressEvent.PrepareWait();
+		if (m_pending.load(std::memory_order_acquire) <= 0 || m_queued.load(std::memory_order_acquire) > 0)
+		{
+			m_progressEvent.CancelWait();
+			continue;
+		}
+		m_progressEvent.CommitWait(key);
+	}
+}
+
+//===========================================
+//
+//      CTaskCounter
+//
+//===========================================
+
+void CTaskCounter::Wait(CThreadPool& pool)
+{
+	while (!Finished())
+	{
+		if (pool.RunOne())
+			continue;
+
+		auto key = pool.m_progressEvent.PrepareWait();
+		if (Finished() || pool.m_queued.load(std::memory_order_acquire) > 0)
+		{
+			pool.m_progressEvent.CancelWait();
+			continue;
+		}
+		/* Done() is usually called from a pool task, which signals the pool when it returns. The timeout covers
+		 * counters finished from outside the pool */
+		pool.m_progressEvent.CommitWaitFor(key, 10);
+	}
+}
+
+//===========================================
+//
+//      Global pool
+//
+//===========================================
+
+static CThreadPool* g_pThreadPool = nullptr;
+
+CThreadPool& GlobalThreadPool()
+{
+	static std::once_flag once;
+	std::call_once(once, []() { g_pThreadPool = new CThreadPool(); });
+	return *g_pThreadPool;
+}
+
+static void KillThreadPool() { delete g_pThreadPool; }
+
+static CStaticDestructionWrapper<KillThreadPool> g_threadPoolKiller;
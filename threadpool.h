@@ -0,0 +1,101 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * threadpool.h
+ * 	Shared worker pool for short, CPU bound tasks
+ */
+#pragma once
+
+#include "public.h"
+#include "threadtools.h"
+#include "containers/array.h"
+
+#undef min
+#undef max
+#include <functional>
+#include <deque>
+#include <mutex>
+
+/**
+ * Fixed-size pool of worker threads pulling from a single FIFO queue.
+ * Tasks should be short and must not block on other tasks without helping (see CTaskCounter::Wait),
+ * otherwise a pool with few workers can deadlock.
+ */
+class EXPORT CThreadPool
+{
+public:
+	typedef std::function<void()> Task_t;
+
+private:
+	Array<CThread*>		m_threads;
+	std::deque<Task_t>	m_queue;
+	std::mutex		m_queueMutex;
+	CEventCount		m_queueEvent; /* Idle workers park here */
+	CEventCount		m_progressEvent; /* WaitIdle/CTaskCounter::Wait park here. Signalled when a task is queued or finishes */
+	threadtools::AtomicInt	m_queued;     /* Tasks in m_queue, readable without the lock */
+	threadtools::AtomicBool m_shutdown;
+	threadtools::AtomicInt	m_pending; /* Queued + running tasks */
+
+	static void* WorkerThread(void* pool);
+	bool	     TryPopTask(Task_t& task);
+	bool	     PopTask(Task_t& task, bool wait);
+	void	     FinishTask();
+
+	friend class CTaskCounter;
+
+public:
+	/* numThreads <= 0 picks one worker per CPU, minus one for the thread that submits work */
+	explicit CThreadPool(int numThreads = 0, const char* name = "worker");
+	~CThreadPool();
+
+	CThreadPool(const CThreadPool&) = delete;
+	CThreadPool(CThreadPool&&)	= delete;
+
+	/* Queues a task */
+	void Submit(Task_t task);
+
+	/* Pops and runs one queued task on the calling thread. Returns false if the queue was empty */
+	bool RunOne();
+
+	/* Blocks until every submitted task has finished, helping out in the meantime */
+	void WaitIdle();
+
+	/* Number of worker threads, not counting the caller */
+	int NumThreads() const { return (int)m_threads.size(); }
+
+	/* Number of threads that can work on a job at once, including the caller */
+	int Concurrency() const { return NumThreads() + 1; }
+};
+
+/**
+ * Counts outstanding tasks of a single job. Wait() runs queued pool tasks while it waits, so
+ * it's safe to call from inside a pool task (nested parallelism)
+ */
+class EXPORT CTaskCounter
+{
+private:
+	threadtools::AtomicInt m_count;
+
+public:
+	CTaskCounter() { m_count.store(0); }
+
+	void Add(int n = 1) { m_count.fetch_add(n, std::memory_order_relaxed); }
+	void Done() { m_count.fetch_sub(1, std::memory_order_release); }
+	bool Finished() const { return m_count.load(std::memory_order_acquire) <= 0; }
+
+	void Wait(CThreadPool& pool);
+};
+
+/* Pool shared by everything in libpublic. Created on first use */
+EXPORT CThreadPool& GlobalThreadPool();
@@ -16,6 +16,7 @@ GNU General Public License for more details.
 #endif
 
 #include "threadtools.h"
+#include "platformspec.h"
 
 #ifdef _POSIX
 #include <pthread.h>
@@ -24,10 +25,147 @@ GNU General Public License for more details.
 #include <sys/types.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sched.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #endif
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+//===========================================
+//
+//      Thread index registry
+//
+//===========================================
+
+#define THREAD_INDEX_WORDS ((THREADTOOLS_MAX_THREADS + 63) / 64)
+
+static std::atomic<unsigned long long> s_threadIndexBits[THREAD_INDEX_WORDS];
+static std::atomic<unsigned int>       s_threadIndexGens[THREADTOOLS_MAX_THREADS];
+static std::atomic<int>		       s_threadIndexCount;
+static std::atomic<int>		       s_threadIndexHighWater;
+
+static inline int LowestClearBit(unsigned long long v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(~v);
+#else
+	unsigned long idx;
+	_BitScanForward64(&idx, ~v);
+	return (int)idx;
+#endif
+}
+
+static int AllocThreadIndex(unsigned int& generation)
+{
+	for (int w = 0; w < THREAD_INDEX_WORDS; w++)
+	{
+		unsigned long long bits = s_threadIndexBits[w].load(std::memory_order_relaxed);
+		while (bits != ~0ULL)
+		{
+			int bit	  = LowestClearBit(bits);
+			int index = w * 64 + bit;
+			if (index >= THREADTOOLS_MAX_THREADS)
+				return threadtools::INVALID_THREAD_INDEX;
+			if (s_threadIndexBits[w].compare_exchange_weak(bits, bits | (1ULL << bit), std::memory_order_acquire))
+			{
+				generation = s_threadIndexGens[index].fetch_add(1, std::memory_order_relaxed) + 1;
+				s_threadIndexCount.fetch_add(1, std::memory_order_relaxed);
+
+				int high = s_threadIndexHighWater.load(std::memory_order_relaxed);
+				while (high < index + 1 && !s_threadIndexHighWater.compare_exchange_weak(high, index + 1))
+				{
+				};
+				return index;
+			}
+		}
+	}
+	return threadtools::INVALID_THREAD_INDEX;
+}
+
+static std::atomic<threadtools::ThreadIndexReleaseCallback_t> s_threadIndexCallbacks[threadtools::MAX_THREAD_INDEX_CALLBACKS];
+static std::atomic<int>						s_numThreadIndexCallbacks;
+
+static void FreeThreadIndex(int index)
+{
+	/* The index still belongs to us while the callbacks run */
+	int numCallbacks = std::min(s_numThreadIndexCallbacks.load(std::memory_order_acquire), threadtools::MAX_THREAD_INDEX_CALLBACKS);
+	for (int i = 0; i < numCallbacks; i++)
+	{
+		threadtools::ThreadIndexReleaseCallback_t callback = s_threadIndexCallbacks[i].load(std::memory_order_acquire);
+		if (callback)
+			callback(index);
+	}
+
+	s_threadIndexBits[index / 64].fetch_and(~(1ULL << (index % 64)), std::memory_order_release);
+	s_threadIndexCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/* Lives in TLS so the index gets released when the thread exits */
+struct ThreadIndexHolder_t
+{
+	int	     index	= threadtools::INVALID_THREAD_INDEX;
+	unsigned int generation = 0;
+	bool	     exhausted	= false;
+
+	~ThreadIndexHolder_t()
+	{
+		if (index != threadtools::INVALID_THREAD_INDEX)
+			FreeThreadIndex(index);
+	}
+};
+
+static thread_local ThreadIndexHolder_t s_threadIndex;
+
+int threadtools::GetThreadIndex(unsigned int* generation)
+{
+	ThreadIndexHolder_t& holder = s_threadIndex;
+	if (holder.index == INVALID_THREAD_INDEX && !holder.exhausted)
+	{
+		holder.index = AllocThreadIndex(holder.generation);
+		/* Don't retry the whole bitmap on every call once we've failed */
+		holder.exhausted = holder.index == INVALID_THREAD_INDEX;
+	}
+	if (generation)
+		*generation = holder.generation;
+	return holder.index;
+}
+
+void threadtools::ReleaseThreadIndex()
+{
+	ThreadIndexHolder_t& holder = s_threadIndex;
+	if (holder.index == INVALID_THREAD_INDEX)
+		return;
+	FreeThreadIndex(holder.index);
+	holder.index	 = INVALID_THREAD_INDEX;
+	holder.exhausted = false;
+}
+
+void threadtools::AddThreadIndexReleaseCallback(ThreadIndexReleaseCallback_t callback)
+{
+	int slot = s_numThreadIndexCallbacks.load(std::memory_order_relaxed);
+	do
+	{
+		if (slot >= MAX_THREAD_INDEX_CALLBACKS)
+			platform::FatalError("Too many thread index release callbacks, raise MAX_THREAD_INDEX_CALLBACKS\n");
+	} while (!s_numThreadIndexCallbacks.compare_exchange_weak(slot, slot + 1, std::memory_order_relaxed));
+	s_threadIndexCallbacks[slot].store(callback, std::memory_order_release);
+}
+
+int threadtools::NumRegisteredThreads() { return s_threadIndexCount.load(std::memory_order_relaxed); }
+
+int threadtools::ThreadIndexHighWater() { return s_threadIndexHighWater.load(std::memory_order_acquire); }
 
 //===========================================
 //
@@ -35,8 +173,19 @@ GNU General Public License for more details.
 //
 //===========================================
 
-CThread::CThread(void* (*threadfn)(void*)) : m_threadfn(threadfn), m_run(false)
+static thread_local CThread* s_currentThread = nullptr;
+
+CThread::CThread(void* (*threadfn)(void*)) : CThread(threadfn, ThreadOptions_t()) {}
+
+CThread::CThread(void* (*threadfn)(void*), const ThreadOptions_t& options)
+	: m_ret(nullptr), m_threadfn(threadfn), m_pvt(nullptr), m_run(false), m_options(options)
 {
+	m_name[0] = 0;
+	if (options.name)
+		snprintf(m_name, sizeof(m_name), "%s", options.name);
+	m_options.name = m_name;
+	m_stopRequested.store(false);
+	m_started.store(false);
 #ifdef _WIN32
 	hThread = nullptr;
 #else
@@ -44,61 +193,511 @@ CThread::CThread(void* (*threadfn)(void*)) : m_threadfn(threadfn), m_run(false)
 #endif
 }
 
-void CThread::Run(void* pvt)
+CThread::~CThread()
 {
+	if (m_run)
+	{
+		if (m_options.joinOnDestroy)
+		{
+			Terminate();
+			Join();
+		}
+		else
+			Detach();
+	}
 #ifdef _WIN32
-	if (m_run && hThread)
-		TerminateThread(hThread, 1);
-	DWORD dwThreadId;
-	hThread = CreateThread(NULL, 0, reinterpret_cast<LPTHREAD_START_ROUTINE>(m_threadfn), pvt, 0, &dwThreadId);
-	m_run	= true;
+	if (hThread)
+		CloseHandle(hThread);
 #else
-	if (m_run)
+	pthread_attr_destroy(&m_attr);
+#endif
+}
+
+#ifdef _POSIX
+static int ToPosixPolicy(EThreadSchedPolicy policy)
+{
+	switch (policy)
 	{
-		pthread_cancel(m_thread);
+	case EThreadSchedPolicy::FIFO:
+		return SCHED_FIFO;
+	case EThreadSchedPolicy::ROUND_ROBIN:
+		return SCHED_RR;
+#ifdef SCHED_BATCH
+	case EThreadSchedPolicy::BATCH:
+		return SCHED_BATCH;
+#endif
+#ifdef SCHED_IDLE
+	case EThreadSchedPolicy::IDLE:
+		return SCHED_IDLE;
+#endif
+	default:
+		return SCHED_OTHER;
 	}
-	m_run = true;
-	pthread_create(&m_thread, &m_attr, m_threadfn, pvt);
+}
+
+static bool IsRealtimePolicy(EThreadSchedPolicy policy) { return policy == EThreadSchedPolicy::FIFO || policy == EThreadSchedPolicy::ROUND_ROBIN; }
+
+/* Realtime policies reject priorities outside their range (including the default 0) with EINVAL */
+static int ClampPriority(int posixPolicy, int priority)
+{
+	int lo = sched_get_priority_min(posixPolicy);
+	int hi = sched_get_priority_max(posixPolicy);
+	if (lo < 0 || hi < 0)
+		return priority;
+	return priority < lo ? lo : (priority > hi ? hi : priority);
+}
+#endif
+
+void* CThread::ThreadEntry(void* thisptr)
+{
+	CThread* thread = static_cast<CThread*>(thisptr);
+	s_currentThread = thread;
+
+	/* Name and affinity are applied from inside the thread so they're in place before any user code runs */
+	thread->ApplyRuntimeOptions();
+
+	void* (*fn)(void*) = thread->m_threadfn;
+	void* pvt	   = thread->m_pvt;
+	thread->m_started.store(true, std::memory_order_release);
+	return fn(pvt);
+}
+
+bool CThread::IsLive() const { return m_run || s_currentThread == this; }
+
+/* m_thread/hThread may not be filled in yet when called from inside the new thread, so use the calling thread's handle there */
+CThread::NativeHandle_t CThread::NativeHandle() const
+{
+#ifdef _WIN32
+	return s_currentThread == this ? GetCurrentThread() : hThread;
+#else
+	return s_currentThread == this ? pthread_self() : m_thread;
+#endif
+}
+
+void CThread::ApplyRuntimeOptions()
+{
+	if (m_name[0])
+		SetName(m_name);
+	if (!m_options.affinity.Empty())
+		SetAffinity(m_options.affinity);
+#ifdef _WIN32
+	if (m_options.policy != EThreadSchedPolicy::DEFAULT)
+		SetPriority(m_options.policy, m_options.priority);
+#else
+	/* Realtime policies are set through the attr in Run, everything else is applied here */
+	if (m_options.policy != EThreadSchedPolicy::DEFAULT && !IsRealtimePolicy(m_options.policy))
+		SetPriority(m_options.policy, m_options.priority);
 #endif
 }
 
-void CThread::Terminate()
+bool CThread::Run(void* pvt)
 {
+	/* Restarting cancels the old thread. Wait for it so it's done with this object before it's reused */
+	if (m_run)
+	{
+		Terminate();
+		Kill();
+		Join();
+	}
+	m_pvt = pvt;
+	m_stopRequested.store(false);
+	m_started.store(false);
 #ifdef _WIN32
 	if (hThread)
-		TerminateThread(hThread, 0);
+		CloseHandle(hThread);
+	DWORD dwThreadId;
+	hThread = CreateThread(NULL, m_options.stackSize, reinterpret_cast<LPTHREAD_START_ROUTINE>(ThreadEntry), this, 0, &dwThreadId);
+	m_run	= hThread != nullptr;
+	return m_run;
 #else
-	pthread_kill(m_thread, SIGTERM);
+	if (m_options.stackSize)
+	{
+		size_t stack = m_options.stackSize < (size_t)PTHREAD_STACK_MIN ? (size_t)PTHREAD_STACK_MIN : m_options.stackSize;
+		pthread_attr_setstacksize(&m_attr, stack);
+	}
+
+	if (IsRealtimePolicy(m_options.policy))
+	{
+		int	    posixPolicy = ToPosixPolicy(m_options.policy);
+		sched_param param;
+		param.sched_priority = ClampPriority(posixPolicy, m_options.priority);
+		pthread_attr_setinheritsched(&m_attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&m_attr, posixPolicy);
+		pthread_attr_setschedparam(&m_attr, &param);
+	}
+
+	int res = pthread_create(&m_thread, &m_attr, ThreadEntry, this);
+
+	/* Unprivileged processes can't use realtime policies. Still run the thread, just with the default scheduling */
+	if (res == EPERM && IsRealtimePolicy(m_options.policy))
+	{
+		pthread_attr_setinheritsched(&m_attr, PTHREAD_INHERIT_SCHED);
+		res = pthread_create(&m_thread, &m_attr, ThreadEntry, this);
+	}
+	m_run = res == 0;
+	return m_run;
 #endif
 }
 
+void CThread::Terminate() { m_stopRequested.store(true); }
+
 void CThread::Kill()
 {
+	if (!m_run)
+		return;
 #ifdef _WIN32
 	if (hThread)
 		TerminateThread(hThread, 0);
 #else
-	pthread_kill(m_thread, SIGKILL);
+	pthread_cancel(m_thread);
 #endif
 }
 
-void CThread::Join()
+void CThread::Detach()
 {
+	if (!m_run)
+		return;
+	m_run = false;
+	/* Wait for ThreadEntry to stop using this object. That only takes as long as thread startup */
+	if (s_currentThread != this)
+	{
+		while (!m_started.load(std::memory_order_acquire))
+			std::this_thread::yield();
+	}
 #ifdef _WIN32
 	if (hThread)
-		WaitForSingleObject(hThread, INFINITE);
+		CloseHandle(hThread);
+	hThread = nullptr;
+#else
+	pthread_detach(m_thread);
+#endif
+}
+
+void CThread::Join()
+{
+	if (!m_run)
+		return;
+	m_run = false;
+#ifdef _WIN32
+	/* A thread can't wait for itself. Its handle is closed by the destructor */
+	if (!hThread || s_currentThread == this)
+		return;
+	WaitForSingleObject(hThread, INFINITE);
+	DWORD code = 0;
+	if (GetExitCodeThread(hThread, &code))
+		m_ret = reinterpret_cast<void*>((uintptr_t)code);
+#else
+	/* A thread can't join itself, so let it clean up after itself when it returns */
+	if (s_currentThread == this)
+		pthread_detach(m_thread);
+	else
+		pthread_join(m_thread, &m_ret);
+#endif
+}
+
+bool CThread::SetName(const char* name)
+{
+	if (!name)
+		return false;
+	if (name != m_name)
+		snprintf(m_name, sizeof(m_name), "%s", name);
+	if (!IsLive())
+		return true;
+#if defined(_WIN32)
+	wchar_t wname[64];
+	MultiByteToWideChar(CP_UTF8, 0, m_name, -1, wname, 64);
+	return SUCCEEDED(SetThreadDescription(NativeHandle(), wname));
+#elif defined(__linux__)
+	/* Linux limits thread names to 16 bytes including the terminator */
+	char shortname[16];
+	snprintf(shortname, sizeof(shortname), "%.15s", m_name);
+	return pthread_setname_np(NativeHandle(), shortname) == 0;
+#elif defined(__APPLE__)
+	/* Can only name the calling thread on macOS */
+	if (s_currentThread != this)
+		return false;
+	return pthread_setname_np(m_name) == 0;
+#else
+	return false;
+#endif
+}
+
+bool CThread::SetAffinity(const CThreadAffinityMask& mask)
+{
+	m_options.affinity = mask;
+	if (!IsLive())
+		return true;
+#if defined(_WIN32)
+	DWORD_PTR winmask = 0;
+	for (int i = 0; i < sizeof(DWORD_PTR) * 8; i++)
+		if (mask.IsSet(i))
+			winmask |= ((DWORD_PTR)1 << i);
+	return SetThreadAffinityMask(NativeHandle(), winmask) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < CThreadAffinityMask::MAX_CPUS && i < CPU_SETSIZE; i++)
+		if (mask.IsSet(i))
+			CPU_SET(i, &set);
+	return pthread_setaffinity_np(NativeHandle(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+bool CThread::SetPriority(EThreadSchedPolicy policy, int priority)
+{
+	m_options.policy   = policy;
+	m_options.priority = priority;
+	if (!IsLive())
+		return true;
+#ifdef _WIN32
+	int winprio = THREAD_PRIORITY_NORMAL;
+	switch (policy)
+	{
+	case EThreadSchedPolicy::FIFO:
+	case EThreadSchedPolicy::ROUND_ROBIN:
+		winprio = priority > 0 ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+		break;
+	case EThreadSchedPolicy::IDLE:
+		winprio = THREAD_PRIORITY_IDLE;
+		break;
+	case EThreadSchedPolicy::BATCH:
+		winprio = THREAD_PRIORITY_BELOW_NORMAL;
+		break;
+	default:
+		break;
+	}
+	return SetThreadPriority(NativeHandle(), winprio) != 0;
+#else
+	sched_param param;
+	int	    posixPolicy = ToPosixPolicy(policy);
+	param.sched_priority	= IsRealtimePolicy(policy) ? ClampPriority(posixPolicy, priority) : 0;
+	return pthread_setschedparam(NativeHandle(), posixPolicy, &param) == 0;
+#endif
+}
+
+CThread* CThread::Current() { return s_currentThread; }
+
+CThreadStopToken threadtools::CurrentStopToken()
+{
+	CThread* thread = CThread::Current();
+	return thread ? thread->GetStopToken() : CThreadStopToken();
+}
+
+int threadtools::GetCPUCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#elif defined(__linux__)
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		return CPU_COUNT(&set);
+	return (int)sysconf(_SC_NPROCESSORS_ONLN);
 #else
-	pthread_join(m_thread, &m_ret);
+	return (int)sysconf(_SC_NPROCESSORS_ONLN);
 #endif
 }
 
+//===========================================
+//
+//      Lock contention profiling
+//
+//===========================================
+
+threadtools::AtomicBool threadtools::g_lockProfilingEnabled(false);
+
+/* The registry can't use any of our own locks, they would try to profile themselves */
+static std::mutex	 s_lockSiteMutex;
+static CLockProfileSite* s_lockSites = nullptr;
+
+static inline void AtomicMax(std::atomic<unsigned long long>& target, unsigned long long value)
+{
+	unsigned long long cur = target.load(std::memory_order_relaxed);
+	while (cur < value && !target.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+	{
+	};
+}
+
+CLockProfileSite::CLockProfileSite(const char* name, const char* type) : m_type(type), m_next(nullptr)
+{
+	snprintf(m_name, sizeof(m_name), "%s", name);
+	Reset();
+}
+
+CLockProfileSite::Shard_t& CLockProfileSite::LocalShard()
+{
+	int index = threadtools::GetThreadIndex();
+	if (index == threadtools::INVALID_THREAD_INDEX)
+		index = 0;
+	return m_shards[index % NUM_SHARDS];
+}
+
+void CLockProfileSite::RecordAcquire(unsigned long long waitNs, bool contended)
+{
+	Shard_t& shard = LocalShard();
+	shard.acquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (!contended)
+		return;
+	shard.contended.fetch_add(1, std::memory_order_relaxed);
+	shard.totalWaitNs.fetch_add(waitNs, std::memory_order_relaxed);
+	AtomicMax(shard.maxWaitNs, waitNs);
+}
+
+void CLockProfileSite::RecordHold(unsigned long long holdNs)
+{
+	Shard_t& shard = LocalShard();
+	shard.totalHoldNs.fetch_add(holdNs, std::memory_order_relaxed);
+	AtomicMax(shard.maxHoldNs, holdNs);
+}
+
+void CLockProfileSite::Snapshot(LockProfileStats_t& out) const
+{
+	memset(&out, 0, sizeof(out));
+	out.name = m_name;
+	out.type = m_type;
+	for (const auto& shard : m_shards)
+	{
+		out.acquisitions += shard.acquisitions.load(std::memory_order_relaxed);
+		out.contended += shard.contended.load(std::memory_order_relaxed);
+		out.totalWaitNs += shard.totalWaitNs.load(std::memory_order_relaxed);
+		out.totalHoldNs += shard.totalHoldNs.load(std::memory_order_relaxed);
+		out.maxWaitNs = std::max(out.maxWaitNs, shard.maxWaitNs.load(std::memory_order_relaxed));
+		out.maxHoldNs = std::max(out.maxHoldNs, shard.maxHoldNs.load(std::memory_order_relaxed));
+	}
+}
+
+void CLockProfileSite::Reset()
+{
+	for (auto& shard : m_shards)
+	{
+		shard.acquisitions.store(0, std::memory_order_relaxed);
+		shard.contended.store(0, std::memory_order_relaxed);
+		shard.totalWaitNs.store(0, std::memory_order_relaxed);
+		shard.maxWaitNs.store(0, std::memory_order_relaxed);
+		shard.totalHoldNs.store(0, std::memory_order_relaxed);
+		shard.maxHoldNs.store(0, std::memory_order_relaxed);
+	}
+}
+
+void CLockProfileHook::SetName(const char* name)
+{
+	/* Serialized with Site() so a lookup racing with the rename can't cache the old site after it was cleared */
+	std::lock_guard<std::mutex> guard(s_lockSiteMutex);
+	m_name.store(name, std::memory_order_release);
+	/* Look up the site again on the next acquisition */
+	m_site.store(nullptr, std::memory_order_release);
+}
+
+CLockProfileSite* CLockProfileHook::Site(const void* lock)
+{
+	CLockProfileSite* site = m_site.load(std::memory_order_acquire);
+	if (site)
+		return site;
+
+	std::lock_guard<std::mutex> guard(s_lockSiteMutex);
+
+	/* Another thread may have created it while we waited */
+	site = m_site.load(std::memory_order_acquire);
+	if (site)
+		return site;
+
+	/* Named locks share a site */
+	const char* lockName = m_name.load(std::memory_order_acquire);
+	if (lockName)
+	{
+		for (CLockProfileSite* it = s_lockSites; it; it = it->m_next)
+		{
+			if (strcmp(it->m_name, lockName) == 0 && strcmp(it->m_type, m_type) == 0)
+			{
+				site = it;
+				break;
+			}
+		}
+	}
+
+	if (!site)
+	{
+		char name[64];
+		if (lockName)
+			snprintf(name, sizeof(name), "%s", lockName);
+		else
+			snprintf(name, sizeof(name), "%s@%p", m_type, lock);
+
+		site	    = new CLockProfileSite(name, m_type);
+		site->m_next = s_lockSites;
+		s_lockSites  = site;
+	}
+
+	m_site.store(site, std::memory_order_release);
+	return site;
+}
+
+void CLockProfileHook::Acquired(const void* lock, unsigned long long waitNs, bool contended, bool exclusive)
+{
+	Site(lock)->RecordAcquire(waitNs, contended);
+	if (exclusive && m_depth++ == 0)
+		m_holdStart = threadtools::LockProfileClock();
+}
+
+void CLockProfileHook::ReleasedSlow()
+{
+	if (--m_depth > 0)
+		return;
+	CLockProfileSite* site = m_site.load(std::memory_order_acquire);
+	if (site)
+		site->RecordHold(threadtools::LockProfileClock() - m_holdStart);
+}
+
+void threadtools::EnableLockProfiling(bool enable) { g_lockProfilingEnabled.store(enable); }
+
+void threadtools::GetLockProfileStats(Array<LockProfileStats_t>& out)
+{
+	out.clear();
+	{
+		std::lock_guard<std::mutex> guard(s_lockSiteMutex);
+		for (CLockProfileSite* it = s_lockSites; it; it = it->Next())
+		{
+			LockProfileStats_t stats;
+			it->Snapshot(stats);
+			out.push_back(stats);
+		}
+	}
+	std::sort(out.begin(), out.end(),
+		  [](const LockProfileStats_t& a, const LockProfileStats_t& b) { return a.totalWaitNs > b.totalWaitNs; });
+}
+
+void threadtools::ResetLockProfileStats()
+{
+	std::lock_guard<std::mutex> guard(s_lockSiteMutex);
+	for (CLockProfileSite* it = s_lockSites; it; it = it->Next())
+		it->Reset();
+}
+
+/* Shared by the exclusive lock types: try first so uncontended acquisitions don't pay for the clock */
+#define PROFILED_LOCK(tryLock, lock, exclusive)                                                                                                      \
+	if (threadtools::LockProfilingEnabled())                                                                                                     \
+	{                                                                                                                                            \
+		if (tryLock)                                                                                                                         \
+			m_profile.Acquired(this, 0, false, exclusive);                                                                               \
+		else                                                                                                                                 \
+		{                                                                                                                                    \
+			unsigned long long start = threadtools::LockProfileClock();                                                                  \
+			lock;                                                                                                                        \
+			m_profile.Acquired(this, threadtools::LockProfileClock() - start, true, exclusive);                                          \
+		}                                                                                                                                    \
+		return;                                                                                                                              \
+	}
+
 //===========================================
 //
 //      CThreadMutex
 //
 //===========================================
 
-CThreadMutex::CThreadMutex()
+CThreadMutex::CThreadMutex() : m_profile("CThreadMutex")
 {
 #ifdef _WIN32
 	m_mutex = CreateMutexA(NULL, TRUE, NULL);
@@ -121,8 +720,10 @@ CThreadMutex::~CThreadMutex()
 void CThreadMutex::Lock()
 {
 #ifdef _WIN32
+	PROFILED_LOCK(WaitForSingleObject(m_mutex, 0) == WAIT_OBJECT_0, WaitForSingleObject(m_mutex, INFINITE), true);
 	WaitForSingleObject(m_mutex, INFINITE);
 #else
+	PROFILED_LOCK(pthread_mutex_trylock(&m_mutex) == 0, pthread_mutex_lock(&m_mutex), true);
 	pthread_mutex_lock(&m_mutex);
 #endif
 }
@@ -131,14 +732,18 @@ bool CThreadMutex::TryLock()
 {
 #ifdef _WIN32
 	DWORD dwRes = WaitForSingleObject(m_mutex, 0);
-	return dwRes == WAIT_OBJECT_0;
+	bool  res   = dwRes == WAIT_OBJECT_0;
 #else
-	return pthread_mutex_trylock(&m_mutex) == 0;
+	bool res = pthread_mutex_trylock(&m_mutex) == 0;
 #endif
+	if (res && threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, 0, false, true);
+	return res;
 }
 
 void CThreadMutex::Unlock()
 {
+	m_profile.Released();
 #ifdef _WIN32
 	ReleaseMutex(m_mutex);
 #else
@@ -152,7 +757,7 @@ void CThreadMutex::Unlock()
 //
 //===========================================
 
-CThreadRecursiveMutex::CThreadRecursiveMutex()
+CThreadRecursiveMutex::CThreadRecursiveMutex() : m_profile("CThreadRecursiveMutex")
 {
 #ifdef _WIN32
 	m_mutex = CreateMutexA(NULL, TRUE, NULL);
@@ -176,8 +781,10 @@ CThreadRecursiveMutex::~CThreadRecursiveMutex()
 void CThreadRecursiveMutex::Lock()
 {
 #ifdef _WIN32
+	PROFILED_LOCK(WaitForSingleObject(m_mutex, 0) == WAIT_OBJECT_0, WaitForSingleObject(m_mutex, INFINITE), true);
 	WaitForSingleObject(m_mutex, INFINITE);
 #else
+	PROFILED_LOCK(pthread_mutex_trylock(&m_mutex) == 0, pthread_mutex_lock(&m_mutex), true);
 	pthread_mutex_lock(&m_mutex);
 #endif
 }
@@ -186,14 +793,18 @@ bool CThreadRecursiveMutex::TryLock()
 {
 #ifdef _WIN32
 	DWORD dwRes = WaitForSingleObject(m_mutex, 0);
-	return dwRes == WAIT_OBJECT_0;
+	bool  res   = dwRes == WAIT_OBJECT_0;
 #else
-	return pthread_mutex_trylock(&m_mutex) == 0;
+	bool res = pthread_mutex_trylock(&m_mutex) == 0;
 #endif
+	if (res && threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, 0, false, true);
+	return res;
 }
 
 void CThreadRecursiveMutex::Unlock()
 {
+	m_profile.Released();
 #ifdef _WIN32
 	ReleaseMutex(m_mutex);
 #else
@@ -207,8 +818,11 @@ void CThreadRecursiveMutex::Unlock()
 //
 //===========================================
 
-CThreadSemaphore::CThreadSemaphore(const char* name, int max, bool shared) : m_name(name), m_max(max), m_shared(shared)
+CThreadSemaphore::CThreadSemaphore(const char* name, int max, bool shared)
+	: m_name(name), m_max(max), m_shared(shared), m_profile("CThreadSemaphore")
 {
+	if (name)
+		m_profile.SetName(name);
 #ifdef _WIN32
 	// NOTE: On windows, a semaphore's value is decreased by one each time it's obtained, and increased by a value each time it's released
 	if (shared)
@@ -240,9 +854,12 @@ CThreadSemaphore::~CThreadSemaphore()
 
 void CThreadSemaphore::Lock()
 {
+	/* The releasing thread is often not the one that acquired, so semaphores are not hold-timed */
 #ifdef _WIN32
+	PROFILED_LOCK(WaitForSingleObject(m_sem, 0) == WAIT_OBJECT_0, WaitForSingleObject(m_sem, INFINITE), false);
 	WaitForSingleObject(m_sem, INFINITE);
 #else
+	PROFILED_LOCK(sem_trywait(m_sem) == 0, sem_wait(m_sem), false);
 	sem_wait(m_sem);
 #endif
 }
@@ -259,11 +876,13 @@ void CThreadSemaphore::Unlock()
 bool CThreadSemaphore::TryLock()
 {
 #ifdef _WIN32
-	DWORD res = WaitForSingleObject(m_sem, 0);
-	return res == WAIT_OBJECT_0;
+	bool res = WaitForSingleObject(m_sem, 0) == WAIT_OBJECT_0;
 #else
-	return sem_trywait(m_sem) == 0;
+	bool res = sem_trywait(m_sem) == 0;
 #endif
+	if (res && threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, 0, false, false);
+	return res;
 }
 
 //===========================================
@@ -290,10 +909,11 @@ int CThreadSpinSemaphore::GetUsers() const { return 0; }
 //
 //===========================================
 
-CThreadRWMutex::CThreadRWMutex()
+CThreadRWMutex::CThreadRWMutex() : m_profile("CThreadRWMutex")
 {
 #ifdef _WIN32
-
+	m_r_mutex = CreateMutexA(NULL, FALSE, NULL);
+	m_w_mutex = CreateMutexA(NULL, FALSE, NULL);
 #else
 	pthread_rwlockattr_init(&m_attr);
 	pthread_rwlock_init(&m_mutex, &m_attr);
@@ -303,7 +923,8 @@ CThreadRWMutex::CThreadRWMutex()
 CThreadRWMutex::~CThreadRWMutex()
 {
 #ifdef _WIN32
-
+	CloseHandle(m_r_mutex);
+	CloseHandle(m_w_mutex);
 #else
 	pthread_rwlockattr_destroy(&m_attr);
 	pthread_rwlock_destroy(&m_mutex);
@@ -313,8 +934,10 @@ CThreadRWMutex::~CThreadRWMutex()
 void CThreadRWMutex::RLock()
 {
 #ifdef _WIN32
-	m_r_mutex.Lock();
+	PROFILED_LOCK(WaitForSingleObject(m_r_mutex, 0) == WAIT_OBJECT_0, WaitForSingleObject(m_r_mutex, INFINITE), false);
+	WaitForSingleObject(m_r_mutex, INFINITE);
 #else
+	PROFILED_LOCK(pthread_rwlock_tryrdlock(&m_mutex) == 0, pthread_rwlock_rdlock(&m_mutex), false);
 	pthread_rwlock_rdlock(&m_mutex);
 #endif
 }
@@ -322,16 +945,19 @@ void CThreadRWMutex::RLock()
 bool CThreadRWMutex::RTryLock()
 {
 #ifdef _WIN32
-	return m_r_mutex.TryLock();
+	bool res = WaitForSingleObject(m_r_mutex, 0) == WAIT_OBJECT_0;
 #else
-	return pthread_rwlock_tryrdlock(&m_mutex) == 0;
+	bool res = pthread_rwlock_tryrdlock(&m_mutex) == 0;
 #endif
+	if (res && threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, 0, false, false);
+	return res;
 }
 
 void CThreadRWMutex::RUnlock()
 {
 #ifdef _WIN32
-	m_r_mutex.Unlock();
+	ReleaseMutex(m_r_mutex);
 #else
 	pthread_rwlock_unlock(&m_mutex);
 #endif
@@ -340,8 +966,10 @@ void CThreadRWMutex::RUnlock()
 void CThreadRWMutex::WLock()
 {
 #ifdef _WIN32
-	m_w_mutex.Lock();
+	PROFILED_LOCK(WaitForSingleObject(m_w_mutex, 0) == WAIT_OBJECT_0, WaitForSingleObject(m_w_mutex, INFINITE), true);
+	WaitForSingleObject(m_w_mutex, INFINITE);
 #else
+	PROFILED_LOCK(pthread_rwlock_trywrlock(&m_mutex) == 0, pthread_rwlock_wrlock(&m_mutex), true);
 	pthread_rwlock_wrlock(&m_mutex);
 #endif
 }
@@ -349,21 +977,290 @@ void CThreadRWMutex::WLock()
 bool CThreadRWMutex::WTryLock()
 {
 #ifdef _WIN32
-	return m_w_mutex.TryLock();
+	bool res = WaitForSingleObject(m_w_mutex, 0) == WAIT_OBJECT_0;
 #else
-	return pthread_rwlock_trywrlock(&m_mutex) == 0;
+	bool res = pthread_rwlock_trywrlock(&m_mutex) == 0;
 #endif
+	if (res && threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, 0, false, true);
+	return res;
 }
 
 void CThreadRWMutex::WUnlock()
 {
+	m_profile.Released();
 #ifdef _WIN32
-	m_w_mutex.Unlock();
+	ReleaseMutex(m_w_mutex);
 #else
 	pthread_rwlock_unlock(&m_mutex);
 #endif
 }
 
+//===========================================
+//
+//      CThreadBigRWMutex
+//
+//===========================================
+
+/* Spins this many times before going to sleep on the condition variable */
+#define BIGRW_SPIN_COUNT 128
+
+static inline void CpuRelax()
+{
+#if defined(PLATFORM_X64) || defined(PLATFORM_X86)
+	_mm_pause();
+#endif
+}
+
+CThreadBigRWMutex::CThreadBigRWMutex(ERWLockPreference preference) : m_preference(preference), m_profile("CThreadBigRWMutex")
+{
+	for (auto& slot : m_readers)
+		slot.count.store(0, std::memory_order_relaxed);
+	m_writer.store(0, std::memory_order_relaxed);
+	m_sleepers.store(0, std::memory_order_relaxed);
+}
+
+CThreadBigRWMutex::~CThreadBigRWMutex() {}
+
+std::atomic<int>& CThreadBigRWMutex::LocalSlot()
+{
+	int index = threadtools::GetThreadIndex();
+	if (index == threadtools::INVALID_THREAD_INDEX)
+		index = 0;
+	return m_readers[index % READER_SLOTS].count;
+}
+
+bool CThreadBigRWMutex::ReadersActive() const
+{
+	for (const auto& slot : m_readers)
+		if (slot.count.load(std::memory_order_seq_cst) != 0)
+			return true;
+	return false;
+}
+
+/* Waits until pred is true or the deadline (LockProfileClock time, 0 for none) passes */
+template <class Pred>
+static bool WaitWithBackoff(Pred pred, unsigned long long deadline, std::mutex& mutex, std::condition_variable& cond, std::atomic<int>& sleepers)
+{
+	for (int i = 0; i < BIGRW_SPIN_COUNT; i++)
+	{
+		if (pred())
+			return true;
+		CpuRelax();
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	/* Bumped before re-checking so a concurrent Wake can't miss us */
+	sleepers.fetch_add(1, std::memory_order_seq_cst);
+	bool ok = true;
+	while (!pred())
+	{
+		if (!deadline)
+		{
+			cond.wait(lock);
+			continue;
+		}
+		unsigned long long now = threadtools::LockProfileClock();
+		if (now >= deadline)
+		{
+			ok = false;
+			break;
+		}
+		cond.wait_for(lock, std::chrono::nanoseconds(deadline - now));
+	}
+	sleepers.fetch_sub(1, std::memory_order_relaxed);
+	return ok;
+}
+
+bool CThreadBigRWMutex::WaitUntilNoReaders(unsigned long long deadline)
+{
+	return WaitWithBackoff([this]() { return !ReadersActive(); }, deadline, m_waitMutex, m_waitCond, m_sleepers);
+}
+
+bool CThreadBigRWMutex::WaitUntilNoWriter(unsigned long long deadline)
+{
+	return WaitWithBackoff([this]() { return m_writer.load(std::memory_order_seq_cst) == 0; }, deadline, m_waitMutex, m_waitCond,
+			       m_sleepers);
+}
+
+void CThreadBigRWMutex::Wake()
+{
+	if (m_sleepers.load(std::memory_order_seq_cst) == 0)
+		return;
+	/* Taking the mutex orders us after a sleeper's last predicate check */
+	{
+		std::lock_guard<std::mutex> lock(m_waitMutex);
+	}
+	m_waitCond.notify_all();
+}
+
+bool CThreadBigRWMutex::TryLockRead()
+{
+	std::atomic<int>& slot = LocalSlot();
+	slot.fetch_add(1, std::memory_order_seq_cst);
+	if (m_writer.load(std::memory_order_seq_cst) == 0)
+		return true;
+	slot.fetch_sub(1, std::memory_order_seq_cst);
+	/* A writer might be waiting on this slot */
+	Wake();
+	return false;
+}
+
+bool CThreadBigRWMutex::LockRead(unsigned long long deadline)
+{
+	while (!TryLockRead())
+	{
+		if (!WaitUntilNoWriter(deadline))
+			return false;
+	}
+	return true;
+}
+
+bool CThreadBigRWMutex::TryLockWrite()
+{
+	if (!m_writeMutex.try_lock())
+		return false;
+	m_writer.store(1, std::memory_order_seq_cst);
+	if (!ReadersActive())
+		return true;
+	m_writer.store(0, std::memory_order_seq_cst);
+	m_writeMutex.unlock();
+	Wake();
+	return false;
+}
+
+bool CThreadBigRWMutex::LockWrite(unsigned long long deadline)
+{
+	if (!deadline)
+		m_writeMutex.lock();
+	else
+	{
+		unsigned long long now = threadtools::LockProfileClock();
+		if (now >= deadline || !m_writeMutex.try_lock_for(std::chrono::nanoseconds(deadline - now)))
+			return false;
+	}
+
+	for (;;)
+	{
+		m_writer.store(1, std::memory_order_seq_cst);
+		if (!ReadersActive())
+			return true;
+
+		if (m_preference == ERWLockPreference::WRITER)
+		{
+			/* New readers back off while m_writer is set, so this only waits for the current ones */
+			if (WaitUntilNoReaders(deadline))
+				return true;
+			break;
+		}
+
+		/* Reader preference: let readers keep going and only take the lock once they have all left */
+		m_writer.store(0, std::memory_order_seq_cst);
+		Wake();
+		if (!WaitUntilNoReaders(deadline))
+			break;
+	}
+
+	/* Timed out */
+	m_writer.store(0, std::memory_order_seq_cst);
+	m_writeMutex.unlock();
+	Wake();
+	return false;
+}
+
+void CThreadBigRWMutex::RLock()
+{
+	PROFILED_LOCK(TryLockRead(), LockRead(0), false);
+	LockRead(0);
+}
+
+bool CThreadBigRWMutex::RTryLock()
+{
+	bool res = TryLockRead();
+	if (res && threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, 0, false, false);
+	return res;
+}
+
+bool CThreadBigRWMutex::RTryLockFor(unsigned int ms)
+{
+	unsigned long long start = threadtools::LockProfileClock();
+	bool		   res	 = LockRead(start + (unsigned long long)ms * 1000000ULL);
+	if (res && threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, threadtools::LockProfileClock() - start, true, false);
+	return res;
+}
+
+void CThreadBigRWMutex::RUnlock()
+{
+	LocalSlot().fetch_sub(1, std::memory_order_seq_cst);
+	Wake();
+}
+
+void CThreadBigRWMutex::WLock()
+{
+	PROFILED_LOCK(TryLockWrite(), LockWrite(0), true);
+	LockWrite(0);
+}
+
+bool CThreadBigRWMutex::WTryLock()
+{
+	bool res = TryLockWrite();
+	if (res && threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, 0, false, true);
+	return res;
+}
+
+bool CThreadBigRWMutex::WTryLockFor(unsigned int ms)
+{
+	unsigned long long start = threadtools::LockProfileClock();
+	bool		   res	 = LockWrite(start + (unsigned long long)ms * 1000000ULL);
+	if (res && threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, threadtools::LockProfileClock() - start, true, true);
+	return res;
+}
+
+void CThreadBigRWMutex::WUnlock()
+{
+	m_profile.Released();
+	m_writer.store(0, std::memory_order_seq_cst);
+	m_writeMutex.unlock();
+	Wake();
+}
+
+void CThreadBigRWMutex::ULock()
+{
+	m_writeMutex.lock();
+	/* Writers need m_writeMutex to set m_writer, so this can't fail */
+	LocalSlot().fetch_add(1, std::memory_order_seq_cst);
+}
+
+void CThreadBigRWMutex::UUnlock()
+{
+	LocalSlot().fetch_sub(1, std::memory_order_seq_cst);
+	m_writeMutex.unlock();
+	Wake();
+}
+
+void CThreadBigRWMutex::Upgrade()
+{
+	/* Always blocks new readers, even with reader preference, otherwise the upgrade could starve */
+	m_writer.store(1, std::memory_order_seq_cst);
+	LocalSlot().fetch_sub(1, std::memory_order_seq_cst);
+	WaitUntilNoReaders(0);
+	if (threadtools::LockProfilingEnabled())
+		m_profile.Acquired(this, 0, false, true);
+}
+
+void CThreadBigRWMutex::Downgrade()
+{
+	m_profile.Released();
+	LocalSlot().fetch_add(1, std::memory_order_seq_cst);
+	m_writer.store(0, std::memory_order_seq_cst);
+	m_writeMutex.unlock();
+	Wake();
+}
+
 //===========================================
 //
 //      CSharedMutex
@@ -392,6 +1289,10 @@ CThreadConditionVariable::CThreadConditionVariable()
 	InitializeConditionVariable(&m_condVar);
 #else
 	pthread_condattr_init(&m_attr);
+#ifdef __linux__
+	/* Timed waits shouldn't jump around when the wall clock is changed */
+	pthread_condattr_setclock(&m_attr, CLOCK_MONOTONIC);
+#endif
 	pthread_cond_init(&m_cond, &m_attr);
 	pthread_mutexattr_init(&m_mutAttr);
 	pthread_mutex_init(&m_mut, &m_mutAttr);
@@ -411,27 +1312,48 @@ CThreadConditionVariable::~CThreadConditionVariable()
 #endif
 }
 
-void CThreadConditionVariable::Wait(int max_time_ms)
+bool CThreadConditionVariable::Wait(int max_time_ms)
 {
 #ifdef _WIN32
 	EnterCriticalSection(&m_critSection);
 	DWORD time = max_time_ms;
-	if(max_time_ms == -1)
+	if (max_time_ms < 0)
 		time = INFINITE;
-	SleepConditionVariableCS(&m_condVar, &m_critSection, time);
+	BOOL res = SleepConditionVariableCS(&m_condVar, &m_critSection, time);
 	LeaveCriticalSection(&m_critSection);
+	return res != FALSE;
+#else
+	pthread_mutex_lock(&m_mut);
+	int res = 0;
+	if (max_time_ms < 0)
+		res = pthread_cond_wait(&m_cond, &m_mut);
+	else
+	{
+		/* pthread_cond_timedwait takes an absolute deadline */
+		timespec timeSpec;
+#ifdef __linux__
+		clock_gettime(CLOCK_MONOTONIC, &timeSpec);
 #else
-	timespec timeSpec;
-	timeSpec.tv_sec = (max_time_ms / 1000);
-	timeSpec.tv_nsec = (max_time_ms * 1000000) - (timeSpec.tv_nsec * 1000000000);
-	pthread_cond_timedwait(&m_cond, &m_mut, &timeSpec);
+		clock_gettime(CLOCK_REALTIME, &timeSpec);
+#endif
+		timeSpec.tv_sec += max_time_ms / 1000;
+		timeSpec.tv_nsec += (long)(max_time_ms % 1000) * 1000000;
+		if (timeSpec.tv_nsec >= 1000000000)
+		{
+			timeSpec.tv_sec++;
+			timeSpec.tv_nsec -= 1000000000;
+		}
+		res = pthread_cond_timedwait(&m_cond, &m_mut, &timeSpec);
+	}
+	pthread_mutex_unlock(&m_mut);
+	return res != ETIMEDOUT;
 #endif
 }
 
 void CThreadConditionVariable::SignalOne()
 {
 #ifdef _WIN32
-	WakeConditionVariable(&m_convVar);
+	WakeConditionVariable(&m_condVar);
 #else
 	pthread_cond_signal(&m_cond);
 #endif
@@ -445,3 +1367,129 @@ void CThreadConditionVariable::SignalAll()
 	pthread_cond_broadcast(&m_cond);
 #endif
 }
+
+//===========================================
+//
+//      Futex / parking lot
+//
+//===========================================
+
+#if !defined(__linux__) && !defined(_WIN32)
+/* No futex, so park on one of a fixed set of condition variables picked by address.
+ * Unrelated addresses may share a bucket, which only costs spurious wakeups */
+#define PARKING_LOT_BUCKETS 64
+
+struct ParkingBucket_t
+{
+	std::mutex		mutex;
+	std::condition_variable cond;
+};
+
+static ParkingBucket_t s_parkingLot[PARKING_LOT_BUCKETS];
+
+static ParkingBucket_t& ParkingBucketFor(const void* addr) { return s_parkingLot[((uintptr_t)addr >> 4) % PARKING_LOT_BUCKETS]; }
+#endif
+
+bool threadtools::FutexWait(std::atomic<unsigned int>* addr, unsigned int expected, int timeoutMs, bool processShared)
+{
+#if defined(__linux__)
+	timespec  ts;
+	timespec* pts = nullptr;
+	if (timeoutMs >= 0)
+	{
+		ts.tv_sec  = timeoutMs / 1000;
+		ts.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+		pts	   = &ts;
+	}
+	long res = syscall(SYS_futex, (unsigned int*)addr, processShared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, expected, pts, nullptr, 0);
+	return !(res == -1 && errno == ETIMEDOUT);
+#else
+	if (processShared)
+	{
+		/* No portable cross-process address wait, poll instead */
+		if (addr->load(std::memory_order_acquire) != expected)
+			return true;
+		if (timeoutMs == 0)
+			return false;
+		threadtools::sleep(1);
+		return true;
+	}
+#if defined(_WIN32)
+	BOOL res = WaitOnAddress((volatile void*)addr, &expected, sizeof(expected), timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs);
+	return res || GetLastError() != ERROR_TIMEOUT;
+#else
+	ParkingBucket_t&	     bucket = ParkingBucketFor(addr);
+	std::unique_lock<std::mutex> lock(bucket.mutex);
+	if (addr->load(std::memory_order_acquire) != expected)
+		return true;
+	if (timeoutMs < 0)
+	{
+		bucket.cond.wait(lock);
+		return true;
+	}
+	return bucket.cond.wait_for(lock, std::chrono::milliseconds(timeoutMs)) == std::cv_status::no_timeout;
+#endif
+#endif
+}
+
+void threadtools::FutexWake(std::atomic<unsigned int>* addr, int count, bool processShared)
+{
+#if defined(__linux__)
+	syscall(SYS_futex, (unsigned int*)addr, processShared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+#else
+	if (processShared)
+		return; /* Waiters are polling */
+#if defined(_WIN32)
+	if (count == 1)
+		WakeByAddressSingle((void*)addr);
+	else
+		WakeByAddressAll((void*)addr);
+#else
+	ParkingBucket_t& bucket = ParkingBucketFor(addr);
+	{
+		/* Orders us after a waiter's check of *addr */
+		std::lock_guard<std::mutex> lock(bucket.mutex);
+	}
+	/* Buckets are shared, so waking only one could wake the wrong thread */
+	bucket.cond.notify_all();
+#endif
+#endif
+}
+
+//===========================================
+//
+//      CEventCount
+//
+//===========================================
+
+void CEventCount::NotifySlow(int count)
+{
+	m_epoch.fetch_add(1, std::memory_order_release);
+	threadtools::FutexWake(&m_epoch, count, m_processShared);
+}
+
+void CEventCount::CommitWait(Key_t key)
+{
+	while (m_epoch.load(std::memory_order_acquire) == key.m_epoch)
+		threadtools::FutexWait(&m_epoch, key.m_epoch, -1, m_processShared);
+	m_waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool CEventCount::CommitWaitFor(Key_t key, int timeoutMs)
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	bool notified = true;
+	while (m_epoch.load(std::memory_order_acquire) == key.m_epoch)
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (now >= deadline)
+		{
+			notified = false;
+			break;
+		}
+		int remaining = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+		threadtools::FutexWait(&m_epoch, key.m_epoch, remaining > 0 ? remaining : 1, m_processShared);
+	}
+	m_waiters.fetch_sub(1, std::memory_order_relaxed);
+	return notified;
+}
@@ -22,10 +22,14 @@ GNU General Public License for more details.
 #endif
 
 #include <atomic>
+#include <chrono>
+#include <climits>
+#include <mutex>
 #include <condition_variable>
 
 #include "public.h"
 #include "debug.h"
+#include "containers/array.h"
 
 #if defined(_M_X86) || defined(__i386__)
 #define PLATFORM_X86
@@ -55,6 +59,11 @@ GNU General Public License for more details.
 
 #endif
 
+/* Max number of threads that can hold a thread index at the same time */
+#ifndef THREADTOOLS_MAX_THREADS
+#define THREADTOOLS_MAX_THREADS 1024
+#endif
+
 /* Forward decls */
 template <class T> class CThreadRAIILock;
 
@@ -104,8 +113,205 @@ static inline void sfence()
 
 #endif
 }
+
+/**
+ * Thread index registry
+ * Each thread is handed a small, dense index in [0, THREADTOOLS_MAX_THREADS) the first time it asks for one.
+ * The index is reclaimed when the thread exits, and the lowest free index is always handed out first, so
+ * per-thread data can live in flat arrays indexed directly instead of being searched for by thread id.
+ * Every time an index is handed out its generation is bumped, which lets consumers detect reuse.
+ */
+static constexpr int INVALID_THREAD_INDEX = -1;
+
+/* Returns the calling thread's index, registering the thread if needed.
+ * Returns INVALID_THREAD_INDEX if all indices are in use. generation is optional */
+EXPORT int GetThreadIndex(unsigned int* generation = nullptr);
+
+/* Explicitly releases the calling thread's index. This happens automatically on thread exit */
+EXPORT void ReleaseThreadIndex();
+
+/* Called on the releasing thread right before its index is handed back, so data kept per index can be cleaned up.
+ * Up to MAX_THREAD_INDEX_CALLBACKS callbacks can be registered, they can't be removed */
+static constexpr int MAX_THREAD_INDEX_CALLBACKS = 8;
+typedef void (*ThreadIndexReleaseCallback_t)(int index);
+EXPORT void AddThreadIndexReleaseCallback(ThreadIndexReleaseCallback_t callback);
+
+/* Number of threads currently holding an index */
+EXPORT int NumRegisteredThreads();
+
+/* One past the highest index ever handed out. Useful as a loop bound when scanning per-thread arrays */
+EXPORT int ThreadIndexHighWater();
 } // namespace threadtools
 
+/**
+ * Per-thread storage indexed by the threadtools thread index
+ * Each thread gets its own lazily created instance of T. When a thread exits and its index is given to a new thread,
+ * the new thread sees a freshly reset value rather than the old thread's data.
+ * Instances of exited threads stay around (and are visited by ForEach) until their index is reused.
+ */
+template <class T> class EXPORT CThreadLocal
+{
+private:
+	struct Slot_t
+	{
+		T	     value;
+		unsigned int generation;
+	};
+
+	std::atomic<Slot_t*> m_slots[THREADTOOLS_MAX_THREADS];
+	T		     m_default;
+
+public:
+	CThreadLocal() : m_default()
+	{
+		for (auto& slot : m_slots)
+			slot.store(nullptr, std::memory_order_relaxed);
+	}
+
+	explicit CThreadLocal(const T& def) : m_default(def)
+	{
+		for (auto& slot : m_slots)
+			slot.store(nullptr, std::memory_order_relaxed);
+	}
+
+	~CThreadLocal()
+	{
+		for (auto& slot : m_slots)
+			delete slot.load(std::memory_order_acquire);
+	}
+
+	CThreadLocal(const CThreadLocal&) = delete;
+	CThreadLocal(CThreadLocal&&)	  = delete;
+
+	/* Returns the calling thread's instance, or nullptr if the thread could not get an index */
+	T* Get()
+	{
+		unsigned int gen;
+		int	     index = threadtools::GetThreadIndex(&gen);
+		if (index == threadtools::INVALID_THREAD_INDEX)
+			return nullptr;
+
+		Slot_t* slot = m_slots[index].load(std::memory_order_acquire);
+		if (!slot)
+		{
+			/* Only the owning thread ever creates its own slot, so no CAS is needed here */
+			slot = new Slot_t{m_default, gen};
+			m_slots[index].store(slot, std::memory_order_release);
+		}
+		else if (slot->generation != gen)
+		{
+			slot->value	 = m_default;
+			slot->generation = gen;
+		}
+		return &slot->value;
+	}
+
+	/* Returns the instance for a specific thread index, or nullptr if that thread never touched this */
+	T* GetForIndex(int index)
+	{
+		if (index < 0 || index >= THREADTOOLS_MAX_THREADS)
+			return nullptr;
+		Slot_t* slot = m_slots[index].load(std::memory_order_acquire);
+		return slot ? &slot->value : nullptr;
+	}
+
+	/* Calls fn(index, T&) for every thread that has an instance.
+	 * NOTE: Other threads may be writing to their instance while this runs, use atomics in T if that matters */
+	template <class F> void ForEach(F fn)
+	{
+		int max = threadtools::ThreadIndexHighWater();
+		for (int i = 0; i < max; i++)
+		{
+			Slot_t* slot = m_slots[i].load(std::memory_order_acquire);
+			if (slot)
+				fn(i, slot->value);
+		}
+	}
+};
+
+/**
+ * Set of CPUs a thread is allowed to run on. An empty mask means "don't care"
+ */
+class EXPORT CThreadAffinityMask
+{
+public:
+	static constexpr int MAX_CPUS = 1024;
+
+private:
+	unsigned long long m_bits[MAX_CPUS / 64];
+
+public:
+	CThreadAffinityMask() { ClearAll(); }
+
+	void Set(int cpu)
+	{
+		if (cpu >= 0 && cpu < MAX_CPUS)
+			m_bits[cpu / 64] |= (1ULL << (cpu % 64));
+	}
+
+	void Clear(int cpu)
+	{
+		if (cpu >= 0 && cpu < MAX_CPUS)
+			m_bits[cpu / 64] &= ~(1ULL << (cpu % 64));
+	}
+
+	bool IsSet(int cpu) const { return cpu >= 0 && cpu < MAX_CPUS && (m_bits[cpu / 64] & (1ULL << (cpu % 64))); }
+
+	void ClearAll()
+	{
+		for (auto& w : m_bits)
+			w = 0;
+	}
+
+	bool Empty() const
+	{
+		for (auto w : m_bits)
+			if (w)
+				return false;
+		return true;
+	}
+};
+
+enum class EThreadSchedPolicy
+{
+	DEFAULT = 0, /* Inherit from the creating thread */
+	NORMAL,	     /* SCHED_OTHER */
+	BATCH,	     /* SCHED_BATCH, throughput oriented. Same as NORMAL where unsupported */
+	IDLE,	     /* SCHED_IDLE, only runs when nothing else wants the CPU. Same as NORMAL where unsupported */
+	FIFO,	     /* SCHED_FIFO, realtime. Usually requires privileges */
+	ROUND_ROBIN, /* SCHED_RR, realtime. Usually requires privileges */
+};
+
+/**
+ * Creation options for CThread. Fields left at their default leave the OS default alone.
+ */
+struct ThreadOptions_t
+{
+	const char*	    name      = nullptr; /* Truncated to 15 chars on Linux */
+	size_t		    stackSize = 0;	 /* In bytes, 0 for the default */
+	CThreadAffinityMask affinity;
+	EThreadSchedPolicy  policy   = EThreadSchedPolicy::DEFAULT;
+	int		    priority = 0; /* Static priority for FIFO/ROUND_ROBIN. Only used to pick a priority class on Windows otherwise */
+	bool		    joinOnDestroy = false; /* The thread polls its stop token, so ~CThread can Terminate and Join it */
+};
+
+/**
+ * Cooperative stop flag handed to the thread function.
+ * CThread::Terminate sets it, the thread is expected to poll StopRequested and return
+ */
+class EXPORT CThreadStopToken
+{
+private:
+	const threadtools::AtomicBool* m_flag;
+
+public:
+	CThreadStopToken() : m_flag(nullptr) {}
+	explicit CThreadStopToken(const threadtools::AtomicBool* flag) : m_flag(flag) {}
+
+	bool StopRequested() const { return m_flag && m_flag->load(std::memory_order_relaxed); }
+	bool StopPossible() const { return m_flag != nullptr; }
+};
+
 /**
  * Simple thread class
  */
@@ -120,27 +326,199 @@ private:
 #endif
 	void* m_ret;
 	void* (*m_threadfn)(void*);
-	bool m_run;
+	void*			m_pvt;
+	bool			m_run;
+	ThreadOptions_t		m_options;
+	char			m_name[64];
+	threadtools::AtomicBool m_stopRequested;
+	threadtools::AtomicBool m_started; /* Set once ThreadEntry is done with this object and has called the thread function */
+
+#ifdef _WIN32
+	typedef HANDLE NativeHandle_t;
+#else
+	typedef pthread_t NativeHandle_t;
+#endif
+
+	static void*   ThreadEntry(void* thisptr);
+	void	       ApplyRuntimeOptions();
+	bool	       IsLive() const;
+	NativeHandle_t NativeHandle() const;
 
 public:
 	/* Calling the CThread baseclass with this parameter specified will execute the passed
 	 * function instead of the potentially overridden ThreadFunction */
 	CThread(void* (*threadfn)(void*));
+	CThread(void* (*threadfn)(void*), const ThreadOptions_t& options);
+
+	/* With ThreadOptions_t::joinOnDestroy, a running thread is asked to stop and joined, so its function must poll
+	 * the stop token. Otherwise it's detached and runs on, and must not use its CThread (or CurrentStopToken) anymore */
+	~CThread();
 
-	/* Runs the thread with the specified val */
-	void Run(void* pvt = nullptr);
+	/* Runs the thread with the specified val. Returns false if the thread could not be created */
+	bool Run(void* pvt = nullptr);
 
-	/* Sends SIGTERM to the thread */
+	/* Requests a cooperative stop. The thread function should poll its stop token and return */
 	void Terminate();
 
-	/* Sends SIGKILL to the thread */
+	/* Forcefully cancels the thread. Only the thread is affected, not the process. Avoid if at all possible */
 	void Kill();
 
 	/* Join the thread into the current one.
 	 * Pauses until it exits */
 	void Join();
 
+	/* Lets the thread run on without this object. Its return value is lost */
+	void Detach();
+
 	void* GetReturn() { return m_ret; };
+
+	/* These may be called before or after Run. Returns false if the OS rejected the change */
+	bool SetName(const char* name);
+	bool SetAffinity(const CThreadAffinityMask& mask);
+	bool SetPriority(EThreadSchedPolicy policy, int priority);
+	void SetStackSize(size_t size) { m_options.stackSize = size; }
+
+	const char*		Name() const { return m_name; }
+	const ThreadOptions_t&	Options() const { return m_options; }
+	CThreadStopToken	GetStopToken() const { return CThreadStopToken(&m_stopRequested); }
+	bool			StopRequested() const { return m_stopRequested.load(std::memory_order_relaxed); }
+
+	/* Returns the CThread running the caller, or nullptr if the calling thread was not started by CThread */
+	static CThread* Current();
+};
+
+namespace threadtools
+{
+/* Stop token of the calling thread. Never requests a stop for threads not started by CThread */
+EXPORT CThreadStopToken CurrentStopToken();
+
+/* Number of CPUs available to the process */
+EXPORT int GetCPUCount();
+} // namespace threadtools
+
+/**
+ * Lock contention profiling
+ * Off by default. Once enabled with threadtools::EnableLockProfiling, CThreadMutex, CThreadRecursiveMutex, CThreadRWMutex,
+ * CThreadSpinlock and CThreadSemaphore record acquisitions, contended acquisitions and wait/hold times into a profile site.
+ * Locks are grouped by the name passed to SetProfileName (locks sharing a name share a site), unnamed locks get a site of their own.
+ * Counters are sharded by thread index so recording never takes a lock. There are NUM_SHARDS shards rather than one per
+ * thread index (that would be THREADTOOLS_MAX_THREADS cache lines per site), so threads whose indices collide modulo
+ * NUM_SHARDS share atomic counters. Sites are never freed, so locks that have already been destroyed still show up in the report.
+ * The report is available through threadtools::GetLockProfileStats or CXProf::DumpLockContention.
+ */
+struct LockProfileStats_t
+{
+	const char*	   name;
+	const char*	   type;
+	unsigned long long acquisitions;
+	unsigned long long contended; /* Acquisitions that had to wait */
+	unsigned long long totalWaitNs;
+	unsigned long long maxWaitNs;
+	unsigned long long totalHoldNs; /* Exclusive holds only, shared (read) holds are not timed */
+	unsigned long long maxHoldNs;
+};
+
+class EXPORT CLockProfileSite
+{
+public:
+	static constexpr int NUM_SHARDS = 8;
+
+private:
+	struct alignas(64) Shard_t
+	{
+		std::atomic<unsigned long long> acquisitions;
+		std::atomic<unsigned long long> contended;
+		std::atomic<unsigned long long> totalWaitNs;
+		std::atomic<unsigned long long> maxWaitNs;
+		std::atomic<unsigned long long> totalHoldNs;
+		std::atomic<unsigned long long> maxHoldNs;
+	};
+
+	Shard_t		  m_shards[NUM_SHARDS];
+	char		  m_name[64];
+	const char*	  m_type;
+	CLockProfileSite* m_next;
+
+	Shard_t& LocalShard();
+
+	friend class CLockProfileHook;
+
+public:
+	CLockProfileSite(const char* name, const char* type);
+
+	CLockProfileSite(const CLockProfileSite&) = delete;
+	CLockProfileSite(CLockProfileSite&&)	  = delete;
+
+	void RecordAcquire(unsigned long long waitNs, bool contended);
+	void RecordHold(unsigned long long holdNs);
+
+	/* Sums up all shards. Other threads may still be recording while this runs */
+	void Snapshot(LockProfileStats_t& out) const;
+	void Reset();
+
+	const char* Name() const { return m_name; }
+	const char*	  Type() const { return m_type; }
+	CLockProfileSite* Next() const { return m_next; }
+};
+
+namespace threadtools
+{
+EXPORT extern AtomicBool g_lockProfilingEnabled;
+
+/* Checked on every lock operation, so keep it inline */
+inline bool LockProfilingEnabled() { return g_lockProfilingEnabled.load(std::memory_order_relaxed); }
+
+EXPORT void EnableLockProfiling(bool enable);
+
+/* Clock used by the lock profiler, in ns */
+inline unsigned long long LockProfileClock()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Fills out with one entry per site, sorted by total wait time (worst first) */
+EXPORT void GetLockProfileStats(Array<LockProfileStats_t>& out);
+
+/* Zeroes the counters of every site */
+EXPORT void ResetLockProfileStats();
+} // namespace threadtools
+
+/**
+ * Per-lock profiling state embedded in each lock class. Acquired/Released are only called while profiling is enabled,
+ * Released is always called on unlock so that toggling profiling while the lock is held is harmless.
+ */
+class EXPORT CLockProfileHook
+{
+private:
+	std::atomic<CLockProfileSite*> m_site;
+	const char*		       m_type;
+	std::atomic<const char*>       m_name;
+	unsigned long long	       m_holdStart; /* Only touched by the thread holding the lock exclusively */
+	int			       m_depth;
+
+	CLockProfileSite* Site(const void* lock);
+	void		  ReleasedSlow();
+
+public:
+	explicit CLockProfileHook(const char* type) : m_type(type), m_holdStart(0), m_depth(0)
+	{
+		m_site.store(nullptr, std::memory_order_relaxed);
+		m_name.store(nullptr, std::memory_order_relaxed);
+	}
+
+	/* name must outlive the lock, it's not copied until the site is created. Safe to call while other threads use the lock */
+	void	    SetName(const char* name);
+	const char* Name() const { return m_name.load(std::memory_order_acquire); }
+
+	/* Call once the lock is held. exclusive is false for shared (read) and semaphore acquisitions, which are not hold-timed */
+	void Acquired(const void* lock, unsigned long long waitNs, bool contended, bool exclusive);
+
+	/* Call right before an exclusive unlock */
+	inline void Released()
+	{
+		if (m_depth)
+			ReleasedSlow();
+	}
 };
 
 /**
@@ -173,6 +551,8 @@ private:
 	pthread_mutex_t	     m_mutex;
 	pthread_mutexattr_t  m_attr;
 #endif
+	CLockProfileHook m_profile;
+
 public:
 	CThreadMutex();
 	~CThreadMutex();
@@ -181,6 +561,9 @@ public:
 	bool TryLock();
 	void Unlock();
 
+	/* Name this lock is reported under by the lock profiler */
+	void SetProfileName(const char* name) { m_profile.SetName(name); }
+
 	CThreadRAIILock<CThreadMutex> RAIILock() { return CThreadRAIILock<CThreadMutex>(this); };
 };
 
@@ -209,6 +592,8 @@ private:
 	pthread_mutex_t	     m_mutex;
 	pthread_mutexattr_t  m_attr;
 #endif
+	CLockProfileHook m_profile;
+
 public:
 	CThreadRecursiveMutex();
 	~CThreadRecursiveMutex();
@@ -217,6 +602,9 @@ public:
 	bool TryLock();
 	void Unlock();
 
+	/* Name this lock is reported under by the lock profiler */
+	void SetProfileName(const char* name) { m_profile.SetName(name); }
+
 	CThreadRAIILock<CThreadRecursiveMutex> RAIILock() { return CThreadRAIILock<CThreadRecursiveMutex>(this); };
 };
 
@@ -227,12 +615,15 @@ class EXPORT CThreadRWMutex
 {
 private:
 #ifdef _WIN32
-	CThreadMutex m_r_mutex;
-	CThreadMutex m_w_mutex;
+	/* Raw mutex handles rather than CThreadMutex, so acquisitions are profiled once, by m_profile */
+	void* m_r_mutex;
+	void* m_w_mutex;
 #else
 	pthread_rwlock_t     m_mutex;
 	pthread_rwlockattr_t m_attr;
 #endif
+	CLockProfileHook m_profile;
+
 public:
 	CThreadRWMutex();
 	~CThreadRWMutex();
@@ -246,6 +637,86 @@ public:
 	void WLock();
 	bool WTryLock();
 	void WUnlock();
+
+	/* Name this lock is reported under by the lock profiler */
+	void SetProfileName(const char* name) { m_profile.SetName(name); }
+};
+
+enum class ERWLockPreference
+{
+	WRITER = 0, /* A waiting writer blocks new readers. Writers can't starve */
+	READER,	    /* Readers get in as long as no writer actually holds the lock. Readers can't starve */
+};
+
+/**
+ * @brief Scalable ("big reader") reader-writer lock
+ * Readers only touch a counter on their own cache line (picked by thread index), so read-mostly locks no longer bounce
+ * a single cache line between every core. Writers pay for it by scanning all reader counters.
+ * Supports upgradable read locks (ULock/Upgrade), downgrading a write lock and timed acquisition.
+ * RUnlock must be called from the thread that took the read lock.
+ */
+class EXPORT CThreadBigRWMutex
+{
+public:
+	static constexpr int READER_SLOTS = 64;
+
+private:
+	struct alignas(64) ReaderSlot_t
+	{
+		std::atomic<int> count;
+	};
+
+	ReaderSlot_t		m_readers[READER_SLOTS];
+	alignas(64) std::atomic<int> m_writer; /* Set while a writer holds the lock or is waiting for readers to drain */
+	std::atomic<int>	m_sleepers;
+	std::timed_mutex	m_writeMutex; /* Held by writers and upgradable readers */
+	std::mutex		m_waitMutex;
+	std::condition_variable m_waitCond;
+	ERWLockPreference	m_preference;
+	CLockProfileHook	m_profile;
+
+	std::atomic<int>& LocalSlot();
+	bool		  ReadersActive() const;
+	bool		  LockRead(unsigned long long deadline);
+	bool		  TryLockRead();
+	bool		  LockWrite(unsigned long long deadline);
+	bool		  TryLockWrite();
+	bool		  WaitUntilNoReaders(unsigned long long deadline);
+	bool		  WaitUntilNoWriter(unsigned long long deadline);
+	void		  Wake();
+
+public:
+	explicit CThreadBigRWMutex(ERWLockPreference preference = ERWLockPreference::WRITER);
+	~CThreadBigRWMutex();
+
+	CThreadBigRWMutex(const CThreadBigRWMutex&) = delete;
+	CThreadBigRWMutex(CThreadBigRWMutex&&)	    = delete;
+
+	/* Read lock */
+	void RLock();
+	bool RTryLock();
+	bool RTryLockFor(unsigned int ms);
+	void RUnlock();
+
+	/* Write lock */
+	void WLock();
+	bool WTryLock();
+	bool WTryLockFor(unsigned int ms);
+	void WUnlock();
+
+	/* Upgradable read lock. Coexists with plain readers but excludes writers and other upgradable readers.
+	 * Either release it with UUnlock, or call Upgrade to turn it into a write lock (released with WUnlock) */
+	void ULock();
+	void UUnlock();
+	void Upgrade();
+
+	/* Atomically turns a held write lock into a read lock (released with RUnlock) */
+	void Downgrade();
+
+	ERWLockPreference Preference() const { return m_preference; }
+
+	/* Name this lock is reported under by the lock profiler */
+	void SetProfileName(const char* name) { m_profile.SetName(name); }
 };
 
 /**
@@ -259,9 +730,10 @@ class EXPORT CThreadSpinlock
 {
 private:
 	threadtools::AtomicFlag m_atomicFlag;
+	CLockProfileHook	m_profile;
 
 public:
-	CThreadSpinlock() { m_atomicFlag.store(0); }
+	CThreadSpinlock() : m_profile("CThreadSpinlock") { m_atomicFlag.store(0); }
 
 	~CThreadSpinlock() { m_atomicFlag.store(1); }
 
@@ -272,19 +744,36 @@ public:
 	inline void Lock()
 	{
 		bool ex = false;
-		while (!m_atomicFlag.compare_exchange_strong(ex, true))
+		if (m_atomicFlag.compare_exchange_strong(ex, true))
+		{
+			if (threadtools::LockProfilingEnabled())
+				m_profile.Acquired(this, 0, false, true);
+			return;
+		}
+
+		unsigned long long start = threadtools::LockProfilingEnabled() ? threadtools::LockProfileClock() : 0;
+		do
 		{
-		};
+			ex = false;
+		} while (!m_atomicFlag.compare_exchange_strong(ex, true));
+
+		if (start)
+			m_profile.Acquired(this, threadtools::LockProfileClock() - start, true, true);
 	}
 
 	inline bool TryLock()
 	{
 		bool ex = false;
-		return m_atomicFlag.compare_exchange_strong(ex, true);
+		if (!m_atomicFlag.compare_exchange_strong(ex, true))
+			return false;
+		if (threadtools::LockProfilingEnabled())
+			m_profile.Acquired(this, 0, false, true);
+		return true;
 	}
 
 	inline void Unlock()
 	{
+		m_profile.Released();
 		bool ex = true;
 		if (!m_atomicFlag.compare_exchange_strong(ex, false))
 		{
@@ -294,6 +783,9 @@ public:
 	}
 
 	CThreadRAIILock<CThreadSpinlock> RAIILock() { return CThreadRAIILock<CThreadSpinlock>(this); };
+
+	/* Name this lock is reported under by the lock profiler */
+	void SetProfileName(const char* name) { m_profile.SetName(name); }
 };
 
 /**
@@ -308,9 +800,10 @@ private:
 	sem_t*		     m_sem;
 	sem_t		     __m_sem; // memory for the actual semaphore
 #endif
-	bool	    m_shared;
-	const char* m_name;
-	int	    m_max;
+	bool		 m_shared;
+	const char*	 m_name;
+	int		 m_max;
+	CLockProfileHook m_profile;
 
 public:
 	CThreadSemaphore(const char* name, int max, bool shared);
@@ -319,6 +812,9 @@ public:
 	void Lock();
 	void Unlock();
 	bool TryLock();
+
+	/* Name this semaphore is reported under by the lock profiler. Defaults to the semaphore name */
+	void SetProfileName(const char* name) { m_profile.SetName(name); }
 };
 
 /**
@@ -373,8 +869,10 @@ public:
 	/**
 	 * Waits on the condition variable
 	 * @param max_time_ms Max time in ms to wait. -1 for infinite
+	 * @return false if the wait timed out
+	 * NOTE: There is no predicate, so a signal sent before Wait is called is lost. Prefer CEventCount
 	 */
-	void Wait(int max_time_ms = -1);
+	bool Wait(int max_time_ms = -1);
 
 	/**
 	 * Signal a single waiting thread
@@ -387,20 +885,131 @@ public:
 	void SignalAll();
 };
 
-template <class T> class EXPORT CInterlockedAccessor;
+namespace threadtools
+{
+/* Blocks while *addr == expected, until woken or timeoutMs passes (-1 for no timeout). May wake up spuriously.
+ * Returns false on timeout. Backed by futex on Linux, WaitOnAddress on Windows and a hashed parking lot elsewhere.
+ * processShared must be set if addr lives in memory shared between processes. Outside of Linux that degrades to polling */
+EXPORT bool FutexWait(std::atomic<unsigned int>* addr, unsigned int expected, int timeoutMs = -1, bool processShared = false);
+
+/* Wakes up to count threads blocked in FutexWait on addr */
+EXPORT void FutexWake(std::atomic<unsigned int>* addr, int count, bool processShared = false);
+} // namespace threadtools
 
-template <class T> class EXPORT CInterlockedSharedPtr
+/**
+ * @brief Event count, for blocking until a condition managed elsewhere (usually lock-free) becomes true
+ * Waiters announce themselves before re-checking the condition, so a notifier only pays for a fence and a load unless
+ * someone is actually asleep, in which case it's one atomic add plus a wake syscall.
+ *
+ * USAGE:
+ * 	// Consumer
+ * 	while (!queue.TryPop(item))
+ * 	{
+ * 		auto key = ec.PrepareWait();
+ * 		if (queue.TryPop(item))
+ * 		{
+ * 			ec.CancelWait();
+ * 			break;
+ * 		}
+ * 		ec.CommitWait(key);
+ * 	}
+ * 	// Producer
+ * 	queue.Push(item);
+ * 	ec.Notify();
+ *
+ * A process shared event count can be placement-new'ed into shared memory.
+ */
+class EXPORT CEventCount
 {
+public:
+	class Key_t
+	{
+		friend class CEventCount;
+		unsigned int m_epoch;
+		explicit Key_t(unsigned int epoch) : m_epoch(epoch) {}
+	};
+
 private:
-	CInterlockedAccessor<T>* m_accessor;
-	const T*		 m_ptr;
+	std::atomic<unsigned int> m_epoch;
+	std::atomic<unsigned int> m_waiters;
+	bool			  m_processShared;
 
-	template <class _X> friend class CInterlockedAccessor;
+	void NotifySlow(int count);
+
+public:
+	explicit CEventCount(bool processShared = false) : m_processShared(processShared)
+	{
+		m_epoch.store(0, std::memory_order_relaxed);
+		m_waiters.store(0, std::memory_order_relaxed);
+	}
+
+	CEventCount(const CEventCount&) = delete;
+	CEventCount(CEventCount&&)	= delete;
+
+	/* Call before the final check of the condition. Must be followed by CancelWait or CommitWait */
+	Key_t PrepareWait()
+	{
+		m_waiters.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return Key_t(m_epoch.load(std::memory_order_acquire));
+	}
+
+	/* The condition turned out to be true, don't wait */
+	void CancelWait() { m_waiters.fetch_sub(1, std::memory_order_relaxed); }
+
+	/* Blocks until Notify/NotifyAll is called after the matching PrepareWait */
+	void CommitWait(Key_t key);
+
+	/* Same as CommitWait with a timeout. Returns false if it timed out */
+	bool CommitWaitFor(Key_t key, int timeoutMs);
+
+	/* Call after making the condition true */
+	inline void Notify()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_waiters.load(std::memory_order_relaxed))
+			NotifySlow(1);
+	}
+
+	inline void NotifyAll()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_waiters.load(std::memory_order_relaxed))
+			NotifySlow(INT_MAX);
+	}
+
+	/* Blocks until condition() returns true */
+	template <class Pred> void Await(Pred condition)
+	{
+		if (condition())
+			return;
+		for (;;)
+		{
+			Key_t key = PrepareWait();
+			if (condition())
+			{
+				CancelWait();
+				return;
+			}
+			CommitWait(key);
+		}
+	}
+};
+
+template <class T, class MutexT = CThreadRWMutex> class EXPORT CInterlockedAccessor;
+
+template <class T, class MutexT = CThreadRWMutex> class EXPORT CInterlockedSharedPtr
+{
+private:
+	CInterlockedAccessor<T, MutexT>* m_accessor;
+	const T*			 m_ptr;
+
+	template <class _X, class _M> friend class CInterlockedAccessor;
 
 public:
 	CInterlockedSharedPtr() = delete;
 
-	CInterlockedSharedPtr(CInterlockedAccessor<T>& accessor) : m_accessor(&accessor), m_ptr(m_accessor->m_resource)
+	CInterlockedSharedPtr(CInterlockedAccessor<T, MutexT>& accessor) : m_accessor(&accessor), m_ptr(m_accessor->m_resource)
 	{
 		m_accessor->m_mutex.RLock();
 	}
@@ -449,18 +1058,18 @@ public:
 	}
 };
 
-template <class T> class EXPORT CInterlockedSharedWritePtr
+template <class T, class MutexT = CThreadRWMutex> class EXPORT CInterlockedSharedWritePtr
 {
 private:
-	CInterlockedAccessor<T>* m_accessor;
-	const T*		 m_ptr;
+	CInterlockedAccessor<T, MutexT>* m_accessor;
+	T*				 m_ptr;
 
-	template <class _X> friend class CInterlockedAccessor;
+	template <class _X, class _M> friend class CInterlockedAccessor;
 
 public:
 	CInterlockedSharedWritePtr() = delete;
 
-	CInterlockedSharedWritePtr(CInterlockedAccessor<T>& accessor) : m_accessor(&accessor), m_ptr(m_accessor->m_resource)
+	CInterlockedSharedWritePtr(CInterlockedAccessor<T, MutexT>& accessor) : m_accessor(&accessor), m_ptr(m_accessor->m_resource)
 	{
 		m_accessor->m_mutex.WLock();
 	}
@@ -480,12 +1089,9 @@ public:
 		other.m_ptr	 = nullptr;
 	}
 
-	CInterlockedSharedWritePtr(const CInterlockedSharedWritePtr& other)
-	{
-		this->m_accessor = other.m_accessor;
-		this->m_ptr	 = other.m_ptr;
-		other.m_accessor->m_mutex.WLock();
-	}
+	/* NOTE: Write locks are exclusive, copying one would deadlock */
+	CInterlockedSharedWritePtr(const CInterlockedSharedWritePtr& other) = delete;
+	CInterlockedSharedWritePtr& operator=(const CInterlockedSharedWritePtr& other) = delete;
 
 	T& operator*() const { return *m_ptr; }
 
@@ -499,37 +1105,31 @@ public:
 		other.m_ptr	 = nullptr;
 		return *this;
 	}
-
-	CInterlockedSharedWritePtr& operator=(const CInterlockedSharedWritePtr& other)
-	{
-		this->m_accessor = other.m_accessor;
-		this->m_ptr	 = other.m_ptr;
-		other.m_accessor->m_mutex.WLock();
-		return *this;
-	}
 };
 
 /**
  * Purpose:
  * 	CInterlockedAccessor is a thread-safe accessor to an arbitrary resource.
- *	The resource can have any number of readers,
+ *	The resource can have any number of readers, or a single writer.
+ *	Use CThreadBigRWMutex as MutexT for resources that are read from many threads at once.
  */
-template <class T> class EXPORT CInterlockedAccessor
+template <class T, class MutexT> class EXPORT CInterlockedAccessor
 {
 private:
-	CThreadRWMutex m_mutex;
-	T*	       m_resource;
+	MutexT m_mutex;
+	T*     m_resource;
 
-	template <class _X> friend class CInterlockedSharedPtr;
+	template <class _X, class _M> friend class CInterlockedSharedPtr;
+	template <class _X, class _M> friend class CInterlockedSharedWritePtr;
 
 public:
 	CInterlockedAccessor(T* ptr) : m_resource(ptr) {}
 
 	CInterlockedAccessor(T& ref) : m_resource(&ref) {}
 
-	CInterlockedSharedPtr<T> GetForRead() { return CInterlockedSharedPtr<T>(*this); }
+	CInterlockedSharedPtr<T, MutexT> GetForRead() { return CInterlockedSharedPtr<T, MutexT>(*this); }
 
-	CInterlockedSharedWritePtr<T> GetForWrite() { return CInterlockedSharedWritePtr<T>(*this); }
+	CInterlockedSharedWritePtr<T, MutexT> GetForWrite() { return CInterlockedSharedWritePtr<T, MutexT>(*this); }
 
 	void ReadLock() { m_mutex.RLock(); }
 
@@ -538,4 +1138,6 @@ public:
 	void WriteLock() { m_mutex.WLock(); }
 
 	void WriteUnlock() { m_mutex.WUnlock(); }
+
+	MutexT& Mutex() { return m_mutex; }
 };
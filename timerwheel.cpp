@@ -0,0 +1,373 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+#include "timerwheel.h"
+#include "static_helpers.h"
+
+#include <chrono>
+
+#define NO_WAKE_TICK (~0ULL)
+
+static unsigned long long SteadyMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//===========================================
+//
+//      CTimerWheel
+//
+//===========================================
+
+CTimerWheel::CTimerWheel()
+	: m_freeList(-1), m_numActive(0), m_currentTick(0), m_startMs(SteadyMs()), m_threadWakeTick(NO_WAKE_TICK), m_thread(nullptr),
+	  m_stopThread(false)
+{
+	for (auto& slot : m_slots)
+		slot = -1;
+}
+
+CTimerWheel::~CTimerWheel() { StopThread(); }
+
+unsigned long long CTimerWheel::NowTick() const { return SteadyMs() - m_startMs; }
+
+int CTimerWheel::AllocTimer()
+{
+	int index;
+	if (m_freeList != -1)
+	{
+		index	   = m_freeList;
+		m_freeList = m_timers[index].next;
+	}
+	else
+	{
+		index = (int)m_timers.size();
+		m_timers.push_back(Timer_t());
+		m_timers[index].generation = 0;
+	}
+
+	Timer_t& timer = m_timers[index];
+	timer.prev = timer.next = timer.slot = -1;
+	timer.generation++;
+	return index;
+}
+
+void CTimerWheel::FreeTimer(int index)
+{
+	Timer_t& timer = m_timers[index];
+	timer.fn       = nullptr;
+	timer.slot     = -1;
+	timer.prev     = -1;
+	timer.next     = m_freeList;
+	m_freeList     = index;
+	m_numActive--;
+}
+
+void CTimerWheel::Insert(int index)
+{
+	Timer_t&	   timer   = m_timers[index];
+	unsigned long long expires = timer.expires;
+	/* Timers cascaded on their due tick land in the current slot, which is expired right after the cascade */
+	if (expires < m_currentTick)
+		expires = m_currentTick;
+
+	unsigned long long delta = expires - m_currentTick;
+	int		   slot;
+	if (delta < LEVEL0_SLOTS)
+		slot = (int)(expires & (LEVEL0_SLOTS - 1));
+	else
+	{
+		/* Too far out, park it in the top level. It gets re-filed every time that slot cascades */
+		if (delta >= MAX_SPAN)
+		{
+			expires = m_currentTick + MAX_SPAN - 1;
+			delta	= MAX_SPAN - 1;
+		}
+
+		int level = 1, shift = LEVEL0_BITS;
+		while (level < NUM_LEVELS - 1 && delta >= (1ULL << (shift + LEVELN_BITS)))
+		{
+			level++;
+			shift += LEVELN_BITS;
+		}
+		slot = LEVEL0_SLOTS + (level - 1) * LEVELN_SLOTS + (int)((expires >> shift) & (LEVELN_SLOTS - 1));
+	}
+
+	timer.slot = slot;
+	timer.prev = -1;
+	timer.next = m_slots[slot];
+	if (timer.next != -1)
+		m_timers[timer.next].prev = index;
+	m_slots[slot] = index;
+}
+
+void CTimerWheel::Unlink(int index)
+{
+	Timer_t& timer = m_timers[index];
+	if (timer.prev != -1)
+		m_timers[timer.prev].next = timer.next;
+	else
+		m_slots[timer.slot] = timer.next;
+	if (timer.next != -1)
+		m_timers[timer.next].prev = timer.prev;
+	timer.prev = timer.next = timer.slot = -1;
+}
+
+/* Re-files the current slot of a level into the levels below */
+void CTimerWheel::Cascade(int level)
+{
+	int shift = LEVEL0_BITS + (level - 1) * LEVELN_BITS;
+	int idx	  = (int)((m_currentTick >> shift) & (LEVELN_SLOTS - 1));
+	int slot  = LEVEL0_SLOTS + (level - 1) * LEVELN_SLOTS + idx;
+
+	int it	      = m_slots[slot];
+	m_slots[slot] = -1;
+	while (it != -1)
+	{
+		int next = m_timers[it].next;
+		Insert(it);
+		it = next;
+	}
+
+	/* The next level only needs to cascade when this one wrapped around */
+	if (idx == 0 && level + 1 < NUM_LEVELS)
+		Cascade(level + 1);
+}
+
+void CTimerWheel::ExpireSlot(int slot, Array<TimerFn_t>& batch)
+{
+	int it	      = m_slots[slot];
+	m_slots[slot] = -1;
+	while (it != -1)
+	{
+		Timer_t& timer = m_timers[it];
+		int	 next  = timer.next;
+		timer.slot     = -1;
+
+		if (timer.expires > m_currentTick)
+			Insert(it); /* Not actually due yet */
+		else if (timer.period)
+		{
+			batch.push_back(timer.fn);
+			/* Skip missed periods instead of firing a burst to catch up */
+			timer.expires += timer.period;
+			if (timer.expires <= m_currentTick)
+				timer.expires = m_currentTick + timer.period;
+			Insert(it);
+		}
+		else
+		{
+			batch.push_back(std::move(timer.fn));
+			FreeTimer(it);
+		}
+		it = next;
+	}
+}
+
+TimerHandle_t CTimerWheel::Schedule(unsigned long long delayMs, TimerFn_t fn, unsigned long long periodMs)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	/* Bring the wheel up to date first, otherwise delays would be measured from the last pump */
+	unsigned long long now = NowTick();
+	if (!m_numActive && now > m_currentTick)
+		m_currentTick = now;
+	if (now < m_currentTick)
+		now = m_currentTick; /* Advance was called with a time ahead of the clock */
+
+	int	 index = AllocTimer();
+	Timer_t& timer = m_timers[index];
+	timer.expires  = now + (delayMs ? delayMs : 1);
+	timer.period   = periodMs;
+	timer.fn       = std::move(fn);
+	m_numActive++;
+	Insert(index);
+
+	if (m_thread && timer.expires < m_threadWakeTick)
+	{
+		m_threadWakeTick = timer.expires;
+		m_cond.notify_one();
+	}
+	return ((TimerHandle_t)timer.generation << 32) | (TimerHandle_t)(index + 1);
+}
+
+bool CTimerWheel::Cancel(TimerHandle_t handle)
+{
+	int	     index	= (int)(handle & 0xFFFFFFFF) - 1;
+	unsigned int generation = (unsigned int)(handle >> 32);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (index < 0 || index >= (int)m_timers.size())
+		return false;
+	Timer_t& timer = m_timers[index];
+	if (timer.generation != generation || timer.slot == -1)
+		return false;
+
+	Unlink(index);
+	FreeTimer(index);
+	return true;
+}
+
+int CTimerWheel::Pump() { return Advance(NowTick()); }
+
+int CTimerWheel::Advance(unsigned long long nowMs)
+{
+	Array<TimerFn_t> batch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		while (m_currentTick < nowMs)
+		{
+			/* Nothing left to fire, skip straight to now */
+			if (!m_numActive)
+			{
+				m_currentTick = nowMs;
+				break;
+			}
+
+			m_currentTick++;
+			if ((m_currentTick & (LEVEL0_SLOTS - 1)) == 0)
+				Cascade(1);
+			ExpireSlot((int)(m_currentTick & (LEVEL0_SLOTS - 1)), batch);
+		}
+	}
+
+	for (auto& fn : batch)
+		fn();
+	return (int)batch.size();
+}
+
+/* Tick the service thread should wake up at. Called with m_mutex held */
+unsigned long long CTimerWheel::NextWakeTick()
+{
+	if (!m_numActive)
+		return NO_WAKE_TICK;
+
+	/* Only level 0 knows exact expiry times. Past the next wrap-around we have to wake up to cascade anyway */
+	unsigned long long boundary = (m_currentTick | (LEVEL0_SLOTS - 1)) + 1;
+	for (unsigned long long tick = m_currentTick + 1; tick < boundary; tick++)
+	{
+		if (m_slots[tick & (LEVEL0_SLOTS - 1)] != -1)
+			return tick;
+	}
+	return boundary;
+}
+
+void* CTimerWheel::ServiceThread(void* wheel)
+{
+	CTimerWheel* self = static_cast<CTimerWheel*>(wheel);
+
+	std::unique_lock<std::mutex> lock(self->m_mutex);
+	while (!self->m_stopThread)
+	{
+		/* Schedule shouldn't bother notifying while we're awake */
+		self->m_threadWakeTick = 0;
+		lock.unlock();
+		self->Pump();
+		lock.lock();
+		if (self->m_stopThread)
+			break;
+
+		unsigned long long wake = self->NextWakeTick();
+		self->m_threadWakeTick	= wake;
+		if (wake == NO_WAKE_TICK)
+			self->m_cond.wait(lock);
+		else
+		{
+			unsigned long long now = self->NowTick();
+			if (wake > now)
+				self->m_cond.wait_for(lock, std::chrono::milliseconds(wake - now));
+		}
+	}
+	return nullptr;
+}
+
+bool CTimerWheel::StartThread(const char* name)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_thread && m_stopThread)
+	{
+		/* A callback asked the thread to stop but it hasn't exited yet */
+		if (CThread::Current() == m_thread)
+		{
+			m_stopThread = false;
+			return true;
+		}
+		lock.unlock();
+		StopThread();
+		lock.lock();
+	}
+	if (m_thread)
+		return true;
+
+	ThreadOptions_t opts;
+	opts.name = name;
+
+	m_stopThread = false;
+	m_thread     = new CThread(ServiceThread, opts);
+	if (!m_thread->Run(this))
+	{
+		delete m_thread;
+		m_thread = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void CTimerWheel::StopThread()
+{
+	CThread* thread;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopThread = true;
+		/* Called from a callback, the service thread can't join itself. It exits once Pump returns, and the
+		 * CThread is reaped by the next StopThread/StartThread from another thread */
+		if (m_thread && CThread::Current() == m_thread)
+			return;
+		thread	 = m_thread;
+		m_thread = nullptr;
+	}
+	if (!thread)
+		return;
+
+	m_cond.notify_all();
+	thread->Join();
+	delete thread;
+}
+
+size_t CTimerWheel::NumPending()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_numActive;
+}
+
+//===========================================
+//
+//      Global wheel
+//
+//===========================================
+
+static CTimerWheel* g_pTimerWheel = nullptr;
+
+CTimerWheel& GlobalTimerWheel()
+{
+	static std::once_flag once;
+	std::call_once(once, []() {
+		g_pTimerWheel = new CTimerWheel();
+		g_pTimerWheel->StartThread();
+	});
+	return *g_pTimerWheel;
+}
+
+static void KillTimerWheel() { delete g_pTimerWheel; }
+
+static CStaticDestructionWrapper<KillTimerWheel> g_timerWheelKiller;
@@ -0,0 +1,125 @@
+/*
+Copyright (C) 2020 Jeremy Lorelli
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+/**
+ * timerwheel.h
+ * 	Delayed and periodic callbacks driven by a hierarchical timing wheel
+ *
+ * Scheduling and cancelling a timer are O(1). Resolution is 1ms.
+ * The wheel either runs on its own thread (StartThread) or is pumped by the owner, e.g. once per frame (Pump).
+ * Expired callbacks are collected under the lock and then run as one batch without it, so callbacks may freely
+ * schedule or cancel timers.
+ *
+ * USAGE:
+ * 	TimerHandle_t h = GlobalTimerWheel().SchedulePeriodic(1000, []() { Log::Flush(); });
+ * 	...
+ * 	GlobalTimerWheel().Cancel(h);
+ */
+#pragma once
+
+#include "public.h"
+#include "threadtools.h"
+#include "containers/array.h"
+
+#undef min
+#undef max
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+typedef unsigned long long TimerHandle_t;
+
+static constexpr TimerHandle_t INVALID_TIMER_HANDLE = 0;
+
+class EXPORT CTimerWheel
+{
+public:
+	typedef std::function<void()> TimerFn_t;
+
+	/* Level 0 has 256 1ms slots, each of the upper levels has 64 slots covering 64x the range of the level below */
+	static constexpr int LEVEL0_BITS  = 8;
+	static constexpr int LEVELN_BITS  = 6;
+	static constexpr int NUM_LEVELS	  = 4;
+	static constexpr int LEVEL0_SLOTS = 1 << LEVEL0_BITS;
+	static constexpr int LEVELN_SLOTS = 1 << LEVELN_BITS;
+	static constexpr int NUM_SLOTS	  = LEVEL0_SLOTS + (NUM_LEVELS - 1) * LEVELN_SLOTS;
+
+	/* Longest delay that fits in the wheel directly, in ms (~18.6 hours). Longer timers are re-filed as they come closer */
+	static constexpr unsigned long long MAX_SPAN = 1ULL << (LEVEL0_BITS + (NUM_LEVELS - 1) * LEVELN_BITS);
+
+private:
+	struct Timer_t
+	{
+		unsigned long long expires; /* Absolute tick */
+		unsigned long long period;  /* 0 for one-shot */
+		TimerFn_t	   fn;
+		int		   prev, next; /* Slot list links, or free list link in next */
+		int		   slot;       /* -1 while not in the wheel */
+		unsigned int	   generation;
+	};
+
+	Array<Timer_t>		m_timers;
+	int			m_slots[NUM_SLOTS];
+	int			m_freeList;
+	size_t			m_numActive;
+	unsigned long long	m_currentTick; /* Last tick that was processed */
+	unsigned long long	m_startMs;
+	std::mutex		m_mutex;
+	std::condition_variable m_cond;
+	unsigned long long	m_threadWakeTick; /* Tick the service thread is sleeping until */
+	CThread*		m_thread;
+	bool			m_stopThread;
+
+	int		   AllocTimer();
+	void		   FreeTimer(int index);
+	void		   Insert(int index);
+	void		   Unlink(int index);
+	void		   Cascade(int level);
+	void		   ExpireSlot(int slot, Array<TimerFn_t>& batch);
+	unsigned long long NextWakeTick();
+	unsigned long long NowTick() const;
+
+	static void* ServiceThread(void* wheel);
+
+public:
+	CTimerWheel();
+	~CTimerWheel();
+
+	CTimerWheel(const CTimerWheel&) = delete;
+	CTimerWheel(CTimerWheel&&)	= delete;
+
+	/* Runs fn once after delayMs, then every periodMs if periodMs is non-zero */
+	TimerHandle_t Schedule(unsigned long long delayMs, TimerFn_t fn, unsigned long long periodMs = 0);
+
+	/* Runs fn every periodMs, starting periodMs from now */
+	TimerHandle_t SchedulePeriodic(unsigned long long periodMs, TimerFn_t fn) { return Schedule(periodMs, std::move(fn), periodMs); }
+
+	/* Returns false if the timer already fired (one-shot) or was cancelled. A callback that is already
+	 * part of a running batch still runs */
+	bool Cancel(TimerHandle_t handle);
+
+	/* Processes every tick up to the current time and runs expired callbacks. Returns the number of callbacks run */
+	int Pump();
+
+	/* Same as Pump but advances to an explicit time, in ms since the wheel was created */
+	int Advance(unsigned long long nowMs);
+
+	/* Starts a service thread that pumps the wheel, sleeping until the next timer is due */
+	bool StartThread(const char* name = "timers");
+	void StopThread();
+
+	size_t NumPending();
+};
+
+/* Wheel shared by everything in libpublic, serviced by its own thread. Created on first use */
+EXPORT CTimerWheel& GlobalTimerWheel();
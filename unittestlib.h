@@ -11,6 +11,11 @@
 #include <chrono>
 #include <stack>
 #include <functional>
+#include <limits>
+#include <type_traits>
+#include <algorithm>
+#include <cstdio>
+#include <cstdarg>
 
 /* Okay I lied about the STL dependencies.. */
 #include "logger.h"
@@ -34,6 +39,7 @@ protected:
 	CUnitTest(const std::string name, CUnitTestSuite* suite) :
 		m_failed(false),
 		m_name(name),
+		m_submitted(false),
 		m_testSuite(suite)
 	{
 	}
@@ -69,13 +75,13 @@ public:
 	}
 
 	/* Must be equal with epsilon for floating point math */
-	template<class A, class B, class C>
+	template<class A, class B, class C, class = typename std::enable_if<std::is_arithmetic<C>::value>::type>
 	bool MustBeEqual(const A& a, const B& b, const C& epsilon, const std::string& failed_name = "")
 	{
 		return this->AssertTrue((a-epsilon <= b) && (a+epsilon >= b), failed_name);
 	}
 
-	template<class A, class B, class C>
+	template<class A, class B, class C, class = typename std::enable_if<std::is_arithmetic<C>::value>::type>
 	bool MustNotBeEqual(const A& a, const B& b, const C& epsilon, const std::string& failed_name = "")
 	{
 		return this->AssertTrue(!((a-epsilon <= b) && (a+epsilon >= b)), failed_name);
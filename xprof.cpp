@@ -21,7 +21,6 @@ GNU General Public License for more details.
 #include <stack>
 #include <stdio.h>
 #include <ostream>
-#include <iomanip>
 
 #ifdef HAVE_ITTNOTIFY
 #include "ittnotify/ittnotify.h"
@@ -76,13 +75,10 @@ static CStaticDestructionWrapper<kill_xprof> g_xprofKiller;
 /* Constructor is NOT thread-safe, obviously! */
 CXProf::CXProf()
 	: m_enabled(true), m_lastFrameTime(), m_flags(0), m_init(false), m_fpsCounterBufferSize(XPROF_DEFAULT_FRAMEBUFFER_SIZE),
-	  m_fpsCounterDataBuffer(), m_fpsCounterTotalSamples(0), m_fpsCounterSampleInterval(1.0f), m_features(XProfFeatures())
+	  m_fpsCounterDataBuffer(XPROF_DEFAULT_FRAMEBUFFER_SIZE), m_fpsCounterTotalSamples(0), m_fpsCounterSampleInterval(1.0f),
+	  m_features(XProfFeatures())
 {
-	for (int i = 0; i < MAX_NODESTACKS; i++)
-	{
-		m_nodeStack[i]	      = std::stack<CXProfNode*>();
-		m_nodeStackThreads[i] = 0;
-	}
+	m_mutex.SetProfileName("CXProf::m_mutex");
 	for (int i = 0; i < (sizeof(g_categories) / sizeof(xprof_node_desc_t)); i++)
 	{
 		this->AddCategoryNode(g_categories[i].name, g_categories[i].budget);
@@ -111,38 +107,17 @@ void CXProf::AddCategoryNode(const char* name, unsigned long long budget)
 	node->m_category = name;
 	node->m_function = name;
 	m_nodes.push_back(node);
+	m_categoryIndex.insert(InternedString(name), node);
 }
 
 void CXProf::PushNode(CXProfNode* node)
 {
 	auto lock = m_mutex.RAIILock();
 
-	/* first, get the nodestack index for this thread */
-	auto threadid = platform::GetCurrentThreadId();
-	int  index    = -1;
-	for (int i = 0; i < MAX_NODESTACKS; i++)
-	{
-		if (m_nodeStackThreads[i] == threadid)
-		{
-			index = i;
-			break;
-		}
-	}
-
-	/* Not found? Loop until a free one is found */
-	if (index == -1)
-	{
-		for (index = 0; index < MAX_NODESTACKS; index++)
-		{
-			if (m_nodeStackThreads[index] == 0)
-			{
-				m_nodeStackThreads[index] = threadid;
-				break;
-			}
-		}
-	}
-
-	std::stack<CXProfNode*>* nodestack = &m_nodeStack[index];
+	/* Node stacks are per-thread, so no lookup is needed here */
+	std::stack<CXProfNode*>* nodestack = m_nodeStacks.Get();
+	if (!nodestack)
+		return;
 
 	CXProfNode* parent = nullptr;
 
@@ -188,9 +163,6 @@ void CXProf::EndFrame()
 	 */
 	if (m_features.EnableFrameTimeCounter)
 	{
-		/* Initialize the ring buffer if it hasnt been already */
-		if (m_fpsCounterDataBuffer.size() == 0)
-			m_fpsCounterDataBuffer.resize(m_fpsCounterBufferSize);
 		/* Update the frame samples */
 		if (frameDt > m_fpsCounterCurrentSample.max_time)
 			m_fpsCounterCurrentSample.max_time = frameDt;
@@ -217,17 +189,10 @@ void CXProf::EndFrame()
 
 void CXProf::PopNode()
 {
-	auto threadid = platform::GetCurrentThreadId();
-	for (int i = 0; i < MAX_NODESTACKS; i++)
-	{
-		if (m_nodeStackThreads[i] == threadid)
-		{
-			if (m_nodeStack[i].empty())
-				return;
-			m_nodeStack[i].pop();
-			return;
-		}
-	}
+	std::stack<CXProfNode*>* nodestack = m_nodeStacks.Get();
+	if (!nodestack || nodestack->empty())
+		return;
+	nodestack->pop();
 }
 
 CXProfNode* CXProf::CreateNode(const char* category, const char* func, const char* file, unsigned long long budget)
@@ -247,12 +212,11 @@ void CXProf::DumpAllNodes(int (*printFn)(const char*, ...))
 
 class CXProfNode* CXProf::FindCategory(const char* category)
 {
-	for (auto x : this->m_nodes)
-	{
-		if (Q_strcmp(category, x->m_category) == 0)
-			return x;
-	}
-	return nullptr;
+	InternedString key = InternedString::Find(category);
+	if (!key)
+		return nullptr;
+	CXProfNode* node;
+	return m_categoryIndex.find(key, node) ? node : nullptr;
 }
 
 void CXProf::DumpCategoryTree(const char* cat, int (*printFn)(const char*, ...))
@@ -293,6 +257,26 @@ void CXProf::DumpNodeTreeInternal(CXProfNode* node, int indent, int (*printFn)(c
 		DumpNodeTreeInternal(x, indent + 1);
 }
 
+void CXProf::DumpLockContention(int (*printFn)(const char*, ...), size_t maxSites)
+{
+	Array<LockProfileStats_t> locks;
+	threadtools::GetLockProfileStats(locks);
+
+	if (!threadtools::LockProfilingEnabled())
+		printFn("Lock profiling is disabled\n");
+
+	printFn("%-40s %-22s %12s %12s %12s %12s %12s %12s\n", "Lock", "Type", "Acquires", "Contended", "Wait (us)", "Max wait", "Hold (us)",
+		"Max hold");
+	for (size_t i = 0; i < locks.size() && i < maxSites; i++)
+	{
+		const LockProfileStats_t& lock = locks[i];
+		if (!lock.acquisitions)
+			continue;
+		printFn("%-40s %-22s %12llu %12llu %12llu %12llu %12llu %12llu\n", lock.name, lock.type, lock.acquisitions, lock.contended,
+			lock.totalWaitNs / 1000, lock.maxWaitNs / 1000, lock.totalHoldNs / 1000, lock.maxHoldNs / 1000);
+	}
+}
+
 void CXProf::ClearNodes()
 {
 	auto lock = m_mutex.RAIILock();
@@ -353,71 +337,85 @@ void CXProf::ReportFree()
 
 class CXProfNode* CXProf::CurrentNode()
 {
-	auto threadid = platform::GetCurrentThreadId();
-	int  index    = -1;
-	for (int i = 0; i < MAX_NODESTACKS; i++)
-	{
-		if (m_nodeStackThreads[i] == threadid)
-		{
-			index = i;
-			break;
-		}
-	}
-
-	if (index == -1)
-		return nullptr;
-	if (m_nodeStack[index].empty())
+	std::stack<CXProfNode*>* nodestack = m_nodeStacks.Get();
+	if (!nodestack || nodestack->empty())
 		return nullptr;
 
-	return m_nodeStack[index].top();
+	return nodestack->top();
 }
 
 void CXProf::SetFrameCountBufferSize(size_t newsize)
 {
+	/* Keeps EndFrame from writing while the ring is reallocated */
+	auto lock = m_mutex.RAIILock();
 	m_fpsCounterDataBuffer.resize(newsize);
-	m_fpsCounterBufferSize = newsize;
+	m_fpsCounterBufferSize = m_fpsCounterDataBuffer.capacity();
 }
 
 size_t CXProf::FrameCountBufferSize() { return m_fpsCounterBufferSize; }
 
 void CXProf::DumpToJSON(std::ostream& stream)
 {
-	// Gotta increase the precision......
-	stream << std::setprecision(1000);
+	StringBuilder sb;
+	this->DumpToJSON(sb);
+	sb.ForEachChunk([&](const char* data, size_t len) { stream.write(data, len); });
+}
 
-	stream << "{";
+void CXProf::DumpToJSON(StringBuilder& sb)
+{
+	sb << "{";
 	/* First part is to write out basic info */
-	stream << "\"game_info\": {";
-	stream << "\"name\": \"" << PROJECT_NAME << "\",";
-	stream << "\"desc\": \"" << PROJECT_DESCRIPTION << "\",";
-	stream << "\"version\": \"" << PROJECT_VERSION << "\"";
-	stream << "},";
-
-	stream << "\"system_info\": {";
+	sb << "\"game_info\": {";
+	sb << "\"name\": ";
+	sb.append_json(PROJECT_NAME) << ",";
+	sb << "\"desc\": ";
+	sb.append_json(PROJECT_DESCRIPTION) << ",";
+	sb << "\"version\": ";
+	sb.append_json(PROJECT_VERSION);
+	sb << "},";
+
+	sb << "\"system_info\": {";
 	// TODO
-	stream << "},";
-
-	stream << "\"frame_times\": [";
-	// Perform a read sequence here, but make sure to adjust the read head in case we wrapped around.
-	// We do not want to lose any frame data.
-	if (m_fpsCounterTotalSamples > m_fpsCounterDataBuffer.size())
-		m_fpsCounterDataBuffer.set_read_index(m_fpsCounterDataBuffer.write_index());
-	for (int i = 0; i < m_fpsCounterDataBuffer.size() && i < m_fpsCounterTotalSamples; i++)
+	sb << "},";
+
+	sb << "\"frame_times\": [";
+	// Snapshot the frame history without consuming it or stopping the frame thread
+	Array<XProfFrameData> frames;
+	frames.resize(m_fpsCounterDataBuffer.capacity());
+	size_t numFrames = m_fpsCounterDataBuffer.snapshot(frames.data(), frames.size());
+	for (size_t i = 0; i < numFrames; i++)
 	{
-		XProfFrameData frame = m_fpsCounterDataBuffer.read();
-		stream << "{\"max\": " << frame.max_time << ", \"min\": " << frame.min_time << ", \"avg\": " << frame.avg
-		       << ", \"timestamp\": " << frame.timestamp << "}";
-		if (i != m_fpsCounterDataBuffer.size() - 1 && i != m_fpsCounterTotalSamples - 1)
-			stream << ",";
+		const XProfFrameData& frame = frames[i];
+		/* Floats are written in their shortest round-trip form */
+		sb << "{\"max\": " << frame.max_time << ", \"min\": " << frame.min_time << ", \"avg\": " << frame.avg
+		   << ", \"timestamp\": " << frame.timestamp << "}";
+		if (i != numFrames - 1)
+			sb << ",";
 	}
-	stream << "],";
+	sb << "],";
 
 	// Print out budget info. Nothing fancy here, still hirearchieal printing
-	stream << "\"budget_info\": [";
+	sb << "\"budget_info\": [";
+
+	sb << "],";
 
-	stream << "]";
+	sb << "\"lock_contention\": [";
+	Array<LockProfileStats_t> locks;
+	threadtools::GetLockProfileStats(locks);
+	for (size_t i = 0; i < locks.size(); i++)
+	{
+		const LockProfileStats_t& lock = locks[i];
+		sb << "{\"name\": ";
+		sb.append_json(lock.name) << ", \"type\": ";
+		sb.append_json(lock.type) << ", \"acquisitions\": " << lock.acquisitions << ", \"contended\": " << lock.contended
+					  << ", \"total_wait_ns\": " << lock.totalWaitNs << ", \"max_wait_ns\": " << lock.maxWaitNs
+					  << ", \"total_hold_ns\": " << lock.totalHoldNs << ", \"max_hold_ns\": " << lock.maxHoldNs << "}";
+		if (i != locks.size() - 1)
+			sb << ",";
+	}
+	sb << "]";
 
-	stream << "}";
+	sb << "}";
 }
 
 void CXProf::SetFrameSampleInterval(float seconds)
@@ -522,7 +520,7 @@ unsigned long long CXProfNode::GetBudget() const
 	return m_timeBudget;
 }
 
-List<CXProfNode*> CXProfNode::Children() const
+SmallArray<CXProfNode*, 8> CXProfNode::Children() const
 {
 	auto lock = this->m_mutex.RAIILock();
 	return this->m_children;
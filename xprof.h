@@ -13,8 +13,12 @@ GNU General Public License for more details.
 */
 #pragma once
 
-#include "containers/list.h"
+#include "containers/deque.h"
 #include "containers/array.h"
+#include "containers/smallarray.h"
+#include "containers/concurrenthashmap.h"
+#include "containers/internedstring.h"
+#include "containers/stringbuilder.h"
 #include "containers/ringbuffer.h"
 #include "platformspec.h"
 #include "threadtools.h"
@@ -25,7 +29,6 @@ GNU General Public License for more details.
 #include <memory.h>
 
 #define MAX_NODESTACK_DEPTH 32
-#define MAX_NODESTACKS	    64
 
 #define XPROF_CATEGORY_OTHER		"Other"
 #define XPROF_CATEGORY_MATH		"MathFuncs"
@@ -128,9 +131,9 @@ class EXPORT CXProf
 {
 private:
 	/* Hirearcheal profiling data */
-	List<class CXProfNode*>	      m_nodes;
-	std::stack<class CXProfNode*> m_nodeStack[MAX_NODESTACKS];
-	unsigned long long	      m_nodeStackThreads[MAX_NODESTACKS];
+	Deque<class CXProfNode*>			     m_nodes;
+	ConcurrentHashMap<InternedString, class CXProfNode*> m_categoryIndex; /* Category name -> category node, read without locking */
+	CThreadLocal<std::stack<class CXProfNode*>>	     m_nodeStacks;
 
 	/* General properties */
 	XProfFeatures m_features;
@@ -154,7 +157,7 @@ private:
 	RingBuffer<XProfFrameData> m_fpsCounterDataBuffer;
 
 	/* List of shutdown hooks */
-	List<void (*)(CXProf&)> m_shutdownHooks;
+	Deque<void (*)(CXProf&)> m_shutdownHooks;
 
 public:
 	CXProf();
@@ -191,7 +194,7 @@ public:
 
 	/* Returns a list of category nodes */
 	/* THREAD SAFE */
-	List<class CXProfNode*> Nodes()
+	Deque<class CXProfNode*> Nodes()
 	{
 		auto lock = m_mutex.RAIILock();
 		return m_nodes;
@@ -204,6 +207,11 @@ public:
 
 	/* Dumps all data to JSON format. Pass it a buffer to write into */
 	void DumpToJSON(std::ostream& stream);
+	void DumpToJSON(StringBuilder& sb);
+
+	/* Prints the lock profiler report, worst offenders first. See threadtools::EnableLockProfiling */
+	/* THREAD SAFE */
+	void DumpLockContention(int (*printFn)(const char*, ...) = printf, size_t maxSites = 32);
 
 	/* Enables or disables xprof */
 	/* THREAD SAFE */
@@ -213,7 +221,8 @@ public:
 
 	void ClearNodes();
 
-	/* Change the size of the frame buffer counter */
+	/* Change the size of the frame buffer counter. The buffer is allocated up front so EndFrame never has to, but
+	 * resizing it reallocates, so don't call this while another thread may be in DumpToJSON */
 	void   SetFrameCountBufferSize(size_t newsize);
 	size_t FrameCountBufferSize();
 	void   SetFrameSampleInterval(float seconds);
@@ -242,7 +251,7 @@ private:
 	void*			m_pvt;
 	CXProfNode*		m_parent; /* Pointer to the node that is one above this, or null */
 	CXProfNode*		m_root;	  /* Pointer to the "category" node. Aka the absolute root. Nullptr if this is the category */
-	List<CXProfNode*>	m_children;
+	SmallArray<CXProfNode*, 8> m_children;
 	const char*		m_function;
 	const char*		m_comment;
 	bool			m_added;
@@ -297,9 +306,9 @@ public:
 	{
 		/* Copy all-nontrivial types */
 		memcpy((void*)this, &other, sizeof(CXProfNode));
-		/* Copy non-trivial types */
-		m_children	 = other.m_children;
-		m_testQueue	 = other.m_testQueue;
+		/* Copy non-trivial types. Constructed in place, the memcpy'd bytes still point at other's storage */
+		new (&m_children) decltype(m_children)(other.m_children);
+		new (&m_testQueue) decltype(m_testQueue)(other.m_testQueue);
 		m_lastSampleTime = other.m_lastSampleTime;
 	}
 
@@ -307,9 +316,9 @@ public:
 	{
 		/* Copy all-nontrivial types */
 		memcpy((void*)this, &other, sizeof(CXProfNode));
-		/* Copy non-trivial types */
-		m_children	 = std::move(other.m_children);
-		m_testQueue	 = std::move(other.m_testQueue);
+		/* Copy non-trivial types. Constructed in place, the memcpy'd bytes still point at other's storage */
+		new (&m_children) decltype(m_children)(std::move(other.m_children));
+		new (&m_testQueue) decltype(m_testQueue)(std::move(other.m_testQueue));
 		m_lastSampleTime = other.m_lastSampleTime;
 	}
 
@@ -359,7 +368,7 @@ public:
 	const char*	  File() const { return m_file; };
 	const char*	  Category() const { return m_category; };
 	CXProfNode*	  Parent() const { return m_parent; };
-	List<CXProfNode*> Children() const;
+	SmallArray<CXProfNode*, 8> Children() const;
 	void		  AddChild(CXProfNode* node);
 	Array<CXProfTest> TestQueue() const;
 };